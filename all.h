@@ -115,6 +115,7 @@ struct Target {
 	char asloc[4];
 	char assym[4];
 	uint cansel:1;
+	uint jtab:1; /* emits jtab jumps, see lowerjtab() */
 };
 
 #define BIT(n) ((bits)1 << (n))
@@ -216,7 +217,7 @@ enum J {
 	X(jfisle) X(jfislt) X(jfiuge) X(jfiugt) \
 	X(jfiule) X(jfiult) X(jffeq)  X(jffge)  \
 	X(jffgt)  X(jffle)  X(jfflt)  X(jffne)  \
-	X(jffo)   X(jffuo)  X(hlt)              \
+	X(jffo)   X(jffuo)  X(hlt)    X(jtab)   \
 	/* Far returns for 8086 medium/large/huge models */ \
 	X(retfw)  X(retfl)  X(retf0)
 #define X(j) J##j,
@@ -321,6 +322,8 @@ struct Blk {
 	} jmp;
 	Blk *s1;
 	Blk *s2;
+	Blk **tab; /* jtab entries, s1 is the default */
+	uint ntab;
 	Blk *link;
 
 	uint id;
@@ -406,6 +409,7 @@ struct Tmp {
 	uint bid; /* id of a defining block */
 	uint cost;
 	int slot; /* -1 for unset */
+	Ins *remat; /* recomputes the value in place of a reload, or 0 */
 	short cls;
 	struct {
 		int r;  /* register or -1 */
@@ -491,6 +495,11 @@ struct Fn {
 	                    * Used by i8086/emit.c Ostorel/Oload Kl to
 	                    * pick "direct slot" vs "deref through slot"
 	                    * semantics.  See [[huge-phase-b-storel-gap]]. */
+	int spill_slot_base; /* i8086: first slot index spill.c hands out
+	                    * (everything below is call args and isel
+	                    * fast-locals).  [spill_slot_base, slot) is
+	                    * recolored by i8086/emit.c packframe() once
+	                    * rega is done. */
 	int vararg_off;    /* i8086: BP-relative byte offset of the first
 	                    * variadic argument (= just past the named params,
 	                    * recorded by selpar).  Used by the Ovargp op
@@ -569,8 +578,9 @@ struct Dat {
 	char isstr;
 };
 
-/* main.c */
+/* lib.c */
 extern Target T;
+extern Target *tlist[];
 extern char debug['Z'+1];
 
 /* util.c */
@@ -640,6 +650,9 @@ bshas(BSet *bs, uint elt)
 /* parse.c */
 extern Op optab[NOp];
 void parse(FILE *, char *, void (char *), void (Dat *), void (Fn *));
+void parseinit(char *);
+void parsefeed(FILE *, void (char *), void (Dat *), void (Fn *));
+void parsefini(void);
 void printfn(Fn *, FILE *);
 void printref(Ref, Fn *, FILE *);
 void err(char *, ...) __attribute__((noreturn));
@@ -649,6 +662,9 @@ void elimsb(Fn *);
 
 /* cfg.c */
 Blk *newblk(void);
+Blk *nextsucc(Blk *, uint *);
+int issucc(Blk *, Blk *);
+void lowerjtab(Fn *);
 void fillpreds(Fn *);
 void fillcfg(Fn *);
 void filldom(Fn *);
@@ -667,6 +683,7 @@ void simplcfg(Fn *);
 
 /* mem.c */
 void promote(Fn *);
+void scalarize(Fn *);
 void coalesce(Fn *);
 void markvol(Fn *);
 void asmvol(Fn *);
@@ -697,6 +714,7 @@ Ref phicopyref(Fn *, Blk *, Phi *);
 /* fold.c */
 int foldint(Con *, int, int, Con *, Con *);
 Ref foldref(Fn *, Ins *);
+void fold(Fn *);
 
 /* gvn.c */
 extern Ref con01[2];  /* 0 and 1 */
@@ -707,6 +725,9 @@ void gvn(Fn *);
 int pinned(Ins *);
 void gcm(Fn *);
 
+/* licm.c */
+void licm(Fn *);
+
 /* ifopt.c */
 void ifconvert(Fn *fn);
 
@@ -13,6 +13,49 @@ newblk()
 	return b;
 }
 
+/* distinct successors of b, 0 after
+ * the last one:
+ *	for (n=0; (s=nextsucc(b, &n));)
+ */
+Blk *
+nextsucc(Blk *b, uint *pn)
+{
+	Blk *s;
+	uint n, i;
+
+	for (;;) {
+		n = (*pn)++;
+		if (n == 0)
+			s = b->s1;
+		else if (n == 1)
+			s = b->s2 == b->s1 ? 0 : b->s2;
+		else if (n-2 < b->ntab) {
+			s = b->tab[n-2];
+			if (s == b->s1)
+				s = 0;
+			for (i=0; s && i<n-2; i++)
+				if (b->tab[i] == s)
+					s = 0;
+		} else
+			return 0;
+		if (s)
+			return s;
+	}
+}
+
+int
+issucc(Blk *b, Blk *s)
+{
+	uint n;
+
+	if (b->s1 == s || b->s2 == s)
+		return 1;
+	for (n=0; n<b->ntab; n++)
+		if (b->tab[n] == s)
+			return 1;
+	return 0;
+}
+
 static void
 fixphis(Fn *f)
 {
@@ -26,7 +69,7 @@ fixphis(Fn *f)
 			for (n=n0=0; n<p->narg; n++) {
 				bp = p->blk[n];
 				if (bp->id != -1u)
-				if (bp->s1 == b || bp->s2 == b) {
+				if (issucc(bp, b)) {
 					p->blk[n0] = bp;
 					p->arg[n0] = p->arg[n];
 					n0++;
@@ -48,22 +91,21 @@ addpred(Blk *bp, Blk *b)
 void
 fillpreds(Fn *f)
 {
-	Blk *b;
+	Blk *b, *s;
+	uint n;
 
 	for (b=f->start; b; b=b->link)
 		b->npred = 0;
-	for (b=f->start; b; b=b->link) {
-		if (b->s1)
-			addpred(b, b->s1);
-		if (b->s2 && b->s2 != b->s1)
-			addpred(b, b->s2);
-	}
+	for (b=f->start; b; b=b->link)
+		for (n=0; (s=nextsucc(b, &n));)
+			addpred(b, s);
 }
 
 static void
 porec(Blk *b, uint *npo)
 {
 	Blk *s1, *s2;
+	uint n;
 
 	if (!b || b->id != -1u)
 		return;
@@ -76,6 +118,8 @@ porec(Blk *b, uint *npo)
 	}
 	porec(s1, npo);
 	porec(s2, npo);
+	for (n=0; n<b->ntab; n++)
+		porec(b->tab[n], npo);
 	b->id = (*npo)++;
 }
 
@@ -109,6 +153,89 @@ fillcfg(Fn *f)
 	fixphis(f);
 }
 
+/* rewrite the jtab jumps as chains of
+ * comparisons, for the targets that
+ * do not emit jump tables; entries
+ * that go to the default need no test;
+ * must run before fillcfg()
+ */
+void
+lowerjtab(Fn *fn)
+{
+	Blk *b, *d, *s, **ch;
+	Phi *p;
+	Ref r, v, x;
+	uint n, k, a, nt, *ix;
+
+	for (b=fn->start; b; b=b->link) {
+		if (b->jmp.type != Jjtab)
+			continue;
+		x = b->jmp.arg;
+		d = b->s1;
+		ix = alloc((b->ntab+1) * sizeof ix[0]);
+		for (nt=0, n=0; n<b->ntab; n++)
+			if (b->tab[n] != d)
+				ix[nt++] = n;
+		b->ntab = 0;
+		if (!nt) {
+			b->jmp.type = Jjmp;
+			b->jmp.arg = R;
+			b->tab = 0;
+			continue;
+		}
+		ch = alloc(nt * sizeof ch[0]);
+		ch[0] = b;
+		for (n=1; n<nt; n++) {
+			ch[n] = newblk();
+			ch[n]->name = strf(PFn, "%s_jt%d", b->name, n);
+			ch[n]->link = ch[n-1]->link;
+			ch[n-1]->link = ch[n];
+		}
+		/* the phis of a target get one
+		 * argument per chain block that
+		 * jumps to it */
+		for (n=0; n<=nt; n++) {
+			s = n < nt ? b->tab[ix[n]] : d;
+			for (k=0; k<n; k++)
+				if (b->tab[ix[k]] == s)
+					break;
+			if (k < n)
+				continue;
+			for (p=s->phi; p; p=p->link) {
+				for (a=0; a<p->narg; a++)
+					if (p->blk[a] == b)
+						break;
+				if (a == p->narg)
+					continue;
+				v = p->arg[a];
+				p->narg--;
+				p->arg[a] = p->arg[p->narg];
+				p->blk[a] = p->blk[p->narg];
+				for (k=0; k<nt; k++)
+					if (b->tab[ix[k]] == s || (k == nt-1 && s == d)) {
+						vgrow(&p->arg, ++p->narg);
+						vgrow(&p->blk, p->narg);
+						p->arg[p->narg-1] = v;
+						p->blk[p->narg-1] = ch[k];
+					}
+			}
+		}
+		for (n=0; n<nt; n++) {
+			r = newtmp("jt", Kw, fn);
+			addins(&ch[n]->ins, &ch[n]->nins, &(Ins){
+				.op = Oceqw, .cls = Kw, .to = r,
+				.arg = {x, getcon(ix[n], fn)},
+			});
+			ch[n]->jmp.type = Jjnz;
+			ch[n]->jmp.arg = r;
+			ch[n]->s1 = b->tab[ix[n]];
+			ch[n]->s2 = n+1 < nt ? ch[n+1] : d;
+		}
+		b->tab = 0;
+		b = ch[nt-1];
+	}
+}
+
 /* for dominators computation, read
  * "A Simple, Fast Dominance Algorithm"
  * by K. Cooper, T. Harvey, and K. Kennedy.
@@ -206,18 +333,15 @@ addfron(Blk *a, Blk *b)
 void
 fillfron(Fn *fn)
 {
-	Blk *a, *b;
+	Blk *a, *b, *s;
+	uint n;
 
 	for (b=fn->start; b; b=b->link)
 		b->nfron = 0;
-	for (b=fn->start; b; b=b->link) {
-		if (b->s1)
-			for (a=b; !sdom(a, b->s1); a=a->idom)
-				addfron(a, b->s1);
-		if (b->s2)
-			for (a=b; !sdom(a, b->s2); a=a->idom)
-				addfron(a, b->s2);
-	}
+	for (b=fn->start; b; b=b->link)
+		for (n=0; (s=nextsucc(b, &n));)
+			for (a=b; !sdom(a, s); a=a->idom)
+				addfron(a, s);
 }
 
 static void
@@ -330,6 +454,7 @@ simpljmp(Fn *fn)
 	Blk **uf; /* union-find */
 	Blk **p, *b, *ret;
 	int n;
+	uint i;
 
 	ret = newblk();
 	ret->id = fn->nblk++;
@@ -362,6 +487,8 @@ simpljmp(Fn *fn)
 			uffind(&b->s1, uf);
 		if (b->s2)
 			uffind(&b->s2, uf);
+		for (i=0; i<b->ntab; i++)
+			uffind(&b->tab[i], uf);
 		if (b->s1 && b->s1 == b->s2) {
 			b->jmp.type = Jjmp;
 			b->s2 = 0;
@@ -374,16 +501,18 @@ simpljmp(Fn *fn)
 static int
 reachrec(Blk *b, Blk *to)
 {
+	Blk *s;
+	uint n;
+
 	if (b == to)
 		return 1;
 	if (!b || b->visit)
 		return 0;
 
 	b->visit = 1;
-	if (reachrec(b->s1, to))
-		return 1;
-	if (reachrec(b->s2, to))
-		return 1;
+	for (n=0; (s=nextsucc(b, &n));)
+		if (reachrec(s, to))
+			return 1;
 
 	return 0;
 }
@@ -461,13 +590,16 @@ struct Jmp {
 	int type;
 	Ref arg;
 	Blk *s1, *s2;
+	Blk **tab;
+	uint ntab;
 };
 
 static int
 jmpeq(Jmp *a, Jmp *b)
 {
 	return a->type == b->type && req(a->arg, b->arg)
-		&& a->s1 == b->s1 && a->s2 == b->s2;
+		&& a->s1 == b->s1 && a->s2 == b->s2
+		&& !a->ntab && !b->ntab;
 }
 
 static int
@@ -485,11 +617,11 @@ void
 simplcfg(Fn *fn)
 {
 	Ins cpy, *i;
-	Blk *b, *bb, **pb;
+	Blk *b, *bb;
 	Jmp *jmp, *j, *jj;
 	Phi *p;
 	int *empty, done;
-	uint n;
+	uint n, m;
 
 	if (debug['C']) {
 		fprintf(stderr, "\n> Before CFG simplification:\n");
@@ -516,6 +648,8 @@ simplcfg(Fn *fn)
 		jmp[b->id].arg = b->jmp.arg;
 		jmp[b->id].s1 = b->s1;
 		jmp[b->id].s2 = b->s2;
+		jmp[b->id].tab = b->tab;
+		jmp[b->id].ntab = b->ntab;
 		empty[b->id] = !b->phi;
 		for (i=b->ins; i<&b->ins[b->nins]; i++)
 			if (i->op != Onop && i->op != Odbgloc) {
@@ -535,12 +669,15 @@ simplcfg(Fn *fn)
 				addbins(&b->ins, &b->nins, j->s1);
 				empty[b->id] &= empty[j->s1->id];
 				jj = &jmp[j->s1->id];
-				pb = (Blk*[]){jj->s1, jj->s2, 0};
-				for (; (bb=*pb); pb++)
-					for (p=bb->phi; p; p=p->link) {
-						n = phiargn(p, j->s1);
-						p->blk[n] = b;
-					}
+				for (m=0; m<2+jj->ntab; m++) {
+					bb = m == 0 ? jj->s1
+						: m == 1 ? jj->s2 : jj->tab[m-2];
+					if (bb)
+					for (p=bb->phi; p; p=p->link)
+						for (n=0; n<p->narg; n++)
+							if (p->blk[n] == j->s1)
+								p->blk[n] = b;
+				}
 				j->s1->id = -1u;
 				*j = *jj;
 				done = 0;
@@ -562,6 +699,8 @@ simplcfg(Fn *fn)
 			b->jmp.arg = j->arg;
 			b->s1 = j->s1;
 			b->s2 = j->s2;
+			b->tab = j->tab;
+			b->ntab = j->ntab;
 			assert(!j->s1 || j->s1->id != -1u);
 			assert(!j->s2 || j->s2->id != -1u);
 		}
@@ -0,0 +1 @@
+#define Deftgt T_amd64_sysv
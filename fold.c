@@ -202,12 +202,72 @@ foldflt(Con *res, int op, int w, Con *cl, Con *cr)
 	}
 }
 
+static int64_t
+extn(int64_t x, int n, int u)
+{
+	if (u)
+		return (uint64_t)x << (64-n) >> (64-n);
+	return (int64_t)((uint64_t)x << (64-n)) >> (64-n);
+}
+
+/* i8086 has 16-bit w and 32-bit l while
+ * foldint() works on 32 and 64 bits; so
+ * the operands are extended from their
+ * width the way the op reads them, and
+ * the result is truncated to its width;
+ * a symbol offset in w is kept unsigned
+ * 16-bit, as the assembler will read it */
+static Ref
+fold86(int op, int cls, Con *cl, Con *cr, Fn *fn)
+{
+	Con c[2], res;
+	int n, k, u;
+
+	switch (op) {
+	case Oudiv:
+	case Ourem:
+	case Oshr:
+	case Oextuw:
+		u = 1;
+		break;
+	default:
+		u = iscmp(op, &k, &n)
+			&& (n == Ciule || n == Ciult || n == Ciugt || n == Ciuge);
+		break;
+	}
+	c[0] = *cl;
+	c[1] = *cr;
+	for (n=0; n<2; n++)
+		if (c[n].type == CBits) {
+			k = optab[op].argcls[n][cls] == Kw ? 16 : 32;
+			c[n].bits.i = extn(c[n].bits.i, k, u);
+		}
+	k = cls == Kw ? 16 : 32;
+	if (op == Osar || op == Oshr || op == Oshl)
+	if ((uint64_t)c[1].bits.i >= (uint64_t)k)
+		return R;
+	if (foldint(&res, op, 1, &c[0], &c[1]))
+		return R;
+	if (res.type == CAddr) {
+		if (cls == Kw)
+			res.bits.i = extn(res.bits.i, 16, 1);
+		return newcon(&res, fn);
+	}
+	res.bits.i = extn(res.bits.i, k, 0);
+	if (cls == Kw)
+		res.bits.i &= 0xffffffff;
+	return newcon(&res, fn);
+}
+
 static Ref
 opfold(int op, int cls, Con *cl, Con *cr, Fn *fn)
 {
 	Ref r;
 	Con c;
 
+	if (T.wordsz == 2)
+	if (KBASE(cls) == 0 && KBASE(optab[op].argcls[0][cls]) == 0)
+		return fold86(op, cls, cl, cr, fn);
 	if (cls == Kw || cls == Kl) {
 		/* `w` means "fold as a 64-bit op".  On i8086 (T.wordsz==2) Kl is
 		 * 32-bit (`long` / far ptr = 4 bytes), so Kl must fold with 32-bit
@@ -252,3 +312,343 @@ foldref(Fn *fn, Ins *i)
 	}
 	return R;
 }
+
+/* sparse conditional constant propagation
+ *
+ * read "Constant Propagation with Conditional
+ * Branches" by M. Wegman and F. K. Zadeck;
+ * temporaries start unknown (Top) and only
+ * go down the lattice, to a constant and
+ * then to Bot; cfg edges start dead and
+ * are only followed when the jump that
+ * owns them may take them
+ */
+
+enum {
+	Bot = -1, /* lattice bottom */
+	Top = 0,  /* lattice top, UNDEF is never a value */
+};
+
+typedef struct Edge Edge;
+
+struct Edge {
+	Blk *dest;
+	int dead;
+	Edge *work;
+};
+
+static int *val;
+static Edge **edge; /* s1, s2, then jtab entries */
+static Edge *flowrk;
+static Use **usewrk;
+static uint nuse;
+
+static int
+latval(Ref r)
+{
+	switch (rtype(r)) {
+	case RTmp:
+		return val[r.val];
+	case RCon:
+		if (req(r, UNDEF))
+			return Bot;
+		return r.val;
+	default:
+		return Bot;
+	}
+}
+
+static int
+latmerge(int v, int m)
+{
+	return m == Top ? v : (v == Top || v == m) ? m : Bot;
+}
+
+static void
+update(int t, int m, Fn *fn)
+{
+	Tmp *tmp;
+	uint u;
+
+	m = latmerge(val[t], m);
+	if (m != val[t]) {
+		tmp = &fn->tmp[t];
+		for (u=0; u<tmp->nuse; u++) {
+			vgrow(&usewrk, ++nuse);
+			usewrk[nuse-1] = &tmp->use[u];
+		}
+		val[t] = m;
+	}
+}
+
+static void
+follow(Edge *e)
+{
+	if (e->dest && e->dead) {
+		e->dead = 0;
+		e->work = flowrk;
+		flowrk = e;
+	}
+}
+
+static int
+edgelive(Blk *bp, Blk *b)
+{
+	Edge *e;
+	uint n;
+
+	for (n=0, e=edge[bp->id]; n<2+bp->ntab; n++, e++)
+		if (e->dest == b && !e->dead)
+			return 1;
+	return 0;
+}
+
+static void
+visitphi(Phi *p, Blk *b, Fn *fn)
+{
+	uint a;
+	int v;
+
+	v = Top;
+	for (a=0; a<p->narg; a++)
+		if (edgelive(p->blk[a], b))
+			v = latmerge(v, latval(p->arg[a]));
+	update(p->to.val, v, fn);
+}
+
+static void
+visitins(Ins *i, Fn *fn)
+{
+	int l, r, v;
+	Ref c;
+
+	if (rtype(i->to) != RTmp)
+		return;
+	if (i->op == Ocopy)
+		v = latval(i->arg[0]);
+	else if (optab[i->op].canfold) {
+		l = latval(i->arg[0]);
+		if (req(i->arg[1], R))
+			r = CON_Z.val;
+		else
+			r = latval(i->arg[1]);
+		if (l == Bot || r == Bot)
+			v = Bot;
+		else if (l == Top || r == Top)
+			v = Top;
+		else if (KBASE(i->cls) == 1
+		&& (fn->con[l].type != CBits || fn->con[r].type != CBits))
+			v = Bot;
+		else {
+			c = opfold(i->op, i->cls, &fn->con[l], &fn->con[r], fn);
+			v = req(c, R) ? Bot : (int)c.val;
+		}
+	} else
+		v = Bot;
+	update(i->to.val, v, fn);
+}
+
+/* index of the only edge that a jump on
+ * the constant c takes, or -1 */
+static int
+conedge(Blk *b, Con *c)
+{
+	uint64_t x;
+
+	if (c->type != CBits)
+		return -1;
+	x = (uint32_t)c->bits.i;
+	if (T.wordsz == 2)
+		x = (uint16_t)x; /* w is 16 bits wide */
+	if (b->jmp.type == Jjnz)
+		return x ? 0 : 1;
+	return x < b->ntab ? 2+x : 0;
+}
+
+static void
+visitjmp(Blk *b, Fn *fn)
+{
+	Edge *e;
+	uint n;
+	int l, k;
+
+	e = edge[b->id];
+	k = -1;
+	switch (b->jmp.type) {
+	case Jjnz:
+	case Jjtab:
+		l = latval(b->jmp.arg);
+		if (l == Top)
+			return;
+		if (l != Bot)
+			k = conedge(b, &fn->con[l]);
+		break;
+	}
+	if (k >= 0)
+		follow(&e[k]);
+	else
+		for (n=0; n<2+b->ntab; n++)
+			follow(&e[n]);
+}
+
+static int
+renref(Ref *r)
+{
+	int l;
+
+	if (rtype(*r) == RTmp)
+	if ((l=val[r->val]) != Bot) {
+		assert(l != Top && "ssa invariant broken");
+		*r = CON(l);
+		return 1;
+	}
+	return 0;
+}
+
+/* requires rpo, use, ssa
+ * prunes dead blocks and recreates rpo, preds
+ * breaks use, dom
+ */
+void
+fold(Fn *fn)
+{
+	Edge *e, start;
+	Use *u;
+	Blk *b;
+	Phi *p, **pp;
+	Ins *i;
+	int t, d, k;
+	uint n, a;
+
+	val = emalloc(fn->ntmp * sizeof val[0]);
+	edge = emalloc(fn->nblk * sizeof edge[0]);
+	usewrk = vnew(0, sizeof usewrk[0], PHeap);
+
+	for (t=0; t<fn->ntmp; t++)
+		val[t] = t < Tmp0 ? Bot : Top;
+	for (b=fn->start; b; b=b->link) {
+		b->visit = 0;
+		e = emalloc((2+b->ntab) * sizeof e[0]);
+		e[0] = (Edge){b->s1, 1, 0};
+		e[1] = (Edge){b->s2, 1, 0};
+		for (n=0; n<b->ntab; n++)
+			e[2+n] = (Edge){b->tab[n], 1, 0};
+		edge[b->id] = e;
+	}
+	start = (Edge){fn->start, 1, 0};
+	flowrk = 0;
+	nuse = 0;
+	follow(&start);
+
+	/* 1. find out constants and dead cfg edges */
+	for (;;) {
+		if ((e = flowrk)) {
+			flowrk = e->work;
+			e->work = 0;
+			b = e->dest;
+			for (p=b->phi; p; p=p->link)
+				visitphi(p, b, fn);
+			if (b->visit == 0) {
+				for (i=b->ins; i<&b->ins[b->nins]; i++)
+					visitins(i, fn);
+				visitjmp(b, fn);
+			}
+			b->visit++;
+		}
+		else if (nuse) {
+			u = usewrk[--nuse];
+			b = fn->rpo[u->bid];
+			if (b->visit == 0)
+				continue;
+			switch (u->type) {
+			case UPhi:
+				visitphi(u->u.phi, b, fn);
+				break;
+			case UIns:
+				visitins(u->u.ins, fn);
+				break;
+			case UJmp:
+				visitjmp(b, fn);
+				break;
+			default:
+				die("unreachable");
+			}
+		}
+		else
+			break;
+	}
+
+	if (debug['F']) {
+		fprintf(stderr, "\n> SCCP findings:");
+		for (t=Tmp0; t<fn->ntmp; t++) {
+			if (val[t] == Bot)
+				continue;
+			fprintf(stderr, "\n%10s: ", fn->tmp[t].name);
+			if (val[t] == Top)
+				fprintf(stderr, "Top");
+			else
+				printref(CON(val[t]), fn, stderr);
+		}
+		fprintf(stderr, "\n dead code: ");
+	}
+
+	/* 2. trim dead code, replace constants;
+	 * the jumps that only follow one edge
+	 * become plain jumps, so the dead blocks
+	 * are exactly the unreachable ones */
+	d = 0;
+	for (b=fn->start; b; b=b->link) {
+		if (b->visit == 0) {
+			d = 1;
+			if (debug['F'])
+				fprintf(stderr, "%s ", b->name);
+			continue;
+		}
+		for (pp=&b->phi; (p=*pp);) {
+			if (val[p->to.val] != Bot) {
+				*pp = p->link;
+				continue;
+			}
+			for (a=0; a<p->narg; a++)
+				if (edgelive(p->blk[a], b))
+					renref(&p->arg[a]);
+			pp = &p->link;
+		}
+		for (i=b->ins; i<&b->ins[b->nins]; i++)
+			if (i->op == Onop)
+				continue;
+			else if (renref(&i->to))
+				*i = (Ins){.op = Onop};
+			else
+				for (n=0; n<2; n++)
+					renref(&i->arg[n]);
+		renref(&b->jmp.arg);
+		if (b->jmp.type != Jjnz && b->jmp.type != Jjtab)
+			continue;
+		if (rtype(b->jmp.arg) != RCon)
+			continue;
+		k = conedge(b, &fn->con[b->jmp.arg.val]);
+		if (k < 0)
+			continue;
+		b->s1 = edge[b->id][k].dest;
+		b->s2 = 0;
+		b->tab = 0;
+		b->ntab = 0;
+		b->jmp.type = Jjmp;
+		b->jmp.arg = R;
+	}
+
+	for (b=fn->start; b; b=b->link)
+		free(edge[b->id]);
+	free(edge);
+	free(val);
+	vfree(usewrk);
+	fillcfg(fn);
+
+	if (debug['F']) {
+		if (!d)
+			fprintf(stderr, "(none)");
+		fprintf(stderr, "\n\n> After constant folding:\n");
+		printfn(fn, stderr);
+	}
+}
@@ -61,4 +61,21 @@ void i8086_abi(Fn *);
 void i8086_isel(Fn *);
 
 /* emit.c */
+enum {
+	C88Sh1,    /* shl/shr/sar/rcl/rcr r, 1 */
+	C88ShCl,   /* shift r, cl; the count adds 4 clocks a bit */
+	C88Mov,    /* mov r, r (word or byte) */
+	C88Alu,    /* add/sub/xor r, r; neg r */
+	C88Xchg,   /* xchg ax, r */
+	C88Cbw,
+	C88Push,
+	C88Pop,
+	C88MovI,   /* mov r16, imm */
+	C88MovCl,  /* mov cl, imm */
+	C88Loop,
+	C88Mul,    /* mul r16 */
+	C88Imul,   /* imul r16 */
+};
+int i8086_cost(int, int);
+int i8086_shcost(int, int);
 void i8086_emitfn(Fn *, FILE *);
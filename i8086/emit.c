@@ -19,7 +19,7 @@ static struct {
 	{ Oadd,    Ki, "add %=, %1" },
 	{ Osub,    Ki, "sub %=, %1" },
 	/* Omul handled in emitins() — `imul reg, r/m` is 286+.  The 8086
-	 * form is single-operand `imul r/m` with implicit AX*r/m → DX:AX. */
+	 * form is single-operand `mul r/m` with implicit AX*r/m → DX:AX. */
 	{ Odiv,    Ki, "idiv %1" },
 	{ Oudiv,   Ki, "div %1" },
 	{ Orem,    Ki, "idiv %1" },  /* remainder in DX */
@@ -64,8 +64,9 @@ static struct {
 	{ Oaddr,   Ki, "lea %=, %M0" },
 
 	/* 16-bit comparisons are emitted in emitins() with an explicit
-	 * 8086-compatible branchy materialize.  setcc + movzx are 386,
-	 * so we don't use them. */
+	 * 8086-compatible branchy materialize, or as a bare cmp when isel
+	 * fused them into the block's jump.  setcc + movzx are 386, so
+	 * we don't use them. */
 
 	/* Control flow */
 	{ Ocall,   Kw, "call %0" },
@@ -108,6 +109,28 @@ static char *rname8[] = {
 	[RBX] = "bl",
 };
 
+/* 8-bit register names (high byte) */
+static char *rname8h[] = {
+	[RAX] = "ah",
+	[RCX] = "ch",
+	[RDX] = "dh",
+	[RBX] = "bh",
+};
+
+/* Conditional jumps, indexed by integer comparison (Jjf* - Jjf) */
+static char *jccname[] = {
+	[Cieq]  = "je",
+	[Cine]  = "jne",
+	[Cisge] = "jge",
+	[Cisgt] = "jg",
+	[Cisle] = "jle",
+	[Cislt] = "jl",
+	[Ciuge] = "jae",
+	[Ciugt] = "ja",
+	[Ciule] = "jbe",
+	[Ciult] = "jb",
+};
+
 /* Memory model names for comments */
 static char *memmodel_name[] = {
 	[Mflat]    = "flat",
@@ -425,6 +448,231 @@ farptr_restore_bx(int saved, FILE *f)
 	if (saved) fprintf(f, "\tpop bx\n");
 }
 
+/* ES tracking for far accesses.  The libstub ABI wants ES = DS = DGROUP
+ * at every call (sprintf's stosb) and return, but nothing in between
+ * reads ES except the far templates, which load it themselves.  So a far
+ * access through a slot-resident pointer leaves ES holding the pointer's
+ * segment instead of bracketing itself with push es/pop es, and the next
+ * access through the same pointer (or a copy, or an addfo/subfo of it —
+ * both keep the segment word) skips its `mov es` as well.  DGROUP is put
+ * back with push ds/pop es only before templates that run foreign code
+ * (calls, soft-float and 32-bit division helpers, inline asm) and before
+ * a return.  The far paths for RCon/RTmp pointers keep their brackets.
+ *
+ * An EsState says what ES is known to hold: DGROUP (dirty == 0), or the
+ * segment word of each slot in off[] (bp-relative byte offsets; empty
+ * means unknown).  The only writes to a slot are through `to` or a
+ * direct store, and spill slots are never address-taken, so checking
+ * those two keeps off[] exact.  esflow() solves the state at each block
+ * entry; es_step() is the transfer shared with the emission loop so the
+ * two always agree. */
+enum { NEsOff = 4 };
+
+typedef struct EsState {
+	int visit;  /* solver: state is known */
+	int dirty;  /* ES may not be DGROUP */
+	int n;
+	long off[NEsOff];
+} EsState;
+
+static EsState g_es;     /* ES before the instruction being emitted */
+static EsState *es_in;   /* block entry states, indexed by b->id */
+static EsState *es_out;
+static uint es_cap;
+
+static int
+es_has(EsState *s, long o)
+{
+	int n;
+
+	for (n = 0; n < s->n; n++)
+		if (s->off[n] == o)
+			return 1;
+	return 0;
+}
+
+static void
+es_add(EsState *s, long o)
+{
+	if (!es_has(s, o) && s->n < NEsOff)
+		s->off[s->n++] = o;
+}
+
+/* a write of up to 4 bytes at [bp+o] */
+static void
+es_kill(EsState *s, long o)
+{
+	int n, m;
+
+	for (n = m = 0; n < s->n; n++)
+		if (o >= s->off[n] + 4 || s->off[n] + 2 >= o + 4)
+			s->off[m++] = s->off[n];
+	s->n = m;
+}
+
+/* does i's template run code that relies on ES = DGROUP */
+static int
+es_needds(Ins *i)
+{
+	if (isloadfar(i->op) || INRANGE(i->op, Ostorefb, Ostorefs))
+		return 0;
+	if (KBASE(i->cls) == 1
+	|| INRANGE(i->op, Ocmps, Ocmps1) || INRANGE(i->op, Ocmpd, Ocmpd1))
+		return 1;
+	switch (i->op) {
+	case Ocall:
+	case Ocallfar:
+	case Oasm:
+	case Ostosi:
+	case Ostoui:
+	case Odtosi:
+	case Odtoui:
+		return 1;
+	case Odiv:
+	case Oudiv:
+	case Orem:
+	case Ourem:
+		return i->cls == Kl;
+	}
+	return 0;
+}
+
+/* the slot holding the pointer of a far access, if slot-resident */
+static int
+es_farslot(Ins *i, Fn *fn, long *o)
+{
+	Ref r;
+
+	if (isloadfar(i->op))
+		r = i->arg[0];
+	else if (INRANGE(i->op, Ostorefb, Ostorefs))
+		r = i->arg[1];
+	else
+		return 0;
+	if (rtype(r) != RSlot)
+		return 0;
+	*o = (long)slot(r, fn);
+	return 1;
+}
+
+static void
+es_step(EsState *s, Ins *i, Fn *fn)
+{
+	long o;
+	int keep;
+
+	if (s->dirty && es_needds(i)) {
+		s->dirty = 0;
+		s->n = 0;
+	}
+	if (es_farslot(i, fn, &o) && !(s->dirty && es_has(s, o))) {
+		s->dirty = 1;
+		s->n = 1;
+		s->off[0] = o;
+	}
+	keep = (i->op == Oaddfo || i->op == Osubfo
+	        || (i->op == Ocopy && i->cls == Kl))
+	    && rtype(i->arg[0]) == RSlot && rtype(i->to) == RSlot
+	    && es_has(s, (long)slot(i->arg[0], fn));
+	if (rtype(i->to) == RSlot)
+		es_kill(s, (long)slot(i->to, fn));
+	if (INRANGE(i->op, Ostoreb, Ostored) && rtype(i->arg[1]) == RSlot)
+		es_kill(s, (long)slot(i->arg[1], fn));
+	if (keep)
+		es_add(s, (long)slot(i->to, fn));
+}
+
+static void
+es_meet(EsState *d, EsState *s)
+{
+	int n, m;
+
+	if (!s->visit)
+		return;
+	if (!d->visit) {
+		*d = *s;
+		return;
+	}
+	if (d->dirty != s->dirty) {
+		d->dirty = 1;
+		d->n = 0;
+		return;
+	}
+	for (n = m = 0; n < d->n; n++)
+		if (es_has(s, d->off[n]))
+			d->off[m++] = d->off[n];
+	d->n = m;
+}
+
+static int
+es_eq(EsState *a, EsState *b)
+{
+	int n;
+
+	if (a->visit != b->visit || a->dirty != b->dirty || a->n != b->n)
+		return 0;
+	for (n = 0; n < a->n; n++)
+		if (!es_has(b, a->off[n]))
+			return 0;
+	return 1;
+}
+
+/* forward fixpoint for the ES state at block entries; if it does
+ * not settle quickly every block but the first starts unknown */
+static void
+esflow(Fn *fn)
+{
+	Blk *b, **p;
+	EsState s;
+	Ins *i;
+	uint n;
+	int chg, iter;
+
+	if (fn->nblk > es_cap) {
+		es_cap = fn->nblk;
+		es_in = realloc(es_in, es_cap * sizeof es_in[0]);
+		es_out = realloc(es_out, es_cap * sizeof es_out[0]);
+		if (!es_in || !es_out)
+			die("emit: out of memory for ES states");
+	}
+	memset(es_out, 0, fn->nblk * sizeof es_out[0]);
+	for (iter = 0;; iter++) {
+		chg = 0;
+		for (n = 0; n < fn->nblk; n++) {
+			b = fn->rpo[n];
+			memset(&s, 0, sizeof s);
+			if (b == fn->start)
+				s.visit = 1;
+			for (p = b->pred; p < &b->pred[b->npred]; p++)
+				es_meet(&s, &es_out[(*p)->id]);
+			es_in[n] = s;
+			for (i = b->ins; i < &b->ins[b->nins]; i++)
+				es_step(&s, i, fn);
+			if (!es_eq(&s, &es_out[n])) {
+				es_out[n] = s;
+				chg = 1;
+			}
+		}
+		if (!chg)
+			break;
+		if (iter == 16) {
+			for (n = 0; n < fn->nblk; n++)
+				if (fn->rpo[n]->npred)
+					es_in[n] = (EsState){.visit = 1, .dirty = 1};
+			break;
+		}
+	}
+}
+
+/* ES:BX = far pointer in the slot at [bp+o] */
+static void
+es_loadptr(long o, FILE *f)
+{
+	fprintf(f, "\tmov bx, word [bp%+ld]\n", o);
+	if (!(g_es.dirty && es_has(&g_es, o)))
+		fprintf(f, "\tmov es, word [bp%+ld]\n", o + 2);
+}
+
 /* Preserve AX/DX across a Kl op that uses them as scratch.  rega doesn't
  * model the implicit clobber, so we save/restore the caller's AX/DX
  * unless the op's destination is one of them (in which case the op writes
@@ -527,13 +775,13 @@ static uint
 chk_blk_liveout(Blk *b)
 {
 	uint out = 0;
+	Blk *s;
+	uint n;
 
 	if (!b->s1 && !b->s2)
 		return CHK_BIT(RAX) | CHK_BIT(RDX);
-	if (b->s1)
-		out |= chk_livein[b->s1->id];
-	if (b->s2)
-		out |= chk_livein[b->s2->id];
+	for (n=0; (s=nextsucc(b, &n));)
+		out |= chk_livein[s->id];
 	return out;
 }
 
@@ -545,7 +793,8 @@ chk_blk_livein(Blk *b, Fn *fn)
 	int n;
 
 	live = chk_blk_liveout(b);
-	if (b->jmp.type == Jjnz && rtype(b->jmp.arg) == RTmp
+	if ((b->jmp.type == Jjnz || b->jmp.type == Jjtab)
+	 && rtype(b->jmp.arg) == RTmp
 	 && CHK_ISGPR(b->jmp.arg.val))
 		live |= CHK_BIT(b->jmp.arg.val);
 	for (n = b->nins - 1; n >= 0; n--)
@@ -762,6 +1011,30 @@ load_farptr_con(Con *pc, FILE *f)
 	}
 }
 
+/* Print the offset (hi = 0) or segment (hi = 1) word of the far
+ * pointer r as an instruction operand: a slot word, an immediate, or
+ * the `sym+addend` / `seg sym` relocation pair load_farptr_con uses. */
+static void
+huge_word(Ref r, int hi, Fn *fn, FILE *f)
+{
+	Con *c;
+
+	if (rtype(r) == RSlot)
+		fprintf(f, "word [bp%+ld]", (long)slot(r, fn) + 2*hi);
+	else if (rtype(r) == RCon) {
+		c = &fn->con[r.val];
+		if (c->type == CAddr && hi) {
+			fputs("seg ", f);
+			fputs(T.assym, f);
+			fputs(str(c->sym.id), f);
+		} else if (c->type == CAddr)
+			emitaddr(c, f);
+		else
+			fprintf(f, "%d", (int)((c->bits.i >> 16*hi) & 0xFFFF));
+	} else
+		die("i8086: huge pointer operand must be slot-resident or constant");
+}
+
 /* Emit a 32-bit immediate bitwise op (and/or/xor) against DX:AX from
  * a Kl RCon.  Handles both CBits (split low/high 16) and CAddr (same
  * `sym+addend` / `seg sym` relocation pair the Kl Oadd/Osub handlers
@@ -790,21 +1063,215 @@ emit32_logop_axdx_con(const char *op, Con *pc, FILE *f)
 	}
 }
 
-/* 8086-safe `shift reg, N`: the multi-bit immediate form (e.g. `shl
- * dx, 8`) was introduced on the 80186, so under `cpu 8086` NASM
- * rejects it.  Emit `shift reg, 1` for N==1 (8086-valid), else stage
- * the count into CL.  Caller must have preserved CX (the Kl shift
- * handlers already push/pop CX as part of the AX/DX/CX bracket). */
+/* 8088 timing of the forms the shift and multiply expansions choose
+ * between: bytes and execution clocks, with the extra bus cycle of
+ * each word memory transfer (push/pop) included.  The 8088 fetches a
+ * byte every 4 clocks, so straight-line code costs the larger of its
+ * execution and fetch times. */
+static struct { uchar bytes, clk; } t88[] = {
+	[C88Sh1]   = {2, 2},
+	[C88ShCl]  = {2, 8},
+	[C88Mov]   = {2, 2},
+	[C88Alu]   = {2, 3},
+	[C88Xchg]  = {1, 3},
+	[C88Cbw]   = {1, 2},
+	[C88Push]  = {1, 15},
+	[C88Pop]   = {1, 12},
+	[C88MovI]  = {3, 4},
+	[C88MovCl] = {2, 4},
+	[C88Loop]  = {2, 17},
+	[C88Mul]   = {2, 126},
+	[C88Imul]  = {2, 141},
+};
+
+/* The cost of n instructions of form t; for C88ShCl, of one shift
+ * by n bits. */
+int
+i8086_cost(int t, int n)
+{
+	int c;
+
+	if (t == C88ShCl)
+		return t88[t].clk + 4 * n;
+	c = t88[t].clk;
+	if (c < 4 * t88[t].bytes)
+		c = 4 * t88[t].bytes;
+	return c * n;
+}
+
+enum { ShBit, ShByte, ShCl };
+
+/* The cheapest way to shift the word register reg by the constant n
+ * (0 < n < 16): n single-bit shifts; for n >= 8 a byte move (cbw for
+ * sar), through AX when reg has no suitable halves, and n-8 single
+ * bits; or the count in CL, priced with the push/pop of CX around it
+ * (the 186 `shl r, imm` is out of reach). */
+static int
+shplan(int op, int n, int reg, int *cost)
+{
+	int c, p, half;
+
+	half = reg == RAX || (op != Osar && reg >= RAX && reg <= RBX);
+	p = ShBit;
+	*cost = i8086_cost(C88Sh1, n);
+	if (n >= 8) {
+		c = i8086_cost(C88Mov, 1) + i8086_cost(C88Sh1, n-8)
+			+ (op == Osar ? i8086_cost(C88Cbw, 1) : i8086_cost(C88Alu, 1))
+			+ (half ? 0 : i8086_cost(C88Xchg, 2));
+		if (c < *cost)
+			p = ShByte, *cost = c;
+	}
+	c = i8086_cost(C88Push, 1) + i8086_cost(C88MovCl, 1)
+		+ i8086_cost(C88ShCl, n) + i8086_cost(C88Pop, 1);
+	if (c < *cost)
+		p = ShCl, *cost = c;
+	return p;
+}
+
+/* The cost of a Kw shift by the constant n, for isel's multiply
+ * expansion; the register is not known yet. */
+int
+i8086_shcost(int op, int n)
+{
+	int c;
+
+	if (n <= 0)
+		return 0;
+	if (n > 15)
+		n = 15;
+	shplan(op, n, RBX, &c);
+	return c;
+}
+
+static char *shname[] = {
+	[Oshl] = "shl",
+	[Oshr] = "shr",
+	[Osar] = "sar",
+};
+
+/* The shBit and shByte plans of shplan(). */
 static void
-emit_shift_imm(const char *op, const char *reg, int n, FILE *f)
+emit_shiftk(int op, int reg, int n, int plan, FILE *f)
 {
-	if (n <= 0) return;
-	if (n == 1) {
-		fprintf(f, "\t%s %s, 1\n", op, reg);
-	} else {
+	int r;
+
+	if (plan == ShByte) {
+		r = reg;
+		if (!(reg == RAX || (op != Osar && reg >= RAX && reg <= RBX))) {
+			fprintf(f, "\txchg ax, %s\n", rname[reg]);
+			r = RAX;
+		}
+		if (op == Oshl) {
+			fprintf(f, "\tmov %s, %s\n", rname8h[r], rname8[r]);
+			fprintf(f, "\txor %s, %s\n", rname8[r], rname8[r]);
+		} else {
+			fprintf(f, "\tmov %s, %s\n", rname8[r], rname8h[r]);
+			if (op == Osar)
+				fprintf(f, "\tcbw\n");
+			else
+				fprintf(f, "\txor %s, %s\n", rname8h[r], rname8h[r]);
+		}
+		if (r != reg)
+			fprintf(f, "\txchg ax, %s\n", rname[reg]);
+		n -= 8;
+	}
+	for (; n > 0; n--)
+		fprintf(f, "\t%s %s, 1\n", shname[op], rname[reg]);
+}
+
+/* 8086-safe `shift reg, N` inside a Kl handler, which keeps CX saved
+ * whenever shplan() picks CL (see klshcx).  The multi-bit immediate
+ * form (e.g. `shl dx, 8`) was introduced on the 80186, so under `cpu
+ * 8086` NASM rejects it. */
+static void
+emit_shift_imm(int op, int reg, int n, FILE *f)
+{
+	int plan, c;
+
+	if (n <= 0)
+		return;
+	plan = shplan(op, n, reg, &c);
+	if (plan == ShCl) {
 		fprintf(f, "\tmov cl, %d\n", n);
-		fprintf(f, "\t%s %s, cl\n", op, reg);
+		fprintf(f, "\t%s %s, cl\n", shname[op], rname[reg]);
+	} else
+		emit_shiftk(op, reg, n, plan, f);
+}
+
+/* Kl shifts by a constant below 16.  Each bit takes a shift and a
+ * rotate, unrolled or looped on CX; from 8 bits on the bytes of DX:AX
+ * move over first. */
+enum { KlBit, KlByte, KlLoop };
+
+static int
+klshplan(int op, int n)
+{
+	int c, best, p;
+
+	p = KlBit;
+	best = i8086_cost(C88Sh1, 2*n);
+	if (n >= 8) {
+		c = i8086_cost(C88Mov, 3) + i8086_cost(C88Sh1, 2*(n-8))
+			+ (op == Osar
+			   ? i8086_cost(C88Xchg, 2) + i8086_cost(C88Cbw, 1)
+			   : i8086_cost(C88Alu, 1));
+		if (c < best)
+			p = KlByte, best = c;
+	}
+	c = i8086_cost(C88Push, 1) + i8086_cost(C88MovI, 1)
+		+ i8086_cost(C88Sh1, 2*n) + i8086_cost(C88Loop, n)
+		+ i8086_cost(C88Pop, 1);
+	if (c < best)
+		p = KlLoop;
+	return p;
+}
+
+/* Whether a Kl shift by r1 needs CX: a variable count, or a constant
+ * one whose plan loops or goes through CL. */
+static int
+klshcx(int op, Ref r1, Fn *fn)
+{
+	int n, c;
+
+	if (rtype(r1) != RCon)
+		return 1;
+	n = fn->con[r1.val].bits.i;
+	if (n >= 16)
+		return n > 16 && shplan(op, n-16, op == Oshl ? RDX : RAX, &c) == ShCl;
+	return n > 0 && klshplan(op, n) == KlLoop;
+}
+
+/* DX:AX shifted by the constant 0 < n < 16, without a loop. */
+static void
+emit_klshiftk(int op, int n, FILE *f)
+{
+	if (klshplan(op, n) == KlByte) {
+		if (op == Oshl) {
+			fprintf(f, "\tmov dh, dl\n");
+			fprintf(f, "\tmov dl, ah\n");
+			fprintf(f, "\tmov ah, al\n");
+			fprintf(f, "\txor al, al\n");
+		} else {
+			fprintf(f, "\tmov al, ah\n");
+			fprintf(f, "\tmov ah, dl\n");
+			fprintf(f, "\tmov dl, dh\n");
+			if (op == Osar) {
+				fprintf(f, "\txchg ax, dx\n");
+				fprintf(f, "\tcbw\n");
+				fprintf(f, "\txchg ax, dx\n");
+			} else
+				fprintf(f, "\txor dh, dh\n");
+		}
+		n -= 8;
 	}
+	for (; n > 0; n--)
+		if (op == Oshl) {
+			fprintf(f, "\tshl ax, 1\n");
+			fprintf(f, "\trcl dx, 1\n");
+		} else {
+			fprintf(f, "\t%s dx, 1\n", shname[op]);
+			fprintf(f, "\trcr ax, 1\n");
+		}
 }
 
 /* Load a 32-bit operand into DX:AX.  The original 32-bit handlers only
@@ -838,25 +1305,31 @@ load32_dxax(Ref r, Fn *fn, FILE *f)
  * always-true or always-false depending on whether DGROUP happened to be
  * zero. */
 static void
-cmp32_high(Ref r, Fn *fn, FILE *f)
+op32_high(char *op, Ref r, Fn *fn, FILE *f)
 {
 	Con *pc;
 	int64_t val;
 	if (rtype(r) == RSlot)
-		fprintf(f, "\tcmp dx, word [bp%+ld]\n", (long)slot(r, fn) + 2);
+		fprintf(f, "\t%s dx, word [bp%+ld]\n", op, (long)slot(r, fn) + 2);
 	else if (rtype(r) == RCon) {
 		pc = &fn->con[r.val];
 		if (pc->type == CAddr) {
-			fprintf(f, "\tcmp dx, seg ");
+			fprintf(f, "\t%s dx, seg ", op);
 			fputs(T.assym, f);
 			fputs(str(pc->sym.id), f);
 			fputc('\n', f);
 		} else {
 			val = pc->bits.i;
-			fprintf(f, "\tcmp dx, %d\n", (int)((val >> 16) & 0xFFFF));
+			fprintf(f, "\t%s dx, %d\n", op, (int)((val >> 16) & 0xFFFF));
 		}
 	} else if (rtype(r) == RTmp)
-		fprintf(f, "\tcmp dx, 0\n");
+		fprintf(f, "\t%s dx, 0\n", op);
+}
+
+static void
+cmp32_high(Ref r, Fn *fn, FILE *f)
+{
+	op32_high("cmp", r, fn, f);
 }
 
 static void
@@ -880,6 +1353,49 @@ cmp32_low(Ref r, Fn *fn, FILE *f)
 		fprintf(f, "\tcmp ax, %s\n", rname[r.val]);
 }
 
+/* Flags-only Kl compare (i->to == R): isel fused it into the block's
+ * Jjf* jump, so only the flags that jump tests must come out right.
+ * Equality chains the two word compares through ZF; the orderings,
+ * which isel turned into lt/ge, run `cmp lo; sbb hi` so SF^OF (signed)
+ * and CF (unsigned) carry the 32-bit result.  The AX/DX pops leave the
+ * flags alone. */
+static void
+kl_flagcmp(Ins *i, Fn *fn, FILE *f)
+{
+	static int id;
+	AxDxSave s;
+	Ref r0, r1;
+	int zero;
+
+	r0 = i->arg[0];
+	r1 = i->arg[1];
+	zero = rtype(r1) == RCon && fn->con[r1.val].type == CBits
+	    && fn->con[r1.val].bits.i == 0;
+	if (zero && rtype(r0) == RSlot
+	&& (i->op == Ocsltl || i->op == Ocsgel)) {
+		/* the sign of the high word decides */
+		fprintf(f, "\tcmp word [bp%+ld], 0\n", (long)slot(r0, fn) + 2);
+		return;
+	}
+	s = kl_save_axdx(R, f);
+	load32_dxax(r0, fn, f);
+	if (i->op == Oceql || i->op == Ocnel) {
+		if (zero)
+			fprintf(f, "\tor ax, dx\n");
+		else {
+			cmp32_high(r1, fn, f);
+			id++;
+			fprintf(f, "\tjne .L_kcmp%d\n", id);
+			cmp32_low(r1, fn, f);
+			fprintf(f, ".L_kcmp%d:\n", id);
+		}
+	} else {
+		cmp32_low(r1, fn, f);
+		op32_high("sbb", r1, fn, f);
+	}
+	kl_restore_axdx(s, f);
+}
+
 /* Push a Kl operand as `push hi; push lo` so that after the pair the low
  * word sits on top of stack — i.e. lower address than the high word.
  * Used to set up cdecl-style 32-bit args for libstub helpers like
@@ -1359,6 +1875,9 @@ emitins(Ins *i, Fn *fn, FILE *f)
 		    (rtype(i->to) == RTmp)     ? rname[i->to.val] : "?";
 		int dst_is_cx = (rtype(i->to) == RTmp && i->to.val == RCX) ||
 		                (rtype(r0)    == RTmp && r0.val    == RCX);
+		int dreg = (rtype(r0) == RTmp)    ? r0.val :
+		           (rtype(i->to) == RTmp) ? i->to.val : -1;
+		int plan, cost;
 
 		if (imm_cnt == 1) {
 			if (need_val_load) emit_shift_val(dstname, r0, fn, f);
@@ -1368,18 +1887,15 @@ emitins(Ins *i, Fn *fn, FILE *f)
 			 * the value is in the destination. */
 			if (need_val_load) emit_shift_val(dstname, r0, fn, f);
 			else fprintf(f, "\t%s %s, 0\n", shiftop, dstname);
-		} else if (imm_cnt > 1 && imm_cnt <= 8) {
-			/* Small immediate count: unroll into repeated
-			 * `shl dst, 1`.  This avoids touching CX/CL entirely,
-			 * which is critical because the i8086 backend doesn't
-			 * tell rega that shifts clobber CL — without unrolling,
-			 * `mov cl, imm` would corrupt any live Kw value rega
-			 * happened to keep in CX across the shift. */
-			int64_t k;
+		} else if (imm_cnt > 1 && imm_cnt < 16 && dreg >= 0
+		        && (plan = shplan(i->op, imm_cnt, dreg, &cost)) != ShCl) {
+			/* Single-bit shifts, or a byte move first, as the
+			 * cycle table prefers (see shplan).  Neither touches
+			 * CX/CL, which matters because the i8086 backend
+			 * doesn't tell rega that shifts clobber CL. */
 			if (need_val_load) emit_shift_val(dstname, r0, fn, f);
-			for (k = 0; k < imm_cnt; k++)
-				fprintf(f, "\t%s %s, 1\n", shiftop, dstname);
-		} else if (imm_cnt > 8) {
+			emit_shiftk(i->op, dreg, imm_cnt, plan, f);
+		} else if (imm_cnt > 1) {
 			/* Large immediate count: must use CL.  Save CX around
 			 * the shift so any unrelated live value in CX is
 			 * preserved.  When dst is CX itself, the value being
@@ -1561,6 +2077,11 @@ emitins(Ins *i, Fn *fn, FILE *f)
 		r0 = i->arg[0];
 		r1 = i->arg[1];
 
+		if (INRANGE(i->op, Oceql, Ocultl) && req(i->to, R)) {
+			kl_flagcmp(i, fn, f);
+			return;
+		}
+
 		switch (i->op) {
 		case Oadd:
 			/*
@@ -1779,6 +2300,158 @@ emitins(Ins *i, Fn *fn, FILE *f)
 			}
 			return;
 
+		case Ohugeadd:
+		case Ohugesub:
+		case Ohugeinc:
+		case Ohugedec:
+			/*
+			 * Huge-pointer add/sub, inline instead of a far call to
+			 * _qbe_huge_add/_qbe_huge_sub.  arg0 = far ptr (slot or
+			 * constant), arg1 = signed 32-bit byte offset.  The result
+			 * is normalised (offset < 16): minic still forms member,
+			 * copy and constant-index addresses with a flat `add`
+			 * (which carries by 16 bytes, not 64 KB) and hands huge
+			 * pointers to libc, so neither may cross the top of the
+			 * offset word.
+			 *
+			 * hugeinc/hugedec are the induction steps hugeiv() found
+			 * in isel, whose pointer has no such uses: while the
+			 * offset word stays at or below 0xFFF0 only it moves,
+			 * and the segment word is copied as is.
+			 *
+			 * Constant step in [0, 64 KB): t = off ± arg1 is 17 bits,
+			 * the carry (borrow) being bit 16, so
+			 *   seg' = seg + (t >> 4), off' = t & 15
+			 * needs one rcr and three shifts (sar for a sub, where
+			 * bit 16 is the sign) on the offset word alone.
+			 *
+			 * Any other step: the same in DX:AX for the 32-bit sum.
+			 * BX stages off'.
+			 */
+			{
+			static int hugeid;
+			int id = hugeid++;
+			int sub = (i->op == Ohugesub || i->op == Ohugedec);
+			int lazy = (i->op == Ohugeinc || i->op == Ohugedec);
+			int fast = 0, bxsv, n;
+			AxDxSave s_hg;
+
+			if (rtype(i->to) != RSlot)
+				die("i8086: huge pointer result must be slot-resident");
+			if (rtype(r1) == RCon) {
+				Con *pc = &fn->con[r1.val];
+				if (pc->type == CAddr)
+					die("i8086: hugeadd/hugesub offset is an address");
+				fast = pc->bits.i >= 0 && pc->bits.i < 0x10000;
+			}
+			if (lazy && !fast)
+				die("i8086: hugeinc/hugedec step must be a constant");
+			s_hg = kl_save_axdx(i->to, f);
+
+			if (lazy) {
+				fprintf(f, "\tmov ax, ");
+				huge_word(r0, 0, fn, f);
+				fprintf(f, "\n\t%s ax, ", sub ? "sub" : "add");
+				huge_word(r1, 0, fn, f);
+				fprintf(f, "\n\tjc .Lhuge%d\n", id);
+				fprintf(f, "\tcmp ax, 0xFFF0\n");
+				fprintf(f, "\tja .Lhuge%d\n", id);
+				fprintf(f, "\tmov word [bp%+ld], ax\n", (long)slot(i->to, fn));
+				if (!req(r0, i->to)) {
+					fprintf(f, "\tmov ax, ");
+					huge_word(r0, 1, fn, f);
+					fprintf(f, "\n\tmov word [bp%+ld], ax\n",
+						(long)slot(i->to, fn) + 2);
+				}
+				fprintf(f, "\tjmp .Lhuge%d_done\n", id);
+				fprintf(f, ".Lhuge%d:\n", id);
+			}
+			bxsv = farptr_save_bx(i->to, f);
+
+			if (fast) {
+				fprintf(f, "\tmov ax, ");
+				huge_word(r0, 0, fn, f);
+				fprintf(f, "\n\t%s ax, ", sub ? "sub" : "add");
+				huge_word(r1, 0, fn, f);
+				fprintf(f, "\n\tmov bx, ax\n");
+				fprintf(f, "\trcr ax, 1\n");
+				for (n = 0; n < 3; n++)
+					fprintf(f, "\t%s ax, 1\n", sub ? "sar" : "shr");
+			} else {
+				/* DX:AX = arg1, negated for a sub */
+				if (rtype(r1) == RSlot) {
+					fprintf(f, "\tmov ax, word [bp%+ld]\n", (long)slot(r1, fn));
+					fprintf(f, "\tmov dx, word [bp%+ld]\n", (long)slot(r1, fn) + 2);
+				} else if (rtype(r1) == RCon)
+					load32_axdx_con(&fn->con[r1.val], f);
+				else if (rtype(r1) == RTmp) {
+					if (strcmp(rname[r1.val], "ax") != 0)
+						fprintf(f, "\tmov ax, %s\n", rname[r1.val]);
+					fprintf(f, "\tcwd\n");
+				}
+				if (sub) {
+					fprintf(f, "\tneg dx\n");
+					fprintf(f, "\tneg ax\n");
+					fprintf(f, "\tsbb dx, 0\n");
+				}
+				fprintf(f, "\tadd ax, ");
+				huge_word(r0, 0, fn, f);
+				fprintf(f, "\n\tadc dx, 0\n");
+				fprintf(f, "\tmov bx, ax\n");
+				for (n = 0; n < 4; n++) {
+					fprintf(f, "\tsar dx, 1\n");
+					fprintf(f, "\trcr ax, 1\n");
+				}
+			}
+			fprintf(f, "\tand bx, 15\n");
+			fprintf(f, "\tadd ax, ");
+			huge_word(r0, 1, fn, f);
+			fprintf(f, "\n\tmov word [bp%+ld], bx\n", (long)slot(i->to, fn));
+			fprintf(f, "\tmov word [bp%+ld], ax\n", (long)slot(i->to, fn) + 2);
+			farptr_restore_bx(bxsv, f);
+			if (lazy)
+				fprintf(f, ".Lhuge%d_done:\n", id);
+			kl_restore_axdx(s_hg, f);
+			}
+			return;
+
+		case Ohugecmp:
+			/*
+			 * Signed linear difference of two huge pointers,
+			 *   (seg0 - seg1) * 16 + off0 - off1
+			 * formed in DX:AX — _qbe_huge_cmp without the call.  The
+			 * segment difference is taken first so it needs 17 bits,
+			 * not the 20 of each linear address.
+			 */
+			{
+			AxDxSave s_hc;
+			int n;
+
+			if (rtype(i->to) != RSlot)
+				die("i8086: hugecmp result must be slot-resident");
+			s_hc = kl_save_axdx(i->to, f);
+			fprintf(f, "\tmov ax, ");
+			huge_word(r0, 1, fn, f);
+			fprintf(f, "\n\txor dx, dx\n");
+			fprintf(f, "\tsub ax, ");
+			huge_word(r1, 1, fn, f);
+			fprintf(f, "\n\tsbb dx, 0\n");
+			for (n = 0; n < 4; n++) {
+				fprintf(f, "\tshl ax, 1\n");
+				fprintf(f, "\trcl dx, 1\n");
+			}
+			fprintf(f, "\tadd ax, ");
+			huge_word(r0, 0, fn, f);
+			fprintf(f, "\n\tadc dx, 0\n");
+			fprintf(f, "\tsub ax, ");
+			huge_word(r1, 0, fn, f);
+			fprintf(f, "\n\tsbb dx, 0\n");
+			fprintf(f, "\tmov word [bp%+ld], ax\n", (long)slot(i->to, fn));
+			fprintf(f, "\tmov word [bp%+ld], dx\n", (long)slot(i->to, fn) + 2);
+			kl_restore_axdx(s_hc, f);
+			}
+			return;
+
 		case Omul:
 			/*
 			 * 32-bit multiplication: dest = src0 * src1 (low 32 bits).
@@ -1809,9 +2482,13 @@ emitins(Ins *i, Fn *fn, FILE *f)
 			klmul_movax(r0, 1, fn, f);   /* ax = a_hi */
 			klmul_byword(r1, 0, fn, f);  /* dx:ax = a_hi*b_lo */
 			fprintf(f, "\tmov cx, ax\n");
-			klmul_movax(r0, 0, fn, f);   /* ax = a_lo */
-			klmul_byword(r1, 1, fn, f);  /* dx:ax = a_lo*b_hi */
-			fprintf(f, "\tadd cx, ax\n");
+			if (!(rtype(r1) == RCon
+			    && (fn->con[r1.val].bits.i & 0xffff0000) == 0)) {
+				/* skipped when b_hi is a constant 0 */
+				klmul_movax(r0, 0, fn, f);   /* ax = a_lo */
+				klmul_byword(r1, 1, fn, f);  /* dx:ax = a_lo*b_hi */
+				fprintf(f, "\tadd cx, ax\n");
+			}
 			/* dx:ax = a_lo*b_lo (full low product) */
 			klmul_movax(r0, 0, fn, f);
 			klmul_byword(r1, 0, fn, f);
@@ -1957,7 +2634,7 @@ emitins(Ins *i, Fn *fn, FILE *f)
 			int dst_in_ax_shl = (rtype(i->to) == RTmp && i->to.val == RAX);
 			int dst_in_dx_shl = (rtype(i->to) == RTmp && i->to.val == RDX);
 			int dst_in_cx_shl = (rtype(i->to) == RTmp && i->to.val == RCX);
-			int save_cx = !dst_in_cx_shl;
+			int save_cx = !dst_in_cx_shl && klshcx(Oshl, r1, fn);
 			int r1_in_axdx = (rtype(r1) == RTmp
 			    && (r1.val == RAX || r1.val == RDX));
 
@@ -1973,7 +2650,9 @@ emitins(Ins *i, Fn *fn, FILE *f)
 					/* Shift by 16+: low word becomes 0, high = low << (n-16) */
 					fprintf(f, "\tmov dx, ax\n");
 					fprintf(f, "\txor ax, ax\n");
-					emit_shift_imm("shl", "dx", shift - 16, f);
+					emit_shift_imm(Oshl, RDX, shift - 16, f);
+				} else if (shift > 0 && klshplan(Oshl, shift) != KlLoop) {
+					emit_klshiftk(Oshl, shift, f);
 				} else if (shift > 0) {
 					/* Use loop for shift */
 					fprintf(f, "\tmov cx, %d\n", shift);
@@ -2027,7 +2706,7 @@ emitins(Ins *i, Fn *fn, FILE *f)
 			int dst_in_ax_shr = (rtype(i->to) == RTmp && i->to.val == RAX);
 			int dst_in_dx_shr = (rtype(i->to) == RTmp && i->to.val == RDX);
 			int dst_in_cx_shr = (rtype(i->to) == RTmp && i->to.val == RCX);
-			int save_cx = !dst_in_cx_shr;
+			int save_cx = !dst_in_cx_shr && klshcx(Oshr, r1, fn);
 			int r1_in_axdx = (rtype(r1) == RTmp
 			    && (r1.val == RAX || r1.val == RDX));
 
@@ -2043,7 +2722,9 @@ emitins(Ins *i, Fn *fn, FILE *f)
 					/* Shift by 16+: high word becomes 0, low = high >> (n-16) */
 					fprintf(f, "\tmov ax, dx\n");
 					fprintf(f, "\txor dx, dx\n");
-					emit_shift_imm("shr", "ax", shift - 16, f);
+					emit_shift_imm(Oshr, RAX, shift - 16, f);
+				} else if (shift > 0 && klshplan(Oshr, shift) != KlLoop) {
+					emit_klshiftk(Oshr, shift, f);
 				} else if (shift > 0) {
 					fprintf(f, "\tmov cx, %d\n", shift);
 					fprintf(f, ".L_shr32_%p:\n", (void*)i);
@@ -2091,7 +2772,7 @@ emitins(Ins *i, Fn *fn, FILE *f)
 			int dst_in_ax_sar = (rtype(i->to) == RTmp && i->to.val == RAX);
 			int dst_in_dx_sar = (rtype(i->to) == RTmp && i->to.val == RDX);
 			int dst_in_cx_sar = (rtype(i->to) == RTmp && i->to.val == RCX);
-			int save_cx = !dst_in_cx_sar;
+			int save_cx = !dst_in_cx_sar && klshcx(Osar, r1, fn);
 			int r1_in_axdx = (rtype(r1) == RTmp
 			    && (r1.val == RAX || r1.val == RDX));
 
@@ -2110,7 +2791,9 @@ emitins(Ins *i, Fn *fn, FILE *f)
 					 * the prior `sar dx, 15` which is 80186+. */
 					fprintf(f, "\tmov ax, dx\n");
 					fprintf(f, "\tcwd\n");
-					emit_shift_imm("sar", "ax", shift - 16, f);
+					emit_shift_imm(Osar, RAX, shift - 16, f);
+				} else if (shift > 0 && klshplan(Osar, shift) != KlLoop) {
+					emit_klshiftk(Osar, shift, f);
 				} else if (shift > 0) {
 					fprintf(f, "\tmov cx, %d\n", shift);
 					fprintf(f, ".L_sar32_%p:\n", (void*)i);
@@ -2789,7 +3472,14 @@ emitins(Ins *i, Fn *fn, FILE *f)
 			 * Make far pointer from segment and offset
 			 * arg[0] = segment (word), arg[1] = offset (word)
 			 * Result: far pointer stored as segment:offset (DX:AX)
+			 *
+			 * With a slot destination DX:AX are only scratch, so
+			 * bracket them like the other Kl handlers.
 			 */
+			{
+			AxDxSave s_mkfar = {0, 0};
+			if (rtype(i->to) == RSlot)
+				s_mkfar = kl_save_axdx(i->to, f);
 			/* Load segment to DX */
 			if (rtype(r0) == RTmp)
 				fprintf(f, "\tmov dx, %s\n", rname[r0.val]);
@@ -2809,6 +3499,8 @@ emitins(Ins *i, Fn *fn, FILE *f)
 				fprintf(f, "\tmov word [bp%+ld], ax\n", (long)slot(i->to, fn));
 				fprintf(f, "\tmov word [bp%+ld], dx\n", (long)slot(i->to, fn) + 2);
 			}
+			kl_restore_axdx(s_mkfar, f);
+			}
 			return;
 
 		case Ovargp: {
@@ -3329,8 +4021,10 @@ emitins(Ins *i, Fn *fn, FILE *f)
 		 *
 		 * The libstub ABI assumes ES = DS = DGROUP at every call (sprintf
 		 * uses stosb against ES:DI; INT 21h handle writes don't, but ES
-		 * stays caller-visible).  Push/pop ES around the far access so
-		 * the caller's invariant survives.
+		 * stays caller-visible).  A slot-resident pointer leaves ES set
+		 * and lets the ES tracking (see es_step) restore DGROUP before
+		 * the next call or return; the other pointer shapes push/pop ES
+		 * around the access.
 		 *
 		 * BX clobber: this handler uses BX as the address scratch; rega
 		 * does not know about that, so a live SSA temp rega placed in BX
@@ -3355,12 +4049,12 @@ emitins(Ins *i, Fn *fn, FILE *f)
 		{
 		AxDxSave s_loadfb = kl_save_axdx(i->to, f);
 		int bxsv_loadfb;
-		fprintf(f, "\tpush es\n");
+		if (rtype(r0) != RSlot)
+			fprintf(f, "\tpush es\n");
 		bxsv_loadfb = farptr_save_bx(i->to, f);
 		/* Load far pointer components into ES:BX */
 		if (rtype(r0) == RSlot) {
-			fprintf(f, "\tmov bx, word [bp%+ld]\n", (long)slot(r0, fn));      /* offset */
-			fprintf(f, "\tmov es, word [bp%+ld]\n", (long)slot(r0, fn) + 2);  /* segment */
+			es_loadptr((long)slot(r0, fn), f);
 		} else if (rtype(r0) == RCon) {
 			load_farptr_con(&fn->con[r0.val], f);
 		} else if (rtype(r0) == RTmp) {
@@ -3372,7 +4066,8 @@ emitins(Ins *i, Fn *fn, FILE *f)
 		fprintf(f, "\tmov al, byte ptr es:[bx]\n");
 		fprintf(f, "\txor ah, ah\n");  /* zero-extend to word */
 		farptr_restore_bx(bxsv_loadfb, f);
-		fprintf(f, "\tpop es\n");
+		if (rtype(r0) != RSlot)
+			fprintf(f, "\tpop es\n");
 		/* Store result */
 		if (rtype(i->to) == RTmp)
 			{ if (strcmp(rname[i->to.val], "ax") != 0) fprintf(f, "\tmov %s, ax\n", rname[i->to.val]); }
@@ -3389,7 +4084,7 @@ emitins(Ins *i, Fn *fn, FILE *f)
 		 * arg[0] = far pointer (32-bit: segment:offset)
 		 * result = word value
 		 *
-		 * Push/pop ES + BX around the access — see Oloadfb for rationale.
+		 * ES + BX handling as in Oloadfb.
 		 * AX clobber save bracket too — same shape as Oloadfb.  See
 		 * [[i8086-compact-loadfb-aliases-ax]].
 		 */
@@ -3397,12 +4092,12 @@ emitins(Ins *i, Fn *fn, FILE *f)
 		{
 		AxDxSave s_loadfw = kl_save_axdx(i->to, f);
 		int bxsv_loadfw;
-		fprintf(f, "\tpush es\n");
+		if (rtype(r0) != RSlot)
+			fprintf(f, "\tpush es\n");
 		bxsv_loadfw = farptr_save_bx(i->to, f);
 		/* Load far pointer components into ES:BX */
 		if (rtype(r0) == RSlot) {
-			fprintf(f, "\tmov bx, word [bp%+ld]\n", (long)slot(r0, fn));      /* offset */
-			fprintf(f, "\tmov es, word [bp%+ld]\n", (long)slot(r0, fn) + 2);  /* segment */
+			es_loadptr((long)slot(r0, fn), f);
 		} else if (rtype(r0) == RCon) {
 			load_farptr_con(&fn->con[r0.val], f);
 		} else if (rtype(r0) == RTmp) {
@@ -3413,7 +4108,8 @@ emitins(Ins *i, Fn *fn, FILE *f)
 		/* Load word through ES:BX */
 		fprintf(f, "\tmov ax, word ptr es:[bx]\n");
 		farptr_restore_bx(bxsv_loadfw, f);
-		fprintf(f, "\tpop es\n");
+		if (rtype(r0) != RSlot)
+			fprintf(f, "\tpop es\n");
 		/* Store result */
 		if (rtype(i->to) == RTmp)
 			{ if (strcmp(rname[i->to.val], "ax") != 0) fprintf(f, "\tmov %s, ax\n", rname[i->to.val]); }
@@ -3441,19 +4137,19 @@ emitins(Ins *i, Fn *fn, FILE *f)
 		 * destination slot per spill.c's Kl-slot-resident invariant.  Use
 		 * kl_save_axdx to preserve any rega-placed live tmps in AX/DX
 		 * (Oloadf{b,h,w} only clobber AX, so they don't need DX-save;
-		 * this handler clobbers both).  Push/pop ES + BX around the
-		 * access — same rationale as Oloadfb.
+		 * this handler clobbers both).  ES + BX handling as in
+		 * Oloadfb.
 		 */
 		r0 = i->arg[0];
 		{
 		AxDxSave s_loadfl = kl_save_axdx(i->to, f);
 		int bxsv_loadfl;
-		fprintf(f, "\tpush es\n");
+		if (rtype(r0) != RSlot)
+			fprintf(f, "\tpush es\n");
 		bxsv_loadfl = farptr_save_bx(i->to, f);
 		/* Load far pointer components into ES:BX */
 		if (rtype(r0) == RSlot) {
-			fprintf(f, "\tmov bx, word [bp%+ld]\n", (long)slot(r0, fn));      /* offset */
-			fprintf(f, "\tmov es, word [bp%+ld]\n", (long)slot(r0, fn) + 2);  /* segment */
+			es_loadptr((long)slot(r0, fn), f);
 		} else if (rtype(r0) == RCon) {
 			load_farptr_con(&fn->con[r0.val], f);
 		} else if (rtype(r0) == RTmp) {
@@ -3466,7 +4162,8 @@ emitins(Ins *i, Fn *fn, FILE *f)
 		fprintf(f, "\tmov ax, word ptr es:[bx]\n");
 		fprintf(f, "\tmov dx, word ptr es:[bx+2]\n");
 		farptr_restore_bx(bxsv_loadfl, f);
-		fprintf(f, "\tpop es\n");
+		if (rtype(r0) != RSlot)
+			fprintf(f, "\tpop es\n");
 		/* Store result into destination */
 		if (rtype(i->to) == RSlot) {
 			fprintf(f, "\tmov word [bp%+ld], ax\n", (long)slot(i->to, fn));
@@ -3487,7 +4184,7 @@ emitins(Ins *i, Fn *fn, FILE *f)
 		 * arg[0] = value to store (word, low byte used)
 		 * arg[1] = far pointer (32-bit: segment:offset)
 		 *
-		 * Push/pop ES + BX around the access — see Oloadfb for rationale.
+		 * ES + BX handling as in Oloadfb.
 		 * CX is also used as the byte-staging scratch (mov cl, ...); save
 		 * it too or any live SSA temp rega placed in CX is silently
 		 * clobbered.  Surfaced by stevie's filetonext: nextra.35 lived
@@ -3509,7 +4206,8 @@ emitins(Ins *i, Fn *fn, FILE *f)
 		{
 		AxDxSave s_storefb = kl_save_axdx(i->to, f);
 		int bxsv_storefb;
-		fprintf(f, "\tpush es\n");
+		if (rtype(r1) != RSlot)
+			fprintf(f, "\tpush es\n");
 		bxsv_storefb = farptr_save_bx(i->to, f);
 		fprintf(f, "\tpush cx\n");
 		/* Load value to store into CL (to preserve AX for far pointer).
@@ -3529,8 +4227,7 @@ emitins(Ins *i, Fn *fn, FILE *f)
 			fprintf(f, "\tmov cl, %d\n", (int)(fn->con[r0.val].bits.i & 0xFF));
 		/* Load far pointer into ES:BX */
 		if (rtype(r1) == RSlot) {
-			fprintf(f, "\tmov bx, word [bp%+ld]\n", (long)slot(r1, fn));      /* offset */
-			fprintf(f, "\tmov es, word [bp%+ld]\n", (long)slot(r1, fn) + 2);  /* segment */
+			es_loadptr((long)slot(r1, fn), f);
 		} else if (rtype(r1) == RCon) {
 			load_farptr_con(&fn->con[r1.val], f);
 		} else if (rtype(r1) == RTmp) {
@@ -3542,7 +4239,8 @@ emitins(Ins *i, Fn *fn, FILE *f)
 		fprintf(f, "\tmov byte ptr es:[bx], cl\n");
 		fprintf(f, "\tpop cx\n");
 		farptr_restore_bx(bxsv_storefb, f);
-		fprintf(f, "\tpop es\n");
+		if (rtype(r1) != RSlot)
+			fprintf(f, "\tpop es\n");
 		kl_restore_axdx(s_storefb, f);
 		}
 		return;
@@ -3554,7 +4252,7 @@ emitins(Ins *i, Fn *fn, FILE *f)
 		 * arg[0] = value to store (word)
 		 * arg[1] = far pointer (32-bit: segment:offset)
 		 *
-		 * Push/pop ES + BX around the access — see Oloadfb for rationale.
+		 * ES + BX handling as in Oloadfb.
 		 * CX is the value-staging scratch (mov cx, ...); save it too or
 		 * any live SSA temp rega placed in CX is silently clobbered.
 		 * AX/DX save bracket (kl_save_axdx) for the RCon-CAddr-dest
@@ -3566,7 +4264,8 @@ emitins(Ins *i, Fn *fn, FILE *f)
 		{
 		AxDxSave s_storefw = kl_save_axdx(i->to, f);
 		int bxsv_storefw;
-		fprintf(f, "\tpush es\n");
+		if (rtype(r1) != RSlot)
+			fprintf(f, "\tpush es\n");
 		bxsv_storefw = farptr_save_bx(i->to, f);
 		fprintf(f, "\tpush cx\n");
 		/* Load value to store into CX (preserve AX for segment load) */
@@ -3578,8 +4277,7 @@ emitins(Ins *i, Fn *fn, FILE *f)
 			fprintf(f, "\tmov cx, %d\n", (int)(fn->con[r0.val].bits.i & 0xFFFF));
 		/* Load far pointer into ES:BX */
 		if (rtype(r1) == RSlot) {
-			fprintf(f, "\tmov bx, word [bp%+ld]\n", (long)slot(r1, fn));      /* offset */
-			fprintf(f, "\tmov es, word [bp%+ld]\n", (long)slot(r1, fn) + 2);  /* segment */
+			es_loadptr((long)slot(r1, fn), f);
 		} else if (rtype(r1) == RCon) {
 			load_farptr_con(&fn->con[r1.val], f);
 		} else if (rtype(r1) == RTmp) {
@@ -3591,7 +4289,8 @@ emitins(Ins *i, Fn *fn, FILE *f)
 		fprintf(f, "\tmov word ptr es:[bx], cx\n");
 		fprintf(f, "\tpop cx\n");
 		farptr_restore_bx(bxsv_storefw, f);
-		fprintf(f, "\tpop es\n");
+		if (rtype(r1) != RSlot)
+			fprintf(f, "\tpop es\n");
 		kl_restore_axdx(s_storefw, f);
 		}
 		return;
@@ -3615,8 +4314,8 @@ emitins(Ins *i, Fn *fn, FILE *f)
 		 * the far ptr into ES:BX (free to clobber AX/DX), pop the value
 		 * back into DX:AX, write through ES:BX.  Always save AX/DX (no
 		 * destination to alias against — Ostorefl has no result reg).
-		 * Push/pop ES + BX too, per [[i8086-farptr-es-clobber]] +
-		 * [[i8086-farptr-bx-clobber]].
+		 * ES + BX handling as in Oloadfb, per [[i8086-farptr-es-clobber]]
+		 * + [[i8086-farptr-bx-clobber]].
 		 */
 		r0 = i->arg[0];  /* value */
 		r1 = i->arg[1];  /* far pointer */
@@ -3624,7 +4323,8 @@ emitins(Ins *i, Fn *fn, FILE *f)
 		int bxsv_storefl;
 		fprintf(f, "\tpush ax\n");
 		fprintf(f, "\tpush dx\n");
-		fprintf(f, "\tpush es\n");
+		if (rtype(r1) != RSlot)
+			fprintf(f, "\tpush es\n");
 		bxsv_storefl = farptr_save_bx(i->to, f);
 		/* Stage value into DX:AX (read source BEFORE far-ptr load may
 		 * clobber AX as scratch). */
@@ -3644,8 +4344,7 @@ emitins(Ins *i, Fn *fn, FILE *f)
 		fprintf(f, "\tpush ax\n");
 		/* Load far pointer into ES:BX */
 		if (rtype(r1) == RSlot) {
-			fprintf(f, "\tmov bx, word [bp%+ld]\n", (long)slot(r1, fn));      /* offset */
-			fprintf(f, "\tmov es, word [bp%+ld]\n", (long)slot(r1, fn) + 2);  /* segment */
+			es_loadptr((long)slot(r1, fn), f);
 		} else if (rtype(r1) == RCon) {
 			load_farptr_con(&fn->con[r1.val], f);
 		} else if (rtype(r1) == RTmp) {
@@ -3662,7 +4361,8 @@ emitins(Ins *i, Fn *fn, FILE *f)
 		fprintf(f, "\tmov word ptr es:[bx], ax\n");
 		fprintf(f, "\tmov word ptr es:[bx+2], dx\n");
 		farptr_restore_bx(bxsv_storefl, f);
-		fprintf(f, "\tpop es\n");
+		if (rtype(r1) != RSlot)
+			fprintf(f, "\tpop es\n");
 		fprintf(f, "\tpop dx\n");
 		fprintf(f, "\tpop ax\n");
 		}
@@ -4095,7 +4795,8 @@ emitins(Ins *i, Fn *fn, FILE *f)
 	}
 
 	/* Omul (16-bit multiply): 286 added `imul reg, r/m`; 8086 only has
-	 * the single-operand form `imul r/m` with implicit AX*r/m → DX:AX.
+	 * the single-operand forms `mul r/m`/`imul r/m` with implicit
+	 * AX*r/m → DX:AX.
 	 * We take the low 16 bits (AX).  Route through AX with save/restore
 	 * when neither input nor output is AX. */
 	if (i->op == Omul && i->cls != Kl && i->cls != Ks && i->cls != Kd) {
@@ -4103,14 +4804,14 @@ emitins(Ins *i, Fn *fn, FILE *f)
 		int dst_is_ax = (rtype(i->to) == RTmp && i->to.val == RAX);
 		int dst_is_dx = (rtype(i->to) == RTmp && i->to.val == RDX);
 		int save_ax = !dst_is_ax;
-		/* `imul r/m` writes DX:AX — DX gets the high word, clobbering
+		/* `mul r/m` writes DX:AX — DX gets the high word, clobbering
 		 * whatever rega had placed there.  rega does not know about this
-		 * implicit clobber, so we must preserve DX around the imul
+		 * implicit clobber, so we must preserve DX around the mul
 		 * (unless DX is the destination, in which case it's getting
 		 * overwritten with the low word anyway). */
 		int save_dx = !dst_is_dx;
 		/* If a1 is AX but a0 isn't, swap them: `mov ax, a0` would clobber
-		 * a1 before `imul a1` reads it, yielding AX*AX = a0*a0 instead of
+		 * a1 before `mul a1` reads it, yielding AX*AX = a0*a0 instead of
 		 * a0*a1.  16-bit mul is commutative for the low-word result. */
 		if (rtype(a1) == RTmp && a1.val == RAX
 		    && !(rtype(a0) == RTmp && a0.val == RAX)) {
@@ -4132,17 +4833,19 @@ emitins(Ins *i, Fn *fn, FILE *f)
 			else if (rtype(a0) == RSlot) fprintf(f, "word [bp%+ld]\n", (long)slot(a0, fn));
 			else fprintf(f, "?\n");
 		}
-		/* imul takes a register/memory operand, never an immediate.
-		 * Hoist a constant multiplier through BX. */
+		/* The low word is the same signed or unsigned, and `mul` is
+		 * cheaper than `imul` (C88Mul vs C88Imul).  It takes a
+		 * register/memory operand, never an immediate: hoist a
+		 * constant multiplier through BX. */
 		if (rtype(a1) == RCon) {
 			fprintf(f, "\tpush bx\n");
 			fprintf(f, "\tmov bx, %"PRIi64"\n", fn->con[a1.val].bits.i);
-			fprintf(f, "\timul bx\n");
+			fprintf(f, "\tmul bx\n");
 			fprintf(f, "\tpop bx\n");
 		} else if (rtype(a1) == RTmp) {
-			fprintf(f, "\timul %s\n", rname[a1.val]);
+			fprintf(f, "\tmul %s\n", rname[a1.val]);
 		} else if (rtype(a1) == RSlot) {
-			fprintf(f, "\timul word [bp%+ld]\n", (long)slot(a1, fn));
+			fprintf(f, "\tmul word [bp%+ld]\n", (long)slot(a1, fn));
 		}
 		/* Result low word is in AX; copy to dst (if dst is DX, do this
 		 * before restoring DX from the stack). */
@@ -4316,7 +5019,14 @@ end_load_block:
 		 * because the immediately following `mov dst, 1` either
 		 * targets a slot or a different register (or AX itself,
 		 * in which case the staged value is dead by then). */
-		{
+		/* `test r, r` sets the flags exactly as `cmp r, 0` does
+		 * (CF = OF = 0) and is a byte shorter. */
+		if (rtype(i->arg[0]) == RTmp && rtype(i->arg[1]) == RCon
+		&& fn->con[i->arg[1].val].type == CBits
+		&& fn->con[i->arg[1].val].bits.i == 0)
+			fprintf(f, "\ttest %s, %s\n", rname[i->arg[0].val],
+				rname[i->arg[0].val]);
+		else {
 		int both_mem = (rtype(i->arg[0]) == RSlot
 		             && rtype(i->arg[1]) == RSlot);
 		if (both_mem) {
@@ -4354,6 +5064,10 @@ end_load_block:
 		if (both_mem)
 			fprintf(f, "\tpop ax\n");
 		}
+		/* Fused into the block's Jjf* jump by isel: the flags are
+		 * the result. */
+		if (req(i->to, R))
+			return;
 		/* Materialize dst = 1 (assume condition true).  No flag impact. */
 		fprintf(f, "\tmov ");
 		if (rtype(i->to) == RTmp)
@@ -4650,30 +5364,1466 @@ end_load_block:
 	}
 }
 
+/* jtab: bounds check against the default, then an indirect jump
+ * through a table of near offsets placed right after it in the code
+ * segment, hence the cs: override in every model.  The index is isel's
+ * private copy (see seljmp), so it may be doubled in place.  The table
+ * needs a base register: BX/SI/DI directly, otherwise BX is borrowed
+ * with two xchg, and a spilled index goes through its own slot. */
+static void
+emitjtab(Blk *b, Fn *fn, FILE *f)
+{
+	static int id;
+	Ref r;
+	char *rn;
+	long off;
+	uint n;
+
+	for (n=0; n<b->ntab; n++)
+		if (!b->tab[n]->name[0])
+			die("i8086: jtab to an unnamed block in %s", fn->name);
+	r = b->jmp.arg;
+	id++;
+	if (rtype(r) == RSlot) {
+		off = slot(r, fn);
+		fprintf(f, "\tcmp word [bp%+ld], %u\n", off, b->ntab);
+		fprintf(f, "\tjae %s\n", b->s1->name);
+		fprintf(f, "\tpush bx\n");
+		fprintf(f, "\tmov bx, word [bp%+ld]\n", off);
+		fprintf(f, "\tshl bx, 1\n");
+		fprintf(f, "\tmov bx, word [cs:bx+.Ljtab%d]\n", id);
+		fprintf(f, "\tmov word [bp%+ld], bx\n", off);
+		fprintf(f, "\tpop bx\n");
+		fprintf(f, "\tjmp word [bp%+ld]\n", off);
+	} else {
+		assert(rtype(r) == RTmp && isreg(r));
+		rn = rname[r.val];
+		fprintf(f, "\tcmp %s, %u\n", rn, b->ntab);
+		fprintf(f, "\tjae %s\n", b->s1->name);
+		fprintf(f, "\tshl %s, 1\n", rn);
+		if (r.val == RBX || r.val == RSI || r.val == RDI)
+			fprintf(f, "\tjmp word [cs:%s+.Ljtab%d]\n", rn, id);
+		else {
+			fprintf(f, "\txchg bx, %s\n", rn);
+			fprintf(f, "\tmov bx, word [cs:bx+.Ljtab%d]\n", id);
+			fprintf(f, "\txchg bx, %s\n", rn);
+			fprintf(f, "\tjmp %s\n", rn);
+		}
+	}
+	fprintf(f, ".Ljtab%d:\n", id);
+	for (n=0; n<b->ntab; n++)
+		fprintf(f, "\t.short %s\n", b->tab[n]->name);
+}
+
 static uint *chk_la_buf;   /* per-instruction live-after masks */
 static uint chk_la_cap;
 
-void
-i8086_emitfn(Fn *fn, FILE *f)
+/* Byte sizes of the emitted code, for the block layout below.  insz()
+ * parses one line of the NASM text this file produces and bounds its
+ * encoded size; it returns -1 for a line it does not know (inline asm
+ * can hold anything).  The bounds only differ where the encoding is
+ * NASM's choice: a jump to a block label, and an immediate such as
+ * 65535 that is a sign-extended byte once truncated to 16 bits. */
+
+enum { ONone, OR16, OR8, OSeg, OMem, OImm };
+
+typedef struct Opnd {
+	int k;
+	int ax;    /* the accumulator (ax or al) */
+	int cl;
+	int sz;    /* OMem: modrm, displacement and segment prefix */
+	int dir;   /* OMem: direct address, no base or index */
+	int wide;  /* OMem: word 1, byte 0, not given -1 */
+	int one;   /* OImm: the constant 1 */
+	int s8lo;  /* OImm: sign-extended byte, lower and upper bound */
+	int s8hi;
+} Opnd;
+
+static char *r16tab[] = {"ax", "cx", "dx", "bx", "sp", "bp", "si", "di", 0};
+static char *r8tab[] = {"al", "cl", "dl", "bl", "ah", "ch", "dh", "bh", 0};
+static char *sregtab[] = {"es", "cs", "ss", "ds", 0};
+static char *alutab[] = {"add", "or", "adc", "sbb", "and", "sub", "xor", "cmp", 0};
+static char *shtab[] = {"rol", "ror", "rcl", "rcr", "shl", "shr", "sal", "sar", 0};
+static char *untab[] = {"not", "neg", "mul", "imul", "div", "idiv", 0};
+static char *onetab[] = {
+	"cwd", "cbw", "clc", "stc", "cmc", "cld", "std", "cli", "sti",
+	"lahf", "sahf", "pushf", "popf", "nop", "hlt", "wait", "int3",
+	"into", "iret", "xlat", "xlatb", "movsb", "movsw", "stosb", "stosw",
+	"lodsb", "lodsw", "scasb", "scasw", "cmpsb", "cmpsw", 0
+};
+static char *pretab[] = {"rep", "repe", "repz", "repne", "repnz", "lock", 0};
+
+static int
+blank(int c)
 {
-	Blk *b;
-	Ins *i;
+	return c == ' ' || c == '\t' || c == '\n';
+}
 
-	if (chk_on == -1)
-		chk_on = (getenv("QBE_EMIT_CHK") != 0);
-	if (chk_on)
-		chk_fixpoint(fn);
+static int
+lookup(char *s, char **tab)
+{
+	int n;
 
-	/* Emit memory model header (once per output file) */
-	emit_model_header(f);
+	for (n=0; tab[n]; n++)
+		if (strcmp(s, tab[n]) == 0)
+			return n;
+	return -1;
+}
 
-	/* Function header */
-	fprintf(f, "\n");
-	if (fn->lnk.isr) {
-		/* Interrupt handler: emit two CS-addressable data words ahead
-		 * of the entry label, inside the same `.text` region so
-		 * asm_to_omf.py keeps them glued to the function when it
-		 * splits oversized TUs at function boundaries.
+static int
+isnum(char *s, int64_t *v)
+{
+	char *e;
+
+	if (!*s)
+		return 0;
+	*v = strtoll(s, &e, 0);
+	return *e == 0;
+}
+
+static char *
+kw(char *s, char *w)
+{
+	size_t n;
+
+	n = strlen(w);
+	if (strncmp(s, w, n) == 0 && s[n] == ' ') {
+		s += n;
+		while (*s == ' ')
+			s++;
+		return s;
+	}
+	return 0;
+}
+
+static int
+opnd(char *s, Opnd *o)
+{
+	char *p, *q, t[64], c;
+	int64_t v, d;
+	int seg, nreg, bp, sym, sign;
+
+	memset(o, 0, sizeof *o);
+	o->wide = -1;
+	for (;;)
+		if ((p = kw(s, "byte")))
+			o->wide = 0, s = p;
+		else if ((p = kw(s, "word")))
+			o->wide = 1, s = p;
+		else if ((p = kw(s, "dword")))
+			o->wide = 2, s = p;
+		else if ((p = kw(s, "ptr")) || (p = kw(s, "far")))
+			s = p;
+		else
+			break;
+	if (kw(s, "seg")) {
+		o->k = OImm;
+		return 1;
+	}
+	seg = 0;
+	if (s[0] && s[1] && s[2] == ':' && s[3] == '[') {
+		snprintf(t, sizeof t, "%.2s", s);
+		if (lookup(t, sregtab) < 0)
+			return 0;
+		seg = 1;
+		s += 3;
+	}
+	if (*s == '[') {
+		p = strchr(s, ']');
+		if (!p || p[1])
+			return 0;
+		*p = 0;
+		s++;
+		if (s[0] && s[1] && s[2] == ':') {
+			snprintf(t, sizeof t, "%.2s", s);
+			if (lookup(t, sregtab) < 0)
+				return 0;
+			seg = 1;
+			s += 3;
+		}
+		d = 0;
+		nreg = bp = sym = 0;
+		sign = 1;
+		while (*s) {
+			for (q=s; *q && *q != '+' && *q != '-'; q++)
+				;
+			c = *q;
+			*q = 0;
+			while (*s == ' ')
+				s++;
+			for (p=s+strlen(s); p>s && p[-1] == ' '; p--)
+				*--p = 0;
+			if (*s == 0)
+				;
+			else if (lookup(s, r16tab) >= 0) {
+				if (sign < 0)
+					return 0;
+				nreg++;
+				bp |= strcmp(s, "bp") == 0;
+			} else if (isnum(s, &v))
+				d += sign * v;
+			else
+				sym = 1;
+			sign = c == '-' ? -1 : 1;
+			s = c ? q+1 : q;
+		}
+		o->k = OMem;
+		o->dir = nreg == 0;
+		if (sym || nreg == 0)
+			o->sz = 3;
+		else if (d == 0 && !(bp && nreg == 1))
+			o->sz = 1;
+		else if (d >= -128 && d <= 127)
+			o->sz = 2;
+		else
+			o->sz = 3;
+		o->sz += seg;
+		return 1;
+	}
+	if (seg)
+		return 0;
+	if (lookup(s, r16tab) >= 0) {
+		o->k = OR16;
+		o->ax = strcmp(s, "ax") == 0;
+	} else if (lookup(s, r8tab) >= 0) {
+		o->k = OR8;
+		o->ax = strcmp(s, "al") == 0;
+		o->cl = strcmp(s, "cl") == 0;
+	} else if (lookup(s, sregtab) >= 0)
+		o->k = OSeg;
+	else {
+		o->k = OImm;
+		if (isnum(s, &v)) {
+			o->one = v == 1;
+			o->s8hi = v >= -128 && v <= 127;
+			o->s8lo = o->s8hi
+				|| ((int16_t)v >= -128 && (int16_t)v <= 127);
+		}
+	}
+	return 1;
+}
+
+static int
+regop(Opnd *o)
+{
+	return o->k == OR16 || o->k == OR8;
+}
+
+static int
+insz(char *line, int *lo)
+{
+	char buf[256], *s, *m, *p, *a[2];
+	Opnd o[2];
+	int n, pre, hi;
+
+	*lo = 0;
+	snprintf(buf, sizeof buf, "%s", line);
+	if ((p = strchr(buf, ';')))
+		*p = 0;
+	for (p=buf+strlen(buf); p>buf && blank(p[-1]);)
+		*--p = 0;
+	for (s=buf; blank(*s); s++)
+		;
+	if (!*s || (s[0] == '/' && s[1] == '*'))
+		return 0;
+	if (s[strlen(s)-1] == ':' && !strpbrk(s, " \t"))
+		return 0;
+	pre = 0;
+	for (;;) {
+		m = s;
+		while (*s && !blank(*s))
+			s++;
+		if (*s)
+			*s++ = 0;
+		while (blank(*s))
+			s++;
+		if (lookup(m, pretab) < 0)
+			break;
+		pre++;
+	}
+	if (strcmp(m, ".short") == 0 || strcmp(m, "dw") == 0) {
+		for (n=1, p=s; (p=strchr(p, ',')); p++)
+			n++;
+		*lo = 2 * n;
+		return *lo;
+	}
+
+	/* jumps look at the raw operand */
+	hi = -1;
+	if (strcmp(m, "jmp") == 0 || strcmp(m, "call") == 0) {
+		if (kw(s, "short"))
+			*lo = hi = 2;
+		else if (kw(s, "near"))
+			*lo = hi = 3;
+		else if ((p = kw(s, "far")) && *p != '[')
+			*lo = hi = 5;
+		else if (strchr(s, '[') || lookup(s, r16tab) >= 0) {
+			if (!opnd(s, &o[0]))
+				return -1;
+			*lo = hi = o[0].k == OMem ? 1 + o[0].sz : 2;
+		} else if (m[0] == 'c')
+			*lo = hi = 3;
+		else {
+			*lo = 2;
+			hi = 3;
+		}
+		return hi + pre;
+	}
+	if (m[0] == 'j' || strncmp(m, "loop", 4) == 0) {
+		*lo = 2;
+		hi = m[1] == 'c' || m[0] == 'l' || strncmp(s, ".L", 2) == 0 ? 2 : 5;
+		return hi + pre;
+	}
+
+	n = 0;
+	if (*s) {
+		a[n++] = s;
+		if ((p = strchr(s, ','))) {
+			*p++ = 0;
+			while (blank(*p))
+				p++;
+			a[n++] = p;
+			if (strchr(p, ','))
+				return -1;
+		}
+		for (p=a[0]+strlen(a[0]); p>a[0] && blank(p[-1]);)
+			*--p = 0;
+	}
+	if ((n > 0 && !opnd(a[0], &o[0])) || (n > 1 && !opnd(a[1], &o[1])))
+		return -1;
+
+	if (n == 0) {
+		if (lookup(m, onetab) >= 0 || strcmp(m, "ret") == 0
+		|| strcmp(m, "retf") == 0)
+			*lo = hi = 1;
+	} else if (n == 1) {
+		if (strcmp(m, "ret") == 0 || strcmp(m, "retf") == 0)
+			*lo = hi = 3;
+		else if (strcmp(m, "int") == 0)
+			*lo = hi = 2;
+		else if (strcmp(m, "push") == 0 || strcmp(m, "pop") == 0) {
+			if (o[0].k == OR16 || o[0].k == OSeg)
+				*lo = hi = 1;
+			else if (o[0].k == OMem)
+				*lo = hi = 1 + o[0].sz;
+		} else if (strcmp(m, "inc") == 0 || strcmp(m, "dec") == 0) {
+			if (o[0].k == OR16)
+				*lo = hi = 1;
+			else if (o[0].k == OR8)
+				*lo = hi = 2;
+			else if (o[0].k == OMem)
+				*lo = hi = 1 + o[0].sz;
+		} else if (lookup(m, untab) >= 0) {
+			if (regop(&o[0]))
+				*lo = hi = 2;
+			else if (o[0].k == OMem)
+				*lo = hi = 1 + o[0].sz;
+		}
+	} else if (lookup(m, alutab) >= 0 || strcmp(m, "mov") == 0
+	       || strcmp(m, "test") == 0) {
+		if (regop(&o[0]) && regop(&o[1]))
+			*lo = hi = 2;
+		else if (o[0].k == OSeg || o[1].k == OSeg) {
+			if (strcmp(m, "mov") == 0) {
+				if (regop(&o[0]) || regop(&o[1]))
+					*lo = hi = 2;
+				else if (o[0].k == OMem)
+					*lo = hi = 1 + o[0].sz;
+				else if (o[1].k == OMem)
+					*lo = hi = 1 + o[1].sz;
+			}
+		} else if (regop(&o[0]) && o[1].k == OMem) {
+			*lo = hi = 1 + o[1].sz;
+			if (strcmp(m, "mov") == 0 && o[0].ax && o[1].dir)
+				*lo = hi = o[1].sz;
+		} else if (o[0].k == OMem && regop(&o[1])) {
+			*lo = hi = 1 + o[0].sz;
+			if (strcmp(m, "mov") == 0 && o[1].ax && o[0].dir)
+				*lo = hi = o[0].sz;
+		} else if (regop(&o[0]) && o[1].k == OImm) {
+			if (o[0].k == OR8)
+				*lo = hi = o[0].ax || m[0] == 'm' ? 2 : 3;
+			else if (o[0].ax || m[0] == 'm')
+				*lo = hi = 3;
+			else if (m[0] == 't')
+				*lo = hi = 4;
+			else {
+				*lo = o[1].s8lo ? 3 : 4;
+				hi = o[1].s8hi ? 3 : 4;
+			}
+		} else if (o[0].k == OMem && o[1].k == OImm) {
+			if (o[0].wide == 0)
+				*lo = hi = 2 + o[0].sz;
+			else if (o[0].wide == 1) {
+				if (m[0] == 'm' || m[0] == 't')
+					*lo = hi = 3 + o[0].sz;
+				else {
+					*lo = (o[1].s8lo ? 2 : 3) + o[0].sz;
+					hi = (o[1].s8hi ? 2 : 3) + o[0].sz;
+				}
+			}
+		}
+	} else if (strcmp(m, "xchg") == 0) {
+		if ((o[0].k == OR16 && o[0].ax && o[1].k == OR16)
+		|| (o[1].k == OR16 && o[1].ax && o[0].k == OR16))
+			*lo = hi = 1;
+		else if (regop(&o[0]) && regop(&o[1]))
+			*lo = hi = 2;
+		else if (o[0].k == OMem || o[1].k == OMem)
+			*lo = hi = 1 + o[0].sz + o[1].sz;
+	} else if (lookup(m, shtab) >= 0) {
+		if ((o[1].k == OImm && o[1].one) || (o[1].k == OR8 && o[1].cl)) {
+			if (regop(&o[0]))
+				*lo = hi = 2;
+			else if (o[0].k == OMem)
+				*lo = hi = 1 + o[0].sz;
+		}
+	} else if (strcmp(m, "lea") == 0 || strcmp(m, "les") == 0
+	       || strcmp(m, "lds") == 0) {
+		if (o[1].k == OMem)
+			*lo = hi = 1 + o[1].sz;
+	} else if (strcmp(m, "in") == 0 || strcmp(m, "out") == 0)
+		*lo = hi = o[0].k == OImm || o[1].k == OImm ? 2 : 1;
+	if (hi < 0)
+		return -1;
+	if (*lo > hi)
+		*lo = hi;
+	*lo += pre;
+	return hi + pre;
+}
+
+/* Block layout.  Each block's body and the branch-free part of its
+ * terminator are spooled, then the blocks are ordered, trampolines
+ * folded and the branches sized once the layout is known.  On the
+ * 8086 every jcc is rel8: a conditional branch further than 127
+ * bytes away becomes the negated jcc over a jmp. */
+
+enum { LNone, LJmp, LFlag };
+
+typedef struct Lay Lay;
+
+struct Lay {
+	Blk *b;
+	int kind;     /* the branches still to emit */
+	int cc;       /* LFlag: Ci* taken to s1 */
+	Blk *s1, *s2;
+	long off;     /* spooled text */
+	long end;
+	int lo, hi;   /* its size bounds */
+	Lay *tail;    /* trampoline whose text is duplicated after ours */
+	int pos;      /* place in the layout, -1 if not (yet) placed */
+	int nref;
+};
+
+static FILE *spool;
+static char *spbuf;
+static long spcap;
+
+static void
+laymeasure(Lay *l)
+{
+	char *s, *e, *nl, ln[256];
+	int lo, hi;
+
+	for (s=&spbuf[l->off], e=&spbuf[l->end]; s<e; s=nl+1) {
+		nl = memchr(s, '\n', e-s);
+		if (!nl)
+			nl = e;
+		if (nl - s >= (long)sizeof ln - 1) {
+			l->lo = l->hi = -1;
+			return;
+		}
+		snprintf(ln, sizeof ln, "%.*s", (int)(nl-s), s);
+		hi = insz(ln, &lo);
+		if (hi < 0) {
+			l->lo = l->hi = -1;
+			return;
+		}
+		l->lo += lo;
+		l->hi += hi;
+	}
+}
+
+static int
+laybr(Lay *l, Blk *next, int *cc, Blk **to)
+{
+	Blk *s1, *s2;
+	int n, c;
+
+	n = 0;
+	switch (l->kind) {
+	case LJmp:
+		if (l->s1 != next && l->s1->name[0]) {
+			cc[n] = -1;
+			to[n++] = l->s1;
+		}
+		break;
+	case LFlag:
+		s1 = l->s1;
+		s2 = l->s2;
+		c = l->cc;
+		if (s1 == next && s2 != next) {
+			s1 = l->s2;
+			s2 = l->s1;
+			c = cmpwlneg(Ocmpw + c) - Ocmpw;
+		}
+		if (s1->name[0]) {
+			cc[n] = c;
+			to[n++] = s1;
+		}
+		if (s2 != next && s2->name[0]) {
+			cc[n] = -1;
+			to[n++] = s2;
+		}
+		break;
+	}
+	return n;
+}
+
+static int
+laytxt(Lay *l, int hi)
+{
+	int n;
+
+	n = hi ? l->hi : l->lo;
+	if (l->tail)
+		n += hi ? l->tail->hi : l->tail->lo;
+	return n;
+}
+
+static int
+laybrsz(int cc, int lng, int k)
+{
+	if (lng & BIT(2+k))
+		return 2;
+	if (lng & BIT(k))
+		return cc < 0 ? 3 : 5;
+	return 2;
+}
+
+/* Addresses of the blocks in ord[] for the lower or upper size
+ * bounds, and which of their branches need the long form: lng[p]
+ * has bit k set for branch k, or bit 2+k when that jcc goes through
+ * an island.  Branches only ever grow, so the loop reaches a
+ * fixpoint. */
+static long
+laysize(Lay *lay, Lay **ord, int n, int hi, uchar *lng, long *addr)
+{
+	int p, k, nb, cc[2], chg;
+	Blk *to[2];
+	long a, d;
+
+	do {
+		a = 0;
+		for (p=0; p<n; p++) {
+			addr[p] = a;
+			a += laytxt(ord[p], hi);
+			nb = laybr(ord[p], p+1 < n ? ord[p+1]->b : 0, cc, to);
+			for (k=0; k<nb; k++)
+				a += laybrsz(cc[k], lng[p], k);
+		}
+		chg = 0;
+		for (p=0; p<n; p++) {
+			a = addr[p] + laytxt(ord[p], hi);
+			nb = laybr(ord[p], p+1 < n ? ord[p+1]->b : 0, cc, to);
+			for (k=0; k<nb; k++) {
+				a += laybrsz(cc[k], lng[p], k);
+				if (lng[p] & (BIT(k) | BIT(2+k)))
+					continue;
+				d = addr[lay[to[k]->id].pos] - a;
+				if (d < -128 || d > 127) {
+					lng[p] |= BIT(k);
+					chg = 1;
+				}
+			}
+		}
+	} while (chg);
+	return a;
+}
+
+/* A jcc that needs the long form may instead reach a jmp to the same
+ * target within rel8 range and use it as an island.  The addresses
+ * are the upper bounds, and every jcc made short only brings code
+ * closer, so the greedy choices stay in range. */
+static void
+layisland(Lay **ord, int n, uchar *lng, long *addr, int *isl)
+{
+	static int id;
+	int p, q, k, j, nb, mb, cc[2], cq[2];
+	uchar l0, m0;
+	Blk *to[2], *tq[2];
+	long a, aq, d;
+
+	for (p=0; p<n; p++) {
+		nb = laybr(ord[p], p+1 < n ? ord[p+1]->b : 0, cc, to);
+		a = addr[p] + laytxt(ord[p], 1);
+		l0 = lng[p];
+		for (k=0; k<nb; a+=laybrsz(cc[k], l0, k), k++) {
+			if (cc[k] < 0 || !(lng[p] & BIT(k)) || isl[2*p+k])
+				continue;
+			for (q=0; q<n && (lng[p] & BIT(k)); q++) {
+				mb = laybr(ord[q], q+1 < n ? ord[q+1]->b : 0, cq, tq);
+				aq = addr[q] + laytxt(ord[q], 1);
+				m0 = lng[q];
+				for (j=0; j<mb; aq+=laybrsz(cq[j], m0, j), j++) {
+					if (tq[j] != to[k] || (q == p && j == k)
+					|| isl[2*q+j] < 0
+					|| (cq[j] >= 0 && !(lng[q] & BIT(j))))
+						continue;
+					/* the jmp itself, or the one in a long jcc */
+					d = aq + (cq[j] < 0 ? 0 : 2) - (a + 2);
+					if (d < -128 || d > 127)
+						continue;
+					if (!isl[2*q+j])
+						isl[2*q+j] = ++id;
+					isl[2*p+k] = -isl[2*q+j];
+					lng[p] &= ~BIT(k);
+					lng[p] |= BIT(2+k);
+					break;
+				}
+			}
+		}
+	}
+}
+
+static int
+unplaced(Lay *lay, Blk *b)
+{
+	return b && lay[b->id].pos < 0;
+}
+
+static void
+layref(Fn *fn, Lay *lay)
+{
+	Lay *l;
+	Blk *b;
+	uint u;
+
+	for (b=fn->start; b; b=b->link)
+		lay[b->id].nref = 0;
+	lay[fn->start->id].nref++;
+	for (b=fn->start; b; b=b->link) {
+		l = &lay[b->id];
+		if (l->kind != LNone) {
+			lay[l->s1->id].nref++;
+			if (l->kind == LFlag)
+				lay[l->s2->id].nref++;
+		} else if (b->jmp.type == Jjtab) {
+			lay[b->s1->id].nref++;
+			for (u=0; u<b->ntab; u++)
+				lay[b->tab[u]->id].nref++;
+		}
+	}
+}
+
+/* Greedy chaining: a block keeps falling into its rpo successor when
+ * it branches there, else it is followed by a successor that only it
+ * branches to, else by the next block of the rpo still to place. */
+static int
+layorder(Fn *fn, Lay *lay, Lay **ord)
+{
+	Blk *b, *nx, *cur, *c[2];
+	Lay *l;
+	int n, k;
+
+	layref(fn, lay);
+	for (b=fn->start; b; b=b->link)
+		lay[b->id].pos = -1;
+	n = 0;
+	cur = fn->start;
+	for (b=fn->start; b; b=nx) {
+		l = &lay[b->id];
+		l->pos = n;
+		ord[n++] = l;
+		c[0] = c[1] = 0;
+		if (l->kind == LJmp)
+			c[0] = l->s1;
+		else if (l->kind == LFlag) {
+			c[0] = l->s2;
+			c[1] = l->s1;
+		}
+		nx = 0;
+		for (k=0; k<2; k++)
+			if (c[k] == b->link && unplaced(lay, c[k]))
+				nx = c[k];
+		for (k=0; k<2 && !nx; k++)
+			if (unplaced(lay, c[k]) && lay[c[k]->id].nref == 1)
+				nx = c[k];
+		while (cur && !unplaced(lay, cur))
+			cur = cur->link;
+		if (!nx)
+			nx = cur;
+	}
+	return n;
+}
+
+/* Drop the blocks nothing reaches any longer and renumber. */
+static int
+laydrop(Fn *fn, Lay *lay, Lay **ord, int n)
+{
+	int p, m;
+
+	layref(fn, lay);
+	for (p=m=0; p<n; p++)
+		if (ord[p]->nref) {
+			ord[p]->pos = m;
+			ord[m++] = ord[p];
+		} else
+			ord[p]->pos = -1;
+	return m;
+}
+
+static Blk *
+laythread(Fn *fn, Lay *lay, Blk *s)
+{
+	Lay *t;
+	uint k;
+
+	for (k=0; k<fn->nblk; k++) {
+		t = &lay[s->id];
+		if (s == fn->start || t->kind != LJmp || t->hi != 0
+		|| t->s1 == s)
+			break;
+		s = t->s1;
+	}
+	return s;
+}
+
+/* Branches to blocks with no code are threaded to where those jump.
+ * A block that is the only way into a label-free trampoline (at most
+ * a short move before its own jmp) then takes a copy of it and jumps
+ * to its target directly, which drops the trampoline. */
+static void
+laydup(Fn *fn, Lay *lay, Lay **ord, int n)
+{
+	Lay *l, *t;
+	char *s, *e;
+	int p;
+
+	for (p=0; p<n; p++) {
+		l = ord[p];
+		if (l->kind == LNone)
+			continue;
+		l->s1 = laythread(fn, lay, l->s1);
+		if (l->kind == LFlag)
+			l->s2 = laythread(fn, lay, l->s2);
+	}
+	layref(fn, lay);
+	for (p=0; p<n; p++) {
+		l = ord[p];
+		if (l->kind != LJmp || l->s1 == fn->start)
+			continue;
+		t = &lay[l->s1->id];
+		if (t == l || t->nref != 1 || t->tail || t->kind != LJmp
+		|| t->s1 == t->b
+		|| t->hi < 0 || t->hi > 2 || (p+1 < n && ord[p+1] == t))
+			continue;
+		for (s=&spbuf[t->off], e=&spbuf[t->end]; s<e; s++)
+			if (*s == ':')
+				break;
+		if (s != e)
+			continue;
+		l->tail = t;
+		l->s1 = t->s1;
+	}
+}
+
+static void
+layout(Fn *fn, Lay *lay, FILE *f)
+{
+	static int id;
+	static char *dbg;
+	Lay **ord, *l;
+	Blk *b, *to[2];
+	uchar *lng;
+	long *addr, len, old[2], new[2];
+	int n, p, k, c, nb, cc[2], sized, *isl;
+
+	len = ftell(spool);
+	if (len > spcap) {
+		spcap = len;
+		spbuf = realloc(spbuf, spcap);
+		if (!spbuf)
+			die("emit: out of memory for the block spool");
+	}
+	fflush(spool);
+	rewind(spool);
+	if (len && fread(spbuf, 1, len, spool) != (size_t)len)
+		die("emit: cannot read back the block spool");
+
+	n = 0;
+	sized = 1;
+	for (b=fn->start; b; b=b->link) {
+		n++;
+		laymeasure(&lay[b->id]);
+		sized &= lay[b->id].hi >= 0;
+	}
+	ord = alloc(n * sizeof ord[0]);
+	lng = alloc(n);
+	addr = alloc((n+1) * sizeof addr[0]);
+
+	if (!dbg)
+		dbg = getenv("QBE_LAYOUT_DBG") ? "1" : "";
+	if (*dbg && sized) {
+		p = 0;
+		for (b=fn->start; b; b=b->link) {
+			lay[b->id].pos = p;
+			ord[p++] = &lay[b->id];
+		}
+		memset(lng, 0, n);
+		old[0] = laysize(lay, ord, n, 0, lng, addr);
+		memset(lng, 0, n);
+		old[1] = laysize(lay, ord, n, 1, lng, addr);
+	}
+
+	n = layorder(fn, lay, ord);
+	laydup(fn, lay, ord, n);
+	n = laydrop(fn, lay, ord, n);
+	isl = alloc(2 * n * sizeof isl[0]);
+	if (sized) {
+		memset(lng, 0, n);
+		laysize(lay, ord, n, 1, lng, addr);
+		layisland(ord, n, lng, addr, isl);
+		new[1] = laysize(lay, ord, n, 1, lng, addr);
+		new[0] = laysize(lay, ord, n, 0, lng, addr);
+	}
+	if (*dbg) {
+		if (sized)
+			fprintf(stderr, "layout %s: %ld-%ld -> %ld-%ld bytes\n",
+				fn->name, old[0], old[1], new[0], new[1]);
+		else
+			fprintf(stderr, "layout %s: unsized\n", fn->name);
+	}
+
+	for (p=0; p<n; p++) {
+		l = ord[p];
+		b = l->b;
+		if (b != fn->start && b->name[0] != 0)
+			fprintf(f, "%s:\n", b->name);
+		fwrite(&spbuf[l->off], 1, l->end - l->off, f);
+		if (l->tail)
+			fwrite(&spbuf[l->tail->off], 1,
+				l->tail->end - l->tail->off, f);
+		nb = laybr(l, p+1 < n ? ord[p+1]->b : 0, cc, to);
+		for (k=0; k<nb; k++) {
+			c = isl[2*p+k];
+			if (cc[k] < 0) {
+				if (c > 0)
+					fprintf(f, "..@isl%d:\n", c);
+				fprintf(f, "\tjmp %s\n", to[k]->name);
+			} else if (c < 0)
+				fprintf(f, "\t%s ..@isl%d\n", jccname[cc[k]], -c);
+			else if (lng[p] & BIT(k)) {
+				id++;
+				fprintf(f, "\t%s .Lrelax%d\n",
+					jccname[cmpwlneg(Ocmpw + cc[k]) - Ocmpw], id);
+				if (c > 0)
+					fprintf(f, "..@isl%d:\n", c);
+				fprintf(f, "\tjmp %s\n", to[k]->name);
+				fprintf(f, ".Lrelax%d:\n", id);
+			} else
+				fprintf(f, "\t%s %s\n", jccname[cc[k]], to[k]->name);
+		}
+	}
+}
+
+/* Emit the body of b and the part of its terminator that does not
+ * depend on the layout; l gets the branches left to emit. */
+static void
+emitblk(Blk *b, Fn *fn, Lay *l, FILE *f)
+{
+	Ins *i;
+
+	/* Precompute AX/DX live-after for each instruction so the save
+	 * brackets can be dropped where the register is dead (see
+	 * compute_axdx_liveafter).  Buffers grow as needed across blocks. */
+	if (b->nins > la_cap) {
+		la_cap = b->nins;
+		la_ax_buf = realloc(la_ax_buf, la_cap);
+		la_dx_buf = realloc(la_dx_buf, la_cap);
+		la_bx_buf = realloc(la_bx_buf, la_cap);
+		if (!la_ax_buf || !la_dx_buf || !la_bx_buf)
+			die("emit: out of memory for liveness buffers");
+	}
+	compute_axdx_liveafter(b, fn, la_ax_buf, la_dx_buf, la_bx_buf);
+	g_es = es_in[b->id];
+
+	if (chk_on) {
+		/* Exact per-instruction live-after for the audit markers:
+		 * backward walk seeded from the CFG-fixpoint live-out. */
+		uint cl;
+		int n;
+		if (b->nins > chk_la_cap) {
+			chk_la_cap = b->nins;
+			chk_la_buf = realloc(chk_la_buf,
+				chk_la_cap * sizeof *chk_la_buf);
+			if (!chk_la_buf)
+				die("emit: out of memory for CHK buffer");
+		}
+		cl = chk_blk_liveout(b);
+		if ((b->jmp.type == Jjnz || b->jmp.type == Jjtab)
+		 && rtype(b->jmp.arg) == RTmp
+		 && CHK_ISGPR(b->jmp.arg.val))
+			cl |= CHK_BIT(b->jmp.arg.val);
+		for (n = b->nins - 1; n >= 0; n--) {
+			chk_la_buf[n] = cl;
+			cl = chk_ins_live(&b->ins[n], fn, cl);
+		}
+	}
+
+	for (i = b->ins; i < &b->ins[b->nins]; i++) {
+		int idx = (int)(i - b->ins);
+		EsState es_nx;
+		g_live_ax_after = la_ax_buf[idx];
+		g_live_dx_after = la_dx_buf[idx];
+		g_live_bx_after = la_bx_buf[idx];
+		if (chk_on)
+			chk_mark_ins(i, fn, chk_la_buf[idx], f);
+		es_nx = g_es;
+		es_step(&es_nx, i, fn);
+		if (g_es.dirty && es_needds(i)) {
+			fprintf(f, "\tpush ds\n");
+			fprintf(f, "\tpop es\n");
+			g_es.dirty = 0;
+			g_es.n = 0;
+		}
+		emitins(i, fn, f);
+		g_es = es_nx;
+	}
+	g_live_ax_after = 1;
+	g_live_dx_after = 1;
+	g_live_bx_after = 1;
+
+	if (chk_on) {
+		if (fn->lnk.isr
+		    && (b->jmp.type == Jret0 || b->jmp.type == Jretw
+		        || b->jmp.type == Jretl || b->jmp.type == Jretf0
+		        || b->jmp.type == Jretfw || b->jmp.type == Jretfl)) {
+			/* ISR ret region: the epilogue restores the
+			 * INTERRUPTED context — every register (and ES/DS)
+			 * legitimately ends different from region entry.
+			 * The `isr` tag tells the checker to skip; the
+			 * epilogue is one fixed template, not bracket
+			 * logic. */
+			fprintf(f, "\t; CHKT %d live=isr\n", b->jmp.type);
+		} else {
+			fprintf(f, "\t; CHKT %d live=", b->jmp.type);
+			chk_print_live(chk_blk_liveout(b), f);
+			fputc('\n', f);
+		}
+	}
+
+	/* Emit jump */
+	switch (b->jmp.type) {
+	case Jret0:
+	case Jretw:
+	case Jretl:
+	case Jretf0:
+	case Jretfw:
+	case Jretfl:
+		if (fn->lnk.isr) {
+			/* Interrupt-handler epilogue: unwind the standard
+			 * frame, then the outer ISR save set, then restore
+			 * ES from static memory LAST (cs: override — DS is
+			 * already the interrupted value) and iret.  Both
+			 * near- and far-ret IR forms end in iret. */
+			fprintf(f, "\tlea sp, [bp-6]\n");
+			fprintf(f, "\tpop di\n");
+			fprintf(f, "\tpop si\n");
+			fprintf(f, "\tpop bx\n");
+			fprintf(f, "\tpop bp\n");
+			fprintf(f, "\tpop ds\n");
+			fprintf(f, "\tpop dx\n");
+			fprintf(f, "\tpop cx\n");
+			fprintf(f, "\tpop ax\n");
+			fprintf(f, "\tmov es, [cs:_qbe_isr_es_%s]\n",
+				fn->name);
+			fprintf(f, "\tiret\n");
+			break;
+		}
+		if (g_es.dirty) {
+			fprintf(f, "\tpush ds\n");
+			fprintf(f, "\tpop es\n");
+		}
+		fprintf(f, "\tlea sp, [bp-6]\n");
+		fprintf(f, "\tpop di\n");
+		fprintf(f, "\tpop si\n");
+		fprintf(f, "\tpop bx\n");
+		fprintf(f, "\tpop bp\n");
+		if (b->jmp.type == Jretf0 || b->jmp.type == Jretfw
+		    || b->jmp.type == Jretfl)
+			/* RETF pops both IP and CS (4 bytes total) —
+			 * medium/large/huge memory models. */
+			fprintf(f, "\tretf\n");
+		else
+			fprintf(f, "\tret\n");
+		break;
+	case Jjmp:
+		l->kind = LJmp;
+		l->s1 = b->s1;
+		break;
+	case Jjtab:
+		if (rtype(b->jmp.arg) == RCon) {
+			Con *c = &fn->con[b->jmp.arg.val];
+			l->kind = LJmp;
+			l->s1 = b->s1;
+			if (c->type == CBits && (uint16_t)c->bits.i < b->ntab)
+				l->s1 = b->tab[(uint16_t)c->bits.i];
+			break;
+		}
+		emitjtab(b, fn, f);
+		break;
+	case Jjnz: {
+		Ref jr = b->jmp.arg;
+		if (rtype(jr) == RTmp
+		    && jr.val >= 0
+		    && jr.val < (int)(sizeof rname / sizeof rname[0])
+		    && rname[jr.val] != 0) {
+			fprintf(f, "\ttest %s, %s\n",
+				rname[jr.val], rname[jr.val]);
+		} else if (rtype(jr) == RSlot) {
+			/* rega spilled the jjnz condition.  We MUST NOT route
+			 * through any GPR — rega may place a live SSA temp in
+			 * any caller-save reg at block end (the phi-edge moves
+			 * in the successor's edge block expect those values).
+			 * Use `cmp mem, 0` which sets ZF directly without
+			 * touching any register. */
+			fprintf(f, "\tcmp word [bp%+ld], 0\n",
+				(long)slot(jr, fn));
+		} else if (rtype(jr) == RCon) {
+			/* Constant jjnz — fold at emit time. */
+			Con *c = &fn->con[jr.val];
+			l->kind = LJmp;
+			l->s1 = b->s1;
+			/* An address constant is non-zero at link time. */
+			if (c->type == CBits && c->bits.i == 0)
+				l->s1 = b->s2;
+			break;
+		} else {
+			fprintf(f, "\t; XXX bad jjnz operand: rtype=%d val=%d\n",
+			        rtype(jr), jr.val);
+			fprintf(f, "\ttest ax, ax\n");
+		}
+		l->kind = LFlag;
+		l->cc = Cine;
+		l->s1 = b->s1;
+		l->s2 = b->s2;
+		break;
+	}
+	/* Conditional jumps on the flags of a compare isel fused
+	 * into the jump. */
+	case Jjfieq:
+	case Jjfine:
+	case Jjfisge:
+	case Jjfisgt:
+	case Jjfisle:
+	case Jjfislt:
+	case Jjfiuge:
+	case Jjfiugt:
+	case Jjfiule:
+	case Jjfiult:
+		l->kind = LFlag;
+		l->cc = b->jmp.type - Jjf;
+		l->s1 = b->s1;
+		l->s2 = b->s2;
+		break;
+	default:
+		/* Unsupported jump type */
+		die("i8086: unsupported jump type %d at end of @%s",
+		    b->jmp.type, b->name);
+	}
+}
+
+/* Frame packing.  spill.c hands every spilled temp a private slot in
+ * [fn->spill_slot_base, fn->slot); with the final code in hand this
+ * recolors them by memory liveness so objects whose lifetimes are
+ * disjoint share storage, whatever their class (a word may sit in the
+ * low half of a dword's slot).  The interference graph is a sorted
+ * edge list, so it grows with the edges rather than with the square
+ * of the object count.  The shared slots are then stacked hottest
+ * first (loop-weighted access count) right below the callee-save
+ * words, where [bp-N] still takes a disp8.  Frame size is the
+ * per-level cost of recursion (MicroPython's generator resume), and
+ * private slots would make it grow with the temp count instead of the
+ * peak liveness.
+ *
+ * Every access counts as a possible write: an accessed object
+ * interferes with everything live after the instruction and with the
+ * instruction's other slot operands (the multi-word templates may
+ * store a result word before reading the last source word).  Only a
+ * def and a whole-word direct store kill.  Call-arg slots, params and
+ * isel fast-locals (already shared by mem.c's coalesce) lie outside
+ * the range and keep their place.
+ */
+static int *pf_obj;     /* slot - spill_slot_base -> object, or -1 */
+static int pf_nu;
+static int *pf_wd;      /* object width, in slots */
+static uint64_t *pf_w;  /* sort key of pfwcmp */
+static uint64_t *pf_e;  /* interference edges, lo<<32 | hi */
+static uint pf_ne, pf_ecap;
+
+/* object of a slot ref, -1 if outside the range, -2 if it names no
+ * object start */
+static int
+pfref(Ref r, Fn *fn)
+{
+	int s;
+
+	if (rtype(r) != RSlot)
+		return -1;
+	s = rsval(r) - fn->spill_slot_base;
+	if (rsval(r) < fn->spill_slot_base || s >= pf_nu)
+		return -1;
+	return pf_obj[s] >= 0 ? pf_obj[s] : -2;
+}
+
+/* the objects i accesses in o[], ru[] set for those it reads;
+ * -1 when the frame cannot be packed */
+static int
+pfins(Ins *i, Fn *fn, int *o, int *ru)
+{
+	Mem *m;
+	char nm[128], *s, *e;
+	int n, k, x;
+
+	if (i->op == Oasm) {
+		/* a `%name` operand the Oasm handler binds to a spill slot */
+		x = rsval(i->arg[0]);
+		if (!fn->asmstr || x < 0 || x >= fn->nasmstr)
+			return 0;
+		for (s=fn->asmstr[x]; *s; s++) {
+			if (s[0] != '%' || !is_asm_name(s[1]))
+				continue;
+			for (e=nm; is_asm_name(s[1]) && e<&nm[sizeof nm-1];)
+				*e++ = *++s;
+			*e = 0;
+			for (x=Tmp0; x<fn->ntmp; x++)
+				if (fn->tmp[x].slot >= 0 && fn->tmp[x].name[0]
+				&& strcmp(fn->tmp[x].name, nm) == 0)
+					break;
+			if (x < fn->ntmp
+			&& fn->tmp[x].slot >= fn->spill_slot_base)
+				return -1;
+		}
+		return 0;
+	}
+	n = 0;
+	for (k=0; k<3; k++) {
+		if (k < 2 && rtype(i->arg[k]) == RMem) {
+			m = &fn->mem[i->arg[k].val];
+			if (pfref(m->base, fn) != -1
+			|| pfref(m->index, fn) != -1)
+				return -1;
+			continue;
+		}
+		x = pfref(k < 2 ? i->arg[k] : i->to, fn);
+		if (x == -1)
+			continue;
+		if (x == -2 || (k < 2 && i->op == Oaddr))
+			return -1;
+		o[n] = x;
+		ru[n] = k < 2;
+		if (k == 1 && (i->op == Ostorew || i->op == Ostoreh)
+		&& pf_wd[x] == 1)
+			ru[n] = 0;
+		for (x=0; x<n; x++)
+			if (o[x] == o[n]) {
+				ru[x] |= ru[n];
+				break;
+			}
+		if (x == n)
+			n++;
+	}
+	return n;
+}
+
+static void
+pfedge(int a, int b)
+{
+	if (a == b)
+		return;
+	if (pf_ne == pf_ecap) {
+		pf_ecap = pf_ecap ? 2*pf_ecap : 1024;
+		pf_e = realloc(pf_e, pf_ecap * sizeof pf_e[0]);
+		if (!pf_e)
+			die("emit: out of memory for frame edges");
+	}
+	if (a > b)
+		pf_e[pf_ne++] = (uint64_t)b << 32 | (uint)a;
+	else
+		pf_e[pf_ne++] = (uint64_t)a << 32 | (uint)b;
+}
+
+static int
+pfecmp(const void *a, const void *b)
+{
+	uint64_t x, y;
+
+	x = *(uint64_t *)a;
+	y = *(uint64_t *)b;
+	return (x > y) - (x < y);
+}
+
+static int
+pfwcmp(const void *a, const void *b)
+{
+	uint64_t x, y;
+
+	x = pf_w[*(int *)a];
+	y = pf_w[*(int *)b];
+	if (x != y)
+		return x > y ? -1 : 1;
+	return *(int *)a - *(int *)b;
+}
+
+/* live = the union of b's successors' live-in */
+static void
+pfout(Blk *b, BSet *in, BSet *live)
+{
+	uint n;
+
+	bszero(live);
+	if (b->s1)
+		bsunion(live, &in[b->s1->id]);
+	if (b->s2)
+		bsunion(live, &in[b->s2->id]);
+	if (b->jmp.type == Jjtab)
+		for (n=0; n<b->ntab; n++)
+			bsunion(live, &in[b->tab[n]->id]);
+}
+
+static void
+packframe(Fn *fn)
+{
+	int t, s, n, k, j, x, c, nobj, ncls, top, chg, o[3], ru[3];
+	int *cls, *ord, *deg, *nbr, *cwd, *pos, *mark;
+	uint64_t *w, *cw;
+	uint e;
+	BSet *gen, *kill, *in, live[1];
+	Blk *b;
+	Ins *i;
+	Ref *r;
+
+	top = fn->slot;
+	pf_nu = fn->slot - fn->spill_slot_base;
+	if (pf_nu <= 0)
+		goto Report;
+	pf_obj = alloc(pf_nu * sizeof pf_obj[0]);
+	pf_wd = alloc(pf_nu * sizeof pf_wd[0]);
+	for (s=0; s<pf_nu; s++)
+		pf_obj[s] = -1;
+	nobj = 0;
+	for (t=Tmp0; t<fn->ntmp; t++) {
+		s = fn->tmp[t].slot - fn->spill_slot_base;
+		if (fn->tmp[t].slot < fn->spill_slot_base || s >= pf_nu)
+			continue;
+		if (pf_obj[s] < 0)
+			pf_obj[s] = nobj++;
+		x = pf_obj[s];
+		k = (KWIDE(fn->tmp[t].cls) || fn->tmp[t].cls == Ks) ? 2 : 1;
+		if (pf_wd[x] < k)
+			pf_wd[x] = k;
+	}
+	for (s=0; s<pf_nu; s++)
+		if (pf_obj[s] >= 0 && pf_wd[pf_obj[s]] == 2
+		&& (s+1 == pf_nu || pf_obj[s+1] >= 0))
+			goto Report;
+	top = fn->spill_slot_base;
+	if (nobj == 0)
+		goto Report;
+
+	/* 1. per-block upward-exposed reads and kills */
+	w = alloc(nobj * sizeof w[0]);
+	gen = alloc(fn->nblk * sizeof gen[0]);
+	kill = alloc(fn->nblk * sizeof kill[0]);
+	in = alloc(fn->nblk * sizeof in[0]);
+	bsinit(live, nobj);
+	for (b=fn->start; b; b=b->link) {
+		bsinit(&gen[b->id], nobj);
+		bsinit(&kill[b->id], nobj);
+		bsinit(&in[b->id], nobj);
+		x = pfref(b->jmp.arg, fn);
+		if (x == -2)
+			goto Unpacked;
+		if (x >= 0) {
+			bsset(&gen[b->id], x);
+			w[x] += b->loop;
+		}
+		for (i=&b->ins[b->nins]; i!=b->ins;) {
+			i--;
+			n = pfins(i, fn, o, ru);
+			if (n < 0)
+				goto Unpacked;
+			for (k=0; k<n; k++) {
+				w[o[k]] += b->loop;
+				if (!ru[k]) {
+					bsset(&kill[b->id], o[k]);
+					bsclr(&gen[b->id], o[k]);
+				}
+			}
+			for (k=0; k<n; k++)
+				if (ru[k])
+					bsset(&gen[b->id], o[k]);
+		}
+	}
+
+	/* 2. live-in fixpoint */
+	do {
+		chg = 0;
+		for (n=fn->nblk; n-->0;) {
+			b = fn->rpo[n];
+			pfout(b, in, live);
+			bsdiff(live, &kill[b->id]);
+			bsunion(live, &gen[b->id]);
+			if (!bsequal(live, &in[b->id])) {
+				bscopy(&in[b->id], live);
+				chg = 1;
+			}
+		}
+	} while (chg);
+
+	/* 3. interference edges */
+	pf_ne = 0;
+	for (b=fn->start; b; b=b->link) {
+		pfout(b, in, live);
+		x = pfref(b->jmp.arg, fn);
+		if (x >= 0) {
+			for (j=0; bsiter(live, &j); j++)
+				pfedge(x, j);
+			bsset(live, x);
+		}
+		for (i=&b->ins[b->nins]; i!=b->ins;) {
+			i--;
+			n = pfins(i, fn, o, ru);
+			for (k=0; k<n; k++) {
+				for (j=0; bsiter(live, &j); j++)
+					pfedge(o[k], j);
+				for (j=k+1; j<n; j++)
+					pfedge(o[k], o[j]);
+			}
+			for (k=0; k<n; k++)
+				if (!ru[k])
+					bsclr(live, o[k]);
+			for (k=0; k<n; k++)
+				if (ru[k])
+					bsset(live, o[k]);
+		}
+	}
+	qsort(pf_e, pf_ne, sizeof pf_e[0], pfecmp);
+	deg = alloc((nobj+1) * sizeof deg[0]);
+	for (e=0; e<pf_ne; e++)
+		if (e == 0 || pf_e[e] != pf_e[e-1]) {
+			deg[pf_e[e] >> 32]++;
+			deg[(uint)pf_e[e]]++;
+		}
+	for (x=0; x<nobj; x++)
+		deg[x+1] += deg[x];
+	nbr = alloc((deg[nobj] + 1) * sizeof nbr[0]);
+	for (e=0; e<pf_ne; e++)
+		if (e == 0 || pf_e[e] != pf_e[e-1]) {
+			x = pf_e[e] >> 32;
+			j = (uint)pf_e[e];
+			nbr[--deg[x]] = j;
+			nbr[--deg[j]] = x;
+		}
+
+	/* 4. color, hottest object first; an object joins the first
+	 * free class wide enough, else the first free one */
+	ord = alloc(nobj * sizeof ord[0]);
+	cls = alloc(nobj * sizeof cls[0]);
+	mark = alloc(nobj * sizeof mark[0]);
+	cwd = alloc(nobj * sizeof cwd[0]);
+	cw = alloc(nobj * sizeof cw[0]);
+	pos = alloc(nobj * sizeof pos[0]);
+	for (x=0; x<nobj; x++) {
+		ord[x] = x;
+		cls[x] = -1;
+	}
+	pf_w = w;
+	qsort(ord, nobj, sizeof ord[0], pfwcmp);
+	ncls = 0;
+	for (k=0; k<nobj; k++) {
+		x = ord[k];
+		for (j=deg[x]; j<deg[x+1]; j++)
+			if (cls[nbr[j]] >= 0)
+				mark[cls[nbr[j]]] = k+1;
+		c = -1;
+		for (j=0; j<ncls; j++)
+			if (mark[j] != k+1) {
+				if (c < 0)
+					c = j;
+				if (cwd[j] >= pf_wd[x]) {
+					c = j;
+					break;
+				}
+			}
+		if (c < 0)
+			c = ncls++;
+		cls[x] = c;
+		if (cwd[c] < pf_wd[x])
+			cwd[c] = pf_wd[x];
+		cw[c] += w[x];
+	}
+
+	/* 5. stack the classes, hottest nearest BP */
+	for (c=0; c<ncls; c++) {
+		ord[c] = c;
+		top += cwd[c];
+	}
+	pf_w = cw;
+	qsort(ord, ncls, sizeof ord[0], pfwcmp);
+	for (s=top, c=0; c<ncls; c++) {
+		s -= cwd[ord[c]];
+		pos[ord[c]] = s;
+	}
+	for (b=fn->start; b; b=b->link) {
+		if ((x = pfref(b->jmp.arg, fn)) >= 0)
+			b->jmp.arg = SLOT(pos[cls[x]]);
+		for (i=b->ins; i<&b->ins[b->nins]; i++)
+			for (k=0; k<3; k++) {
+				r = k < 2 ? &i->arg[k] : &i->to;
+				if ((x = pfref(*r, fn)) >= 0)
+					*r = SLOT(pos[cls[x]]);
+			}
+	}
+	for (t=Tmp0; t<fn->ntmp; t++) {
+		s = fn->tmp[t].slot - fn->spill_slot_base;
+		if (fn->tmp[t].slot >= fn->spill_slot_base && s < pf_nu)
+			fn->tmp[t].slot = pos[cls[pf_obj[s]]];
+	}
+	goto Report;
+Unpacked:
+	top = fn->slot;
+Report:
+	if (getenv("QBE_SLOT_DBG"))
+		fprintf(stderr, "SLOTDBG %s: spill slots %d -> %d, "
+			"frame %d bytes\n", fn->name, pf_nu > 0 ? pf_nu : 0,
+			top - fn->spill_slot_base, 2 * top);
+	fn->slot = top;
+}
+
+void
+i8086_emitfn(Fn *fn, FILE *f)
+{
+	Blk *b;
+	Lay *lay, *l;
+
+	packframe(fn);
+	if (chk_on == -1)
+		chk_on = (getenv("QBE_EMIT_CHK") != 0);
+	if (chk_on)
+		chk_fixpoint(fn);
+
+	/* Emit memory model header (once per output file) */
+	emit_model_header(f);
+
+	/* Function header */
+	fprintf(f, "\n");
+	if (fn->lnk.isr) {
+		/* Interrupt handler: emit two CS-addressable data words ahead
+		 * of the entry label, inside the same `.text` region so
+		 * asm_to_omf.py keeps them glued to the function when it
+		 * splits oversized TUs at function boundaries.
 		 *
 		 *   _qbe_isr_es_<fn>:  static ES save slot.  The Victor 9000
 		 *       BIOS ROM handlers clobber ES without saving it, so the
@@ -4741,241 +6891,21 @@ i8086_emitfn(Fn *fn, FILE *f)
 	if (fn->slot > 0)
 		fprintf(f, "\tsub sp, %d\n", 2 * fn->slot);
 
-	/* Emit blocks */
-	for (b = fn->start; b; b = b->link) {
-		/* Skip empty-name blocks; these creep in at function epilogues
-		 * and would emit a stray bare `:` line. */
-		if (b != fn->start && b->name[0] != 0)
-			fprintf(f, "%s:\n", b->name);
+	esflow(fn);
 
-		/* Precompute AX/DX live-after for each instruction so the save
-		 * brackets can be dropped where the register is dead (see
-		 * compute_axdx_liveafter).  Buffers grow as needed across blocks. */
-		if (b->nins > la_cap) {
-			la_cap = b->nins;
-			la_ax_buf = realloc(la_ax_buf, la_cap);
-			la_dx_buf = realloc(la_dx_buf, la_cap);
-			la_bx_buf = realloc(la_bx_buf, la_cap);
-			if (!la_ax_buf || !la_dx_buf || !la_bx_buf)
-				die("emit: out of memory for liveness buffers");
-		}
-		compute_axdx_liveafter(b, fn, la_ax_buf, la_dx_buf, la_bx_buf);
-
-		if (chk_on) {
-			/* Exact per-instruction live-after for the audit markers:
-			 * backward walk seeded from the CFG-fixpoint live-out. */
-			uint cl;
-			int n;
-			if (b->nins > chk_la_cap) {
-				chk_la_cap = b->nins;
-				chk_la_buf = realloc(chk_la_buf,
-					chk_la_cap * sizeof *chk_la_buf);
-				if (!chk_la_buf)
-					die("emit: out of memory for CHK buffer");
-			}
-			cl = chk_blk_liveout(b);
-			if (b->jmp.type == Jjnz && rtype(b->jmp.arg) == RTmp
-			 && CHK_ISGPR(b->jmp.arg.val))
-				cl |= CHK_BIT(b->jmp.arg.val);
-			for (n = b->nins - 1; n >= 0; n--) {
-				chk_la_buf[n] = cl;
-				cl = chk_ins_live(&b->ins[n], fn, cl);
-			}
-		}
-
-		for (i = b->ins; i < &b->ins[b->nins]; i++) {
-			int idx = (int)(i - b->ins);
-			g_live_ax_after = la_ax_buf[idx];
-			g_live_dx_after = la_dx_buf[idx];
-			g_live_bx_after = la_bx_buf[idx];
-			if (chk_on)
-				chk_mark_ins(i, fn, chk_la_buf[idx], f);
-			emitins(i, fn, f);
-		}
-		g_live_ax_after = 1;
-		g_live_dx_after = 1;
-		g_live_bx_after = 1;
-
-		if (chk_on) {
-			if (fn->lnk.isr
-			    && (b->jmp.type == Jret0 || b->jmp.type == Jretw
-			        || b->jmp.type == Jretl || b->jmp.type == Jretf0
-			        || b->jmp.type == Jretfw || b->jmp.type == Jretfl)) {
-				/* ISR ret region: the epilogue restores the
-				 * INTERRUPTED context — every register (and ES/DS)
-				 * legitimately ends different from region entry.
-				 * The `isr` tag tells the checker to skip; the
-				 * epilogue is one fixed template, not bracket
-				 * logic. */
-				fprintf(f, "\t; CHKT %d live=isr\n", b->jmp.type);
-			} else {
-				fprintf(f, "\t; CHKT %d live=", b->jmp.type);
-				chk_print_live(chk_blk_liveout(b), f);
-				fputc('\n', f);
-			}
-		}
-
-		/* Emit jump */
-		switch (b->jmp.type) {
-		case Jret0:
-		case Jretw:
-		case Jretl:
-		case Jretf0:
-		case Jretfw:
-		case Jretfl:
-			if (fn->lnk.isr) {
-				/* Interrupt-handler epilogue: unwind the standard
-				 * frame, then the outer ISR save set, then restore
-				 * ES from static memory LAST (cs: override — DS is
-				 * already the interrupted value) and iret.  Both
-				 * near- and far-ret IR forms end in iret. */
-				fprintf(f, "\tlea sp, [bp-6]\n");
-				fprintf(f, "\tpop di\n");
-				fprintf(f, "\tpop si\n");
-				fprintf(f, "\tpop bx\n");
-				fprintf(f, "\tpop bp\n");
-				fprintf(f, "\tpop ds\n");
-				fprintf(f, "\tpop dx\n");
-				fprintf(f, "\tpop cx\n");
-				fprintf(f, "\tpop ax\n");
-				fprintf(f, "\tmov es, [cs:_qbe_isr_es_%s]\n",
-					fn->name);
-				fprintf(f, "\tiret\n");
-				break;
-			}
-			fprintf(f, "\tlea sp, [bp-6]\n");
-			fprintf(f, "\tpop di\n");
-			fprintf(f, "\tpop si\n");
-			fprintf(f, "\tpop bx\n");
-			fprintf(f, "\tpop bp\n");
-			if (b->jmp.type == Jretf0 || b->jmp.type == Jretfw
-			    || b->jmp.type == Jretfl)
-				/* RETF pops both IP and CS (4 bytes total) —
-				 * medium/large/huge memory models. */
-				fprintf(f, "\tretf\n");
-			else
-				fprintf(f, "\tret\n");
-			break;
-		case Jjmp:
-			if (b->s1 != b->link && b->s1->name[0])
-				fprintf(f, "\tjmp %s\n", b->s1->name);
-			break;
-		case Jjnz: {
-			Ref jr = b->jmp.arg;
-			if (rtype(jr) == RTmp
-			    && jr.val >= 0
-			    && jr.val < (int)(sizeof rname / sizeof rname[0])
-			    && rname[jr.val] != 0) {
-				fprintf(f, "\ttest %s, %s\n",
-					rname[jr.val], rname[jr.val]);
-			} else if (rtype(jr) == RSlot) {
-				/* rega spilled the jjnz condition.  We MUST NOT route
-				 * through any GPR — rega may place a live SSA temp in
-				 * any caller-save reg at block end (the phi-edge moves
-				 * in the successor's edge block expect those values).
-				 * Use `cmp mem, 0` which sets ZF directly without
-				 * touching any register. */
-				fprintf(f, "\tcmp word [bp%+ld], 0\n",
-					(long)slot(jr, fn));
-			} else if (rtype(jr) == RCon) {
-				/* Constant jjnz — fold at emit time. */
-				Con *c = &fn->con[jr.val];
-				if (c->type == CBits && c->bits.i == 0) {
-					/* Always-false: only the s2 branch matters. */
-					if (b->s2 != b->link && b->s2->name[0])
-						fprintf(f, "\tjmp %s\n",
-							b->s2->name);
-					break;
-				}
-				if (c->type == CBits) {
-					/* Non-zero constant: always-true. */
-					if (b->s1->name[0])
-						fprintf(f, "\tjmp %s\n",
-							b->s1->name);
-					break;
-				}
-				/* Address constant — non-zero at link time. */
-				if (b->s1->name[0])
-					fprintf(f, "\tjmp %s\n", b->s1->name);
-				break;
-			} else {
-				fprintf(f, "\t; XXX bad jjnz operand: rtype=%d val=%d\n",
-				        rtype(jr), jr.val);
-				fprintf(f, "\ttest ax, ax\n");
-			}
-			if (b->s1->name[0])
-				fprintf(f, "\tjnz %s\n", b->s1->name);
-			if (b->s2 != b->link && b->s2->name[0])
-				fprintf(f, "\tjmp %s\n", b->s2->name);
-			break;
-		}
-		/* Conditional jumps based on flags (from comparison) */
-		case Jjfieq:
-			if (b->s1->name[0])
-				fprintf(f, "\tje %s\n", b->s1->name);
-			if (b->s2 != b->link && b->s2->name[0])
-				fprintf(f, "\tjmp %s\n", b->s2->name);
-			break;
-		case Jjfine:
-			if (b->s1->name[0])
-				fprintf(f, "\tjne %s\n", b->s1->name);
-			if (b->s2 != b->link && b->s2->name[0])
-				fprintf(f, "\tjmp %s\n", b->s2->name);
-			break;
-		case Jjfislt:
-			if (b->s1->name[0])
-				fprintf(f, "\tjl %s\n", b->s1->name);
-			if (b->s2 != b->link && b->s2->name[0])
-				fprintf(f, "\tjmp %s\n", b->s2->name);
-			break;
-		case Jjfisgt:
-			if (b->s1->name[0])
-				fprintf(f, "\tjg %s\n", b->s1->name);
-			if (b->s2 != b->link && b->s2->name[0])
-				fprintf(f, "\tjmp %s\n", b->s2->name);
-			break;
-		case Jjfisle:
-			if (b->s1->name[0])
-				fprintf(f, "\tjle %s\n", b->s1->name);
-			if (b->s2 != b->link && b->s2->name[0])
-				fprintf(f, "\tjmp %s\n", b->s2->name);
-			break;
-		case Jjfisge:
-			if (b->s1->name[0])
-				fprintf(f, "\tjge %s\n", b->s1->name);
-			if (b->s2 != b->link && b->s2->name[0])
-				fprintf(f, "\tjmp %s\n", b->s2->name);
-			break;
-		case Jjfiult:
-			if (b->s1->name[0])
-				fprintf(f, "\tjb %s\n", b->s1->name);
-			if (b->s2 != b->link && b->s2->name[0])
-				fprintf(f, "\tjmp %s\n", b->s2->name);
-			break;
-		case Jjfiugt:
-			if (b->s1->name[0])
-				fprintf(f, "\tja %s\n", b->s1->name);
-			if (b->s2 != b->link && b->s2->name[0])
-				fprintf(f, "\tjmp %s\n", b->s2->name);
-			break;
-		case Jjfiule:
-			if (b->s1->name[0])
-				fprintf(f, "\tjbe %s\n", b->s1->name);
-			if (b->s2 != b->link && b->s2->name[0])
-				fprintf(f, "\tjmp %s\n", b->s2->name);
-			break;
-		case Jjfiuge:
-			if (b->s1->name[0])
-				fprintf(f, "\tjae %s\n", b->s1->name);
-			if (b->s2 != b->link && b->s2->name[0])
-				fprintf(f, "\tjmp %s\n", b->s2->name);
-			break;
-		default:
-			/* Unsupported jump type */
-			die("i8086: unsupported jump type %d at end of @%s",
-			    b->jmp.type, b->name);
-		}
+	/* Emit the blocks into the spool, then lay them out */
+	if (!spool && !(spool = tmpfile()))
+		die("emit: cannot create the block spool");
+	rewind(spool);
+	lay = alloc(fn->nblk * sizeof lay[0]);
+	for (b = fn->start; b; b = b->link) {
+		l = &lay[b->id];
+		l->b = b;
+		l->off = ftell(spool);
+		emitblk(b, fn, l, spool);
+		l->end = ftell(spool);
 	}
+	layout(fn, lay, f);
 
 	/* MASM `endp` directive removed (not used by NASM). */
 }
@@ -97,7 +97,12 @@ fixarg(Ref *r, int k, Ins *i, Fn *fn)
 	*r = r1;
 }
 
-static void
+static uint ncmpfused, ncmpmat;
+
+/* With i.to == R the compare only sets the flags for a Jjf* jump
+ * (seljmp); the returned comparison is the one the jump must test,
+ * operand swaps included. */
+static int
 selcmp(Ins i, int k, int cmp, Fn *fn)
 {
 	Ins *i0;
@@ -136,6 +141,14 @@ selcmp(Ins i, int k, int cmp, Fn *fn)
 		/* Cieq, Cine: swap-symmetric */
 		}
 	}
+	/* A flags-only Kl compare ends in `cmp lo; sbb hi`, which gets
+	 * SF^OF and CF right but not ZF; turn gt/le into lt/ge on the
+	 * swapped operands so the jump never needs ZF. */
+	if (req(i.to, R) && k == Kl
+	&& (cmp == Cisgt || cmp == Cisle || cmp == Ciugt || cmp == Ciule)) {
+		Ref tmp = i.arg[0]; i.arg[0] = i.arg[1]; i.arg[1] = tmp;
+		cmp = cmpop(cmp);
+	}
 	/* Two-constant cmp (`cmp imm, imm`) is illegal in any register/memory
 	 * combination 8086 supports.  Hoist arg[0] into a fresh temp so the
 	 * generated form becomes `cmp reg, imm`.  The Ocopy must execute
@@ -199,19 +212,63 @@ selcmp(Ins i, int k, int cmp, Fn *fn)
 		    |= BIT(RSI) | BIT(RDI) | BIT(RBP) | BIT(RSP)
 		    |  BIT(RES) | BIT(RDS);
 	}
+	if (req(i0->to, R))
+		ncmpfused++;
+	else
+		ncmpmat++;
+	return cmp;
 }
 
 static void
 seljmp(Blk *b, Fn *fn)
 {
 	Ref r;
-
+	Ins *fi;
+	int c, k;
+
+	/* A compare whose only use is the jnz is fused into it: the
+	 * compare moves to the end of the block with no destination and
+	 * the jump tests the flags (Jjf*), so the 0/1 materialize and the
+	 * `test` go away.  Moving it is safe, its arguments are SSA temps;
+	 * nothing may run between it and the jump since almost every 8086
+	 * instruction clobbers the flags. */
+	if (b->jmp.type == Jjnz && rtype(b->jmp.arg) == RTmp
+	&& fn->tmp[b->jmp.arg.val].nuse == 1) {
+		r = b->jmp.arg;
+		for (fi=&b->ins[b->nins]; fi!=b->ins; fi--)
+			if (req(fi[-1].to, r))
+				break;
+		if (fi-- != b->ins && iscmp(fi->op, &k, &c)
+		&& (k == Kw || k == Kl)) {
+			c = selcmp((Ins){.op = fi->op, .cls = Kw,
+				.arg = {fi->arg[0], fi->arg[1]}}, k, c, fn);
+			*fi = (Ins){.op = Onop};
+			b->jmp.type = Jjf + c;
+			b->jmp.arg = R;
+			return;
+		}
+	}
 	if (b->jmp.type == Jjnz) {
 		/* test reg, reg; jnz label */
 		r = b->jmp.arg;
 		fixarg(&r, Kw, 0, fn);
 		b->jmp.arg = r;
 	}
+	if (b->jmp.type == Jjtab && rtype(b->jmp.arg) != RCon) {
+		/* The emitter doubles the index in place to address the
+		 * table (`shl r, 1; jmp [cs:r+table]`), so the jump gets a
+		 * copy that dies there.  Only BX/SI/DI can be a base or
+		 * index register; steer rega away from the others (soft,
+		 * like the setCC hint in selcmp — emit copes with any
+		 * register or a spill slot). */
+		r = newtmp("isel", Kw, fn);
+		emit(Ocopy, Kw, r, b->jmp.arg, R);
+		fixarg(&curi->arg[0], Kw, curi, fn);
+		fn->tmp[r.val].hint.m
+		    |= BIT(RAX) | BIT(RCX) | BIT(RDX) | BIT(RBP) | BIT(RSP)
+		    |  BIT(RES) | BIT(RDS);
+		b->jmp.arg = r;
+	}
 	/* Other jump types are handled in emit phase */
 }
 
@@ -244,6 +301,168 @@ seldiv(Ins i, Fn *fn, int issigned)
 	fixarg(&i0->arg[1], Kw, i0, fn);
 }
 
+static uint nmulexp, nmulkept;
+
+/* Multiplication by a constant as a chain of shifts, adds and subs
+ * on the other operand x.  Each step rewrites the running product
+ * acc; MFadd/MFsub multiply it by 2^k+1 / 2^k-1 through a scratch
+ * copy.  The 8086 lea has no scaled index, so unlike amd64 there is
+ * no lea step. */
+enum { MShl, MAdd, MSub, MFadd, MFsub, MNeg };
+enum { NMStep = 8 };
+
+typedef struct {
+	short op, k;
+} MStep;
+
+static int mulplan(uint, int, int, MStep *, int *);
+
+static void
+mulalt(uint c, int op, int k, int cost, int d, int *best, MStep *s, int *ns)
+{
+	MStep s1[NMStep];
+	int c1, n1;
+
+	if (*best <= cost || d <= 0)
+		return;
+	c1 = mulplan(c, *best - cost, d - 1, s1, &n1);
+	if (c1 >= *best - cost)
+		return;
+	memcpy(s, s1, n1 * sizeof s1[0]);
+	s[n1] = (MStep){op, k};
+	*ns = n1 + 1;
+	*best = c1 + cost;
+}
+
+/* The cheapest chain computing c*x in at most d steps, if it costs
+ * less than lim cycles (i8086_cost); returns lim otherwise. */
+static int
+mulplan(uint c, int lim, int d, MStep *s, int *ns)
+{
+	int best, k, alu, fac;
+
+	*ns = 0;
+	if (c == 1)
+		return 0;
+	best = lim;
+	alu = i8086_cost(C88Alu, 1);
+	if (!(c & 1)) {
+		for (k = 0; !(c >> k & 1); k++)
+			;
+		mulalt(c >> k, MShl, k, i8086_shcost(Oshl, k), d,
+			&best, s, ns);
+		return best;
+	}
+	mulalt(c - 1, MAdd, 0, alu, d, &best, s, ns);
+	if (c != 0xffff)
+		mulalt(c + 1, MSub, 0, alu, d, &best, s, ns);
+	for (k = 1; k < 16; k++) {
+		fac = i8086_cost(C88Mov, 1) + i8086_shcost(Oshl, k) + alu;
+		if (c % ((1u << k) + 1) == 0)
+			mulalt(c / ((1u << k) + 1), MFadd, k, fac, d,
+				&best, s, ns);
+		if (k > 1 && c % ((1u << k) - 1) == 0)
+			mulalt(c / ((1u << k) - 1), MFsub, k, fac, d,
+				&best, s, ns);
+	}
+	return best;
+}
+
+/* Kw multiply by a constant: `mul` needs AX, DX and a register for
+ * the constant, all saved around it (see emitins), so expand into a
+ * shift/add chain when the 8088 cycle table prices that lower. */
+static int
+selmul(Ins i, Fn *fn)
+{
+	MStep s[NMStep];
+	Ins v[2*NMStep];
+	Ref x, acc, to, t;
+	Con *c;
+	uint m;
+	int n, nv, j, base, cost, op;
+
+	if (rtype(i.arg[0]) == RCon) {
+		x = i.arg[0];
+		i.arg[0] = i.arg[1];
+		i.arg[1] = x;
+	}
+	x = i.arg[0];
+	if (rtype(i.arg[1]) != RCon || rtype(x) != RTmp || isreg(x)
+	 || fn->tmp[x.val].slot != -1 || req(i.to, R))
+		return 0;
+	c = &fn->con[i.arg[1].val];
+	if (c->type != CBits)
+		return 0;
+	m = c->bits.i & 0xffff;
+	if (m <= 1) {
+		emit(Ocopy, Kw, i.to, m ? x : CON_Z, R);
+		nmulexp++;
+		return 1;
+	}
+
+	/* The `mul` path: the constant through a saved register, AX
+	 * loaded and the low word moved out; charge the first step's
+	 * copy of x against it. */
+	base = i8086_cost(C88Mul, 1) + i8086_cost(C88MovI, 1)
+		+ i8086_cost(C88Push, 1) + i8086_cost(C88Pop, 1)
+		+ i8086_cost(C88Mov, 1);
+	cost = mulplan(m, base, NMStep, s, &n);
+	if (m & 0x8000) {
+		/* acc = 0 - acc last */
+		MStep s1[NMStep];
+		int n1, c1;
+
+		c1 = mulplan(-m & 0xffff, cost, NMStep-1, s1, &n1);
+		c1 += i8086_cost(C88MovI, 1) + i8086_cost(C88Alu, 1);
+		if (c1 < cost) {
+			memcpy(s, s1, n1 * sizeof s1[0]);
+			s[n1] = (MStep){MNeg, 0};
+			n = n1 + 1;
+			cost = c1;
+		}
+	}
+	if (cost >= base) {
+		nmulkept++;
+		return 0;
+	}
+
+	nv = 0;
+	acc = x;
+	for (j = 0; j < n; j++) {
+		to = j == n-1 ? i.to : newtmp("mul", Kw, fn);
+		switch (s[j].op) {
+		case MShl:
+			v[nv++] = (Ins){.op = Oshl, .cls = Kw, .to = to,
+				.arg = {acc, getcon(s[j].k, fn)}};
+			break;
+		case MAdd:
+		case MSub:
+			op = s[j].op == MAdd ? Oadd : Osub;
+			v[nv++] = (Ins){.op = op, .cls = Kw, .to = to,
+				.arg = {acc, x}};
+			break;
+		case MFadd:
+		case MFsub:
+			op = s[j].op == MFadd ? Oadd : Osub;
+			t = newtmp("mul", Kw, fn);
+			v[nv++] = (Ins){.op = Oshl, .cls = Kw, .to = t,
+				.arg = {acc, getcon(s[j].k, fn)}};
+			v[nv++] = (Ins){.op = op, .cls = Kw, .to = to,
+				.arg = {t, acc}};
+			break;
+		case MNeg:
+			v[nv++] = (Ins){.op = Osub, .cls = Kw, .to = to,
+				.arg = {CON_Z, acc}};
+			break;
+		}
+		acc = to;
+	}
+	while (nv)
+		emiti(v[--nv]);
+	nmulexp++;
+	return 1;
+}
+
 static void
 selshift(Ins i, Fn *fn)
 {
@@ -257,8 +476,8 @@ selshift(Ins i, Fn *fn)
 
 	r1 = i.arg[1];
 	if (rtype(r1) == RCon) {
-		/* Immediate count: emit handles it without touching CX
-		 * (0/1 direct, 2-8 unrolled, >8 via CL with push/pop). */
+		/* Immediate count: emit handles it, touching CX only when
+		 * shplan() prices the count in CL (with push/pop) lowest. */
 		emiti(i);
 		i0 = curi;
 		fixarg(&i0->arg[0], Kw, i0, fn);
@@ -301,6 +520,83 @@ selfp(Ins i, Fn *fn)
 	fixarg(&i0->arg[1], argcls(&i, 1), i0, fn);
 }
 
+/* Can every use of the huge pointer t live with an offset word up
+ * to 0xFFF0?  Far loads and stores through it can (an access of up to
+ * 16 bytes stays in the segment), and so can the huge ops, which carry
+ * into the segment themselves; the phi p closes the loop.  A flat
+ * `add` of a member offset, a call argument or a store of the pointer
+ * could not. */
+static int
+hugesafe(int t, Phi *p, Fn *fn)
+{
+	Tmp *tmp;
+	Use *u;
+	Ins *i;
+
+	tmp = &fn->tmp[t];
+	for (u = tmp->use; u < &tmp->use[tmp->nuse]; u++) {
+		if (u->type == UPhi) {
+			if (u->u.phi != p)
+				return 0;
+			continue;
+		}
+		if (u->type != UIns)
+			return 0;
+		i = u->u.ins;
+		if (isloadfar(i->op))
+			continue;
+		if (INRANGE(i->op, Ostorefb, Ostorefs)
+		&& !req(i->arg[0], TMP(t)))
+			continue;
+		if ((i->op == Ohugeadd || i->op == Ohugesub)
+		&& !req(i->arg[1], TMP(t)))
+			continue;
+		if (i->op == Ohugecmp)
+			continue;
+		return 0;
+	}
+	return 1;
+}
+
+/* An induction pointer p = phi(p0, q), q = p +/- c, loops through a
+ * huge array one constant step at a time, and there is no need to
+ * normalise q on every iteration: as long as all uses of p and q are
+ * hugesafe(), q may keep a large offset and only needs the carry into
+ * the segment once the offset word would pass 0xFFF0.  Such steps
+ * become hugeinc/hugedec. */
+static void
+hugeiv(Fn *fn)
+{
+	Blk *b;
+	Phi *p;
+	Ins *q;
+	Con *c;
+	uint n;
+	int t;
+
+	for (b = fn->start; b; b = b->link)
+		for (p = b->phi; p; p = p->link) {
+			if (p->cls != Kl)
+				continue;
+			for (n = 0; n < p->narg; n++) {
+				if (rtype(p->arg[n]) != RTmp)
+					continue;
+				t = p->arg[n].val;
+				q = fn->tmp[t].def;
+				if (!q || (q->op != Ohugeadd && q->op != Ohugesub)
+				|| !req(q->arg[0], p->to)
+				|| rtype(q->arg[1]) != RCon)
+					continue;
+				c = &fn->con[q->arg[1].val];
+				if (c->type != CBits
+				|| c->bits.i < 0 || c->bits.i > 0xFFF0)
+					continue;
+				if (hugesafe(p->to.val, p, fn) && hugesafe(t, p, fn))
+					q->op = q->op == Ohugeadd ? Ohugeinc : Ohugedec;
+			}
+		}
+}
+
 /* 8086 [reg] addressing is restricted to BX/BP/SI/DI.  rega doesn't
  * know that, so by default a pointer can land in AX/CX/DX and emit.c
  * pays a 2x `xchg bx, <reg>` + 1-byte clobber per load/store to work
@@ -401,6 +697,9 @@ sel(Ins i, Fn *fn)
 		return;
 	}
 
+	if (i.op == Omul && i.cls == Kw && selmul(i, fn))
+		return;
+
 	/* Emit the instruction first, then fix args
 	 * This follows the pattern from rv64/isel.c
 	 */
@@ -438,10 +737,10 @@ sel(Ins i, Fn *fn)
 void
 i8086_isel(Fn *fn)
 {
-	Blk *b, **sb;
+	Blk *b, *s;
 	Ins *i;
 	Phi *p;
-	uint n;
+	uint n, ns;
 	int al;
 	int64_t sz;
 
@@ -528,14 +827,18 @@ i8086_isel(Fn *fn)
 					*i = (Ins){.op = Onop};
 				}
 
+	ncmpfused = ncmpmat = 0;
+	nmulexp = nmulkept = 0;
+	hugeiv(fn);
+
 	/* Process blocks in forward order */
 	for (b = fn->start; b; b = b->link) {
 		/* Reset instruction buffer for this block */
 		curi = &insb[NIns];
 
 		/* Process phi nodes */
-		for (sb=(Blk*[3]){b->s1, b->s2, 0}; *sb; sb++)
-			for (p=(*sb)->phi; p; p=p->link) {
+		for (ns=0; (s=nextsucc(b, &ns));)
+			for (p=s->phi; p; p=p->link) {
 				for (n=0; p->blk[n] != b; n++)
 					assert(n+1 < p->narg);
 				fixarg(&p->arg[n], p->cls, 0, fn);
@@ -555,5 +858,9 @@ i8086_isel(Fn *fn)
 	if (debug['I']) {
 		fprintf(stderr, "\n> After instruction selection:\n");
 		printfn(fn, stderr);
+		fprintf(stderr, "\n> Compares: %u fused into jumps, "
+			"%u materialized\n", ncmpfused, ncmpmat);
+		fprintf(stderr, "> Constant multiplies: %u expanded, "
+			"%u kept\n", nmulexp, nmulkept);
 	}
 }
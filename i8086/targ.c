@@ -52,6 +52,7 @@ Target T_i8086 = {
 	.emitfin = elf_emitfin,  /* TODO: maybe need custom output format */
 	.asloc = ".L",
 	.assym = "_",  /* DOS/OMF conventionally prefixes symbols with _ */
+	.jtab = 1,
 };
 
 MAKESURE(rsave_size_ok, sizeof i8086_rsave == (NGPS+NFPS+1) * sizeof(int));
@@ -0,0 +1,270 @@
+#define _POSIX_C_SOURCE 200809L /* fmemopen */
+#include "all.h"
+#include "config.h"
+#include "libqbe.h"
+#include <ctype.h>
+
+Target T;
+
+char debug['Z'+1] = {
+	['P'] = 0, /* parsing */
+	['M'] = 0, /* memory optimization */
+	['N'] = 0, /* ssa construction */
+	['C'] = 0, /* copy elimination */
+	['G'] = 0, /* gvn/gcm */
+	['K'] = 0, /* if-conversion */
+	['A'] = 0, /* abi lowering */
+	['I'] = 0, /* instruction selection */
+	['L'] = 0, /* liveness */
+	['S'] = 0, /* spilling */
+	['R'] = 0, /* reg. allocation */
+};
+
+extern Target T_amd64_sysv;
+extern Target T_amd64_apple;
+extern Target T_amd64_win;
+extern Target T_arm64;
+extern Target T_arm64_apple;
+extern Target T_rv64;
+extern Target T_i8086;
+
+Target *tlist[] = {
+	&T_amd64_sysv,
+	&T_amd64_apple,
+	&T_amd64_win,
+	&T_arm64,
+	&T_arm64_apple,
+	&T_rv64,
+	&T_i8086,
+	0
+};
+static FILE *outf;
+static int dbg;
+static int ndef;
+
+/* Memory model names for command line */
+static struct {
+	char *name;
+	enum MemModel model;
+} mmodels[] = {
+	{ "tiny",    Mtiny },
+	{ "small",   Msmall },
+	{ "medium",  Mmedium },
+	{ "compact", Mcompact },
+	{ "large",   Mlarge },
+	{ "huge",    Mhuge },
+	{ 0, 0 }
+};
+
+static void
+data(Dat *d)
+{
+	ndef++;
+	if (dbg)
+		return;
+	emitdat(d, outf);
+	if (d->type == DEnd) {
+		fputs("/* end data */\n\n", outf);
+		freeall();
+	}
+}
+
+static void
+func(Fn *fn)
+{
+	uint n;
+
+	ndef++;
+	if (dbg)
+		fprintf(stderr, "**** Function %s ****", fn->name);
+	if (debug['P']) {
+		fprintf(stderr, "\n> After parsing:\n");
+		printfn(fn, stderr);
+	}
+	if (!T.jtab)
+		lowerjtab(fn);
+	T.abi0(fn);
+	fillcfg(fn);
+	filluse(fn);
+	asmvol(fn);   /* keep inline-asm operand slots in memory (before markvol) */
+	markvol(fn);  /* propagate C volatile from allocs to their loads/stores */
+	promote(fn);
+	scalarize(fn);
+	filluse(fn);
+	ssa(fn);
+	filluse(fn);
+	ssacheck(fn);
+	fillalias(fn);
+	loadopt(fn);
+	filluse(fn);
+	fillalias(fn);
+	coalesce(fn);
+	filluse(fn);
+	filldom(fn);
+	ssacheck(fn);
+	fold(fn);
+	filluse(fn);
+	filldom(fn);
+	ssacheck(fn);
+	licm(fn);
+	filluse(fn);
+	ssacheck(fn);
+	gvn(fn);
+	fillcfg(fn);
+	simplcfg(fn);
+	filluse(fn);
+	filldom(fn);
+	gcm(fn);
+	filluse(fn);
+	ssacheck(fn);
+	if (T.cansel) {
+		ifconvert(fn);
+		fillcfg(fn);
+		filluse(fn);
+		filldom(fn);
+		ssacheck(fn);
+	}
+	T.abi1(fn);
+	simpl(fn);
+	fillcfg(fn);
+	filluse(fn);
+	T.isel(fn);
+	fillcfg(fn);
+	filllive(fn);
+	fillloop(fn);
+	fillcost(fn);
+	spill(fn);
+	rega(fn);
+	fillcfg(fn);
+	simpljmp(fn);
+	fillcfg(fn);
+	assert(fn->rpo[0] == fn->start);
+	for (n=0;; n++)
+		if (n == fn->nblk-1) {
+			fn->rpo[n]->link = 0;
+			break;
+		} else
+			fn->rpo[n]->link = fn->rpo[n+1];
+	if (!dbg) {
+		T.emitfn(fn, outf);
+		fprintf(outf, "/* end function %s */\n\n", fn->name);
+	} else
+		fprintf(stderr, "\n");
+	freeall();
+}
+
+static void
+dbgfile(char *fn)
+{
+	emitdbgfile(fn, outf);
+}
+
+/* a null name selects the host default */
+int
+qbe_target(char *name)
+{
+	Target **t;
+
+	if (!name) {
+		T = Deftgt;
+		return 0;
+	}
+	for (t=tlist; *t; t++)
+		if (strcmp(name, (*t)->name) == 0) {
+			T = **t;
+			return 0;
+		}
+	return -1;
+}
+
+int
+qbe_model(char *name)
+{
+	int m;
+
+	for (m=0; mmodels[m].name; m++)
+		if (strcmp(name, mmodels[m].name) == 0) {
+			T.memmodel = mmodels[m].model;
+			return 0;
+		}
+	return -1;
+}
+
+/* split stack (SS != DS) is only meaningful for the
+ * i8086 far-data models, where every register-indirect
+ * near deref is stack-derived
+ */
+int
+qbe_splitstack()
+{
+	if (strcmp(T.name, "i8086") != 0
+	|| (T.memmodel != Mcompact && T.memmodel != Mlarge
+	    && T.memmodel != Mhuge))
+		return -1;
+	T.splitstack = 1;
+	return 0;
+}
+
+void
+qbe_debug(char *flags)
+{
+	for (; *flags; flags++)
+		if (isalpha(*flags)) {
+			debug[toupper(*flags)] = 1;
+			dbg = 1;
+		}
+}
+
+void
+qbe_begin(FILE *out)
+{
+	outf = out;
+	ndef = 0;
+}
+
+/* aggregate types are local to a unit; the unit can be
+ * fed in several pieces, each ending on a complete
+ * top-level definition
+ */
+void
+qbe_unit(char *path)
+{
+	parseinit(path);
+}
+
+void
+qbe_feed(FILE *in)
+{
+	parsefeed(in, dbgfile, data, func);
+}
+
+void
+qbe_feedmem(char *buf, size_t len)
+{
+	FILE *in;
+
+	if (!len)
+		return;
+	in = fmemopen(buf, len, "r");
+	if (!in)
+		die("fmemopen failed");
+	qbe_feed(in);
+	fclose(in);
+}
+
+void
+qbe_endunit()
+{
+	parsefini();
+}
+
+/* with force unset, the target trailer is only written
+ * when something was compiled, so that an empty unit
+ * gives an empty output
+ */
+void
+qbe_end(int force)
+{
+	if (!dbg && (ndef || force))
+		T.emitfin(outf);
+}
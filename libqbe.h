@@ -0,0 +1,30 @@
+/* libqbe.a: the qbe backend as a library
+ *
+ * A front end linked against libqbe.a compiles IL in
+ * its own process instead of writing a .ssa file for
+ * the qbe command:
+ *
+ *	qbe_target("i8086");
+ *	qbe_model("medium");
+ *	qbe_begin(stdout);
+ *	qbe_unit("file.c");
+ *	qbe_feedmem(buf, len);	(once per finished function)
+ *	qbe_endunit();
+ *	qbe_end(0);
+ *
+ * Every piece handed to qbe_feed or qbe_feedmem must
+ * end on a complete top-level definition; functions
+ * are compiled and emitted as soon as they are read.
+ * Errors in the IL are fatal, as in the qbe command.
+ */
+
+int qbe_target(char *);
+int qbe_model(char *);
+int qbe_splitstack(void);
+void qbe_debug(char *);
+void qbe_begin(FILE *);
+void qbe_unit(char *);
+void qbe_feed(FILE *);
+void qbe_feedmem(char *, size_t);
+void qbe_endunit(void);
+void qbe_end(int);
@@ -0,0 +1,564 @@
+#include "all.h"
+
+/* loop-invariant code motion
+ *
+ * loops are handled one per round, innermost
+ * first, and the cfg is rebuilt in between;
+ * in each loop:
+ *  - the invariant pure instructions and the
+ *    loads that nothing in the loop may write
+ *    move to the preheader;
+ *  - a global scalar that a call-free loop
+ *    reads and writes lives in a temporary,
+ *    loaded in the preheader and stored back
+ *    on the loop exits
+ */
+
+typedef struct Acc Acc;
+
+struct Acc {
+	Ins *i;
+	Ref ref; /* address */
+	int sz;
+	int st;  /* is a write */
+	int mem; /* 1 in the current candidate, 2 tried */
+};
+
+static Fn *curf;
+static int i8086;
+static Blk **lhd, **lbb; /* loopiter() pairs */
+static uint nlb;
+static Blk **body; /* the loop, in rpo order */
+static uint nbody;
+static Acc *acc;   /* its memory accesses */
+static uint nacc;
+static int *lpdef; /* temporaries defined in the loop */
+static uint nhoist, npromo;
+
+static void
+addlb(Blk *hd, Blk *b)
+{
+	vgrow(&lhd, ++nlb);
+	vgrow(&lbb, nlb);
+	lhd[nlb-1] = hd;
+	lbb[nlb-1] = b;
+}
+
+static int
+bidcmp(const void *a, const void *b)
+{
+	return (int)(*(Blk **)a)->id - (int)(*(Blk **)b)->id;
+}
+
+/* like alias(), but a direct access to a
+ * global stays within its object, so two
+ * distinct symbols do not overlap
+ */
+static int
+lalias(Ref p, int sp, Ref q, int sq, int *delta)
+{
+	Alias ap, aq;
+	int r;
+
+	r = alias(p, 0, sp, q, sq, delta, curf);
+	if (r == MayAlias) {
+		getalias(&ap, p, curf);
+		getalias(&aq, q, curf);
+		if (ap.type == ASym && aq.type == ASym
+		&& !symeq(ap.u.sym, aq.u.sym)
+		&& ap.offset >= 0 && aq.offset >= 0)
+			r = NoAlias;
+	}
+	return r;
+}
+
+static void
+addacc(Ins *i, Ref r, int sz, int st)
+{
+	vgrow(&acc, ++nacc);
+	acc[nacc-1] = (Acc){i, r, sz, st, 0};
+}
+
+/* collects the memory accesses of the loop;
+ * returns 2 if some instruction may touch
+ * any memory, 1 if there are calls, else 0
+ */
+static int
+scan(void)
+{
+	Blk *b;
+	Ins *i;
+	uint n;
+	int cl;
+
+	nacc = 0;
+	cl = 0;
+	for (n=0; n<nbody; n++) {
+		b = body[n];
+		for (i=b->ins; i<&b->ins[b->nins]; i++) {
+			if (iscall(i->op))
+				cl |= 1;
+			else if (i->op == Oasm
+			|| i->op == Ovastart || i->op == Ovaarg)
+				cl |= 2;
+			else if (isload(i->op))
+				addacc(i, i->arg[0], loadsz(i), 0);
+			else if (isloadfar(i->op))
+				addacc(i, i->arg[0], 4, 0);
+			else if (isstore(i->op))
+				addacc(i, i->arg[1], storesz(i), 1);
+			else if (i->op == Oblit1) {
+				assert(rtype(i->arg[0]) == RInt);
+				addacc(i-1, (i-1)->arg[0],
+					abs(rsval(i->arg[0])), 0);
+				addacc(i-1, (i-1)->arg[1],
+					abs(rsval(i->arg[0])), 1);
+			}
+		}
+	}
+	return cl > 1 ? 2 : cl;
+}
+
+static int
+invref(Ref r)
+{
+	return rtype(r) != RTmp || !lpdef[r.val];
+}
+
+/* a load can run in the preheader when
+ * nothing in the loop may write what it
+ * reads, and when it cannot fault there:
+ * it reads a global or the stack, or it
+ * runs on every way out of the loop (real
+ * mode has no memory protection, so any
+ * load is safe on i8086)
+ */
+static int
+canhoist(Ins *i, Blk *b, int cl, Blk **ex, uint nex)
+{
+	Alias a;
+	Acc *p;
+	uint n;
+	int sz, d;
+
+	if (!isload(i->op) || i->vol)
+		return 0;
+	getalias(&a, i->arg[0], curf);
+	/* on i8086, one instruction reads a global
+	 * or a frame slot, which is no dearer than
+	 * reloading the hoisted value once it
+	 * spills; wide values stay in slots there
+	 */
+	if (i8086)
+	if (i->cls != Kw || a.type == ASym || astack(a.type))
+		return 0;
+	if (cl == 2 || (cl == 1 && escapes(i->arg[0], curf)))
+		return 0;
+	sz = loadsz(i);
+	for (p=acc; p<&acc[nacc]; p++)
+		if (p->st)
+		if (lalias(i->arg[0], sz, p->ref, p->sz, &d) != NoAlias)
+			return 0;
+	if (!i8086 && a.type != ASym && !astack(a.type))
+		for (n=0; n<nex; n++)
+			if (!dom(b, ex[n]))
+				return 0;
+	return 1;
+}
+
+/* splits the edge b -> s */
+static Blk *
+split(Blk *b, Blk *s)
+{
+	Blk *e;
+	Phi *p;
+	uint n;
+
+	e = newblk();
+	e->loop = b->loop;
+	e->name = strf(PFn, "%s_%s", b->name, s->name);
+	e->jmp.type = Jjmp;
+	e->s1 = s;
+	vgrow(&e->pred, 1);
+	e->pred[0] = b;
+	e->npred = 1;
+	e->link = b->link;
+	b->link = e;
+	if (b->s1 == s)
+		b->s1 = e;
+	if (b->s2 == s)
+		b->s2 = e;
+	for (n=0; n<b->ntab; n++)
+		if (b->tab[n] == s)
+			b->tab[n] = e;
+	for (n=0; n<s->npred; n++)
+		if (s->pred[n] == b)
+			s->pred[n] = e;
+	for (p=s->phi; p; p=p->link)
+		for (n=0; n<p->narg; n++)
+			if (p->blk[n] == b)
+				p->blk[n] = e;
+	return e;
+}
+
+static void
+prepend(Blk *b, Ins *i)
+{
+	Ins *v;
+
+	v = vnew(b->nins+1, sizeof v[0], PFn);
+	v[0] = *i;
+	icpy(&v[1], b->ins, b->nins);
+	b->ins = v;
+	b->nins++;
+}
+
+/* the accesses of the loop to the global
+ * read or written by a0 are marked when
+ * they can all be kept in a temporary
+ */
+static int
+candidate(Acc *a0, int *pk, int *pst)
+{
+	Alias a;
+	Acc *p;
+	int d, nst, k, ok;
+
+	getalias(&a, a0->ref, curf);
+	if (a.type != ASym || a0->i->op == Oblit0)
+		return 0;
+	k = a0->sz > T.wordsz ? Kl : Kw;
+	if (a0->sz > 2*T.wordsz || (i8086 && k == Kl))
+		return 0;
+	ok = 1;
+	nst = 0;
+	for (p=acc; p<&acc[nacc]; p++) {
+		switch (lalias(a0->ref, a0->sz, p->ref, p->sz, &d)) {
+		case NoAlias:
+			continue;
+		case MustAlias:
+			if (d == 0 && p->sz == a0->sz)
+				break;
+			/* fall through */
+		default:
+			ok = 0;
+			continue;
+		}
+		p->mem = 1;
+		if (p->i->vol)
+			ok = 0;
+		else if (isload(p->i->op)) {
+			if (KBASE(p->i->cls) != 0)
+				ok = 0;
+		} else if (INRANGE(p->i->op, Ostoreb, Ostorel)) {
+			*pst = p->i->op;
+			nst++;
+		} else
+			ok = 0;
+	}
+	*pk = k;
+	return ok && nst > 0;
+}
+
+static int
+extop(Ins *i, int sz)
+{
+	if (sz == T.wordsz && i->cls == Kw)
+		return Ocopy;
+	if (sz == 2*T.wordsz && i->cls == Kl)
+		return Ocopy;
+	switch (i->op) {
+	case Oloadsb: return Oextsb;
+	case Oloadub: return Oextub;
+	case Oloadsh: return Oextsh;
+	case Oloaduh: return Oextuh;
+	case Oloadsw: return Oextsw;
+	case Oloaduw: return Oextuw;
+	}
+	return Ocopy;
+}
+
+/* rewrites the marked accesses of a0 to
+ * use a temporary, a phi is added to the
+ * header and to the join points
+ */
+static void
+promote1(Fn *fn, Blk *hd, Blk *pre, Acc *a0, int k, int st)
+{
+	Alias a;
+	Blk *b, *s, **eb, **es;
+	Phi **bp, *p;
+	Ref *out, adr, v0, cur, r;
+	Acc *q;
+	Ins ld, *i;
+	Con c;
+	uint n, m, ne;
+	int sz;
+
+	sz = a0->sz;
+	getalias(&a, a0->ref, fn);
+	memset(&c, 0, sizeof c);
+	c.type = CAddr;
+	c.sym = a.u.sym;
+	c.bits.i = a.offset;
+	adr = newcon(&c, fn);
+
+	v0 = newtmp("lp", k, fn);
+	ld = (Ins){.op = Oload, .cls = k, .to = v0, .arg = {adr, R}};
+	if (sz == 1)
+		ld.op = Oloadub;
+	else if (sz < T.wordsz)
+		ld.op = Oloaduh;
+	addins(&pre->ins, &pre->nins, &ld);
+
+	bp = emalloc(nbody * sizeof bp[0]);
+	out = emalloc(nbody * sizeof out[0]);
+	for (n=0; n<nbody; n++) {
+		b = body[n];
+		if (b != hd && b->npred == 1)
+			continue;
+		p = alloc(sizeof *p);
+		p->to = newtmp("lp", k, fn);
+		p->cls = k;
+		p->narg = b->npred;
+		p->arg = vnew(p->narg, sizeof p->arg[0], PFn);
+		p->blk = vnew(p->narg, sizeof p->blk[0], PFn);
+		p->link = b->phi;
+		b->phi = p;
+		bp[n] = p;
+	}
+
+	q = acc;
+	for (n=0; n<nbody; n++) {
+		b = body[n];
+		if (bp[n])
+			cur = bp[n]->to;
+		else
+			cur = out[b->pred[0]->visit - 1];
+		for (; q<&acc[nacc] && b->ins<=q->i && q->i<&b->ins[b->nins]; q++) {
+			if (q->mem != 1)
+				continue;
+			q->mem = 2;
+			i = q->i;
+			if (isstore(i->op)) {
+				r = i->arg[0];
+				if (rtype(r) == RTmp && fn->tmp[r.val].cls != k) {
+					cur = newtmp("lp", k, fn);
+					*i = (Ins){.op = Ocopy, .cls = k,
+						.to = cur, .arg = {r, R}};
+				} else {
+					cur = r;
+					*i = (Ins){.op = Onop};
+				}
+			} else {
+				i->op = extop(i, sz);
+				i->arg[0] = cur;
+				i->arg[1] = R;
+			}
+		}
+		out[n] = cur;
+	}
+
+	for (n=0; n<nbody; n++) {
+		if (!(p = bp[n]))
+			continue;
+		b = body[n];
+		for (m=0; m<b->npred; m++) {
+			p->blk[m] = b->pred[m];
+			if (b->pred[m]->visit)
+				p->arg[m] = out[b->pred[m]->visit - 1];
+			else
+				p->arg[m] = v0;
+		}
+	}
+
+	/* store back on the exit edges */
+	eb = vnew(0, sizeof eb[0], PHeap);
+	es = vnew(0, sizeof es[0], PHeap);
+	ne = 0;
+	for (n=0; n<nbody; n++)
+		for (m=0; (s=nextsucc(body[n], &m));)
+			if (!s->visit) {
+				vgrow(&eb, ++ne);
+				vgrow(&es, ne);
+				eb[ne-1] = body[n];
+				es[ne-1] = s;
+			}
+	for (m=0; m<ne; m++) {
+		b = eb[m];
+		s = es[m];
+		if (s->npred != 1)
+			s = split(b, s);
+		ld = (Ins){.op = st, .arg = {out[b->visit - 1], adr}};
+		prepend(s, &ld);
+	}
+	vfree(eb);
+	vfree(es);
+	free(bp);
+	free(out);
+	npromo++;
+}
+
+static void
+doloop(Fn *fn, Blk *hd)
+{
+	Blk *b, *s, *pre, **ex;
+	Phi *p;
+	Ins *i, *hv;
+	Acc *a0;
+	uint n, m, nex, nh;
+	int cl, k, st;
+
+	for (b=fn->start; b; b=b->link)
+		b->visit = 0;
+	for (n=0; n<nbody; n++)
+		body[n]->visit = n+1;
+	pre = 0;
+	for (n=0; n<hd->npred; n++)
+		if (!hd->pred[n]->visit) {
+			if (pre)
+				return;
+			pre = hd->pred[n];
+		}
+	if (!pre)
+		return;
+
+	/* the loop must be entered through
+	 * its header only and have an exit
+	 */
+	ex = vnew(0, sizeof ex[0], PHeap);
+	nex = 0;
+	for (n=0; n<nbody; n++) {
+		b = body[n];
+		if (b != hd) {
+			if (!dom(hd, b))
+				goto Out;
+			for (m=0; m<b->npred; m++)
+				if (!b->pred[m]->visit)
+					goto Out;
+		}
+		for (m=0; (s=nextsucc(b, &m));)
+			if (!s->visit) {
+				vgrow(&ex, ++nex);
+				ex[nex-1] = b;
+				break;
+			}
+	}
+	if (nex == 0)
+		goto Out;
+
+	lpdef = emalloc(fn->ntmp * sizeof lpdef[0]);
+	for (n=0; n<nbody; n++) {
+		b = body[n];
+		for (p=b->phi; p; p=p->link)
+			lpdef[p->to.val] = 1;
+		for (i=b->ins; i<&b->ins[b->nins]; i++)
+			if (rtype(i->to) == RTmp)
+				lpdef[i->to.val] = 1;
+	}
+	cl = scan();
+
+	hv = vnew(0, sizeof hv[0], PHeap);
+	nh = 0;
+	for (n=0; n<nbody; n++) {
+		b = body[n];
+		for (i=b->ins; i<&b->ins[b->nins]; i++) {
+			if (rtype(i->to) != RTmp
+			|| !invref(i->arg[0]) || !invref(i->arg[1]))
+				continue;
+			if (pinned(i) && !canhoist(i, b, cl, ex, nex))
+				continue;
+			if (isload(i->op))
+				nhoist++;
+			addins(&hv, &nh, i);
+			lpdef[i->to.val] = 0;
+			*i = (Ins){.op = Onop};
+		}
+	}
+	free(lpdef);
+
+	if (nh && (pre->s1 != hd || pre->s2 || pre->ntab))
+		pre = split(pre, hd);
+	for (n=0; n<nh; n++)
+		addins(&pre->ins, &pre->nins, &hv[n]);
+	vfree(hv);
+
+	if (cl == 0)
+		for (a0=acc; a0<&acc[nacc]; a0++) {
+			if (a0->mem)
+				continue;
+			if (candidate(a0, &k, &st)) {
+				if (pre->s1 != hd || pre->s2 || pre->ntab)
+					pre = split(pre, hd);
+				promote1(fn, hd, pre, a0, k, st);
+			}
+			for (n=0; n<nacc; n++)
+				if (acc[n].mem == 1)
+					acc[n].mem = 2;
+		}
+Out:
+	vfree(ex);
+}
+
+/* requires rpo pred ssa
+ * maintains rpo pred dom ssa
+ * breaks use alias
+ */
+void
+licm(Fn *fn)
+{
+	Blk **done, *hd;
+	uint n, m, ndone;
+
+	curf = fn;
+	i8086 = strcmp(T.name, "i8086") == 0;
+	nhoist = npromo = 0;
+	lhd = vnew(0, sizeof lhd[0], PHeap);
+	lbb = vnew(0, sizeof lbb[0], PHeap);
+	body = vnew(0, sizeof body[0], PHeap);
+	acc = vnew(0, sizeof acc[0], PHeap);
+	done = vnew(0, sizeof done[0], PHeap);
+	ndone = 0;
+	for (;;) {
+		fillcfg(fn);
+		filldom(fn);
+		nlb = 0;
+		loopiter(fn, addlb);
+		/* inner loops have later headers */
+		hd = 0;
+		for (n=0; n<nlb; n++) {
+			if (hd && lhd[n]->id <= hd->id)
+				continue;
+			for (m=0; m<ndone; m++)
+				if (done[m] == lhd[n])
+					break;
+			if (m == ndone)
+				hd = lhd[n];
+		}
+		if (!hd)
+			break;
+		vgrow(&done, ++ndone);
+		done[ndone-1] = hd;
+		nbody = 0;
+		for (n=0; n<nlb; n++)
+			if (lhd[n] == hd) {
+				vgrow(&body, ++nbody);
+				body[nbody-1] = lbb[n];
+			}
+		qsort(body, nbody, sizeof body[0], bidcmp);
+		fillalias(fn);
+		doloop(fn, hd);
+	}
+	vfree(lhd);
+	vfree(lbb);
+	vfree(body);
+	vfree(acc);
+	vfree(done);
+
+	if (debug['M']) {
+		fprintf(stderr, "\n> After loop-invariant code motion:\n");
+		fprintf(stderr, "\thoisted loads: %u\n", nhoist);
+		fprintf(stderr, "\tpromoted globals: %u\n", npromo);
+		printfn(fn, stderr);
+	}
+}
@@ -38,9 +38,10 @@ bset(Ref r, Blk *b, int *nlv, Tmp *tmp)
 void
 filllive(Fn *f)
 {
-	Blk *b;
+	Blk *b, *s;
 	Ins *i;
 	int k, t, m[2], n, chg, nlv[2];
+	uint j;
 	BSet u[1], v[1];
 	Mem *ma;
 
@@ -57,12 +58,8 @@ Again:
 		b = f->rpo[n];
 
 		bscopy(u, b->out);
-		if (b->s1) {
-			liveon(v, b, b->s1);
-			bsunion(b->out, v);
-		}
-		if (b->s2) {
-			liveon(v, b, b->s2);
+		for (j=0; (s=nextsucc(b, &j));) {
+			liveon(v, b, s);
 			bsunion(b->out, v);
 		}
 		chg |= !bsequal(b->out, u);
@@ -1,166 +1,24 @@
 #include "all.h"
-#include "config.h"
-#include <ctype.h>
+#include "libqbe.h"
 #ifdef DOS
 #include "dosgetopt.h"
 #else
 #include <getopt.h>
 #endif
 
-Target T;
-
-char debug['Z'+1] = {
-	['P'] = 0, /* parsing */
-	['M'] = 0, /* memory optimization */
-	['N'] = 0, /* ssa construction */
-	['C'] = 0, /* copy elimination */
-	['G'] = 0, /* gvn/gcm */
-	['K'] = 0, /* if-conversion */
-	['A'] = 0, /* abi lowering */
-	['I'] = 0, /* instruction selection */
-	['L'] = 0, /* liveness */
-	['S'] = 0, /* spilling */
-	['R'] = 0, /* reg. allocation */
-};
-
-extern Target T_amd64_sysv;
-extern Target T_amd64_apple;
-extern Target T_amd64_win;
-extern Target T_arm64;
-extern Target T_arm64_apple;
-extern Target T_rv64;
-extern Target T_i8086;
-
-static Target *tlist[] = {
-	&T_amd64_sysv,
-	&T_amd64_apple,
-	&T_amd64_win,
-	&T_arm64,
-	&T_arm64_apple,
-	&T_rv64,
-	&T_i8086,
-	0
-};
-static FILE *outf;
-static int dbg;
-
-/* Memory model names for command line */
-static struct {
-	char *name;
-	enum MemModel model;
-} mmodels[] = {
-	{ "tiny",    Mtiny },
-	{ "small",   Msmall },
-	{ "medium",  Mmedium },
-	{ "compact", Mcompact },
-	{ "large",   Mlarge },
-	{ "huge",    Mhuge },
-	{ 0, 0 }
-};
-
-static void
-data(Dat *d)
-{
-	if (dbg)
-		return;
-	emitdat(d, outf);
-	if (d->type == DEnd) {
-		fputs("/* end data */\n\n", outf);
-		freeall();
-	}
-}
-
-static void
-func(Fn *fn)
-{
-	uint n;
-
-	if (dbg)
-		fprintf(stderr, "**** Function %s ****", fn->name);
-	if (debug['P']) {
-		fprintf(stderr, "\n> After parsing:\n");
-		printfn(fn, stderr);
-	}
-	T.abi0(fn);
-	fillcfg(fn);
-	filluse(fn);
-	asmvol(fn);   /* keep inline-asm operand slots in memory (before markvol) */
-	markvol(fn);  /* propagate C volatile from allocs to their loads/stores */
-	promote(fn);
-	filluse(fn);
-	ssa(fn);
-	filluse(fn);
-	ssacheck(fn);
-	fillalias(fn);
-	loadopt(fn);
-	filluse(fn);
-	fillalias(fn);
-	coalesce(fn);
-	filluse(fn);
-	filldom(fn);
-	ssacheck(fn);
-	gvn(fn);
-	fillcfg(fn);
-	simplcfg(fn);
-	filluse(fn);
-	filldom(fn);
-	gcm(fn);
-	filluse(fn);
-	ssacheck(fn);
-	if (T.cansel) {
-		ifconvert(fn);
-		fillcfg(fn);
-		filluse(fn);
-		filldom(fn);
-		ssacheck(fn);
-	}
-	T.abi1(fn);
-	simpl(fn);
-	fillcfg(fn);
-	filluse(fn);
-	T.isel(fn);
-	fillcfg(fn);
-	filllive(fn);
-	fillloop(fn);
-	fillcost(fn);
-	spill(fn);
-	rega(fn);
-	fillcfg(fn);
-	simpljmp(fn);
-	fillcfg(fn);
-	assert(fn->rpo[0] == fn->start);
-	for (n=0;; n++)
-		if (n == fn->nblk-1) {
-			fn->rpo[n]->link = 0;
-			break;
-		} else
-			fn->rpo[n]->link = fn->rpo[n+1];
-	if (!dbg) {
-		T.emitfn(fn, outf);
-		fprintf(outf, "/* end function %s */\n\n", fn->name);
-	} else
-		fprintf(stderr, "\n");
-	freeall();
-}
-
-static void
-dbgfile(char *fn)
-{
-	emitdbgfile(fn, outf);
-}
-
 int
 main(int ac, char *av[])
 {
 	Target **t;
-	FILE *inf, *hf;
-	char *f, *sep;
-	int c, m;
-	enum MemModel memmodel = Mflat; /* Will be set properly after target selection */
-	int splitstack = 0;
+	FILE *inf, *outf, *hf;
+	char *f, *sep, *model, *deftgt;
+	int c, splitstack;
 
-	T = Deftgt;
+	qbe_target(0);
+	deftgt = T.name;
 	outf = stdout;
+	model = 0;
+	splitstack = 0;
 	while ((c = getopt(ac, av, "hd:m:o:st:")) != -1)
 		switch (c) {
 		case 's':
@@ -169,25 +27,12 @@ main(int ac, char *av[])
 			splitstack = 1;
 			break;
 		case 'd':
-			for (; *optarg; optarg++)
-				if (isalpha(*optarg)) {
-					debug[toupper(*optarg)] = 1;
-					dbg = 1;
-				}
+			qbe_debug(optarg);
 			break;
 		case 'm':
-			/* Memory model selection (for 8086 target) */
-			for (m=0;; m++) {
-				if (!mmodels[m].name) {
-					fprintf(stderr, "unknown memory model '%s'\n", optarg);
-					fprintf(stderr, "valid models: tiny, small, medium, compact, large, huge\n");
-					exit(1);
-				}
-				if (strcmp(optarg, mmodels[m].name) == 0) {
-					memmodel = mmodels[m].model;
-					break;
-				}
-			}
+			/* Memory model selection (for 8086 target),
+			 * applied after target selection */
+			model = optarg;
 			break;
 		case 'o':
 			if (strcmp(optarg, "-") != 0) {
@@ -203,15 +48,9 @@ main(int ac, char *av[])
 				puts(T.name);
 				exit(0);
 			}
-			for (t=tlist;; t++) {
-				if (!*t) {
-					fprintf(stderr, "unknown target '%s'\n", optarg);
-					exit(1);
-				}
-				if (strcmp(optarg, (*t)->name) == 0) {
-					T = **t;
-					break;
-				}
+			if (qbe_target(optarg) < 0) {
+				fprintf(stderr, "unknown target '%s'\n", optarg);
+				exit(1);
 			}
 			break;
 		case 'h':
@@ -224,7 +63,7 @@ main(int ac, char *av[])
 			fprintf(hf, "\t%-11s ", "");
 			for (t=tlist, sep=""; *t; t++, sep=", ") {
 				fprintf(hf, "%s%s", sep, (*t)->name);
-				if (*t == &Deftgt)
+				if (strcmp((*t)->name, deftgt) == 0)
 					fputs(" (default)", hf);
 			}
 			fprintf(hf, "\n");
@@ -236,26 +75,26 @@ main(int ac, char *av[])
 		}
 
 	/* Apply memory model if specified */
-	if (memmodel != Mflat) {
+	if (model) {
 		if (strcmp(T.name, "i8086") != 0) {
 			fprintf(stderr, "warning: memory model only applies to i8086 target\n");
 		}
-		T.memmodel = memmodel;
+		if (qbe_model(model) < 0) {
+			fprintf(stderr, "unknown memory model '%s'\n", model);
+			fprintf(stderr, "valid models: tiny, small, medium, compact, large, huge\n");
+			exit(1);
+		}
 	}
 
 	/* Apply split-stack: only meaningful for i8086 far-data models,
 	 * where every register-indirect near deref is stack-derived. */
-	if (splitstack) {
-		if (strcmp(T.name, "i8086") != 0
-		    || (T.memmodel != Mcompact && T.memmodel != Mlarge
-		        && T.memmodel != Mhuge)) {
-			fprintf(stderr, "error: -s (split stack) requires "
-			        "-t i8086 with -m compact/large/huge\n");
-			exit(1);
-		}
-		T.splitstack = 1;
+	if (splitstack && qbe_splitstack() < 0) {
+		fprintf(stderr, "error: -s (split stack) requires "
+		        "-t i8086 with -m compact/large/huge\n");
+		exit(1);
 	}
 
+	qbe_begin(outf);
 	do {
 		f = av[optind];
 		if (!f || strcmp(f, "-") == 0) {
@@ -268,12 +107,13 @@ main(int ac, char *av[])
 				exit(1);
 			}
 		}
-		parse(inf, f, dbgfile, data, func);
+		qbe_unit(f);
+		qbe_feed(inf);
+		qbe_endunit();
 		fclose(inf);
 	} while (++optind < ac);
 
-	if (!dbg)
-		T.emitfin(outf);
+	qbe_end(1);
 
 	exit(0);
 }
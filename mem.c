@@ -3,6 +3,7 @@
 typedef struct Range Range;
 typedef struct Store Store;
 typedef struct Slot Slot;
+typedef struct Acc Acc;
 
 /* C volatile: minic marks only the `alloc` of a volatile object with the
  * vol bit.  Propagate it to every load/store that addresses the alloc slot
@@ -99,6 +100,30 @@ asmvol(Fn *fn)
 		}
 }
 
+/* try to turn a load from a slot holding a value of
+ * class k into a copy so we can eliminate it later */
+static void
+ldcopy(Ins *l, int k)
+{
+	switch(l->op) {
+	case Oloadsw:
+	case Oloaduw:
+		if (k == Kl)
+			goto Extend;
+		/* fall through */
+	case Oload:
+		if (KBASE(k) != KBASE(l->cls))
+			l->op = Ocast;
+		else
+			l->op = Ocopy;
+		break;
+	default:
+	Extend:
+		l->op = Oextsb + (l->op - Oloadsb);
+		break;
+	}
+}
+
 /* require use, maintains use counts */
 void
 promote(Fn *fn)
@@ -169,25 +194,7 @@ promote(Fn *fn)
 				if (k == -1)
 					err("slot %%%s is read but never stored to",
 						fn->tmp[l->arg[0].val].name);
-				/* try to turn loads into copies so we
-				 * can eliminate them later */
-				switch(l->op) {
-				case Oloadsw:
-				case Oloaduw:
-					if (k == Kl)
-						goto Extend;
-					/* fall through */
-				case Oload:
-					if (KBASE(k) != KBASE(l->cls))
-						l->op = Ocast;
-					else
-						l->op = Ocopy;
-					break;
-				default:
-				Extend:
-					l->op = Oextsb + (l->op - Oloadsb);
-					break;
-				}
+				ldcopy(l, k);
 			}
 		}
 	Skip:;
@@ -198,6 +205,158 @@ promote(Fn *fn)
 	}
 }
 
+struct Acc {
+	Ins *i;
+	int64_t off;
+	int sz; /* 0 for an address computation */
+};
+
+/* the field accesses by offset, then the address computations */
+static int
+acccmp(const void *pa, const void *pb)
+{
+	const Acc *a, *b;
+
+	a = pa, b = pb;
+	if (!a->sz != !b->sz)
+		return !a->sz - !b->sz;
+	if (a->off != b->off)
+		return a->off < b->off ? -1 : 1;
+	return 0;
+}
+
+/* collect the accesses through r, which points off bytes
+ * into a slot; fails unless every use of r is a load, a
+ * store to r, or an add of a constant that only has such
+ * uses in turn */
+static int
+sraccess(Ref r, int64_t off, Acc **pa, uint *pn, Fn *fn)
+{
+	Tmp *t;
+	Use *u;
+	Ins *l;
+	int64_t o;
+	int sz;
+
+	t = &fn->tmp[r.val];
+	if (t->ndef != 1)
+		return 0;
+	for (u=t->use; u<&t->use[t->nuse]; u++) {
+		if (u->type != UIns)
+			return 0;
+		l = u->u.ins;
+		if (l->vol)
+			return 0;
+		if (isload(l->op))
+			sz = loadsz(l);
+		else if (INRANGE(l->op, Ostoreb, Ostored)
+		&& req(l->arg[1], r) && !req(l->arg[0], r))
+			sz = storesz(l);
+		else if (l->op == Oadd && rtype(l->to) == RTmp
+		&& (req(l->arg[0], r) ? isconbits(fn, l->arg[1], &o)
+		    : isconbits(fn, l->arg[0], &o))) {
+			if (!sraccess(l->to, off + o, pa, pn, fn))
+				return 0;
+			sz = 0;
+		} else
+			return 0;
+		vgrow(pa, ++*pn);
+		(*pa)[*pn-1] = (Acc){l, off, sz};
+	}
+	return 1;
+}
+
+/* class of the values stored in the field at f */
+static int
+srcls(Acc *f, Acc *fe)
+{
+	Acc *g;
+	int k;
+
+	k = -1;
+	for (g=f; g<fe && g->off == f->off; g++)
+		if (isstore(g->i->op)) {
+			if (k != -1 && k != optab[g->i->op].argcls[0][0])
+				return -2;
+			k = optab[g->i->op].argcls[0][0];
+		}
+	return k;
+}
+
+/* scalar replacement: a stack slot that promote() left
+ * alone because it is addressed at constant offsets (a
+ * small struct accessed by fields) becomes one temporary
+ * per offset, provided the accesses at an offset all have
+ * the same size and stored class, and stay clear of the
+ * next offset; require use, breaks use */
+void
+scalarize(Fn *fn)
+{
+	Blk *b;
+	Ins *i, *l;
+	Acc *a, *f, *g, *fe;
+	Ref r;
+	uint n, nf;
+	int64_t sz;
+	int k;
+
+	if (calls_setjmp(fn))
+		return;
+	a = vnew(0, sizeof a[0], PHeap);
+	b = fn->start;
+	for (i=b->ins; i<&b->ins[b->nins]; i++) {
+		if (!isalloc(i->op) || i->vol)
+			continue;
+		if (rtype(i->to) != RTmp || !isconbits(fn, i->arg[0], &sz))
+			continue;
+		n = 0;
+		if (!sraccess(i->to, 0, &a, &n, fn))
+			continue;
+		qsort(a, n, sizeof a[0], acccmp);
+		for (nf=0; nf<n && a[nf].sz; nf++)
+			;
+		if (nf == 0)
+			continue;
+		fe = &a[nf];
+		for (f=a; f<fe; f=g) {
+			if (f->off < 0 || f->off + f->sz > sz)
+				goto Skip;
+			if (srcls(f, fe) < 0)
+				goto Skip;
+			for (g=f; g<fe && g->off == f->off; g++)
+				if (g->sz != f->sz)
+					goto Skip;
+			if (g < fe && g->off < f->off + f->sz)
+				goto Skip;
+		}
+		for (f=a; f<fe; f=g) {
+			k = srcls(f, fe);
+			r = newtmp("sra", k, fn);
+			for (g=f; g<fe && g->off == f->off; g++) {
+				l = g->i;
+				if (isstore(l->op)) {
+					l->cls = k;
+					l->op = Ocopy;
+					l->to = r;
+					l->arg[1] = R;
+				} else {
+					l->arg[0] = r;
+					ldcopy(l, k);
+				}
+			}
+		}
+		for (f=fe; f<&a[n]; f++)
+			*f->i = (Ins){.op = Onop};
+		*i = (Ins){.op = Onop};
+	Skip:;
+	}
+	vfree(a);
+	if (debug['M']) {
+		fprintf(stderr, "\n> After scalar replacement:\n");
+		printfn(fn, stderr);
+	}
+}
+
 /* [a, b) with 0 <= a */
 struct Range {
 	int a, b;
@@ -314,7 +473,7 @@ coalesce(Fn *fn)
 {
 	Range r, *br;
 	Slot *s, *s0, *sl;
-	Blk *b, **ps, *succ[3];
+	Blk *b, *sb;
 	Ins *i, **bl;
 	Use *u;
 	Tmp *t, *ts;
@@ -322,7 +481,7 @@ coalesce(Fn *fn)
 	bits x;
 	int64_t off0, off1;
 	int n, m, ip, sz, nsl, nbl, *stk;
-	uint total, freed, fused;
+	uint total, freed, fused, j;
 
 	/* minimize the stack usage
 	 * by coalescing slots
@@ -362,14 +521,11 @@ coalesce(Fn *fn)
 	ip = INT_MAX - 1;
 	for (n=fn->nblk-1; n>=0; n--) {
 		b = fn->rpo[n];
-		succ[0] = b->s1;
-		succ[1] = b->s2;
-		succ[2] = 0;
 		br[n].b = ip--;
 		for (s=sl; s<&sl[nsl]; s++) {
 			s->l = 0;
-			for (ps=succ; *ps; ps++) {
-				m = (*ps)->id;
+			for (j=0; (sb=nextsucc(b, &j));) {
+				m = sb->id;
 				if (m > n && rin(s->r, br[m].a)) {
 					s->l = s->m;
 					radd(&s->r, ip);
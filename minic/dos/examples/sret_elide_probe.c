@@ -0,0 +1,137 @@
+/*
+ * sret_elide_probe.c -- struct-return copy elision gate.
+ *
+ * `x = f(...)` passes x's own address as f's hidden return pointer, and
+ * `return f(...)` in a struct-returning function forwards its caller's
+ * hidden pointer, so neither copies through a temporary slot any more
+ * (see sret_into in minic.y).  Elision rests on the callee writing
+ * through the hidden pointer only in its final `return` copy; these
+ * cases pin the shapes where the destination is also read by the call:
+ *
+ *   1. The destination passed by address (`x = swap(&x)`).
+ *   2. The destination passed by value (`x = bump(x)`, `x = sum(x, x)`).
+ *   3. Struct-returning calls as the arguments (`x = sum(mk(), fw())`).
+ *   4. Forwarding through a direct and an indirect call.
+ *   5. A chained assignment (`z = y = mk()`).
+ *   6. A global destination (elided under near data only).
+ *   7. An odd-sized struct (byte tail) forwarded.
+ *
+ * Build:  tools/build-example.sh --model=medium minic/dos/examples/sret_elide_probe.c
+ * Verify: tools/run-dos-exe.sh build/examples/sret_elide_probe/sret_elide_probe.exe \
+ *             | diff - minic/dos/tests/sret_elide_probe.golden.txt
+ *
+ * Wired into tools/test-dos.sh (medium + compact).
+ */
+
+#include <stdio.h>
+
+struct Pt { int x; int y; int z; };
+struct Sm { int a; char b; };          /* 3 bytes -> byte tail */
+
+struct Pt g;
+struct Pt (*fp)(int, int);
+
+struct Pt
+mk(int a, int b)
+{
+	struct Pt p;
+	p.x = a;
+	p.y = b;
+	p.z = a + b;
+	return p;
+}
+
+struct Pt
+fw(int a)
+{
+	return mk(a, a + 1);
+}
+
+struct Pt
+fwi(int a)
+{
+	return (*fp)(a, 7);
+}
+
+struct Pt
+swap(struct Pt *p)
+{
+	struct Pt r;
+	r.x = p->y;
+	r.y = p->x;
+	r.z = p->z;
+	return r;
+}
+
+struct Pt
+bump(struct Pt v)
+{
+	v.x = v.x + 100;
+	return v;
+}
+
+struct Pt
+sum(struct Pt u, struct Pt v)
+{
+	struct Pt r;
+	r.x = u.x + v.x;
+	r.y = u.y + v.y;
+	r.z = u.z + v.z;
+	return r;
+}
+
+struct Sm
+msm(int a, int b)
+{
+	struct Sm s;
+	s.a = a;
+	s.b = (char)b;
+	return s;
+}
+
+struct Sm
+fsm(int a)
+{
+	return msm(a, 77);
+}
+
+int
+main(void)
+{
+	struct Pt x;
+	struct Pt y;
+	struct Pt z;
+	struct Sm s;
+
+	x = mk(1, 2);
+	x = swap(&x);
+	printf("swap=%d,%d,%d (want 2,1,3)\r\n", x.x, x.y, x.z);
+
+	x = bump(x);
+	printf("bump=%d,%d,%d (want 102,1,3)\r\n", x.x, x.y, x.z);
+	x = sum(x, x);
+	printf("self=%d,%d,%d (want 204,2,6)\r\n", x.x, x.y, x.z);
+
+	x = sum(mk(1, 1), fw(2));
+	printf("nest=%d,%d,%d (want 3,4,7)\r\n", x.x, x.y, x.z);
+
+	y = fw(5);
+	printf("fw=%d,%d,%d (want 5,6,11)\r\n", y.x, y.y, y.z);
+	fp = mk;
+	y = fwi(9);
+	printf("fwi=%d,%d,%d (want 9,7,16)\r\n", y.x, y.y, y.z);
+	y = (*fp)(4, 5);
+	printf("ind=%d,%d,%d (want 4,5,9)\r\n", y.x, y.y, y.z);
+
+	z = y = mk(10, 20);
+	printf("chain=%d,%d,%d,%d (want 10,20,20,30)\r\n", z.x, z.y, y.y, y.z);
+
+	g = mk(3, 4);
+	g = sum(g, mk(1, 1));
+	printf("glob=%d,%d,%d (want 4,5,9)\r\n", g.x, g.y, g.z);
+
+	s = fsm(1000);
+	printf("sm=%d,%d (want 1000,77)\r\n", s.a, s.b);
+
+	return 0;
+}
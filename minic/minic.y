@@ -4,21 +4,28 @@
 #include <stdio.h>
 #include <stdlib.h>
 #include <string.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <unistd.h>
+#ifdef LIBQBE
+#include "libqbe.h"
+#endif
 
 enum {
 	NString = 128,  /* max identifier length; MicroPython has 49-char names
 	                 * (e.g. MP_MAP_LOOKUP_ADD_IF_NOT_FOUND_OR_REMOVE_IF_FOUND)
 	                 * and longer generated qstr symbols. Host-only memory. */
-	NGlo = 512,
+	NGlo = 512,     /* initial size of the global tables; they grow */
 	/* varh[] is an open-addressing table holding all globals + enum
 	 * constants (never cleared) plus the current function's locals.
 	 * MicroPython pulls ~214 MP_QSTR_* enum constants from genhdr alone,
-	 * plus hundreds of `extern const mp_obj_type_t` globals, so 512
-	 * overflowed ("too many variables") on 62/132 spike files.  Keep the
-	 * load factor low for the linear-probe chain repair; host-only memory
-	 * (~140 B/slot).  A full REPL build generates still more qstrs. */
+	 * plus hundreds of `extern const mp_obj_type_t` globals, so it starts
+	 * at NVar slots and doubles whenever it gets half full.  NVar also
+	 * sizes fnproto[] and the hash() range.  Host-only memory. */
 	NVar = 4096,
 	NStr = 256,
+	NAddrLbl = 512,  /* `&&label`s per function; MicroPython's vm.c
+	                  * dispatch takes the address of ~100 */
 };
 
 enum { /* minic types */
@@ -351,18 +358,28 @@ int cur_fn_labelid = 0;     /* Bumped once per emitted function body.  C `goto`
                              * `too_short:` in py/runtime.c) then collide at the
                              * assembler.  Suffixing every user label with this
                              * id (`@user_<name>_F<id>`) makes them unique. */
-char *ini[NGlo];
-char gloname[NGlo][NString];  /* Real C name for each global slot — used to
+/* Labels of the current function whose address is taken
+ * with `&&name`, in order of first use.  The value of
+ * `&&name` is its index here plus one, and `goto *e`
+ * becomes a QBE jtab over the list, so label values are
+ * small integers rather than code addresses: they are the
+ * same in every memory model and need no relocation when
+ * stored in a static table. */
+char addrlbl[NAddrLbl][NString];
+int naddrlbl;
+int addrlbl_fn;  /* cur_fn_labelid that addrlbl[] belongs to */
+char **ini;
+char (*gloname)[NString];  /* Real C name for each global slot — used to
                                * emit `data $foo = ...` instead of $glo1 so
                                * cross-translation-unit linkage uses the
                                * source-level identifier. */
-char glosec[NGlo][NString];   /* Optional section override for each global.
+char (*glosec)[NString];      /* Optional section override for each global.
                                * Used by huge memory model to route arrays
                                * larger than 64K into per-symbol segments
                                * (`_HUGE_<sym>`) that the linker keeps out
                                * of DGROUP; asm_to_omf.py picks these up
                                * via `.section "_HUGE_<sym>"` markers. */
-char glostatic[NGlo];         /* 1 = internal linkage (C `static` file-scope
+char *glostatic;              /* 1 = internal linkage (C `static` file-scope
                                * data, or a mangled function-local static):
                                * emitted as plain `data` (no .globl).  0 =
                                * external linkage: emitted as `export data`
@@ -381,10 +398,14 @@ void
 glo_mark_static_range(int start)
 {
 	int i;
-	for (i = start; i < nglo && i < NGlo; i++)
+	for (i = start; i < nglo; i++)
 		glostatic[i] = 1;
 }
-struct {
+
+/* The global tables above have room for nglocap slots; see glogrow(). */
+int nglocap;
+
+struct Var {
 	char v[NString];
 	unsigned ctyp;
 	int glo;
@@ -414,7 +435,13 @@ struct {
 	                    * alloc is emitted with the QBE `volatile` keyword, so
 	                    * the backend's markvol pass keeps all its loads/stores
 	                    * (no promote/forward/elide/reorder).  See [[minic-volatile]]. */
-} varh[NVar];
+} *varh;
+unsigned nvarh;      /* varh[] size, a power of two (0 until first use) */
+unsigned varhused;   /* live entries */
+/* Names added to varh[] as locals since the last varclr(), so that the
+ * function-exit reset deletes just those instead of sweeping the table. */
+char (*varlocal)[NString];
+int nvarlocal, varlocalsz;
 
 /* Per-function parameter-type table, for argument coercion at call sites.
  * C11 6.5.2.2p4: when a prototype is in scope, each argument is converted
@@ -502,7 +529,7 @@ int g_td_fpid = -1;  /* fn-ptr proto index of the typedef the lexer last
                       * reset like g_td_arraydim so it never leaks forward. */
 
 /* Struct/union member */
-enum { NMember = 256 };
+enum { NMember = 16 };  /* initial members[] size; grows */
 struct Member {
 	char name[NString];
 	unsigned ctyp;
@@ -517,22 +544,35 @@ struct Member {
 };
 
 /* Struct/union definition table.  minic is a host-compiled tool (runs on
- * the build machine, not on DOS), so this is sized for real translation
- * units: preprocessed MicroPython headers define well over 64 aggregate
- * types in a single TU. */
-enum { NStruct = 256 };
-struct {
+ * the build machine, not on DOS), and preprocessed MicroPython headers
+ * define well over 64 aggregate types in a single TU, so structh[] and
+ * each members[] grow as needed.  Tags are found through structtab[] and
+ * members through membtab[] (see structfind, structfindmember). */
+enum { NStruct = 256 };  /* initial structh[] size; grows */
+struct Aggr {
 	char name[NString];
 	int isunion;  /* 1 for union, 0 for struct */
 	int nmembers;
-	struct Member members[NMember];  /* Max NMember members per struct */
+	int nmemberscap;          /* members[] size */
+	struct Member *members;
 	int size;
 	int align;        /* §4g: struct alignment = max member alignment (1 under
 	                   * NEAR_DATA, so medium stays byte-identical/packed). */
 	int curbfoffset;  /* Current bit offset for bitfield packing */
 	int curbfbase;    /* Byte offset of current bitfield storage unit */
 	int forward;      /* 1 = forward/incomplete (tag known, body not yet defined) */
-} structh[NStruct];
+} *structh;
+int nstructcap;       /* structh[] size */
+int *structtab;       /* tag hash: structh index + 1, or 0 if empty */
+unsigned nstructtab;  /* structtab[] size, a power of two */
+/* (struct, member name) hash over every members[] array.  An entry is
+ * only trusted once it is checked against the member it points at, so
+ * resetting a struct's nmembers needs no cleanup here. */
+struct {
+	int sidx;
+	int mnum;  /* member index + 1, 0 in an empty slot */
+} *membtab;
+unsigned nmembtab, membused;
 int nstruct = 0;
 int curstruct = -1;  /* Index of struct currently being defined */
 int parentstruct = -1;  /* Parent struct for anonymous members (legacy, unused) */
@@ -554,7 +594,7 @@ die(char *s)
 	exit(1);
 }
 
-void *
+static void *
 alloc(size_t s)
 {
 	void *p;
@@ -565,65 +605,555 @@ alloc(size_t s)
 	return p;
 }
 
-unsigned
-hash(char *s)
+static void *
+ralloc(void *p, size_t s)
+{
+	p = realloc(p, s);
+	if (!p)
+		die("out of memory");
+	return p;
+}
+
+/* Every site that fills global slot nglo calls glogrow() first.  New
+ * slots read as zero, as the old fixed-size arrays did. */
+void
+glogrow()
+{
+	int n;
+
+	if (nglo < nglocap)
+		return;
+	n = nglocap ? 2 * nglocap : NGlo;
+	ini = ralloc(ini, n * sizeof ini[0]);
+	gloname = ralloc(gloname, n * sizeof gloname[0]);
+	glosec = ralloc(glosec, n * sizeof glosec[0]);
+	glostatic = ralloc(glostatic, n * sizeof glostatic[0]);
+	memset(&ini[nglocap], 0, (n - nglocap) * sizeof ini[0]);
+	memset(&gloname[nglocap], 0, (n - nglocap) * sizeof gloname[0]);
+	memset(&glosec[nglocap], 0, (n - nglocap) * sizeof glosec[0]);
+	memset(&glostatic[nglocap], 0, (n - nglocap) * sizeof glostatic[0]);
+	nglocap = n;
+}
+
+static unsigned
+strhash(char *s)
 {
 	unsigned h;
 
 	h = 42;
 	while (*s)
 		h += 11 * h + *s++;
-	return h % NVar;
+	return h;
+}
+
+static unsigned
+hash(char *s)
+{
+	return strhash(s) % NVar;
+}
+
+/* strhash() with its bits mixed, for the power-of-two tables: the low
+ * bits of strhash() depend on little more than the last few characters,
+ * so names like MP_QSTR_foo_1 .. MP_QSTR_foo_999 would pile up. */
+static unsigned
+symhash(char *s)
+{
+	unsigned h;
+
+	h = strhash(s);
+	h ^= h >> 16;
+	h *= 0x45d9f3b;
+	h ^= h >> 16;
+	return h;
+}
+
+/* of collects the IL of one function at a time in memory;
+ * ilsave files it in ilfn[] when the body is closed.  Once the
+ * whole file is parsed, ilemit writes the functions and data
+ * out in their original order, less the internal-linkage ones
+ * (C `static', string literals) that nothing kept refers to:
+ * the `static inline' helpers of every included header would
+ * otherwise go through the backend in every file. */
+static char *ilbuf;
+static size_t illen;
+
+static struct Ilfn {
+	char *text;
+	size_t len;
+	char *name;	/* 0 if the text is not a single function */
+	int isstatic;
+} *ilfn;
+static int nilfn, ilfncap;
+
+static void
+ilopen()
+{
+	of = open_memstream(&ilbuf, &illen);
+	if (!of)
+		die("cannot open the IL buffer");
+}
+
+static void
+ilsave()
+{
+	struct Ilfn *f;
+	char *p, *q;
+
+	fclose(of);
+	if (illen) {
+		if (nilfn == ilfncap) {
+			ilfncap = ilfncap ? 2 * ilfncap : 64;
+			ilfn = ralloc(ilfn, ilfncap * sizeof ilfn[0]);
+		}
+		f = &ilfn[nilfn++];
+		f->text = ilbuf;
+		f->len = illen;
+		f->name = 0;
+		f->isstatic = 0;
+		p = ilbuf;
+		if (strncmp(p, "export ", 7) != 0)
+			f->isstatic = 1;
+		else
+			p += 7;
+		if (strncmp(p, "interrupt ", 10) == 0)
+			p += 10;
+		if (strncmp(p, "function ", 9) == 0
+		&& (p = strchr(p, '$')) && (q = strchr(p, '('))
+		&& !memchr(p, '\n', q - p)) {
+			f->name = alloc(q - p);
+			memcpy(f->name, p + 1, q - p - 1);
+			f->name[q - p - 1] = 0;
+		} else
+			f->isstatic = 0;
+	} else
+		free(ilbuf);
+	ilopen();
+}
+
+/* Reachability over ilfn[] (nodes 0..nilfn-1) and the global
+ * data slots (node nilfn+i for slot i), by name.  ilpin marks
+ * the nodes an inline asm string names. */
+static char **ilname;
+static int *iltab, iltabsz;
+static char *ilkeep, *ilpin;
+static int *ilstk, nilstk;
+
+/* Node named s[0..len), or -1. */
+static int
+ilfind(char *s, int len)
+{
+	char name[NString];
+	unsigned h;
+	int n;
+
+	if (len >= NString)
+		return -1;
+	memcpy(name, s, len);
+	name[len] = 0;
+	for (h = symhash(name);; h++) {
+		n = iltab[h & (iltabsz - 1)];
+		if (n < 0 || strcmp(ilname[n], name) == 0)
+			return n;
+	}
+}
+
+static void
+ilref(char *s, int len, int inasm)
+{
+	int n;
+
+	n = ilfind(s, len);
+	if (n < 0)
+		return;
+	if (inasm)
+		ilpin[n] = 1;
+	if (!ilkeep[n]) {
+		ilkeep[n] = 1;
+		ilstk[nilstk++] = n;
+	}
+}
+
+#define ILWORD(c) (isalnum((unsigned char)(c)) || (c) == '_' || (c) == '.')
+
+/* Mark what the IL text p..e refers to: every $name, and every
+ * word of an inline asm string, which may name a symbol bare
+ * or with the assembler's leading underscore. */
+static void
+ilrefs(char *p, char *e)
+{
+	char *w;
+	int inasm;
+
+	inasm = 0;
+	while (p < e) {
+		if (*p == '\n') {
+			p++;
+			inasm = e - p > 6 && strncmp(p, "\tasm \"", 6) == 0;
+			continue;
+		}
+		if (*p == '$' || (inasm && ILWORD(*p) && !ILWORD(p[-1]))) {
+			if (*p == '$')
+				p++;
+			for (w = p; p < e && ILWORD(*p); p++)
+				;
+			ilref(w, p - w, inasm);
+			if (inasm && *w == '_')
+				ilref(w + 1, p - w - 1, inasm);
+			continue;
+		}
+		p++;
+	}
+}
+
+/* The string literal pool.  A kept literal whose bytes end
+ * another kept literal (a copy of it, or "error" against
+ * "parse error") is not emitted; references to it point into
+ * the other one instead: slot i lives in slot ilown[i] at byte
+ * ilofs[i], and ilown[i] == i for the literals that are
+ * written out. */
+static struct Strlit {
+	int slot;
+	int len;
+	unsigned char *s;
+} *ilstr;
+static int nilstr;
+static int *ilown, *ilofs;
+
+int strlit_bytelen(int);
+static int strlit_decode(int, unsigned char *, int);
+
+/* Whether slot i is a string literal the pool can take: a
+ * single `{ b "...", b 0 }` string whose escapes mean the
+ * same to strlit_decode and to the assemblers. */
+static int
+strlitok(int i)
+{
+	char *s;
+	int k;
+
+	if (gloname[i][0] || glosec[i][0])
+		return 0;
+	s = ini[i];
+	if (strncmp(s, "{ b \"", 5) != 0)
+		return 0;
+	for (s += 5; *s != '"'; s++) {
+		if (*s == 0)
+			return 0;
+		if (*s != '\\')
+			continue;
+		s++;
+		if (*s == 'x') {
+			for (k = 0; isxdigit((unsigned char)s[1]); k++)
+				s++;
+			if (k == 0 || k > 2)
+				return 0;
+		} else if (*s >= '0' && *s <= '7') {
+			for (k = 1; k < 3 && s[1] >= '0' && s[1] <= '7'; k++)
+				s++;
+		} else if (!strchr("ntrabfv\\\"'?", *s) || *s == 0)
+			return 0;
+	}
+	return strcmp(s, "\", b 0 }") == 0;
+}
+
+/* Order by the bytes read from the end, a literal before the
+ * ones that end it, copies by slot. */
+static int
+strlitcmp(const void *a, const void *b)
+{
+	const struct Strlit *x = a, *y = b;
+	int i;
+
+	for (i = 1; i <= x->len && i <= y->len; i++)
+		if (x->s[x->len - i] != y->s[y->len - i])
+			return y->s[y->len - i] - x->s[x->len - i];
+	if (x->len != y->len)
+		return y->len - x->len;
+	return x->slot - y->slot;
+}
+
+/* Fill ilown[] and ilofs[] for the kept literals.  After the
+ * sort, each literal is either the end of the last one written
+ * out or starts a new group.  A literal an asm string names is
+ * always written out. */
+static void
+ilpool()
+{
+	struct Strlit *l, *o;
+	int i, merged, saved;
+
+	ilown = alloc(nglo * sizeof ilown[0]);
+	ilofs = alloc(nglo * sizeof ilofs[0]);
+	ilstr = alloc(nglo * sizeof ilstr[0]);
+	nilstr = 0;
+	for (i = 0; i < nglo; i++) {
+		ilown[i] = i;
+		ilofs[i] = 0;
+		if (i == 0 || !ilkeep[nilfn + i] || !strlitok(i))
+			continue;
+		l = &ilstr[nilstr++];
+		l->slot = i;
+		l->len = strlit_bytelen(i) - 1;
+		l->s = alloc(l->len + 1);
+		if (strlit_decode(i, l->s, l->len) != l->len)
+			die("string literal pool: bad literal");
+	}
+	qsort(ilstr, nilstr, sizeof ilstr[0], strlitcmp);
+	o = 0;
+	merged = saved = 0;
+	for (l = ilstr; l < &ilstr[nilstr]; l++) {
+		if (o && l->len <= o->len && !ilpin[nilfn + l->slot]
+		&& memcmp(l->s, o->s + o->len - l->len, l->len) == 0) {
+			ilown[l->slot] = o->slot;
+			ilofs[l->slot] = o->len - l->len;
+			merged++;
+			saved += l->len + 1;
+		} else if (!o || l->len > o->len
+		|| memcmp(l->s, o->s + o->len - l->len, l->len) != 0)
+			o = l;
+	}
+	if (merged)
+		fprintf(of, "# string pool: %d of %d literals merged, "
+			"%d bytes saved\n\n", merged, nilstr, saved);
+}
+
+/* Write the IL text p..e, pointing the references to pooled
+ * literals at the slot that holds them.  Quoted strings are
+ * copied as they are. */
+static void
+ilput(char *p, char *e)
+{
+	char *w;
+	int n, off;
+
+	while (p < e) {
+		for (w = p; w < e && *w != '$' && *w != '"'; w++)
+			;
+		if (w < e && *w == '"')
+			for (w++; w < e && *w != '"'; w++)
+				if (*w == '\\')
+					w++;
+		if (w >= e || *w == '"') {
+			if (w < e)
+				w++;
+			fwrite(p, 1, w - p, of);
+			p = w;
+			continue;
+		}
+		fwrite(p, 1, w - p, of);
+		for (p = ++w; p < e && ILWORD(*p); p++)
+			;
+		n = ilfind(w, p - w) - nilfn;
+		if (n <= 0 || ilown[n] == n) {
+			fwrite(w - 1, 1, p - w + 1, of);
+			continue;
+		}
+		off = ilofs[n];
+		if (p < e && *p == '+')
+			off += strtol(p + 1, &p, 10);
+		fprintf(of, "$glo%d", ilown[n]);
+		if (off)
+			fprintf(of, "+%d", off);
+	}
+}
+
+/* Write out the file's functions and data, dropping the
+ * internal-linkage ones that no exported function or data,
+ * and nothing they reach, refers to.  A data slot with an
+ * explicit section is always kept.  String literals go
+ * through the pool and need no alignment. */
+static void
+ilemit()
+{
+	int n, i;
+	unsigned h;
+	char *t;
+
+	n = nilfn + nglo;
+	for (iltabsz = 16; iltabsz < 2 * n; iltabsz *= 2)
+		;
+	iltab = alloc(iltabsz * sizeof iltab[0]);
+	memset(iltab, -1, iltabsz * sizeof iltab[0]);
+	ilname = alloc(n * sizeof ilname[0]);
+	ilkeep = alloc(n);
+	memset(ilkeep, 0, n);
+	ilpin = alloc(n);
+	memset(ilpin, 0, n);
+	ilstk = alloc(n * sizeof ilstk[0]);
+	nilstk = 0;
+	for (i = 0; i < n; i++) {
+		if (i < nilfn) {
+			ilname[i] = ilfn[i].name;
+			if (!ilfn[i].isstatic) {
+				ilkeep[i] = 1;
+				ilstk[nilstk++] = i;
+			}
+		} else if (i > nilfn) {
+			t = gloname[i - nilfn];
+			if (t[0] == 0) {
+				t = alloc(16);
+				sprintf(t, "glo%d", i - nilfn);
+			} else if (!glostatic[i - nilfn] || glosec[i - nilfn][0]) {
+				ilkeep[i] = 1;
+				ilstk[nilstk++] = i;
+			}
+			ilname[i] = t;
+		} else
+			ilname[i] = 0;
+		if (!ilname[i])
+			continue;
+		for (h = symhash(ilname[i]); iltab[h & (iltabsz - 1)] >= 0; h++)
+			;
+		iltab[h & (iltabsz - 1)] = i;
+	}
+	while (nilstk) {
+		i = ilstk[--nilstk];
+		if (i < nilfn)
+			ilrefs(ilfn[i].text, ilfn[i].text + ilfn[i].len);
+		else
+			ilrefs(ini[i - nilfn], ini[i - nilfn] + strlen(ini[i - nilfn]));
+	}
+	ilpool();
+
+	for (i = 0; i < nilfn; i++)
+		if (ilkeep[i])
+			ilput(ilfn[i].text, ilfn[i].text + ilfn[i].len);
+	for (i=1; i<nglo; i++) {
+		if (!ilkeep[nilfn + i] || ilown[i] != i)
+			continue;
+		if (glosec[i][0] != 0)
+			fprintf(of, "section \"%s\" ", glosec[i]);
+		if (gloname[i][0] != 0)
+			/* C file-scope data has external linkage unless declared
+			 * `static`; `export` makes qbe emit `.globl _name`, which
+			 * asm_to_omf.py now treats as authoritative for data
+			 * publics (it used to auto-promote every data label) —
+			 * §6b.  Anonymous $glo<N> slots (string literals) stay
+			 * module-local. */
+			fprintf(of, "%sdata $%s = ",
+				glostatic[i] ? "" : "export ", gloname[i]);
+		else
+			fprintf(of, "data $glo%d = %s", i,
+				strlitok(i) ? "align 1 " : "");
+		ilput(ini[i], ini[i] + strlen(ini[i]));
+		fputc('\n', of);
+	}
+}
+
+/* Close the body of the function being emitted. */
+void
+fnend()
+{
+	fprintf(of, "}\n\n");
+	ilsave();
+}
+
+/* Index of `v' in varh[], or -1. */
+static int
+varslot(char *v)
+{
+	unsigned m, h;
+
+	if (!nvarh)
+		return -1;
+	m = nvarh - 1;
+	for (h = symhash(v) & m; varh[h].v[0]; h = (h+1) & m)
+		if (strcmp(varh[h].v, v) == 0)
+			return h;
+	return -1;
+}
+
+/* Claim an empty slot for `v', doubling varh[] once it is half full.
+ * The caller fills in the entry. */
+static struct Var *
+varnew(char *v)
+{
+	struct Var *old;
+	unsigned n, m, h, i;
+
+	if (2 * (varhused + 1) > nvarh) {
+		old = varh;
+		n = nvarh;
+		nvarh = n ? 2 * n : NVar;
+		varh = alloc(nvarh * sizeof varh[0]);
+		m = nvarh - 1;
+		for (h = 0; h < nvarh; h++)
+			varh[h].v[0] = 0;
+		for (i = 0; i < n; i++)
+			if (old[i].v[0]) {
+				for (h = symhash(old[i].v) & m; varh[h].v[0]; h = (h+1) & m)
+					;
+				varh[h] = old[i];
+			}
+		free(old);
+	}
+	m = nvarh - 1;
+	for (h = symhash(v) & m; varh[h].v[0]; h = (h+1) & m)
+		;
+	varhused++;
+	memset(&varh[h], 0, sizeof varh[h]);
+	strcpy(varh[h].v, v);
+	return &varh[h];
+}
+
+/* Empty slot `h' and slide later members of its probe run back over the
+ * gap, so a lookup never stops early at the hole. */
+static void
+vardel(unsigned h)
+{
+	unsigned m, i, hi;
+
+	m = nvarh - 1;
+	varh[h].v[0] = 0;
+	varhused--;
+	for (i = (h+1) & m; varh[i].v[0]; i = (i+1) & m) {
+		hi = symhash(varh[i].v) & m;
+		if (h < i ? (hi <= h || hi > i) : (hi <= h && hi > i)) {
+			varh[h] = varh[i];
+			varh[i].v[0] = 0;
+			h = i;
+		}
+	}
+}
+
+/* Remember `v' as a function-scope name for varclr(). */
+static void
+varlog(char *v)
+{
+	if (nvarlocal == varlocalsz) {
+		varlocalsz = varlocalsz ? 2 * varlocalsz : 256;
+		varlocal = ralloc(varlocal, varlocalsz * sizeof varlocal[0]);
+	}
+	strcpy(varlocal[nvarlocal++], v);
 }
 
 void
 varclr()
 {
-	unsigned h;
+	int i, h;
 
 	/* Drop any inner-block renames left over from the previous function
 	 * (defensive — a well-formed body pops them all at its closing }). */
 	renamestksp = 0;
 
-	for (h=0; h<NVar; h++)
-		if ((!varh[h].glo && !varh[h].enumconst) || varh[h].isstaticlocal)
-			varh[h].v[0] = 0;
-
-	/* Linear-probe chain repair: a freshly emptied slot can sit between
-	 * a hash bucket and entries that probed past it.  Lookup by name
-	 * stops at the empty slot and falsely reports "undefined", which
-	 * showed up after a function with many locals when a later global
-	 * collided with one of those locals.  Walk the table from each
-	 * empty slot, sliding live entries back into earlier positions if
-	 * their hash bucket lies on or before the gap. */
-	for (h = 0; h < NVar; h++) {
-		if (varh[h].v[0] == 0) {
-			unsigned i = (h + 1) % NVar;
-			while (varh[i].v[0] != 0) {
-				unsigned hi = hash(varh[i].v);
-				int between;
-				if (h < i)
-					between = (hi <= h || hi > i);
-				else
-					between = (hi <= h && hi > i);
-				if (between) {
-					varh[h] = varh[i];
-					varh[i].v[0] = 0;
-					h = i;
-				}
-				i = (i + 1) % NVar;
-				if (i == h)
-					break;
-			}
-		}
+	/* Locals and static locals never share a name with a live global
+	 * (block_scope_rename mangles them), so the function scope is just
+	 * the names logged since the last call.  An enum declared inside
+	 * the function logs its constants too, but they stay. */
+	for (i = 0; i < nvarlocal; i++) {
+		h = varslot(varlocal[i]);
+		if (h >= 0
+		&& ((!varh[h].glo && !varh[h].enumconst) || varh[h].isstaticlocal))
+			vardel(h);
 	}
+	nvarlocal = 0;
 }
 
 void
 varadd(char *v, int glo, unsigned ctyp, int isarray)
 {
-	unsigned h0, h;
-	int vol;
+	struct Var *p;
+	int h, vol;
 
 	/* Consume the pending `volatile` qualifier exactly once per declarator
 	 * (reset so a non-volatile sibling/next declaration can't inherit it).
@@ -637,59 +1167,55 @@ varadd(char *v, int glo, unsigned ctyp, int isarray)
 	g_decl_volatile = 0;
 	ctyp &= ~QVOLATILE;
 
-	h0 = hash(v);
-	h = h0;
-	do {
-		if (varh[h].v[0] == 0) {
-			strcpy(varh[h].v, v);
-			varh[h].glo = glo;
-			varh[h].ctyp = ctyp;
-			varh[h].enumconst = (glo == -2) ? 1 : 0;
-			varh[h].isarray = isarray;
-			varh[h].isextern = 0;
-			varh[h].isstaticlocal = 0;
-			varh[h].arraybytes = 0;
-			varh[h].aoa_dim = 0;
-			varh[h].istentative = 0;
-			varh[h].fpid = -1;
-			varh[h].isvolatile = vol;
-			return;
-		}
-		if (strcmp(varh[h].v, v) == 0) {
-			/* Allow definition after extern declaration */
-			if (varh[h].isextern && glo > 0) {
-				varh[h].glo = glo;  /* Update to actual glo value */
-				varh[h].isextern = 0;  /* Now it's a real definition */
-				return;
-			}
-			/* Allow definition after function prototype with the same type:
-			 * `char *foo(int);` followed later by `char *foo(int x) { ... }`. */
-			if (KIND(varh[h].ctyp) == FUN && KIND(ctyp) == FUN &&
-			    varh[h].ctyp == ctyp)
-				return;
-			/* Permit re-declaration of a same-typed local in a nested
-			 * block.  Stevie does this in distinct for-bodies:
-			 *   for (...) { LPTR *pos; ... }
-			 *   for (...) { LPTR *pos; ... }
-			 * QBE accepts the duplicate alloc (it isn't strict-SSA on
-			 * input); the second decl effectively rebinds %name.
-			 * Different-typed re-declaration across sibling blocks
-			 * (e.g. MicroPython's `{const byte *t;}` then `{size_t
-			 * t;}`) is handled *before* reaching varadd, by
-			 * block_scope_decl() — it alpha-renames the new declarator
-			 * so the two bindings stay distinct.  By the time a
-			 * different-typed name reaches varadd unrenamed, it is a
-			 * genuine redefinition. */
-			if (glo == 0 && varh[h].glo == 0 && !varh[h].isextern &&
-			    !varh[h].enumconst && varh[h].ctyp == ctyp) {
-				varh[h].isarray = isarray;
-				return;
-			}
-			die("double definition");
-		}
-		h = (h+1) % NVar;
-	} while(h != h0);
-	die("too many variables");
+	h = varslot(v);
+	if (h < 0) {
+		p = varnew(v);
+		p->glo = glo;
+		p->ctyp = ctyp;
+		p->enumconst = (glo == -2) ? 1 : 0;
+		p->isarray = isarray;
+		p->isextern = 0;
+		p->isstaticlocal = 0;
+		p->arraybytes = 0;
+		p->aoa_dim = 0;
+		p->istentative = 0;
+		p->fpid = -1;
+		p->isvolatile = vol;
+		if (glo == 0)
+			varlog(v);
+		return;
+	}
+	p = &varh[h];
+	/* Allow definition after extern declaration */
+	if (p->isextern && glo > 0) {
+		p->glo = glo;  /* Update to actual glo value */
+		p->isextern = 0;  /* Now it's a real definition */
+		return;
+	}
+	/* Allow definition after function prototype with the same type:
+	 * `char *foo(int);` followed later by `char *foo(int x) { ... }`. */
+	if (KIND(p->ctyp) == FUN && KIND(ctyp) == FUN &&
+	    p->ctyp == ctyp)
+		return;
+	/* Permit re-declaration of a same-typed local in a nested
+	 * block.  Stevie does this in distinct for-bodies:
+	 *   for (...) { LPTR *pos; ... }
+	 *   for (...) { LPTR *pos; ... }
+	 * QBE accepts the duplicate alloc (it isn't strict-SSA on
+	 * input); the second decl effectively rebinds %name.
+	 * Different-typed re-declaration across sibling blocks
+	 * (e.g. MicroPython's `{const byte *t;}` then `{size_t
+	 * t;}`) is handled *before* reaching varadd, by
+	 * block_scope_decl() — it alpha-renames the new declarator
+	 * so the two bindings stay distinct.  By the time a
+	 * different-typed name reaches varadd unrenamed, it is a
+	 * genuine redefinition. */
+	if (glo == 0 && p->glo == 0 && !p->isextern &&
+	    !p->enumconst && p->ctyp == ctyp) {
+		p->isarray = isarray;
+		return;
+	}
+	die("double definition");
 }
 
 /* Return the active mangled name for a source identifier, or NULL.  The
@@ -727,40 +1253,31 @@ rename_pop_closed(void)
 char *
 block_scope_rename(char *v, unsigned ctyp, int isarray)
 {
-	unsigned h0, h;
-
-	h0 = hash(v);
-	h = h0;
-	do {
-		if (varh[h].v[0] == 0)
-			break;
-		if (strcmp(varh[h].v, v) == 0) {
-			/* Rename when the new local would collide with (a) a
-			 * same-named LOCAL of a different type (the original
-			 * §1k inner-block case), or (b) ANY global, extern,
-			 * function, or enum constant — C says a block-scope
-			 * declaration shadows the file-scope binding (§6a:
-			 * newlibc vfs_open has a local `fat_mount` next to the
-			 * file-scope function fat_mount()). */
-			if ((varh[h].glo == 0 && !varh[h].isextern &&
-			    !varh[h].enumconst &&
-			    (varh[h].ctyp != ctyp || varh[h].isarray != isarray))
-			    || varh[h].glo != 0 || varh[h].isextern
-			    || varh[h].enumconst) {
-				if (renamestksp >= NRename)
-					die("too many block-scoped renames");
-				sprintf(renamestk[renamestksp].mangled,
-					"%s$%d", v, ++rename_serial);
-				strcpy(renamestk[renamestksp].canon, v);
-				renamestk[renamestksp].depth = brace_depth;
-				strcpy(v, renamestk[renamestksp].mangled);
-				renamestksp++;
-				return v;
-			}
-			break;
-		}
-		h = (h+1) % NVar;
-	} while (h != h0);
+	struct Var *p;
+	int h;
+
+	h = varslot(v);
+	if (h < 0)
+		return v;
+	p = &varh[h];
+	/* Rename when the new local would collide with (a) a same-named
+	 * LOCAL of a different type (the original §1k inner-block case),
+	 * or (b) ANY global, extern, function, or enum constant — C says a
+	 * block-scope declaration shadows the file-scope binding (§6a:
+	 * newlibc vfs_open has a local `fat_mount` next to the file-scope
+	 * function fat_mount()). */
+	if ((p->glo == 0 && !p->isextern && !p->enumconst &&
+	    (p->ctyp != ctyp || p->isarray != isarray))
+	    || p->glo != 0 || p->isextern || p->enumconst) {
+		if (renamestksp >= NRename)
+			die("too many block-scoped renames");
+		sprintf(renamestk[renamestksp].mangled,
+			"%s$%d", v, ++rename_serial);
+		strcpy(renamestk[renamestksp].canon, v);
+		renamestk[renamestksp].depth = brace_depth;
+		strcpy(v, renamestk[renamestksp].mangled);
+		renamestksp++;
+	}
 	return v;
 }
 
@@ -773,8 +1290,8 @@ block_scope_decl(Node *node, unsigned ctyp, int isarray)
 void
 varaddextern(char *v, unsigned ctyp, int isarray)
 {
-	unsigned h0, h;
-	int vol;
+	struct Var *p;
+	int h, vol;
 
 	/* Consume the pending `volatile` qualifier (set by the VOLATILE type
 	 * productions) just like varadd, so `extern volatile int g;` marks the
@@ -785,43 +1302,144 @@ varaddextern(char *v, unsigned ctyp, int isarray)
 	g_decl_volatile = 0;
 	ctyp &= ~QVOLATILE;
 
-	h0 = hash(v);
-	h = h0;
-	do {
-		if (varh[h].v[0] == 0) {
-			strcpy(varh[h].v, v);
-			varh[h].glo = 1;  /* Mark as global */
-			varh[h].ctyp = ctyp;
-			varh[h].enumconst = 0;
-			varh[h].isarray = isarray;
-			varh[h].isextern = 1;  /* Mark as extern */
-			varh[h].isstaticlocal = 0;
-			varh[h].isvolatile = vol;
-			return;
-		}
-		if (strcmp(varh[h].v, v) == 0) {
-			/* Allow multiple extern declarations, or extern after definition */
-			if (varh[h].isextern || varh[h].glo == 1) {
-				varh[h].isvolatile |= vol;  /* upgrade if any decl is volatile */
-				return;  /* Already declared/defined */
-			}
-			die("double definition");
-		}
-		h = (h+1) % NVar;
-	} while(h != h0);
-	die("too many variables");
+	h = varslot(v);
+	if (h < 0) {
+		p = varnew(v);
+		p->glo = 1;  /* Mark as global */
+		p->ctyp = ctyp;
+		p->enumconst = 0;
+		p->isarray = isarray;
+		p->isextern = 1;  /* Mark as extern */
+		p->isstaticlocal = 0;
+		p->isvolatile = vol;
+		return;
+	}
+	p = &varh[h];
+	/* Allow multiple extern declarations, or extern after definition */
+	if (p->isextern || p->glo == 1) {
+		p->isvolatile |= vol;  /* upgrade if any decl is volatile */
+		return;  /* Already declared/defined */
+	}
+	die("double definition");
 }
 
 int
 structfind(char *name)
 {
+	unsigned m, h;
+
+	if (!nstructtab)
+		return -1;
+	m = nstructtab - 1;
+	for (h = symhash(name) & m; structtab[h]; h = (h+1) & m)
+		if (strcmp(structh[structtab[h]-1].name, name) == 0)
+			return structtab[h] - 1;
+	return -1;
+}
+
+/* Append a zeroed struct/union entry for tag `name' and return its index;
+ * the caller fills in the rest.  structfind(name) must have failed. */
+static int
+structnew(char *name)
+{
+	unsigned m, h;
 	int i;
-	for (i = 0; i < nstruct; i++)
-		if (strcmp(structh[i].name, name) == 0)
+
+	if (nstruct == nstructcap) {
+		nstructcap = nstructcap ? 2 * nstructcap : NStruct;
+		structh = ralloc(structh, nstructcap * sizeof structh[0]);
+	}
+	if (2 * (nstruct + 1) > nstructtab) {
+		nstructtab = nstructtab ? 2 * nstructtab : 2 * NStruct;
+		free(structtab);
+		structtab = alloc(nstructtab * sizeof structtab[0]);
+		memset(structtab, 0, nstructtab * sizeof structtab[0]);
+		m = nstructtab - 1;
+		for (i = 0; i < nstruct; i++) {
+			for (h = symhash(structh[i].name) & m; structtab[h]; h = (h+1) & m)
+				;
+			structtab[h] = i + 1;
+		}
+	}
+	i = nstruct++;
+	memset(&structh[i], 0, sizeof structh[i]);
+	strcpy(structh[i].name, name);
+	m = nstructtab - 1;
+	for (h = symhash(name) & m; structtab[h]; h = (h+1) & m)
+		;
+	structtab[h] = i + 1;
+	return i;
+}
+
+static unsigned
+membhash(int sidx, char *name)
+{
+	return symhash(name) ^ (unsigned)sidx * 2654435761u;
+}
+
+/* Find a member by name in a struct, returns member index or -1 if not found */
+int
+structfindmember(int sidx, char *name)
+{
+	unsigned m, h;
+	int i;
+
+	if (!nmembtab)
+		return -1;
+	m = nmembtab - 1;
+	for (h = membhash(sidx, name) & m; membtab[h].mnum; h = (h+1) & m) {
+		i = membtab[h].mnum - 1;
+		if (membtab[h].sidx == sidx && i < structh[sidx].nmembers
+		&& strcmp(structh[sidx].members[i].name, name) == 0)
 			return i;
+	}
 	return -1;
 }
 
+static void
+membput(int sidx, int i)
+{
+	unsigned m, h;
+
+	m = nmembtab - 1;
+	h = membhash(sidx, structh[sidx].members[i].name) & m;
+	while (membtab[h].mnum)
+		h = (h+1) & m;
+	membtab[h].sidx = sidx;
+	membtab[h].mnum = i + 1;
+	membused++;
+}
+
+/* Claim members[nmembers] of struct `sidx' for `name', zeroed, and index
+ * it.  The caller fills in the rest and bumps nmembers. */
+static struct Member *
+structnewmember(int sidx, char *name)
+{
+	struct Aggr *a;
+	int i, j;
+
+	a = &structh[sidx];
+	if (a->nmembers == a->nmemberscap) {
+		a->nmemberscap = a->nmemberscap ? 2 * a->nmemberscap : NMember;
+		a->members = ralloc(a->members, a->nmemberscap * sizeof a->members[0]);
+	}
+	if (2 * (membused + 1) > nmembtab) {
+		free(membtab);
+		nmembtab = nmembtab ? 2 * nmembtab : 1024;
+		membtab = alloc(nmembtab * sizeof membtab[0]);
+		memset(membtab, 0, nmembtab * sizeof membtab[0]);
+		membused = 0;
+		for (i = 0; i < nstruct; i++)
+			for (j = 0; j < structh[i].nmembers; j++)
+				membput(i, j);
+	}
+	i = a->nmembers;
+	memset(&a->members[i], 0, sizeof a->members[i]);
+	strcpy(a->members[i].name, name);
+	membput(sidx, i);
+	return &a->members[i];
+}
+
 /* Extract the actual string content from a string literal (stored in ini[] with QBE format)
  * Format is: { b "actual string", b 0 }
  * We skip 5 chars prefix and 8 chars suffix
@@ -872,11 +1490,7 @@ structadd(char *name, int isunion)
 		return idx;
 	}
 
-	if (nstruct >= NStruct)
-		die("too many struct/union definitions");
-
-	idx = nstruct++;
-	strcpy(structh[idx].name, name);
+	idx = structnew(name);
 	structh[idx].isunion = isunion;
 	structh[idx].nmembers = 0;
 	structh[idx].size = 0;
@@ -900,11 +1514,7 @@ structadd_forward(char *name, int isunion)
 	if (idx >= 0)
 		return idx;
 
-	if (nstruct >= NStruct)
-		die("too many struct/union definitions");
-
-	idx = nstruct++;
-	strcpy(structh[idx].name, name);
+	idx = structnew(name);
 	structh[idx].isunion = isunion;
 	structh[idx].nmembers = 0;
 	structh[idx].size = 0;
@@ -953,24 +1563,18 @@ structfinish(int idx)
 void
 structaddmember(int sidx, char *name, unsigned ctyp)
 {
-	int i;
 	int malign;
 	struct Member *m;
 
-	if (structh[sidx].nmembers >= NMember)
-		die("too many members in struct/union");
-
 	/* Check for duplicate member names */
-	for (i = 0; i < structh[sidx].nmembers; i++)
-		if (strcmp(structh[sidx].members[i].name, name) == 0)
-			die("duplicate member name");
+	if (structfindmember(sidx, name) >= 0)
+		die("duplicate member name");
 
 	/* Non-bitfield member resets bitfield packing state */
 	structh[sidx].curbfoffset = 0;
 	structh[sidx].curbfbase = 0;
 
-	m = &structh[sidx].members[structh[sidx].nmembers];
-	strcpy(m->name, name);
+	m = structnewmember(sidx, name);
 	m->ctyp = ctyp;
 	/* A `volatile` member captures its qualifier in m->ctyp's QVOLATILE
 	 * bit (from the `VOLATILE T` type production), so the g_decl_volatile
@@ -1010,21 +1614,17 @@ structaddmember(int sidx, char *name, unsigned ctyp)
 void
 structaddarrmember(int sidx, char *name, unsigned ctyp, int count)
 {
-	int i, total;
+	int total;
 	int malign;
 	struct Member *m;
 
-	if (structh[sidx].nmembers >= NMember)
-		die("too many members in struct/union");
-	for (i = 0; i < structh[sidx].nmembers; i++)
-		if (strcmp(structh[sidx].members[i].name, name) == 0)
-			die("duplicate member name");
+	if (structfindmember(sidx, name) >= 0)
+		die("duplicate member name");
 
 	structh[sidx].curbfoffset = 0;
 	structh[sidx].curbfbase = 0;
 
-	m = &structh[sidx].members[structh[sidx].nmembers];
-	strcpy(m->name, name);
+	m = structnewmember(sidx, name);
 	m->ctyp = ctyp;       /* Element type — accesses through s.arr[i] use this */
 	g_decl_volatile = 0;  /* see structaddmember: don't leak to the next decl */
 	m->bitwidth = 0;
@@ -1053,18 +1653,13 @@ structaddarrmember(int sidx, char *name, unsigned ctyp, int count)
 void
 structaddbitfield(int sidx, char *name, unsigned ctyp, int width)
 {
-	int i;
 	struct Member *m;
 	int unitsize;      /* Size of storage unit in bits */
 	int unitbytes;     /* Size of storage unit in bytes */
 
-	if (structh[sidx].nmembers >= NMember)
-		die("too many members in struct/union");
-
 	/* Check for duplicate member names */
-	for (i = 0; i < structh[sidx].nmembers; i++)
-		if (strcmp(structh[sidx].members[i].name, name) == 0)
-			die("duplicate member name");
+	if (structfindmember(sidx, name) >= 0)
+		die("duplicate member name");
 
 	/* Calculate storage unit size based on declared type */
 	unitbytes = SIZE(ctyp);
@@ -1090,8 +1685,7 @@ structaddbitfield(int sidx, char *name, unsigned ctyp, int width)
 		structh[sidx].size += unitbytes;
 	}
 
-	m = &structh[sidx].members[structh[sidx].nmembers];
-	strcpy(m->name, name);
+	m = structnewmember(sidx, name);
 	m->ctyp = ctyp;
 	g_decl_volatile = 0;  /* see structaddmember: don't leak to the next decl */
 	m->offset = structh[sidx].curbfbase;  /* Points to storage unit base */
@@ -1132,19 +1726,13 @@ hoistanonymous(int parent_sidx, int anon_sidx)
 	for (i = 0; i < structh[anon_sidx].nmembers; i++) {
 		struct Member *anon_mem = &structh[anon_sidx].members[i];
 		struct Member *parent_mem;
-		int j;
-
-		if (structh[parent_sidx].nmembers >= 16)
-			die("too many members in struct (from anonymous)");
 
 		/* Check for duplicate names in parent */
-		for (j = 0; j < structh[parent_sidx].nmembers; j++)
-			if (strcmp(structh[parent_sidx].members[j].name, anon_mem->name) == 0)
-				die("anonymous member name conflicts with parent");
+		if (structfindmember(parent_sidx, anon_mem->name) >= 0)
+			die("anonymous member name conflicts with parent");
 
 		/* Add member to parent */
-		parent_mem = &structh[parent_sidx].members[structh[parent_sidx].nmembers];
-		strcpy(parent_mem->name, anon_mem->name);
+		parent_mem = structnewmember(parent_sidx, anon_mem->name);
 		parent_mem->ctyp = anon_mem->ctyp;
 		parent_mem->bitwidth = anon_mem->bitwidth;
 		parent_mem->bitoffset = anon_mem->bitoffset;
@@ -1176,17 +1764,6 @@ hoistanonymous(int parent_sidx, int anon_sidx)
 	}
 }
 
-/* Find a member by name in a struct, returns member index or -1 if not found */
-int
-structfindmember(int sidx, char *name)
-{
-	int i;
-	for (i = 0; i < structh[sidx].nmembers; i++)
-		if (strcmp(structh[sidx].members[i].name, name) == 0)
-			return i;
-	return -1;
-}
-
 void
 typhadd(char *v, unsigned ctyp)
 {
@@ -1284,24 +1861,14 @@ typhset_fpid(char *v, int fpid)
 	} while(h != h0);
 }
 
-/* Probe the symbol table for the array flag of a variable.  varh[]
- * uses linear probing, so the entry for `v` may be at hash(v)+k for
- * some k > 0; looking only at hash(v) misses collisions.  Return 0
- * if not found. */
+/* Array flag of variable `v', or 0 if not found. */
 int
 var_isarray(char *v)
 {
-	unsigned h0, h;
-	h0 = hash(v);
-	h = h0;
-	do {
-		if (varh[h].v[0] == 0)
-			return 0;
-		if (strcmp(varh[h].v, v) == 0)
-			return varh[h].isarray;
-		h = (h+1) % NVar;
-	} while (h != h0);
-	return 0;
+	int h;
+
+	h = varslot(v);
+	return h < 0 ? 0 : varh[h].isarray;
 }
 
 /* Record the total byte size of an array declarator so sizeof(arrayvar)
@@ -1310,35 +1877,23 @@ var_isarray(char *v)
 void
 var_set_arraybytes(char *v, int bytes)
 {
-	unsigned h0, h;
-	h0 = hash(v);
-	h = h0;
-	do {
-		if (varh[h].v[0] == 0)
-			return;
-		if (strcmp(varh[h].v, v) == 0) {
-			varh[h].arraybytes = bytes;
-			return;
-		}
-		h = (h+1) % NVar;
-	} while (h != h0);
+	int h;
+
+	h = varslot(v);
+	if (h >= 0)
+		varh[h].arraybytes = bytes;
 }
 
 /* Total byte size of an array variable, or 0 if unknown / not an array. */
 int
 var_arraybytes(char *v)
 {
-	unsigned h0, h;
-	h0 = hash(v);
-	h = h0;
-	do {
-		if (varh[h].v[0] == 0)
-			return 0;
-		if (strcmp(varh[h].v, v) == 0)
-			return varh[h].isarray ? varh[h].arraybytes : 0;
-		h = (h+1) % NVar;
-	} while (h != h0);
-	return 0;
+	int h;
+
+	h = varslot(v);
+	if (h < 0 || !varh[h].isarray)
+		return 0;
+	return varh[h].arraybytes;
 }
 
 /* Flag a variable as an array-of-array-typedef element (`jmp_buf bufs[N]`),
@@ -1346,18 +1901,11 @@ var_arraybytes(char *v)
 void
 var_set_aoa_dim(char *v, int dim)
 {
-	unsigned h0, h;
-	h0 = hash(v);
-	h = h0;
-	do {
-		if (varh[h].v[0] == 0)
-			return;
-		if (strcmp(varh[h].v, v) == 0) {
-			varh[h].aoa_dim = dim;
-			return;
-		}
-		h = (h+1) % NVar;
-	} while (h != h0);
+	int h;
+
+	h = varslot(v);
+	if (h >= 0)
+		varh[h].aoa_dim = dim;
 }
 
 /* Inner array dimension D of an array-of-array variable, or 0 if `v` is not
@@ -1366,17 +1914,10 @@ var_set_aoa_dim(char *v, int dim)
 int
 var_aoa_dim(char *v)
 {
-	unsigned h0, h;
-	h0 = hash(v);
-	h = h0;
-	do {
-		if (varh[h].v[0] == 0)
-			return 0;
-		if (strcmp(varh[h].v, v) == 0)
-			return varh[h].aoa_dim;
-		h = (h+1) % NVar;
-	} while (h != h0);
-	return 0;
+	int h;
+
+	h = varslot(v);
+	return h < 0 ? 0 : varh[h].aoa_dim;
 }
 
 /* Probe the symbol table for a *local* declaration (parameter or
@@ -1388,18 +1929,12 @@ var_aoa_dim(char *v)
 int
 var_islocal(char *v)
 {
-	unsigned h0, h;
-	h0 = hash(v);
-	h = h0;
-	do {
-		if (varh[h].v[0] == 0)
-			return 0;
-		if (strcmp(varh[h].v, v) == 0)
-			return (!varh[h].glo && !varh[h].enumconst)
-			    || varh[h].isstaticlocal;
-		h = (h+1) % NVar;
-	} while (h != h0);
-	return 0;
+	int h;
+
+	h = varslot(v);
+	if (h < 0)
+		return 0;
+	return (!varh[h].glo && !varh[h].enumconst) || varh[h].isstaticlocal;
 }
 
 /* Mark the just-added global `name` as a tentative (uninitialized) file-
@@ -1408,18 +1943,22 @@ var_islocal(char *v)
 void
 mark_tentative(char *name)
 {
-	unsigned h0, h;
-	h0 = hash(name);
-	h = h0;
-	do {
-		if (varh[h].v[0] == 0)
-			return;
-		if (strcmp(varh[h].v, name) == 0) {
-			varh[h].istentative = 1;
-			return;
-		}
-		h = (h+1) % NVar;
-	} while (h != h0);
+	int h;
+
+	h = varslot(name);
+	if (h >= 0)
+		varh[h].istentative = 1;
+}
+
+/* Flag the just-added `v' as an enum constant (its glo is the value). */
+void
+var_set_enumconst(char *v)
+{
+	int h;
+
+	h = varslot(v);
+	if (h >= 0)
+		varh[h].enumconst = 1;
 }
 
 /* If `name` already exists as a tentative global, return its buffered glo
@@ -1429,71 +1968,51 @@ mark_tentative(char *name)
 int
 glo_redef_index(char *name)
 {
-	unsigned h0, h;
-	h0 = hash(name);
-	h = h0;
-	do {
-		if (varh[h].v[0] == 0)
-			return -1;
-		if (strcmp(varh[h].v, name) == 0) {
-			if (varh[h].istentative) {
-				varh[h].istentative = 0;
-				return varh[h].glo;
-			}
-			return -1;
-		}
-		h = (h+1) % NVar;
-	} while (h != h0);
-	return -1;
+	int h;
+
+	h = varslot(name);
+	if (h < 0 || !varh[h].istentative)
+		return -1;
+	varh[h].istentative = 0;
+	return varh[h].glo;
 }
 
 Symb *
 varget(char *v)
 {
 	static Symb s;
-	unsigned h0, h;
+	int h;
 
-	h0 = hash(v);
-	h = h0;
-	do {
-		if (strcmp(varh[h].v, v) == 0) {
-			if (varh[h].enumconst) {
-				/* Enum constant - return as integer constant */
-				s.t = Con;
-				s.u.n = varh[h].glo;
-			} else if (varh[h].isextern) {
-				/* External symbol - reference by name */
-				s.t = Ext;
-				strcpy(s.u.v, v);
-			} else if (!varh[h].glo) {
-				s.t = Var;
-				strcpy(s.u.v, v);
-			} else {
-				s.t = Glo;
-				s.u.n = varh[h].glo;
-			}
-			s.ctyp = varh[h].ctyp;
-			return &s;
-		}
-		h = (h+1) % NVar;
-	} while (h != h0 && varh[h].v[0] != 0);
-	return 0;
+	h = varslot(v);
+	if (h < 0)
+		return 0;
+	if (varh[h].enumconst) {
+		/* Enum constant - return as integer constant */
+		s.t = Con;
+		s.u.n = varh[h].glo;
+	} else if (varh[h].isextern) {
+		/* External symbol - reference by name */
+		s.t = Ext;
+		strcpy(s.u.v, v);
+	} else if (!varh[h].glo) {
+		s.t = Var;
+		strcpy(s.u.v, v);
+	} else {
+		s.t = Glo;
+		s.u.n = varh[h].glo;
+	}
+	s.ctyp = varh[h].ctyp;
+	return &s;
 }
 
 /* Return 1 if the local/param named `v` was declared `volatile`. */
 int
 var_isvolatile(char *v)
 {
-	unsigned h0, h;
+	int h;
 
-	h0 = hash(v);
-	h = h0;
-	do {
-		if (strcmp(varh[h].v, v) == 0)
-			return varh[h].isvolatile;
-		h = (h+1) % NVar;
-	} while (h != h0 && varh[h].v[0] != 0);
-	return 0;
+	h = varslot(v);
+	return h < 0 ? 0 : varh[h].isvolatile;
 }
 
 /* Return 1 if the address Symb `s` names a `volatile`-qualified scalar
@@ -1508,7 +2027,7 @@ var_isvolatile(char *v)
 int
 symb_isvolatile(Symb s)
 {
-	if (s.t == Glo && s.u.n > 0 && s.u.n < NGlo && gloname[s.u.n][0] != 0)
+	if (s.t == Glo && s.u.n > 0 && s.u.n < nglocap && gloname[s.u.n][0] != 0)
 		return var_isvolatile(gloname[s.u.n]);
 	if (s.t == Ext)
 		return var_isvolatile(s.u.v);
@@ -1678,50 +2197,302 @@ constfoldable(Node *n)
 	case 'N':
 		return 1;
 	case 'V':
-		sv = varget(n->u.v);
-		return sv && sv->t == Con;
+		sv = varget(n->u.v);
+		return sv && sv->t == Con;
+	case '~':
+	case '!':
+	case 'K':
+		return constfoldable(n->l);
+	case '-':
+		if (n->r == 0)
+			return constfoldable(n->l);
+		return constfoldable(n->l) && constfoldable(n->r);
+	case '?':
+		return constfoldable(n->l) &&
+		       constfoldable(n->r->l) && constfoldable(n->r->r);
+	case '+': case '*': case '/': case '%': case '&': case '|':
+	case '^': case 'L': case 'R': case 'e': case 'n': case '<':
+	case 'l': case 'a': case 'o':
+		return constfoldable(n->l) && constfoldable(n->r);
+	default:
+		return 0;
+	}
+}
+
+/* Type-only mirrors of expr(), lval() and prom(): compute the C type
+ * an expression would get without emitting any IL or touching the
+ * tmp/lbl/clit counters.  They answer sizeof(expr) for the shapes that
+ * occur in practice — variables, derefs, members, casts, address-of,
+ * arithmetic and ternaries — and return 0 for anything else (calls,
+ * assignments, inc/dec, compound literals) and for the error cases, so
+ * the caller can fall back to a discarded expr() walk.  Keep them in
+ * step with the typing in expr()/lval()/prom(), except where sizeof
+ * needs the C type rather than the loaded one: a char or short operand
+ * keeps its own size and is promoted only by the operator using it,
+ * and a string literal is a char array (see the sizeof rule). */
+char irtyp_ret(unsigned);
+static int exprtype(Node *, unsigned *);
+
+static struct Member *
+membertype(unsigned styp, char *name)
+{
+	int sidx, i;
+
+	if (KIND(styp) != STRUCT_T && KIND(styp) != UNION_T)
+		return 0;
+	sidx = DREF(styp);
+	i = structfindmember(sidx, name);
+	return i < 0 ? 0 : &structh[sidx].members[i];
+}
+
+static int
+lvaltype(Node *n, unsigned *t)
+{
+	Symb *v;
+	struct Member *m;
+	unsigned s0;
+
+	switch (n->op) {
+	case 'V':
+		if (!(v = varget(n->u.v)))
+			return 0;
+		*t = v->ctyp;
+		if ((KIND(*t) == STRUCT_T || KIND(*t) == UNION_T) &&
+		    var_isvolatile(n->u.v))
+			*t |= QVOLATILE;
+		return 1;
+	case '@':
+		if (!exprtype(n->l, &s0) || KIND(s0) != PTR)
+			return 0;
+		*t = DREF(s0) | ISFAR(s0);
+		return 1;
+	case '.':
+		if (!lvaltype(n->l, &s0) || !(m = membertype(s0, n->r->u.v)))
+			return 0;
+		/* FARSTORAGE(s0) is implied by !NEAR_DATA() */
+		*t = m->ctyp | ((ISFAR(s0) || !NEAR_DATA()) ? FAR : 0)
+		   | ISVOLATILE(s0);
+		return 1;
+	default:
+		return 0;
+	}
+}
+
+/* The integer promotion of an operand's type: char and short go as
+ * int, unsigned ones as unsigned int (the width is the same). */
+static unsigned
+intprom(unsigned t)
+{
+	if (!ISFLOAT(t)
+	&& (KIND(t) == CHR || (KIND(t) == INT && (t & SHORT))))
+		return ISUNSIGNED(t) ? (INT | UNSIGNED) : INT;
+	return t;
+}
+
+static int
+promtype(int op, unsigned l, unsigned r, unsigned *t)
+{
+	unsigned s;
+
+	if (ISFLOAT(l) || ISFLOAT(r)) {
+		*t = ((ISFLOAT(l) && KIND(l) == LNG) || (ISFLOAT(r) && KIND(r) == LNG))
+		   ? (LNG | FLOAT) : (INT | FLOAT);
+		return 1;
+	}
+	l = intprom(l);
+	r = intprom(r);
+	if (l == r && KIND(l) != PTR) {
+		*t = l;
+		return 1;
+	}
+	if (KIND(l) == LNG && KIND(r) == INT) {
+		*t = ISUNSIGNED(l) ? (LNG | UNSIGNED) : LNG;
+		return 1;
+	}
+	if (KIND(l) == INT && KIND(r) == LNG) {
+		*t = ISUNSIGNED(r) ? (LNG | UNSIGNED) : LNG;
+		return 1;
+	}
+	if (op == '-' && KIND(l) == PTR && KIND(r) == PTR) {
+		if (l != r)
+			return 0;
+		*t = ISFAR(l) ? LNG : INT;
+		return 1;
+	}
+	if (KIND(l) == KIND(r)) {
+		*t = (ISUNSIGNED(l) || ISUNSIGNED(r)) ? (KIND(l) | UNSIGNED) : l;
+		return 1;
+	}
+	if (strchr("ne<l", op) && (KIND(l) == PTR || KIND(r) == PTR)) {
+		*t = KIND(l) == PTR ? l : r;
+		return 1;
+	}
+	if (op == '+' && KIND(r) == PTR) {
+		s = l;
+		l = r;
+		r = s;
+	}
+	if ((op == '+' && KIND(r) == PTR) || (op == '-' && KIND(l) != PTR))
+		return 0;
+	/* Scale: the pointee needs a size */
+	if (KIND(l) != PTR || KIND(DREF(l)) == NIL)
+		return 0;
+	*t = l;
+	return 1;
+}
+
+static int
+exprtype(Node *n, unsigned *t)
+{
+	Symb *v;
+	struct Member *m;
+	Node *a, *match;
+	unsigned s0, s1;
+	char w0, w1;
+
+	switch (n->op) {
+	case ',':
+		return exprtype(n->r, t);
+	case '?':
+		if (!exprtype(n->r->l, &s0) || !exprtype(n->r->r, &s1))
+			return 0;
+		if ((KIND(s0) == CHR || KIND(s0) == INT || KIND(s0) == LNG)
+		&& (KIND(s1) == CHR || KIND(s1) == INT || KIND(s1) == LNG))
+			return promtype('?', s0, s1, t);
+		if (s0 == s1) {
+			*t = s0;
+			return 1;
+		}
+		w0 = irtyp_ret(s0);
+		w1 = irtyp_ret(s1);
+		if (w1 == 'l' && w0 == 'w')
+			*t = s1;
+		else if (s0 == INT && s1 == LNG)
+			*t = LNG;
+		else
+			*t = s0;
+		return 1;
+	case 'o':
+	case 'a':
+	case '!':
+		*t = INT;
+		return 1;
+	case 'V':
+		if (!(v = varget(n->u.v)))
+			return 0;
+		if (!lvaltype(n, t))
+			return 0;
+		if (v->t == Con || var_isarray(n->u.v))
+			return 1;
+		if (KIND(*t) == FUN)
+			*t = IDIR(*t);
+		return 1;
+	case 'N':
+		*t = n->nlong ? LNG : INT;
+		return 1;
+	case 'F':
+		*t = INT | FLOAT;
+		return 1;
+	case 'S':
+		*t = IDIR(CHR);
+		return 1;
+	case 'G':
+		if (n->l->op == 'V' && (v = varget(n->l->u.v)))
+			s0 = v->ctyp;
+		else if (!exprtype(n->l, &s0))
+			return 0;
+		match = 0;
+		for (a = n->r; a; a = a->r)
+			if (a->u.n == -1)
+				match = match ? match : a;
+			else if ((unsigned)a->u.n == s0) {
+				match = a;
+				break;
+			}
+		return match && exprtype(match->l, t);
+	case '@':
+		if (!exprtype(n->l, &s0) || KIND(s0) != PTR)
+			return 0;
+		*t = DREF(s0);
+		if (KIND(*t) == FUN)
+			*t = s0;
+		else
+			*t &= ~QVOLATILE;
+		return 1;
+	case 'A':
+		if (!lvaltype(n->l, &s0))
+			return 0;
+		*t = IDIR(s0 & ~QVOLATILE);
+		return 1;
+	case '.':
+		if (!lvaltype(n->l, &s0) || !(m = membertype(s0, n->r->u.v)))
+			return 0;
+		if (m->count > 0 || m->isflex) {
+			if (ISFAR(s0) || !NEAR_DATA())
+				*t = IDIR_FAR(m->ctyp);
+			else
+				*t = IDIR(m->ctyp) & ~FAR;
+		} else
+			*t = m->ctyp & ~QVOLATILE;
+		return 1;
 	case '~':
-	case '!':
+		if (!exprtype(n->l, t) || ISFLOAT(*t))
+			return 0;
+		*t = intprom(*t);
+		return 1;
 	case 'K':
-		return constfoldable(n->l);
-	case '-':
+		if (!exprtype(n->l, &s0))
+			return 0;
+		*t = n->u.n;
+		return 1;
+	case 'L':
 		if (n->r == 0)
-			return constfoldable(n->l);
-		return constfoldable(n->l) && constfoldable(n->r);
-	case '?':
-		return constfoldable(n->l) &&
-		       constfoldable(n->r->l) && constfoldable(n->r->r);
-	case '+': case '*': case '/': case '%': case '&': case '|':
-	case '^': case 'L': case 'R': case 'e': case 'n': case '<':
-	case 'l': case 'a': case 'o':
-		return constfoldable(n->l) && constfoldable(n->r);
+			return 0;
+		/* fall through: shift */
+	case '+': case '-': case '*': case '/': case '%':
+	case '&': case '|': case '^': case 'R':
+	case '<': case 'l': case 'e': case 'n':
+		if (!exprtype(n->l, &s0) || !exprtype(n->r, &s1)
+		|| !promtype(n->op, s0, s1, t))
+			return 0;
+		if (strchr("ne<l", n->op))
+			*t = INT;
+		return 1;
 	default:
 		return 0;
 	}
 }
 
-/* Type of an expression, for sizeof(expr).  minic has no pure
- * type-inference pass, so this runs the normal expr() emitter with `of`
- * redirected to the bit bucket and the scratch counters restored
- * afterwards.  sizeof is unevaluated in C, so discarding the emitted
- * code is correct.  (Any string / compound-literal data globals
- * registered during the walk are left in place — harmless extra data
- * that is never referenced.)  Used for the `sizeof(arr)/sizeof(arr[0])`
- * count idiom and `sizeof(*ptr)`. */
+/* Type of an expression, for sizeof(expr).  exprtype() answers
+ * without emitting anything; the shapes it does not model go through
+ * the normal expr() emitter with `of` redirected to the bit bucket
+ * and the scratch counters restored afterwards.  sizeof is unevaluated
+ * in C, so discarding the emitted code is correct.  Used for the
+ * `sizeof(arr)/sizeof(arr[0])` count idiom and `sizeof(*ptr)`. */
+static FILE *
+nullfile()
+{
+	static FILE *f;
+
+	if (!f)
+		f = fopen("/dev/null", "w");
+	return f;
+}
+
 unsigned
 typeof_expr(Node *n)
 {
-	FILE *save_of = of, *nullf;
+	FILE *save_of = of;
 	int save_tmp = tmp, save_lbl = lbl, save_clit = clit;
+	unsigned t;
 	Symb s;
 
-	nullf = fopen("/dev/null", "w");
-	if (nullf)
-		of = nullf;
+	if (exprtype(n, &t))
+		return t;
+	if (nullfile())
+		of = nullfile();
 	s = expr(n);
 	of = save_of;
-	if (nullf)
-		fclose(nullf);
 	tmp = save_tmp;
 	lbl = save_lbl;
 	clit = save_clit;
@@ -1731,40 +2502,30 @@ typeof_expr(Node *n)
 int
 sizeof_member_array_expr(Node *n)
 {
-	FILE *save_of = of, *nullf;
+	FILE *save_of = of;
 	int save_tmp = tmp, save_lbl = lbl, save_clit = clit;
 	Symb s;
-	struct Member *m = 0;
-	int sidx, i, bytes = 0;
+	unsigned t;
+	struct Member *m;
 
 	if (!n || n->op != '.')
 		return 0;
 
-	nullf = fopen("/dev/null", "w");
-	if (nullf)
-		of = nullf;
-	s = lval(n->l);
-	of = save_of;
-	if (nullf)
-		fclose(nullf);
-	tmp = save_tmp;
-	lbl = save_lbl;
-	clit = save_clit;
-
-	if (KIND(s.ctyp) != STRUCT_T && KIND(s.ctyp) != UNION_T)
-		return 0;
-
-	sidx = DREF(s.ctyp);
-	for (i = 0; i < structh[sidx].nmembers; i++) {
-		if (strcmp(structh[sidx].members[i].name, n->r->u.v) == 0) {
-			m = &structh[sidx].members[i];
-			break;
-		}
+	if (!lvaltype(n->l, &t)) {
+		if (nullfile())
+			of = nullfile();
+		s = lval(n->l);
+		of = save_of;
+		tmp = save_tmp;
+		lbl = save_lbl;
+		clit = save_clit;
+		t = s.ctyp;
 	}
+
+	m = membertype(t, n->r->u.v);
 	if (!m || m->count <= 0)
 		return 0;
-	bytes = SIZE(m->ctyp) * m->count;
-	return bytes;
+	return SIZE(m->ctyp) * m->count;
 }
 
 char
@@ -1853,7 +2614,7 @@ emit_zero_init(char *buf, unsigned ctyp)
  * (`_HUGE_<symname>`).  asm_to_omf.py recognises the section override
  * and splits the segment across paragraph-aligned chunks; omf_link.py
  * places the chunks outside DGROUP at consecutive paragraph bases so
- * pointer arithmetic through `_qbe_huge_add` normalises into a
+ * `hugeadd` pointer arithmetic carries into a
  * contiguous linear region.  Returns 1 if the override was applied. */
 static int
 maybe_mark_huge_global(int idx, char *symname, int total_bytes)
@@ -1887,8 +2648,7 @@ emit_static_local(char *name, unsigned sym_ctyp, int isarray, char *init_buf)
 {
 	char mangled[NString];
 	char srcname[NString];
-	unsigned h0, h;
-	int n;
+	int h, n;
 
 	if (cur_fn_name[0] == 0)
 		die("static local outside function context");
@@ -1898,8 +2658,7 @@ emit_static_local(char *name, unsigned sym_ctyp, int isarray, char *init_buf)
 	n = snprintf(mangled, sizeof mangled, "_%s_%s", cur_fn_name, name);
 	if (n < 0 || n >= (int)sizeof mangled)
 		die("static-local mangled name too long");
-	if (nglo == NGlo)
-		die("too many globals");
+	glogrow();
 	ini[nglo] = alloc(strlen(init_buf) + 1);
 	strcpy(ini[nglo], init_buf);
 	strcpy(gloname[nglo], mangled);
@@ -1912,15 +2671,9 @@ emit_static_local(char *name, unsigned sym_ctyp, int isarray, char *init_buf)
 	strcpy(srcname, name);
 	block_scope_rename(srcname, sym_ctyp, isarray);
 	varadd(srcname, nglo, sym_ctyp, isarray);
-	h0 = hash(srcname);
-	h = h0;
-	do {
-		if (strcmp(varh[h].v, srcname) == 0) {
-			varh[h].isstaticlocal = 1;
-			break;
-		}
-		h = (h + 1) % NVar;
-	} while (h != h0);
+	h = varslot(srcname);
+	varh[h].isstaticlocal = 1;
+	varlog(srcname);
 	nglo++;
 }
 
@@ -1938,7 +2691,7 @@ psymb(Symb s)
 		/* Reference globals by their source name when available so the
 		 * generated symbol matches what other translation units expect
 		 * via `extern` declarations. */
-		if (s.u.n > 0 && s.u.n < NGlo && gloname[s.u.n][0] != 0)
+		if (s.u.n > 0 && s.u.n < nglocap && gloname[s.u.n][0] != 0)
 			fprintf(of, "$%s", gloname[s.u.n]);
 		else
 			fprintf(of, "$glo%d", s.u.n);
@@ -1967,7 +2720,7 @@ symb_operand(Symb s, char *buf, size_t n)
 		snprintf(buf, n, "%%%s", s.u.v);
 		break;
 	case Glo:
-		if (s.u.n > 0 && s.u.n < NGlo && gloname[s.u.n][0] != 0)
+		if (s.u.n > 0 && s.u.n < nglocap && gloname[s.u.n][0] != 0)
 			snprintf(buf, n, "$%s", gloname[s.u.n]);
 		else
 			snprintf(buf, n, "$glo%d", s.u.n);
@@ -2215,7 +2968,7 @@ Scale:
 		char pt = irtyp(l->ctyp);  /* 'w' near, 'l' far */
 		if (pt == 'l' && irtyp(r->ctyp) != 'l') {
 			/* Under huge, the FULL 32-bit scaled index reaches
-			 * _qbe_huge_add and is added to the 20-bit linear
+			 * hugeadd and is added to the 20-bit linear
 			 * address, so an UNSIGNED index whose 16-bit value is
 			 * >= 0x8000 (e.g. a size_t byte offset into a >32 KB
 			 * object) must ZERO-extend: a sign-extend makes it
@@ -2662,19 +3415,51 @@ call_target_name(char *f)
 	return f;
 }
 
-/* Struct/union return-by-value (caller side): allocate storage for the
- * returned aggregate and emit its alloc.  The returned temp number holds
- * the slot address; the caller passes it as the hidden first argument
- * and then treats it as the call's result (the address of the filled
- * aggregate).  Must be called before evaluating the real arguments so
- * the slot temp number is stable. */
+/* Struct/union return-by-value copy elision.  `x = f(...)` and, in a
+ * struct-returning function, `return f(...)` hand their destination down
+ * as sret_into (the address of x, or our own hidden pointer) before
+ * evaluating the call; the call passes it as f's hidden pointer, so f's
+ * `return` copy lands in place and the copy out of a temporary slot
+ * disappears.  This is sound because a callee writes through the hidden
+ * pointer only in its final `return` copy, after everything that could
+ * read the destination.  sret_into_sz is the size of the aggregate the
+ * destination holds, 0 when none is pending; take_sret() claims it at the
+ * head of a call, before nested calls in the arguments can see it. */
+static Symb sret_into;
+static int sret_into_sz;
+
 static int
-alloc_sret_slot(unsigned aggr_ctyp)
+take_sret(Symb *dst)
+{
+	int sz = sret_into_sz;
+
+	*dst = sret_into;
+	sret_into_sz = 0;
+	return sz;
+}
+
+/* Struct/union return-by-value (caller side): the storage for the
+ * returned aggregate — the claimed destination `into` when it fits (see
+ * take_sret), else a fresh slot whose alloc is emitted here.  The caller
+ * passes its address as the hidden first argument and then treats it as
+ * the call's result (the address of the filled aggregate).  Must be
+ * called before evaluating the real arguments so the slot temp number is
+ * stable. */
+static Symb
+alloc_sret_slot(unsigned aggr_ctyp, int into_sz, Symb *into)
 {
-	int slot = tmp++;
-	fprintf(of, "\t%%t%d =%c alloc%d %d\n", slot, ALLOC_T(),
-		iralign(aggr_ctyp), SIZE(aggr_ctyp));
-	return slot;
+	Symb s;
+
+	if (into_sz && into_sz == SIZE(aggr_ctyp))
+		s = *into;
+	else {
+		s.t = Tmp;
+		s.u.n = tmp++;
+		fprintf(of, "\t%%t%d =%c alloc%d %d\n", s.u.n, ALLOC_T(),
+			iralign(aggr_ctyp), SIZE(aggr_ctyp));
+	}
+	s.ctyp = aggr_ctyp | (NEAR_DATA() ? 0 : FAR);
+	return s;
 }
 
 static int
@@ -2759,33 +3544,21 @@ fpproto_alloc(unsigned rett, Node *chain)
 static void
 varsetfpid(char *v, int fpid)
 {
-	unsigned h0, h;
+	int h;
 
-	h0 = hash(v);
-	h = h0;
-	do {
-		if (strcmp(varh[h].v, v) == 0) {
-			varh[h].fpid = fpid;
-			return;
-		}
-		h = (h+1) % NVar;
-	} while (h != h0 && varh[h].v[0] != 0);
+	h = varslot(v);
+	if (h >= 0)
+		varh[h].fpid = fpid;
 }
 
 /* Return the fn-ptr prototype index recorded for variable `v', or -1. */
 static int
 varfpid(char *v)
 {
-	unsigned h0, h;
+	int h;
 
-	h0 = hash(v);
-	h = h0;
-	do {
-		if (strcmp(varh[h].v, v) == 0)
-			return varh[h].fpid;
-		h = (h+1) % NVar;
-	} while (h != h0 && varh[h].v[0] != 0);
-	return -1;
+	h = varslot(v);
+	return h < 0 ? -1 : varh[h].fpid;
 }
 
 /* Stamp the fn-ptr prototype index onto the most-recently-added member of
@@ -2988,11 +3761,11 @@ call(Node *n, Symb *sr)
 		/* Check if this is a function pointer - if so, do indirect call */
 		if (KIND(ft) == PTR && KIND(DREF(ft)) == FUN) {
 			/* Function pointer: generate indirect call */
-			Symb fptr;
+			Symb fptr, sret_slot, into;
 			unsigned fptr_type = DREF(ft);  /* FUN(return_type) */
 			int sret;
 			unsigned aggr;
-			int sret_slot = 0;
+			int into_sz = take_sret(&into);
 			int fpid = varfpid(f);
 			sr->ctyp = DREF(fptr_type);     /* return_type */
 			/* The double-DREF decode can LOSE a float return:
@@ -3015,7 +3788,7 @@ call(Node *n, Symb *sr)
 			/* Struct/union return-by-value: alloc result storage and
 			 * pass its address as the hidden first argument. */
 			if (sret)
-				sret_slot = alloc_sret_slot(aggr);
+				sret_slot = alloc_sret_slot(aggr, into_sz, &into);
 
 			/* Evaluate all arguments, coercing each to the fn-ptr's
 			 * declared parameter type (§2q) — a width mismatch on an
@@ -3036,7 +3809,9 @@ call(Node *n, Symb *sr)
 			if (sret) {
 				fprintf(of, "\tcall ");
 				psymb(fptr);
-				fprintf(of, "(%c %%t%d, ", DATAPTR_T(), sret_slot);
+				fprintf(of, "(%c ", DATAPTR_T());
+				psymb(sret_slot);
+				fprintf(of, ", ");
 			} else if (sr->ctyp == NIL) {
 				/* Void function pointer - no return value */
 				fprintf(of, "\tcall ");
@@ -3052,11 +3827,8 @@ call(Node *n, Symb *sr)
 			for (a=n->r; a; a=a->r)
 				emit_arg(a->u.s);
 			fprintf(of, "...)\n");
-			if (sret) {
-				sr->t = Tmp;
-				sr->u.n = sret_slot;
-				sr->ctyp = aggr | (NEAR_DATA() ? 0 : FAR);
-			}
+			if (sret)
+				*sr = sret_slot;
 			return;
 		}
 		if (KIND(ft) != FUN)
@@ -3076,7 +3848,8 @@ call(Node *n, Symb *sr)
 	 * argument evaluation so its temp number stays stable. */
 	int sret;
 	unsigned aggr;
-	int sret_slot = 0;
+	Symb sret_slot, into;
+	int into_sz = take_sret(&into);
 	int proto = fnproto_find(f);
 	int argi = 0;
 	/* §5c: the DREF(FUNC(ret)) decode strips any ret bit that lands on
@@ -3089,7 +3862,7 @@ call(Node *n, Symb *sr)
 	sret = (KIND(sr->ctyp) == STRUCT_T || KIND(sr->ctyp) == UNION_T);
 	aggr = sr->ctyp;
 	if (sret)
-		sret_slot = alloc_sret_slot(aggr);
+		sret_slot = alloc_sret_slot(aggr, into_sz, &into);
 	for (a=n->r; a; a=a->r, argi++) {
 		a->u.s = eval_arg(a);
 		/* Convert each argument to the declared parameter type (C11
@@ -3103,7 +3876,9 @@ call(Node *n, Symb *sr)
 	if (sret) {
 		/* Hidden return pointer first; the returned pointer is
 		 * discarded since we already hold the slot address. */
-		fprintf(of, "\tcall $%s(%c %%t%d, ", cf, DATAPTR_T(), sret_slot);
+		fprintf(of, "\tcall $%s(%c ", cf, DATAPTR_T());
+		psymb(sret_slot);
+		fprintf(of, ", ");
 	} else if (sr->ctyp == NIL) {
 		/* Void function - no return value */
 		fprintf(of, "\tcall $%s(", cf);
@@ -3120,9 +3895,7 @@ call(Node *n, Symb *sr)
 		/* The call result IS the result slot's address (an aggregate
 		 * lvalue).  Mark it far under far-data so downstream copies
 		 * use the far load/store variants and 4-byte address arith. */
-		sr->t = Tmp;
-		sr->u.n = sret_slot;
-		sr->ctyp = aggr | (NEAR_DATA() ? 0 : FAR);
+		*sr = sret_slot;
 	}
 	}
 }
@@ -3134,11 +3907,12 @@ call(Node *n, Symb *sr)
  * dx, hi` we use in compact/large model does NOT compute a normalised
  * pointer (it carries between bit 15 and bit 16, but a real-mode
  * segment carry happens at bit 4) and therefore mis-addresses any
- * array > 64K under huge.  Route the arithmetic through the libstub
- * helpers _qbe_huge_add / _qbe_huge_sub instead.  See
+ * array > 64K under huge.  Emit the backend's `hugeadd` / `hugesub`
+ * ops instead; qbe expands them inline (they used to be far calls to
+ * the libstub helpers _qbe_huge_add / _qbe_huge_sub).  See
  * [[huge-mode-plan]] / [[huge-phase-a]].
  *
- * Returns 1 if a call was emitted (caller skips its usual add/sub
+ * Returns 1 if the op was emitted (caller skips its usual add/sub
  * format-string emission), 0 otherwise.  Float operands, non-pointer
  * results, and non-FAR pointer types fall through to the regular path.
  */
@@ -3160,7 +3934,7 @@ huge_ptr_binop(int op, Symb dst, Symb lhs, Symb rhs)
 	 * destination or a spilled pointer VALUE.  Phase B' (i8086/emit.c
 	 * Ostorel/Oload Kl via fn->arg_slot_top) closed that gap: spilled
 	 * Kl-ptr slots now deref through ES:BX, so a normalised stack
-	 * pointer returned by _qbe_huge_add behaves the same as a
+	 * pointer produced by hugeadd behaves the same as a
 	 * normalised global pointer.  See [[phase-bprime]] /
 	 * [[huge-phase-b-storel-gap]]. */
 	/* Under MHuge, default data pointers are 32-bit (l) regardless of
@@ -3178,10 +3952,8 @@ huge_ptr_binop(int op, Symb dst, Symb lhs, Symb rhs)
 		soff = lhs;
 	}
 
-	/* Helper signature: unsigned long _qbe_huge_add(unsigned long ptr,
-	 * long offset).  The offset arg must be Kl, so widen narrower tmps
-	 * with the right signedness.  Constants take their class from the
-	 * call signature (we emit `l <N>`), so they need no extension. */
+	/* `hugeadd ptr, offset` takes a Kl offset, so widen narrower tmps
+	 * with the right signedness.  Constants need no extension. */
 	if (soff.t == Tmp && irtyp(soff.ctyp) != 'l') {
 		const char *ext = ISUNSIGNED(soff.ctyp) ? "extuw" : "extsw";
 		fprintf(of, "\t%%t%d =l %s ", tmp, ext);
@@ -3194,12 +3966,11 @@ huge_ptr_binop(int op, Symb dst, Symb lhs, Symb rhs)
 
 	fprintf(of, "\t");
 	psymb(dst);
-	fprintf(of, " =l call $%s(l ",
-		op == '+' ? "qbe_huge_add" : "qbe_huge_sub");
+	fprintf(of, " =l %s ", op == '+' ? "hugeadd" : "hugesub");
 	psymb(sptr);
-	fprintf(of, ", l ");
+	fprintf(of, ", ");
 	psymb(soff);
-	fprintf(of, ")\n");
+	fprintf(of, "\n");
 	return 1;
 }
 
@@ -3222,7 +3993,7 @@ huge_ptr_binop(int op, Symb dst, Symb lhs, Symb rhs)
  * (idx*sz) mod 0x10000).  See NEXT_SESSION §4i / [[project-far-ptr-unsigned-index-bug]].
  *
  * MHuge is excluded: there an object can exceed 64 KB, so a genuine segment
- * carry is required — handled by huge_ptr_binop (_qbe_huge_add/sub), which the
+ * carry is required — handled by huge_ptr_binop (hugeadd/hugesub), which the
  * callers run first.  Function pointers (pointee FUN, living in CS) and near
  * pointers (16-bit, irtyp 'w') keep the regular add/sub.
  *
@@ -3683,11 +4454,11 @@ expr(Node *n)
 		/* Indirect function call: (*fptr)(args) */
 		{
 			Node *a;
-			Symb fptr;
+			Symb fptr, sret_slot, into;
 			unsigned fptr_type;
 			int sret;
 			unsigned aggr;
-			int sret_slot = 0;
+			int into_sz = take_sret(&into);
 			int fpid;
 
 			/* Evaluate function pointer expression.  Reset the member
@@ -3724,7 +4495,7 @@ expr(Node *n)
 			/* Struct/union return-by-value: alloc result storage and
 			 * pass its address as the hidden first argument. */
 			if (sret)
-				sret_slot = alloc_sret_slot(aggr);
+				sret_slot = alloc_sret_slot(aggr, into_sz, &into);
 
 			/* Evaluate all arguments, coercing each to the fn-ptr's
 			 * declared parameter type (§2q): a width mismatch shifts the
@@ -3743,7 +4514,9 @@ expr(Node *n)
 			if (sret) {
 				fprintf(of, "\tcall ");
 				psymb(fptr);
-				fprintf(of, "(%c %%t%d, ", DATAPTR_T(), sret_slot);
+				fprintf(of, "(%c ", DATAPTR_T());
+				psymb(sret_slot);
+				fprintf(of, ", ");
 			} else if (sr.ctyp == NIL) {
 				/* Void-returning function pointer - no result. */
 				fprintf(of, "\tcall ");
@@ -3759,11 +4532,8 @@ expr(Node *n)
 			for (a=n->r; a; a=a->r)
 				emit_arg(a->u.s);
 			fprintf(of, "...)\n");
-			if (sret) {
-				sr.t = Tmp;
-				sr.u.n = sret_slot;
-				sr.ctyp = aggr | (NEAR_DATA() ? 0 : FAR);
-			}
+			if (sret)
+				sr = sret_slot;
 		}
 		break;
 
@@ -3869,20 +4639,15 @@ expr(Node *n)
 		{
 			int sidx = DREF(s0.ctyp);
 			char *mname = n->r->u.v;
-			int i, found = 0;
+			int i;
 			struct Member *m;
 			Symb addr;
 
 			/* Find member */
-			for (i = 0; i < structh[sidx].nmembers; i++) {
-				if (strcmp(structh[sidx].members[i].name, mname) == 0) {
-					found = 1;
-					m = &structh[sidx].members[i];
-					break;
-				}
-			}
-			if (!found)
+			i = structfindmember(sidx, mname);
+			if (i < 0)
 				die("struct member not found");
+			m = &structh[sidx].members[i];
 
 			/* Stash this member's fn-ptr prototype id (or -1) for an
 			 * immediately-following indirect call `obj->fn(...)' (§2q). */
@@ -4097,12 +4862,9 @@ expr(Node *n)
 				struct Member *m = NULL;
 
 				/* Find member */
-				for (i = 0; i < structh[sidx].nmembers; i++) {
-					if (strcmp(structh[sidx].members[i].name, mname) == 0) {
-						m = &structh[sidx].members[i];
-						break;
-					}
-				}
+				i = structfindmember(sidx, mname);
+				if (i >= 0)
+					m = &structh[sidx].members[i];
 
 				if (m && m->bitwidth > 0) {
 					/* Bitfield assignment - read-modify-write */
@@ -4223,7 +4985,22 @@ expr(Node *n)
 			}
 		}
 
+		/* `x = f(...)` with f returning a struct: hand x's address
+		 * down as f's hidden return pointer (see sret_into).  Only a
+		 * named non-volatile object whose address is a plain data
+		 * pointer qualifies: a local, or a global under near data (a
+		 * far-data global's address is a segment relocation). */
+		if ((n->r->op == 'C' || n->r->op == 'I') && n->l->op == 'V'
+		 && varget(n->l->u.v) && is_aggr(varget(n->l->u.v)->ctyp)) {
+			Symb d = lval(n->l);
+			if (!ISVOLATILE(d.ctyp) && !symb_isvolatile(d)
+			 && (d.t == Var || (NEAR_DATA() && (d.t == Glo || d.t == Ext)))) {
+				sret_into = d;
+				sret_into_sz = SIZE(d.ctyp);
+			}
+		}
 		s0 = expr(n->r);
+		sret_into_sz = 0;
 		s1 = lval(n->l);
 		s1_far_storage = lval_storage_far;  /* capture before any further expr/lval */
 		sr = s0;
@@ -4247,9 +5024,16 @@ expr(Node *n)
 			 * time, so reuse s0 directly. */
 			if (n->r->op == '=')
 				src_addr = lval(n->r->l);
-			else if (n->r->op == 'C' || n->r->op == 'I')
+			else if (n->r->op == 'C' || n->r->op == 'I') {
+				/* The call already wrote x in place when it
+				 * took it as its hidden pointer: only a fresh
+				 * result slot is a temporary. */
+				if (s0.t != Tmp) {
+					sr = s1;
+					break;
+				}
 				src_addr = s0;
-			else
+			} else
 				src_addr = lval(n->r);
 
 			emit_struct_copy(s1, src_addr);
@@ -4483,9 +5267,9 @@ expr(Node *n)
 	Binop:
 		sr.ctyp = prom(o, &s0, &s1);
 
-		/* Under MHuge, pointer +/- offset must normalise; route the
-		 * arithmetic through libstub's _qbe_huge_add / _qbe_huge_sub
-		 * instead of emitting flat 32-bit add/sub.  See
+		/* Under MHuge, pointer +/- offset must carry into the
+		 * segment; emit hugeadd / hugesub instead of a flat 32-bit
+		 * add/sub.  See
 		 * [[huge-mode-plan]] / [[huge-phase-a]]. */
 		if (huge_ptr_binop(o, sr, s0, s1))
 			break;
@@ -4494,7 +5278,7 @@ expr(Node *n)
 		 * be computed on the LINEAR addresses: two normalised far pointers
 		 * into the same object can sit in different segments, so a flat
 		 * 32-bit `sub` of their seg:off words gives (Δseg<<16)+Δoff instead
-		 * of the true Δseg*16+Δoff.  `_qbe_huge_cmp(p,q)` already returns the
+		 * of the true Δseg*16+Δoff.  `hugecmp p, q` already returns the
 		 * signed linear difference linear(p)-linear(q); reuse it.  (Flat sub
 		 * stays correct under compact/large, where the segment is shared and
 		 * cancels — and under near-data.  Comparison `p<q` also stays flat:
@@ -4508,11 +5292,11 @@ expr(Node *n)
 		&& KIND(DREF(s0.ctyp)) != FUN) {
 			fprintf(of, "\t");
 			psymb(sr);
-			fprintf(of, " =l call $qbe_huge_cmp(l ");
+			fprintf(of, " =l hugecmp ");
 			psymb(s0);
-			fprintf(of, ", l ");
+			fprintf(of, ", ");
 			psymb(s1);
-			fprintf(of, ")\n");
+			fprintf(of, "\n");
 			break;
 		}
 
@@ -4524,9 +5308,9 @@ expr(Node *n)
 		 * monotonic in linear address — but a bare symbol address ($sym,
 		 * e.g. _sbrk's __heap_end) is UNNORMALISED (raw DGROUP:offset, the
 		 * offset can exceed 0xF), so comparing it flat against a normalised
-		 * pointer (one that went through _qbe_huge_add) gives the wrong
-		 * order.  Route through _qbe_huge_cmp(p,q) = signed linear(p)-linear(q)
-		 * and test its sign: p<q ⟺ cmp<0, p<=q ⟺ cmp<=0.  huge_cmp recomputes
+		 * pointer (one that went through hugeadd) gives the wrong
+		 * order.  Route through `hugecmp p, q` = signed linear(p)-linear(q)
+		 * and test its sign: p<q ⟺ cmp<0, p<=q ⟺ cmp<=0.  hugecmp recomputes
 		 * seg*16+off from the raw words, so it is normalisation-invariant and
 		 * correct for both forms.  MHuge-gated, so the compact/large/near
 		 * corpora — including the MP byte-compare — are untouched.  Found in
@@ -4536,11 +5320,11 @@ expr(Node *n)
 		&& KIND(s0.ctyp) == PTR && KIND(s1.ctyp) == PTR
 		&& KIND(DREF(s0.ctyp)) != FUN) {
 			int ct = tmp++;
-			fprintf(of, "\t%%t%d =l call $qbe_huge_cmp(l ", ct);
+			fprintf(of, "\t%%t%d =l hugecmp ", ct);
 			psymb(s0);
-			fprintf(of, ", l ");
+			fprintf(of, ", ");
 			psymb(s1);
-			fprintf(of, ")\n");
+			fprintf(of, "\n");
 			sr.ctyp = INT;
 			fprintf(of, "\t");
 			psymb(sr);
@@ -4554,10 +5338,10 @@ expr(Node *n)
 		 * `ceql`/`cnel` further down compares the raw 32-bit seg:off words
 		 * bit-for-bit, so two pointers that denote the SAME linear address
 		 * through DIFFERENT normalisations — e.g. an unnormalised symbol
-		 * address (offset > 0xF) vs the normalised pointer _qbe_huge_add
+		 * address (offset > 0xF) vs the pointer hugeadd
 		 * returns for the same byte — wrongly compare UNEQUAL (and a genuinely
 		 * different address can never alias, so == has no false-positive risk;
-		 * the bug is purely false-negative).  Route through _qbe_huge_cmp(p,q)
+		 * the bug is purely false-negative).  Route through `hugecmp p, q`
 		 * = signed linear(p)-linear(q) and test == 0 / != 0: linear equality is
 		 * exactly C pointer equality (C11 6.5.9) on the flat 8086 huge model,
 		 * and it stays correct for NULL too (0:0 → linear 0, so p == NULL ⟺
@@ -4569,11 +5353,11 @@ expr(Node *n)
 		&& KIND(s0.ctyp) == PTR && KIND(s1.ctyp) == PTR
 		&& KIND(DREF(s0.ctyp)) != FUN) {
 			int ct = tmp++;
-			fprintf(of, "\t%%t%d =l call $qbe_huge_cmp(l ", ct);
+			fprintf(of, "\t%%t%d =l hugecmp ", ct);
 			psymb(s0);
-			fprintf(of, ", l ");
+			fprintf(of, ", ");
 			psymb(s1);
-			fprintf(of, ")\n");
+			fprintf(of, "\n");
 			sr.ctyp = INT;
 			fprintf(of, "\t");
 			psymb(sr);
@@ -4822,21 +5606,16 @@ lval(Node *n)
 
 			int sidx = DREF(s0.ctyp);
 			char *mname = n->r->u.v;
-			int i, found = 0;
+			int i;
 			struct Member *m;
 			char klass;
 			unsigned far_flag;
 
 			/* Find member */
-			for (i = 0; i < structh[sidx].nmembers; i++) {
-				if (strcmp(structh[sidx].members[i].name, mname) == 0) {
-					found = 1;
-					m = &structh[sidx].members[i];
-					break;
-				}
-			}
-			if (!found)
+			i = structfindmember(sidx, mname);
+			if (i < 0)
 				die("struct member not found");
+			m = &structh[sidx].members[i];
 
 			/* Stash this member's fn-ptr prototype id (or -1) for an
 			 * immediately-following indirect call `obj->fn(...)' (§2q). */
@@ -4957,6 +5736,72 @@ collectcases(Stmt *s, Stmt **cases, int *ncase, int *defidx)
 
 int genswitchbody(Stmt *s, int brk, int cont, Stmt **cases, int *caselbl, int ncase);
 
+/* Value of `&&name` in the current function, see addrlbl. */
+int
+addrlabel(char *name)
+{
+	int i;
+
+	if (addrlbl_fn != cur_fn_labelid) {
+		addrlbl_fn = cur_fn_labelid;
+		naddrlbl = 0;
+	}
+	for (i = 0; i < naddrlbl; i++)
+		if (strcmp(addrlbl[i], name) == 0)
+			return i + 1;
+	if (naddrlbl == NAddrLbl)
+		die("too many address-taken labels");
+	strcpy(addrlbl[naddrlbl], name);
+	return ++naddrlbl;
+}
+
+/* A switch with at least 4 cases whose values span no more
+ * than 3 entries per case dispatches through a QBE jtab on
+ * the value minus the smallest case; holes and out of range
+ * values go to the default.  On the 8086 that is a bounds
+ * check and one indirect jump, where the comparison chain
+ * costs a compare and a branch per case tried. */
+int
+genjtab(Symb val, Stmt **cases, int *caselbl, int ncase, int dflt)
+{
+	long lo, hi, v;
+	int i, n;
+
+	if (irtyp(val.ctyp) == 'l')
+		return 0;
+	lo = hi = 0;
+	for (i = 0, n = 0; i < ncase; i++) {
+		if (cases[i]->t != Case)
+			continue;
+		v = cases[i]->val;
+		if (!n || v < lo)
+			lo = v;
+		if (!n || v > hi)
+			hi = v;
+		n++;
+	}
+	if (n < 4 || hi - lo + 1 > 3 * n)
+		return 0;
+	if (lo) {
+		fprintf(of, "	%%t%d =w sub ", tmp);
+		psymb(val);
+		fprintf(of, ", %ld\n", lo);
+		fprintf(of, "	jtab %%t%d, @l%d", tmp++, dflt);
+	} else {
+		fprintf(of, "	jtab ");
+		psymb(val);
+		fprintf(of, ", @l%d", dflt);
+	}
+	for (v = lo; v <= hi; v++) {
+		for (i = 0; i < ncase; i++)
+			if (cases[i]->t == Case && cases[i]->val == v)
+				break;
+		fprintf(of, ", @l%d", i < ncase ? caselbl[i] : dflt);
+	}
+	fprintf(of, "\n");
+	return 1;
+}
+
 int
 genswitch(Symb val, Stmt *body, int brk, int cont)
 {
@@ -4973,6 +5818,12 @@ genswitch(Symb val, Stmt *body, int brk, int cont)
 		caselbl[i] = lbl++;
 	}
 
+	if (genjtab(val, cases, caselbl, ncase,
+	    defidx >= 0 ? caselbl[defidx] : brk)) {
+		genswitchbody(body, brk, cont, cases, caselbl, ncase);
+		return 0;
+	}
+
 	/* Generate case comparisons */
 	for (i = 0; i < ncase; i++) {
 		if (cases[i]->t == Case) {
@@ -5131,19 +5982,28 @@ stmt(Stmt *s, int b, int c)
 			Node *rv = (Node *)s->p1;
 			if (!rv)
 				die("return; in struct-returning function");
-			if (rv->op == 'C' || rv->op == 'I')
-				src = expr(rv);
-			else
-				src = lval(rv);
 			/* The hidden pointer is far under far-data models (it
 			 * addresses caller storage as a 4-byte seg:off), near
-			 * under medium.  Reload it and copy the aggregate. */
+			 * under medium.  Reload it and copy the aggregate —
+			 * unless the value is a call, which gets it as its own
+			 * hidden pointer (see sret_into) and fills it. */
 			dst.t = Tmp;
 			dst.u.n = tmp++;
 			dst.ctyp = cur_fn_sret_ctyp | (NEAR_DATA() ? 0 : FAR);
 			fprintf(of, "\t");
 			psymb(dst);
 			fprintf(of, " =%c load%c %%__sret\n", DATAPTR_T(), DATAPTR_T());
+			if (rv->op == 'C' || rv->op == 'I') {
+				sret_into = dst;
+				sret_into_sz = SIZE(cur_fn_sret_ctyp);
+				src = expr(rv);
+				sret_into_sz = 0;
+				if (src.t == Tmp && src.u.n == dst.u.n) {
+					fprintf(of, "\tret %%t%d\n", dst.u.n);
+					return 1;
+				}
+			} else
+				src = lval(rv);
 			/* Mirror the dst's far-ness onto the source aggregate
 			 * address: under far-data every data address is a far
 			 * (seg:off) pointer, so the copy must use the far load/
@@ -5312,6 +6172,26 @@ stmt(Stmt *s, int b, int c)
 			stmt((Stmt*)s->p2, b, c);
 		return 0;
 	case Goto:
+		if (s->p1) {
+			/* `goto *e`: label values start at 1; 0 and
+			 * values out of range go to the first label */
+			int i;
+			Node *n = mknode('K', s->p1, 0);
+
+			if (addrlbl_fn != cur_fn_labelid || !naddrlbl)
+				die("goto * in a function with no &&label");
+			n->u.n = INT;
+			x = expr(n);
+			fprintf(of, "\tjtab ");
+			psymb(x);
+			fprintf(of, ", @user_%s_F%d, @user_%s_F%d", addrlbl[0],
+			    cur_fn_labelid, addrlbl[0], cur_fn_labelid);
+			for (i = 0; i < naddrlbl; i++)
+				fprintf(of, ", @user_%s_F%d", addrlbl[i],
+				    cur_fn_labelid);
+			fprintf(of, "\n");
+			return 1;
+		}
 		fprintf(of, "\tjmp @user_%s_F%d\n", s->label, cur_fn_labelid);
 		return 1;
 	case Label:
@@ -5424,6 +6304,41 @@ mknode(char op, Node *l, Node *r)
 	return n;
 }
 
+/* GNU range designator `[lo ... hi] = v`: a ready-made
+ * initlist of one `[k] = v` item per index, which
+ * initcons splices in.  Later designators override it, as
+ * in MicroPython's `[0 ... 255] = &&entry_default`. */
+Node *
+mkrange(Node *lo, Node *hi, Node *v)
+{
+	Node *l, *k;
+	int a, b;
+
+	a = const_eval(lo);
+	b = const_eval(hi);
+	if (a < 0 || b < a)
+		die("bad range designator");
+	for (l = 0; b >= a; b--) {
+		k = mknode('N', 0, 0);
+		k->u.n = b;
+		l = mknode(0, mknode('d', v, k), l);
+	}
+	return mknode('g', l, 0);
+}
+
+Node *
+initcons(Node *item, Node *rest)
+{
+	Node *l;
+
+	if (item->op != 'g')
+		return mknode(0, item, rest);
+	for (l = item->l; l->r; l = l->r)
+		;
+	l->r = rest;
+	return item->l;
+}
+
 Node *
 mkidx(Node *a, Node *i)
 {
@@ -5777,8 +6692,7 @@ emit_global_int_init(int value)
 	char buf[64];
 	if (parsed_type == NIL)
 		die("invalid void declaration");
-	if (nglo == NGlo)
-		die("too many globals");
+	glogrow();
 	sprintf(buf, "{ %c %d }", irtyp(parsed_type), value);
 	ini[nglo] = alloc(strlen(buf) + 1);
 	strcpy(ini[nglo], buf);
@@ -5803,8 +6717,7 @@ emit_struct_global_array(char *name, int count)
 	styp = (idx << 3) + STRUCT_T;
 	curstruct = -1;
 	total = SIZE(styp) * count;
-	if (nglo == NGlo)
-		die("too many globals");
+	glogrow();
 	sprintf(buf, "align %d { z %d }", iralign(styp), total);
 	ini[nglo] = alloc(strlen(buf) + 1);
 	strcpy(ini[nglo], buf);
@@ -5837,8 +6750,7 @@ emit_global_sym_init(char *sym, long off)
 	char buf[NString + 32];
 	if (parsed_type == NIL)
 		die("invalid void declaration");
-	if (nglo == NGlo)
-		die("too many globals");
+	glogrow();
 	if (off)
 		sprintf(buf, "{ %c $%s+%ld }", irtyp(parsed_type), sym, off);
 	else
@@ -5866,8 +6778,7 @@ emit_global_fnptr(char *name, unsigned base, Node *fptpar, Node *init, int is_st
 	char buf[NString + 32];
 	int start = nglo;
 
-	if (nglo == NGlo)
-		die("too many globals");
+	glogrow();
 	if (init) {
 		struct CIVal v;
 		cival_eval(init, &v);
@@ -6052,8 +6963,7 @@ emit_pointer_array_data(unsigned elemtyp, char *name)
 	}
 	buflen += sprintf(buf + buflen, " }");
 
-	if (nglo == NGlo)
-		die("too many globals");
+	glogrow();
 	ini[nglo] = alloc(buflen + 1);
 	strcpy(ini[nglo], buf);
 	strcpy(gloname[nglo], name);
@@ -6091,8 +7001,7 @@ emit_scalar_array_data(unsigned elemtyp, char *name)
 	}
 	buflen += sprintf(buf + buflen, " }");
 
-	if (nglo == NGlo)
-		die("too many globals");
+	glogrow();
 	ini[nglo] = alloc(buflen + 1);
 	strcpy(ini[nglo], buf);
 	strcpy(gloname[nglo], name);
@@ -6157,8 +7066,7 @@ emit_struct_array_data(int sidx, char *name)
 	}
 	buflen += sprintf(buf + buflen, " }");
 
-	if (nglo == NGlo)
-		die("too many globals");
+	glogrow();
 	ini[nglo] = alloc(buflen + 1);
 	strcpy(ini[nglo], buf);
 	strcpy(gloname[nglo], name);
@@ -6401,8 +7309,7 @@ emit_global_float_init(Node *n)
 
 	if (parsed_type == NIL)
 		die("invalid void declaration");
-	if (nglo == NGlo)
-		die("too many globals");
+	glogrow();
 	cival_float_text(n, ftext);
 	sprintf(buf, "{ s s_%s }", ftext);
 	ini[nglo] = alloc(strlen(buf) + 1);
@@ -6550,13 +7457,9 @@ agg_emit_struct(int sidx, int isunion, Node *agg, char *buf, int *bl, int *first
 		Node *val;
 
 		if (item->op == 'D') {         /* .field = val */
-			int k, found = -1;
-			for (k = 0; k < nmembers; k++)
-				if (strcmp(structh[sidx].members[k].name,
-				           item->r->u.v) == 0) {
-					found = k;
-					break;
-				}
+			int found;
+
+			found = structfindmember(sidx, item->r->u.v);
 			if (found < 0)
 				die("unknown member in designated initializer");
 			memidx = found;
@@ -6689,8 +7592,7 @@ emit_global_aggregate(unsigned ctyp, char *name, Node *agg)
 	 * T name;` declaration; otherwise allocate a fresh global slot. */
 	idx = glo_redef_index(name);
 	if (idx < 0) {
-		if (nglo == NGlo)
-			die("too many globals");
+		glogrow();
 		idx = nglo++;
 		strcpy(gloname[idx], name);
 		varadd(name, idx, ctyp, 0);
@@ -6756,8 +7658,7 @@ emit_string_array(unsigned elemtyp, char *name, int str_idx, int static_local)
 	if (static_local) {
 		emit_static_local(name, IDIR(elemtyp), 1, ini[str_idx]);
 	} else {
-		if (nglo == NGlo)
-			die("too many globals");
+		glogrow();
 		ini[nglo] = ini[str_idx];
 		strcpy(gloname[nglo], name);
 		varadd(name, nglo++, IDIR(elemtyp), 1);
@@ -6803,8 +7704,7 @@ emit_string_array_sized(unsigned elemtyp, char *name, int str_idx, long count,
 	if (static_local) {
 		emit_static_local(name, IDIR(elemtyp), 1, blk);
 	} else {
-		if (nglo == NGlo)
-			die("too many globals");
+		glogrow();
 		ini[nglo] = blk;
 		strcpy(gloname[nglo], name);
 		varadd(name, nglo++, IDIR(elemtyp), 1);
@@ -6882,8 +7782,7 @@ emit_global_array(unsigned elemtyp, char *name, long count, Node *agg)
 	static char buf[65536];
 	long total;
 
-	if (nglo == NGlo)
-		die("too many globals");
+	glogrow();
 	total = build_array_init(elemtyp, count, agg, buf);
 	ini[nglo] = alloc(strlen(buf) + 1);
 	strcpy(ini[nglo], buf);
@@ -7231,8 +8130,7 @@ emit_global_arr_instance(char *name, unsigned elem, int dim)
 {
 	char buf[64];
 	int total = SIZE(elem) * dim;
-	if (nglo == NGlo)
-		die("too many globals");
+	glogrow();
 	sprintf(buf, "align %d { z %d }", iralign(elem), total);
 	ini[nglo] = alloc(strlen(buf) + 1);
 	strcpy(ini[nglo], buf);
@@ -7254,8 +8152,7 @@ emit_global_sized_array(char *name, long count)
 	int elemsz, total;
 	unsigned elemtyp;
 	int aoa;
-	if (nglo == NGlo)
-		die("too many globals");
+	glogrow();
 	if (g_td_arraydim > 0) {
 		aoa = g_td_arraydim;
 		elemtyp = g_td_arrayelem;
@@ -7599,7 +8496,7 @@ attr_kfunc: attrspec storageopt inlineopt init_attr prot_knr '{' dcls stmts '}'
 	 * register-restore + iret epilogue. */
 	if (!stmt($8, -1, -1))
 		fprintf(of, "\tret 0\n");
-	fprintf(of, "}\n\n");
+	fnend();
 };
 
 attr_typed_decl: attrspec type_and_ident_noattr typed_decl_rest
@@ -7642,16 +8539,7 @@ enums: enum
 enum: IDENT
 {
 	varadd($1->u.v, enumval, INT, 0);
-	{
-		unsigned eh0 = hash($1->u.v), eh = eh0;
-		do {
-			if (strcmp(varh[eh].v, $1->u.v) == 0) {
-				varh[eh].enumconst = 1;
-				break;
-			}
-			eh = (eh + 1) % NVar;
-		} while (eh != eh0);
-	}
+	var_set_enumconst($1->u.v);
 	enumval++;
 }
     | IDENT '=' expr
@@ -7663,16 +8551,7 @@ enum: IDENT
 	 * reduces. */
 	enumval = const_eval($3);
 	varadd($1->u.v, enumval, INT, 0);
-	{
-		unsigned eh0 = hash($1->u.v), eh = eh0;
-		do {
-			if (strcmp(varh[eh].v, $1->u.v) == 0) {
-				varh[eh].enumconst = 1;
-				break;
-			}
-			eh = (eh + 1) % NVar;
-		} while (eh != eh0);
-	}
+	var_set_enumconst($1->u.v);
 	enumval++;
 }
     ;
@@ -8284,7 +9163,7 @@ typed_decl_rest: ansi_func_proto '{' dcls stmts '}'
 		else
 			fprintf(of, "\tret 0\n");
 	}
-	fprintf(of, "}\n\n");
+	fnend();
 }
                | ansi_proto_register ';'
                | ansi_proto_register ATTRIBUTE '(' '(' attrlist ')' ')' ';'
@@ -8311,8 +9190,7 @@ typed_decl_rest: ansi_func_proto '{' dcls stmts '}'
 		 * emit_global_arr_instance). */
 		emit_global_arr_instance(parsed_ident, g_td_arrayelem, g_td_arraydim);
 	} else {
-	if (nglo == NGlo)
-		die("too many string literals");
+	glogrow();
 	emit_zero_init(buf, parsed_type);
 	ini[nglo] = alloc(strlen(buf) + 1);
 	strcpy(ini[nglo], buf);
@@ -8329,8 +9207,7 @@ typed_decl_rest: ansi_func_proto '{' dcls stmts '}'
 	char buf[64];
 	if (parsed_type == NIL)
 		die("invalid void declaration");
-	if (nglo == NGlo)
-		die("too many string literals");
+	glogrow();
 	sprintf(buf, "{ %c %d }", irtyp(parsed_type), $2->u.n);
 	ini[nglo] = alloc(strlen(buf) + 1);
 	strcpy(ini[nglo], buf);
@@ -8404,16 +9281,14 @@ typed_decl_rest: ansi_func_proto '{' dcls stmts '}'
 			varadd(n->u.v, 1, FUNC(parsed_type), 0);
 		} else if (n->op == 'A') {
 			t = IDIR(parsed_type);
-			if (nglo == NGlo)
-				die("too many globals");
+			glogrow();
 			sprintf(buf, "align %d { z 0 }", iralign(parsed_type));
 			ini[nglo] = alloc(strlen(buf) + 1);
 			strcpy(ini[nglo], buf);
 			strcpy(gloname[nglo], n->u.v);
 			varadd(n->u.v, nglo++, t, 1);
 		} else {
-			if (nglo == NGlo)
-				die("too many globals");
+			glogrow();
 			emit_zero_init(buf, parsed_type);
 			ini[nglo] = alloc(strlen(buf) + 1);
 			strcpy(ini[nglo], buf);
@@ -8432,8 +9307,7 @@ typed_decl_rest: ansi_func_proto '{' dcls stmts '}'
 	char buf[64];
 	if (parsed_type == NIL)
 		die("invalid void declaration");
-	if (nglo == NGlo)
-		die("too many globals");
+	glogrow();
 	sprintf(buf, "{ l $glo%d }", $2->u.n);
 	ini[nglo] = alloc(strlen(buf) + 1);
 	strcpy(ini[nglo], buf);
@@ -8460,8 +9334,7 @@ typed_decl_rest: ansi_func_proto '{' dcls stmts '}'
 	if (aoa > 0) {
 		emit_global_arr_instance(parsed_ident, aelem, aoa);
 	} else {
-	if (nglo == NGlo)
-		die("too many globals");
+	glogrow();
 	emit_zero_init(buf, parsed_type);
 	ini[nglo] = alloc(strlen(buf) + 1);
 	strcpy(ini[nglo], buf);
@@ -8479,8 +9352,7 @@ typed_decl_rest: ansi_func_proto '{' dcls stmts '}'
 			varadd(n->u.v, 1, t, 0);
 		} else if (n->op == 'A') {
 			t = IDIR(parsed_type);
-			if (nglo == NGlo)
-				die("too many globals");
+			glogrow();
 			sprintf(buf, "align %d { z 0 }", iralign(parsed_type));
 			ini[nglo] = alloc(strlen(buf) + 1);
 			strcpy(ini[nglo], buf);
@@ -8493,8 +9365,7 @@ typed_decl_rest: ansi_func_proto '{' dcls stmts '}'
 			 * element and register a scalar - wrong size AND no decay). */
 			int total = SIZE(parsed_type) * n->l->u.n;
 			t = IDIR(parsed_type);
-			if (nglo == NGlo)
-				die("too many globals");
+			glogrow();
 			sprintf(buf, "align %d { z %d }", iralign(parsed_type), total);
 			ini[nglo] = alloc(strlen(buf) + 1);
 			strcpy(ini[nglo], buf);
@@ -8502,8 +9373,7 @@ typed_decl_rest: ansi_func_proto '{' dcls stmts '}'
 			varadd(n->u.v, nglo++, t, 1);
 			var_set_arraybytes(n->u.v, total);
 		} else {
-			if (nglo == NGlo)
-				die("too many globals");
+			glogrow();
 			emit_zero_init(buf, parsed_type);
 			ini[nglo] = alloc(strlen(buf) + 1);
 			strcpy(ini[nglo], buf);
@@ -8525,7 +9395,7 @@ typed_decl_rest: ansi_func_proto '{' dcls stmts '}'
 		else
 			fprintf(of, "\tret 0\n");
 	}
-	fprintf(of, "}\n\n");
+	fnend();
 }
                | '(' init_ansi par0 ')' ',' ext_decllist ';'
 {
@@ -8749,7 +9619,7 @@ kfunc: storageopt inlineopt attropt init prot_knr '{' dcls stmts '}'
 	 * fn_export_kw (QBE `interrupt` linkage). */
 	if (!stmt($8, -1, -1))
 		fprintf(of, "\tret 0\n");
-	fprintf(of, "}\n\n");
+	fnend();
 };
 
 prot_knr: IDENT '(' par0 ')'
@@ -9557,25 +10427,27 @@ idlist: IDENT                  { $$ = $1; $$->r = 0; }
 inititem: expr                        { $$ = $1; }
         | '.' IDENT '=' expr          { $$ = mknode('D', $4, $2); }
         | '[' NUM ']' '=' expr        { $$ = mknode('d', $5, $2); }
+        | '[' expr ELLIPSIS expr ']' '=' expr { $$ = mkrange($2, $4, $7); }
         | '{' initlist '}'            { $$ = mknode('{', $2, 0); }
         | '.' IDENT '=' '{' initlist '}' { $$ = mknode('D', mknode('{', $5, 0), $2); }
         ;
 
-initlist: inititem                    { $$ = mknode(0, $1, 0); }
-        | inititem ','                { $$ = mknode(0, $1, 0); }
-        | inititem ',' initlist       { $$ = mknode(0, $1, $3); }
+initlist: inititem                    { $$ = initcons($1, 0); }
+        | inititem ','                { $$ = initcons($1, 0); }
+        | inititem ',' initlist       { $$ = initcons($1, $3); }
         ;
 
 gaggr: '{' gilist opt_trailing_comma '}'   { $$ = mknode('{', $2, 0); }
      ;
 
-gilist: gitem                 { $$ = mknode(0, $1, 0); }
-      | gilist ',' gitem      { Node *p = $1; while (p->r) p = p->r; p->r = mknode(0, $3, 0); $$ = $1; }
+gilist: gitem                 { $$ = initcons($1, 0); }
+      | gilist ',' gitem      { Node *p = $1; while (p->r) p = p->r; p->r = initcons($3, 0); $$ = $1; }
       ;
 
 gitem: gival                  { $$ = $1; }
      | '.' IDENT '=' gival    { $$ = mknode('D', $4, $2); }
      | '[' expr ']' '=' gival { $$ = mknode('d', $5, $2); }
+     | '[' expr ELLIPSIS expr ']' '=' gival { $$ = mkrange($2, $4, $7); }
      ;
 
 gival: expr                   { $$ = $1; }
@@ -9741,6 +10613,7 @@ stmt: ';'                            { $$ = 0; }
     | RETURN expr ';'                { $$ = mkstmt(Ret, $2, 0, 0); }
     | RETURN ';'                     { $$ = mkstmt(Ret, 0, 0, 0); }
     | GOTO IDENT ';'                 { Stmt *s = mkstmt(Goto, 0, 0, 0); strcpy(s->label, $2->u.v); $$ = s; }
+    | GOTO '*' expr ';'              { $$ = mkstmt(Goto, $3, 0, 0); }
     | IDENT ':' stmt                 { Stmt *s = mkstmt(Label, $3, 0, 0); strcpy(s->label, $1->u.v); $$ = s; }
     | enumstart enums '}' ';'        {
         /* Block-scoped (inner-block) anonymous/tagged enum declaration:
@@ -10601,6 +11474,13 @@ pref: post
     | '-' pref          { $$ = mkneg($2); }
     | '*' pref          { $$ = mknode('@', $2, 0); }
     | '&' pref          { $$ = mknode('A', $2, 0); }
+    | AND IDENT         {
+        /* GNU label address: an integer index, see addrlbl */
+        Node *n = mknode('N', 0, 0);
+        n->u.n = addrlabel($2->u.v);
+        $$ = mknode('K', n, 0);
+        $$->u.n = IDIR(NIL);
+    }
     | '~' pref          { $$ = mknode('~', $2, 0); }
     | '!' pref          { $$ = mknode('!', $2, 0); }
     | PP pref           { $$ = mknode('p', $2, 0); }
@@ -10638,6 +11518,8 @@ post: NUM
         $$ = mknode('N', 0, 0);
         if ($3->op == 'V' && var_arraybytes($3->u.v) > 0)
             $$->u.n = var_arraybytes($3->u.v);
+        else if ($3->op == 'S')
+            $$->u.n = strlit_bytelen($3->u.n);
         else if ((member_array_bytes = sizeof_member_array_expr($3)) > 0)
             $$->u.n = member_array_bytes;
         else
@@ -10772,10 +11654,56 @@ yylex()
 	return t;
 }
 
+/* The whole input, mapped or read in by srcload() before parsing.  The
+ * lexer walks it with a cursor: GETC() and UNGETC() replace getchar() and
+ * ungetc(), so no character costs a stdio call, and identifiers are
+ * copied out of the buffer as slices. */
+static char *src, *srcp, *srcend;
+
+#define GETC() (srcp < srcend ? (unsigned char)*srcp++ : EOF)
+#define UNGETC(c) ((c) == EOF ? (void)0 : (void)srcp--)
+
+static void
+srcload()
+{
+	struct stat st;
+	size_t n, sz, r;
+
+	if (fstat(0, &st) == 0 && S_ISREG(st.st_mode) && st.st_size > 0
+	&& lseek(0, 0, SEEK_CUR) == 0) {
+		src = mmap(0, st.st_size, PROT_READ, MAP_PRIVATE, 0, 0);
+		if (src != MAP_FAILED) {
+			srcp = src;
+			srcend = src + st.st_size;
+			return;
+		}
+	}
+	/* a pipe, or a file that cannot be mapped */
+	sz = 1 << 16;
+	n = 0;
+	src = alloc(sz);
+	while ((r = fread(src + n, 1, sz - n, stdin)) > 0) {
+		n += r;
+		if (n == sz)
+			src = ralloc(src, sz *= 2);
+	}
+	srcp = src;
+	srcend = src + n;
+}
+
+/* End of the identifier characters starting at `p'. */
+static char *
+identend(char *p)
+{
+	while (p < srcend && (isalnum((unsigned char)*p) || *p == '_'))
+		p++;
+	return p;
+}
+
 int
 yylex_inner()
 {
-	struct {
+	static struct {
 		char *s;
 		int t;
 	} kwds[] = {
@@ -10832,21 +11760,21 @@ yylex_inner()
 	char v[NString], *p;
 
 	do {
-		c = getchar();
+		c = GETC();
 		if (c == '#')
-			while ((c = getchar()) != '\n')
+			while ((c = GETC()) != '\n' && c != EOF)
 				;
 		if (c == '/') {
-			c1 = getchar();
+			c1 = GETC();
 			if (c1 == '/') {
 				/* Single-line comment */
-				while ((c = getchar()) != '\n')
+				while ((c = GETC()) != '\n' && c != EOF)
 					;
 			} else if (c1 == '*') {
 				/* Block comment */
 				int prev = 0;
 				while (1) {
-					c = getchar();
+					c = GETC();
 					if (c == EOF)
 						die("unclosed block comment");
 					if (c == '\n')
@@ -10857,7 +11785,7 @@ yylex_inner()
 				}
 				c = ' ';
 			} else {
-				ungetc(c1, stdin);
+				UNGETC(c1);
 			}
 		}
 		if (c == '\n')
@@ -10876,17 +11804,17 @@ yylex_inner()
 
 		/* Handle leading dot for numbers like .5 */
 		if (c == '.') {
-			c = getchar();
+			c = GETC();
 			if (c == '.') {
 				/* `...` ellipsis (variadic prototype). */
-				c = getchar();
+				c = GETC();
 				if (c == '.')
 					return ELLIPSIS;
 				die("unexpected '..' (incomplete ellipsis)");
 			}
 			if (!isdigit(c)) {
 				/* Not a float, just a dot operator */
-				ungetc(c, stdin);
+				UNGETC(c);
 				return '.';
 			}
 			/* Float with a leading dot, e.g. .5 */
@@ -10897,10 +11825,10 @@ yylex_inner()
 		n = 0;
 		/* Check for hex (0x) or octal (0) - these can't be floats */
 		if (c == '0' && !isfloat) {
-			c = getchar();
+			c = GETC();
 			if (c == 'x' || c == 'X') {
 				/* Hexadecimal */
-				c = getchar();
+				c = GETC();
 				while (isdigit(c) || (c >= 'a' && c <= 'f') || (c >= 'A' && c <= 'F')) {
 					n *= 16;
 					if (isdigit(c))
@@ -10909,16 +11837,16 @@ yylex_inner()
 						n += c - 'a' + 10;
 					else
 						n += c - 'A' + 10;
-					c = getchar();
+					c = GETC();
 				}
 				/* Consume integer suffixes: U, L, UL, LU, ULL, LLU, etc. */
 				suffix_l = 0;
 				for (i = 0; i < 3; i++) {
-					if (c == 'l' || c == 'L') { suffix_l = 1; c = getchar(); }
-					else if (c == 'u' || c == 'U') c = getchar();
+					if (c == 'l' || c == 'L') { suffix_l = 1; c = GETC(); }
+					else if (c == 'u' || c == 'U') c = GETC();
 					else break;
 				}
-				ungetc(c, stdin);
+				UNGETC(c);
 				yylval.n = mknode('N', 0, 0);
 				yylval.n->u.n = (int)n;
 				yylval.n->nlong = suffix_l || (n > 0xFFFFUL);
@@ -10928,16 +11856,16 @@ yylex_inner()
 				while (c >= '0' && c <= '7') {
 					n *= 8;
 					n += c - '0';
-					c = getchar();
+					c = GETC();
 				}
 				/* Consume integer suffixes: U, L, UL, LU, ULL, LLU, etc. */
 				suffix_l = 0;
 				for (i = 0; i < 3; i++) {
-					if (c == 'l' || c == 'L') { suffix_l = 1; c = getchar(); }
-					else if (c == 'u' || c == 'U') c = getchar();
+					if (c == 'l' || c == 'L') { suffix_l = 1; c = GETC(); }
+					else if (c == 'u' || c == 'U') c = GETC();
 					else break;
 				}
-				ungetc(c, stdin);
+				UNGETC(c);
 				yylval.n = mknode('N', 0, 0);
 				yylval.n->u.n = (int)n;
 				yylval.n->nlong = suffix_l || (n > 0xFFFFUL);
@@ -10956,7 +11884,7 @@ yylex_inner()
 			}
 			if (p < v + NString - 1)
 				*p++ = c;
-			c = getchar();
+			c = GETC();
 		}
 
 		/* Check for decimal point */
@@ -10964,12 +11892,12 @@ yylex_inner()
 			isfloat = 1;
 			if (p < v + NString - 1)
 				*p++ = c;
-			c = getchar();
+			c = GETC();
 			/* Parse fractional part */
 			while (isdigit(c)) {
 				if (p < v + NString - 1)
 					*p++ = c;
-				c = getchar();
+				c = GETC();
 			}
 		}
 
@@ -10978,18 +11906,18 @@ yylex_inner()
 			isfloat = 1;
 			if (p < v + NString - 1)
 				*p++ = c;
-			c = getchar();
+			c = GETC();
 			/* Handle optional sign */
 			if (c == '+' || c == '-') {
 				if (p < v + NString - 1)
 					*p++ = c;
-				c = getchar();
+				c = GETC();
 			}
 			/* Parse exponent digits */
 			while (isdigit(c)) {
 				if (p < v + NString - 1)
 					*p++ = c;
-				c = getchar();
+				c = GETC();
 			}
 		}
 
@@ -11003,23 +11931,23 @@ yylex_inner()
 		if (c == 'f' || c == 'F') {
 			isfloat = 1;
 			single_float = 1;  /* `1.5f` is single-precision (Ks), not double */
-			c = getchar();  /* Consume float suffix */
+			c = GETC();  /* Consume float suffix */
 		} else if (c == 'l' || c == 'L') {
 			if (isfloat) {
 				/* `1.0L` / `1.0l` is long double — keep as double. */
-				c = getchar();
+				c = GETC();
 			} else {
 				/* Integer long suffix; consume one or two L/l. */
 				suffix_l = 1;
-				c = getchar();
+				c = GETC();
 				if (c == 'l' || c == 'L')
-					c = getchar();
+					c = GETC();
 				/* Optional trailing U/u for `LU` etc. */
 				if (c == 'u' || c == 'U')
-					c = getchar();
+					c = GETC();
 			}
 		} else if (c == 'u' || c == 'U') {
-			c = getchar();
+			c = GETC();
 			/* Optional trailing L/l for `UL` etc. — the L still
 			 * means LONG (12345UL pushed as 2 words, not 1); this
 			 * branch used to consume it without setting suffix_l,
@@ -11027,13 +11955,13 @@ yylex_inner()
 			 * (newlibc snprintf_test, §6b). */
 			if (c == 'l' || c == 'L') {
 				suffix_l = 1;
-				c = getchar();
+				c = GETC();
 				if (c == 'l' || c == 'L')
-					c = getchar();
+					c = GETC();
 			}
 		}
 
-		ungetc(c, stdin);
+		UNGETC(c);
 
 		if (isfloat) {
 			*p = 0;
@@ -11051,9 +11979,9 @@ yylex_inner()
 
 	/* Character literals */
 	if (c == '\'') {
-		c = getchar();
+		c = GETC();
 		if (c == '\\') {
-			c = getchar();
+			c = GETC();
 			switch (c) {
 			case 'n': n = '\n'; break;
 			case 't': n = '\t'; break;
@@ -11067,7 +11995,7 @@ yylex_inner()
 			case '\"': n = '\"'; break;
 			case 'x': {  /* Hex escape: \xHH */
 				n = 0;
-				c = getchar();
+				c = GETC();
 				while ((c >= '0' && c <= '9') || (c >= 'a' && c <= 'f') || (c >= 'A' && c <= 'F')) {
 					n *= 16;
 					if (c >= '0' && c <= '9')
@@ -11076,26 +12004,26 @@ yylex_inner()
 						n += c - 'a' + 10;
 					else
 						n += c - 'A' + 10;
-					c = getchar();
+					c = GETC();
 				}
-				ungetc(c, stdin);
+				UNGETC(c);
 				break;
 			}
 			default:
 				/* Check for octal escape: \ooo */
 				if (c >= '0' && c <= '7') {
 					n = c - '0';
-					c = getchar();
+					c = GETC();
 					if (c >= '0' && c <= '7') {
 						n = n * 8 + (c - '0');
-						c = getchar();
+						c = GETC();
 						if (c >= '0' && c <= '7') {
 							n = n * 8 + (c - '0');
 						} else {
-							ungetc(c, stdin);
+							UNGETC(c);
 						}
 					} else {
-						ungetc(c, stdin);
+						UNGETC(c);
 					}
 				} else {
 					/* Unknown escape, treat as literal character */
@@ -11106,7 +12034,7 @@ yylex_inner()
 		} else {
 			n = c;
 		}
-		c = getchar();
+		c = GETC();
 		if (c != '\'')
 			die("unclosed character literal");
 		yylval.n = mknode('N', 0, 0);
@@ -11115,47 +12043,23 @@ yylex_inner()
 	}
 
 	if (isalpha(c) || c == '_') {
-		p = v;
-		do {
-			if (p == &v[NString-1])
-				die("ident too long");
-			*p++ = c;
-			c = getchar();
-		} while (isalpha(c) || c == '_' || isdigit(c));
-		*p = 0;
-		ungetc(c, stdin);
+		/* The identifier is a slice of the input buffer. */
+		p = srcp - 1;
+		srcp = identend(srcp);
+		if (srcp - p >= NString)
+			die("ident too long");
+		memcpy(v, p, srcp - p);
+		v[srcp - p] = 0;
 
 		/* Check for "long long" */
 		if (strcmp(v, "long") == 0) {
-			char v2[NString];
-			char *p2;
-			int saved_c;
-
-			/* Skip whitespace */
-			do {
-				saved_c = getchar();
-			} while (isspace(saved_c) && saved_c != '\n');
-
-			/* Try to read next identifier */
-			if (isalpha(saved_c) || saved_c == '_') {
-				p2 = v2;
-				*p2++ = saved_c;
-				while (isalpha(saved_c = getchar()) || saved_c == '_' || isdigit(saved_c)) {
-					if (p2 < &v2[NString-1])
-						*p2++ = saved_c;
-				}
-				*p2 = 0;
-				ungetc(saved_c, stdin);
-
-				/* Check if it's "long" */
-				if (strcmp(v2, "long") == 0)
-					return TLNGLNG;
-
-				/* Not "long", need to put back the entire identifier */
-				for (i = strlen(v2) - 1; i >= 0; i--)
-					ungetc(v2[i], stdin);
-			} else {
-				ungetc(saved_c, stdin);
+			p = srcp;
+			while (p < srcend && isspace((unsigned char)*p) && *p != '\n')
+				p++;
+			if (srcend - p >= 4 && memcmp(p, "long", 4) == 0
+			&& identend(p + 4) == p + 4) {
+				srcp = p + 4;
+				return TLNGLNG;
 			}
 		}
 
@@ -11169,7 +12073,7 @@ yylex_inner()
 			return yylex_inner();
 
 		for (i=0; kwds[i].s; i++)
-			if (strcmp(v, kwds[i].s) == 0) {
+			if (v[0] == kwds[i].s[0] && strcmp(v, kwds[i].s) == 0) {
 				/* A type keyword (int/char/struct/...) starts a
 				 * non-array-typedef type; clear any array dim left
 				 * over from a previous TNAME so it can't leak into
@@ -11251,7 +12155,7 @@ yylex_inner()
 		p = alloc(n);
 		strcpy(p, "{ b \"");
 		for (i=5;; i++) {
-			c = getchar();
+			c = GETC();
 			if (c == EOF)
 				die("unclosed string literal");
 			if (i+8 >= n) {
@@ -11273,7 +12177,7 @@ yylex_inner()
 				 * overwritten by the next string's first char). */
 				int d;
 				do {
-					d = getchar();
+					d = GETC();
 					if (d == '\n')
 						line++;
 				} while (d == ' ' || d == '\t' || d == '\n'
@@ -11282,28 +12186,27 @@ yylex_inner()
 					i--;  /* for-loop i++ re-targets the quote slot */
 					continue;
 				}
-				ungetc(d, stdin);
+				UNGETC(d);
 				break;
 			}
 		}
 		strcpy(&p[i], "\", b 0 }");
-		if (nglo == NGlo)
-			die("too many globals");
+		glogrow();
 		ini[nglo] = p;
 		yylval.n = mknode('S', 0, 0);
 		yylval.n->u.n = nglo++;
 		return STR;
 	}
 
-	c1 = getchar();
+	c1 = GETC();
 
 	/* Check for <<= and >>= first (three character operators) */
 	if ((c == '<' && c1 == '<') || (c == '>' && c1 == '>')) {
-		int c2 = getchar();
+		int c2 = GETC();
 		if (c2 == '=') {
 			return (c == '<') ? SHLEQ : SHREQ;
 		}
-		ungetc(c2, stdin);
+		UNGETC(c2);
 		/* Fall through to return SHL or SHR below */
 	}
 
@@ -11331,7 +12234,7 @@ yylex_inner()
 	}
 #undef DI
 
-	ungetc(c1, stdin);
+	UNGETC(c1);
 
 	return c;
 }
@@ -11347,6 +12250,11 @@ int
 main(int argc, char **argv)
 {
 	int i;
+#ifdef LIBQBE
+	char *target = "i8086", *qmodel = "small";
+	int splitstack = 0;
+	FILE *outf = stdout;
+#endif
 	static struct { const char *name; int model; } mmodels[] = {
 		{ "tiny",    MTiny },
 		{ "small",   MSmall },
@@ -11366,12 +12274,35 @@ main(int argc, char **argv)
 			m = a + 2;
 		else if (strncmp(a, "--model=", 8) == 0)
 			m = a + 8;
+#ifdef LIBQBE
+		else if (strcmp(a, "-t") == 0 && i + 1 < argc)
+			target = argv[++i];
+		else if (strcmp(a, "-s") == 0)
+			splitstack = 1;
+		else if (strcmp(a, "-o") == 0 && i + 1 < argc) {
+			outf = fopen(argv[++i], "w");
+			if (!outf) {
+				fprintf(stderr, "%s: cannot open '%s'\n", argv[0], argv[i]);
+				return 1;
+			}
+		}
+#endif
 		else if (strcmp(a, "-h") == 0 || strcmp(a, "--help") == 0) {
+#ifdef LIBQBE
+			fprintf(stderr,
+			    "usage: %s [-m <model>] [-t <target>] [-s] [-o output.s] < input.c\n"
+			    "  -m <model>   memory model: tiny, small (default),\n"
+			    "               medium, compact, large, huge\n"
+			    "  -t <target>  qbe target (default: i8086)\n"
+			    "  -s           split stack (i8086 compact/large/huge)\n",
+			    argv[0]);
+#else
 			fprintf(stderr,
 			    "usage: %s [-m <model>] < input.c > output.ssa\n"
 			    "  -m <model>   memory model: tiny, small (default),\n"
 			    "               medium, compact, large, huge\n",
 			    argv[0]);
+#endif
 			return 0;
 		} else {
 			fprintf(stderr, "%s: unknown argument '%s'\n", argv[0], a);
@@ -11388,27 +12319,44 @@ main(int argc, char **argv)
 				fprintf(stderr, "%s: unknown memory model '%s'\n", argv[0], m);
 				return 1;
 			}
+#ifdef LIBQBE
+			qmodel = (char *)m;
+#endif
 		}
 	}
 
-	of = stdout;
+#ifdef LIBQBE
+	if (qbe_target(target) < 0) {
+		fprintf(stderr, "%s: unknown target '%s'\n", argv[0], target);
+		return 1;
+	}
+	qbe_model(qmodel);
+	if (splitstack && qbe_splitstack() < 0) {
+		fprintf(stderr, "%s: -s requires -t i8086 with -m "
+		    "compact/large/huge\n", argv[0]);
+		return 1;
+	}
+	qbe_begin(outf);
+	qbe_unit("<minic>");
+#endif
+	ilopen();
 	nglo = 1;
+	srcload();
 	if (yyparse() != 0)
 		die("parse error");
-	for (i=1; i<nglo; i++) {
-		if (glosec[i][0] != 0)
-			fprintf(of, "section \"%s\" ", glosec[i]);
-		if (gloname[i][0] != 0)
-			/* C file-scope data has external linkage unless declared
-			 * `static`; `export` makes qbe emit `.globl _name`, which
-			 * asm_to_omf.py now treats as authoritative for data
-			 * publics (it used to auto-promote every data label) —
-			 * §6b.  Anonymous $glo<N> slots (string literals) stay
-			 * module-local. */
-			fprintf(of, "%sdata $%s = %s\n",
-				glostatic[i] ? "" : "export ", gloname[i], ini[i]);
-		else
-			fprintf(of, "data $glo%d = %s\n", i, ini[i]);
-	}
+	ilsave();
+#ifdef LIBQBE
+	ilemit();
+	fclose(of);
+	qbe_feedmem(ilbuf, illen);
+	qbe_endunit();
+	qbe_end(0);
+	fclose(outf);
+#else
+	fclose(of);
+	free(ilbuf);
+	of = stdout;
+	ilemit();
+#endif
 	return 0;
 }
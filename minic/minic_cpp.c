@@ -1,8 +1,13 @@
 /* minic_cpp.c - Standalone C preprocessor for MiniC
  *
- * Usage: minic_cpp [-Ipath] [-Dname[=value]] <input.c>
+ * Usage: minic_cpp [-Ipath] [-Dname[=value]] [-C dir] <input.c>
  *
  * Outputs preprocessed C code to stdout, which can be piped to minic.
+ *
+ * With -C, the state after the leading #include lines of the input is
+ * kept in dir, keyed by those lines and the -I/-D options, and later
+ * runs that start with the same lines pick it up from there instead of
+ * reading the headers again.  The output is the same either way.
  */
 
 #include "minic_token.h"
@@ -27,16 +32,29 @@ static void print_tokens(FILE *out, Token *tok) {
     fprintf(out, "\n");
 }
 
+// First token after the leading #include lines
+static Token *skip_includes(Token *tok) {
+    while (tok->at_bol && equal(tok, "#") && equal(tok->next, "include")) {
+        tok = tok->next->next;
+        while (!tok->at_bol && tok->kind != TK_EOF)
+            tok = tok->next;
+    }
+    return tok;
+}
+
 static void usage(char *prog) {
-    fprintf(stderr, "Usage: %s [-Ipath] [-Dname[=value]] <input.c>\n", prog);
+    fprintf(stderr, "Usage: %s [-Ipath] [-Dname[=value]] [-C dir] <input.c>\n", prog);
     fprintf(stderr, "  -Ipath         Add include path\n");
     fprintf(stderr, "  -Dname         Define macro (value=1)\n");
     fprintf(stderr, "  -Dname=value   Define macro with value\n");
+    fprintf(stderr, "  -C dir         Cache the included headers in dir\n");
     exit(1);
 }
 
 int main(int argc, char **argv) {
     char *input_file = NULL;
+    char *cache_dir = NULL;
+    uint64_t key = fnv_update(FNV_BASIS, "minic_cpp pch 1", 16);
 
     // Parse command line arguments
     for (int i = 1; i < argc; i++) {
@@ -52,6 +70,8 @@ int main(int argc, char **argv) {
                     path = argv[i];
                 }
                 add_include_path(path);
+                key = fnv_update(key, "I", 1);
+                key = fnv_update(key, path, strlen(path) + 1);
             } else if (strncmp(argv[i], "-D", 2) == 0) {
                 // Define macro
                 char *def = argv[i] + 2;
@@ -62,6 +82,8 @@ int main(int argc, char **argv) {
                     }
                     def = argv[i];
                 }
+                key = fnv_update(key, "D", 1);
+                key = fnv_update(key, def, strlen(def) + 1);
                 // Parse name=value
                 char *eq = strchr(def, '=');
                 if (eq) {
@@ -70,6 +92,16 @@ int main(int argc, char **argv) {
                 } else {
                     define_macro(def, "1");
                 }
+            } else if (strncmp(argv[i], "-C", 2) == 0) {
+                // Prefix cache directory
+                cache_dir = argv[i] + 2;
+                if (*cache_dir == '\0') {
+                    if (++i >= argc) {
+                        fprintf(stderr, "Error: -C requires an argument\n");
+                        usage(argv[0]);
+                    }
+                    cache_dir = argv[i];
+                }
             } else {
                 fprintf(stderr, "Unknown option: %s\n", argv[i]);
                 usage(argv[0]);
@@ -101,10 +133,45 @@ int main(int argc, char **argv) {
         return 1;
     }
 
+    // Pick up the headers from the cache, or have them recorded
+    char *cache = NULL;
+    Token *rest = skip_includes(tok);
+    if (cache_dir && rest != tok) {
+        char *contents = tok->file->contents;
+        key = fnv_update(key, input_file, strlen(input_file) + 1);
+        key = fnv_update(key, contents, rest->loc - contents);
+        cache = format("%s/%016llx.pch", cache_dir, (unsigned long long)key);
+
+        char *text = pch_load(cache);
+        if (text) {
+            fputs(text, stdout);
+            tok = rest;
+            cache = NULL;
+        } else {
+            pch_begin(rest);
+        }
+    }
+
     // Preprocess
     tok = preprocess(tok);
 
-    // Output preprocessed code
+    // Output preprocessed code, saving what the headers put out
+    Token *last;
+    if (cache && pch_end(&last)) {
+        char *text;
+        size_t len;
+        FILE *mem = open_memstream(&text, &len);
+        for (; last; tok = tok->next) {
+            print_token(mem, tok);
+            if (tok == last) {
+                tok = tok->next;
+                break;
+            }
+        }
+        fclose(mem);
+        pch_save(cache, text, len);
+        fwrite(text, 1, len, stdout);
+    }
     print_tokens(stdout, tok);
 
     return 0;
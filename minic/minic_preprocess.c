@@ -14,6 +14,7 @@
 #include <libgen.h>
 #include <sys/stat.h>
 #include <time.h>
+#include <unistd.h>
 
 //
 // Global state
@@ -25,6 +26,14 @@ static HashMap pragma_once;             // #pragma once tracking
 static HashMap include_guards;          // Include guard optimization
 static CondIncl *cond_incl;             // Conditional inclusion stack
 
+static Token *pch_mark;                 // Prefix end, while recording
+static FILE *pch_deps;                  // Files the prefix depends on
+static bool pch_volatile;               // __DATE__/__TIME__ was expanded
+static void pch_snapshot(Token *head, Token *cur);
+static void pch_note_include(char *includer, char *filename, bool is_dquote, char *path);
+static void pch_note_probe(char *includer, char *filename, bool is_dquote, char *path);
+static char *resolve_include(char *includer, char *filename, bool is_dquote);
+
 //
 // Utility functions
 //
@@ -197,7 +206,7 @@ static Token *paste(Token *lhs, Token *rhs) {
 //
 
 static Hideset *new_hideset(char *name) {
-    Hideset *hs = calloc_checked(1, sizeof(Hideset));
+    Hideset *hs = arena_alloc(sizeof(Hideset));
     hs->name = name;
     return hs;
 }
@@ -339,7 +348,7 @@ static MacroArg *read_macro_arg_one(Token **rest, Token *tok, bool read_rest) {
 
     cur->next = new_eof(tok);
 
-    MacroArg *arg = calloc_checked(1, sizeof(MacroArg));
+    MacroArg *arg = arena_alloc(sizeof(MacroArg));
     arg->tok = head.next;
     *rest = tok;
     return arg;
@@ -377,7 +386,7 @@ static MacroArg *read_macro_args(Token **rest, Token *tok, MacroParam *params, c
         MacroArg *arg;
         if (equal(tok, ")")) {
             // No variadic args - create empty arg
-            arg = calloc_checked(1, sizeof(MacroArg));
+            arg = arena_alloc(sizeof(MacroArg));
             arg->tok = new_eof(tok);
         } else {
             // Read all remaining args as variadic
@@ -612,12 +621,32 @@ static Token *skip_cond_incl(Token *tok) {
 // For now, just support defined(MACRO) and integer constants
 static long eval_const_expr(Token **rest, Token *tok);
 
+// __has_include counts as defined, so #ifdef __has_include works
+static bool is_defined(Token *tok) {
+    return find_macro(tok) || equal(tok, "__has_include");
+}
+
 // Expand macros in #if expression, but leave "defined" operator alone
 static Token *preprocess_if_expr(Token *tok) {
     Token head = {};
     Token *cur = &head;
 
     while (tok->kind != TK_EOF) {
+        // Nor the header name of __has_include
+        if (equal(tok, "__has_include")) {
+            cur = cur->next = copy_token(tok);
+            tok = tok->next;
+            if (equal(tok, "(")) {
+                while (tok->kind != TK_EOF) {
+                    cur = cur->next = copy_token(tok);
+                    tok = tok->next;
+                    if (equal(cur, ")"))
+                        break;
+                }
+            }
+            continue;
+        }
+
         // Don't expand "defined" operator
         if (equal(tok, "defined")) {
             cur = cur->next = copy_token(tok);
@@ -664,7 +693,7 @@ static long eval_defined(Token **rest, Token *tok) {
     if (tok->kind != TK_IDENT)
         error_tok(start, "macro name must be an identifier");
 
-    Macro *m = find_macro(tok);
+    bool defined = is_defined(tok);
     tok = tok->next;
 
     if (has_paren) {
@@ -673,7 +702,37 @@ static long eval_defined(Token **rest, Token *tok) {
     }
 
     *rest = tok;
-    return m ? 1 : 0;
+    return defined;
+}
+
+// __has_include("file") or __has_include(<file>): would #include find it
+static long eval_has_include(Token **rest, Token *tok) {
+    Token *start = tok;
+    char *filename;
+    bool is_dquote;
+
+    tok = skip(tok, "(");
+    if (tok->kind == TK_STR) {
+        is_dquote = true;
+        filename = strndup_checked(tok->loc + 1, tok->len - 2);
+        tok = tok->next;
+    } else if (equal(tok, "<")) {
+        Token *lt = tok;
+        for (; !equal(tok, ">"); tok = tok->next)
+            if (tok->kind == TK_EOF)
+                error_tok(start, "expected '>'");
+        is_dquote = false;
+        filename = join_tokens(lt->next, tok);
+        tok = tok->next;
+    } else {
+        error_tok(tok, "expected a filename");
+    }
+    *rest = skip(tok, ")");
+
+    char *path = resolve_include(start->file->name, filename, is_dquote);
+    if (pch_mark)
+        pch_note_probe(start->file->name, filename, is_dquote, path);
+    return path != NULL;
 }
 
 // Primary expression: number, defined(), or ( expr )
@@ -687,6 +746,9 @@ static long eval_primary(Token **rest, Token *tok) {
     if (equal(tok, "defined"))
         return eval_defined(rest, tok->next);
 
+    if (equal(tok, "__has_include"))
+        return eval_has_include(rest, tok->next);
+
     if (tok->kind == TK_NUM) {
         *rest = tok->next;
         return tok->val;
@@ -925,6 +987,17 @@ char *search_include_paths(char *filename) {
     return NULL;
 }
 
+// Find the file for #include: "..." is tried next to the includer first
+static char *resolve_include(char *includer, char *filename, bool is_dquote) {
+    if (filename[0] != '/' && is_dquote) {
+        char *dir = dirname(strdup(includer));
+        char *path = format("%s/%s", dir, filename);
+        if (file_exists(path))
+            return path;
+    }
+    return search_include_paths(filename);
+}
+
 //
 // Include guard detection (optimization)
 //
@@ -1067,6 +1140,9 @@ static Token *preprocess2(Token *tok) {
     Token *cur = &head;
 
     while (tok->kind != TK_EOF) {
+        if (tok == pch_mark)
+            pch_snapshot(&head, cur);
+
         // Macro expansion
         if (expand_macro(&tok, tok))
             continue;
@@ -1088,21 +1164,12 @@ static Token *preprocess2(Token *tok) {
             bool is_dquote;
             char *filename = read_include_filename(&tok, tok->next, &is_dquote);
 
-            // Try relative path first for "..." includes
-            if (filename[0] != '/' && is_dquote) {
-                char *dir = dirname(strdup(start->file->name));
-                char *path = format("%s/%s", dir, filename);
-                if (file_exists(path)) {
-                    tok = include_file(tok, path, start->next);
-                    continue;
-                }
-            }
-
-            // Search include paths
-            char *path = search_include_paths(filename);
+            char *path = resolve_include(start->file->name, filename, is_dquote);
             if (!path)
                 error_tok(start, "cannot find include file: %s", filename);
 
+            if (pch_mark)
+                pch_note_include(start->file->name, filename, is_dquote, path);
             tok = include_file(tok, path, start->next);
             continue;
         }
@@ -1163,7 +1230,7 @@ static Token *preprocess2(Token *tok) {
         // #ifdef directive
         //
         if (equal(tok, "ifdef")) {
-            bool defined = find_macro(tok->next);
+            bool defined = is_defined(tok->next);
             push_cond_incl(start, defined);
             if (!defined)
                 tok = skip_cond_incl(tok->next);
@@ -1176,7 +1243,7 @@ static Token *preprocess2(Token *tok) {
         // #ifndef directive
         //
         if (equal(tok, "ifndef")) {
-            bool defined = find_macro(tok->next);
+            bool defined = is_defined(tok->next);
             push_cond_incl(start, !defined);
             if (defined)
                 tok = skip_cond_incl(tok->next);
@@ -1283,6 +1350,9 @@ static Token *preprocess2(Token *tok) {
         error_tok(start, "invalid preprocessing directive");
     }
 
+    if (tok == pch_mark)
+        pch_snapshot(&head, cur);
+
     cur->next = tok;
     return head.next;
 }
@@ -1316,10 +1386,12 @@ static char *get_time_str(void) {
 }
 
 static Token *date_macro(Token *tmpl) {
+    pch_volatile = true;
     return new_str_token(get_date_str(), tmpl);
 }
 
 static Token *time_macro(Token *tmpl) {
+    pch_volatile = true;
     return new_str_token(get_time_str(), tmpl);
 }
 
@@ -1352,3 +1424,353 @@ void define_macro(char *name, char *buf) {
 void undef_macro(char *name) {
     hashmap_delete(&macros, name);
 }
+
+//
+// Prefix cache
+//
+// Most files open with a run of #include lines that pull in the same
+// headers every time.  minic_cpp -C marks the first token after that run
+// with pch_begin(); when preprocess2() reaches it, the macro table,
+// include guards and #pragma once set are written down together with the
+// includes that were resolved on the way.  A later run with the same
+// prefix and options loads that state with pch_load() and only has to
+// preprocess the rest of the file.
+//
+// A cache file is text with length-prefixed strings:
+//
+//   R dquote includer filename path hash   an #include and what it found
+//   H dquote includer filename path        a __has_include probe; path
+//                                          is empty if it found nothing
+//   O path                                 #pragma once
+//   G path guard                           include guard
+//   M objlike name file nparams params... va ntok lines... body
+//   T text                                 printed output of the prefix
+//
+// It is only used when every R record still resolves to the same file
+// with the same contents, and every H probe to the same file or, for a
+// negative one, still to none.
+//
+
+#define PCH_MAGIC "minic_cpp pch 2\n"
+
+static HashMap pch_seen;                // R and H records already written
+static char *pch_state;                 // Snapshot, once taken
+static size_t pch_statelen;
+static Token *pch_last;                 // Last output token of the prefix
+
+static void put_str(FILE *f, char *s, int len) {
+    fprintf(f, "%d:", len);
+    fwrite(s, 1, len, f);
+    fputc(' ', f);
+}
+
+static bool hash_file(char *path, uint64_t *hash) {
+    FILE *fp = fopen(path, "r");
+    if (!fp)
+        return false;
+    char buf[8192];
+    size_t n;
+    *hash = FNV_BASIS;
+    while ((n = fread(buf, 1, sizeof(buf), fp)) > 0)
+        *hash = fnv_update(*hash, buf, n);
+    fclose(fp);
+    return true;
+}
+
+// Record everything preprocess2() does until it reaches mark
+void pch_begin(Token *mark) {
+    pch_mark = mark;
+    pch_deps = open_memstream(&pch_state, &pch_statelen);
+    if (!pch_deps)
+        error("open_memstream failed: %s", strerror(errno));
+}
+
+static void pch_note_include(char *includer, char *filename, bool is_dquote, char *path) {
+    char *key = format("%d%s\n%s", is_dquote, includer, filename);
+    if (hashmap_get(&pch_seen, key))
+        return;
+    hashmap_put(&pch_seen, key, (void *)1);
+
+    uint64_t hash;
+    if (!hash_file(path, &hash))
+        error("%s: %s", path, strerror(errno));
+    fprintf(pch_deps, "R %d ", is_dquote);
+    put_str(pch_deps, includer, strlen(includer));
+    put_str(pch_deps, filename, strlen(filename));
+    put_str(pch_deps, path, strlen(path));
+    fprintf(pch_deps, "%llx\n", (unsigned long long)hash);
+}
+
+static void pch_note_probe(char *includer, char *filename, bool is_dquote, char *path) {
+    char *key = format("H%d%s\n%s", is_dquote, includer, filename);
+    if (hashmap_get(&pch_seen, key))
+        return;
+    hashmap_put(&pch_seen, key, (void *)1);
+
+    if (!path)
+        path = "";
+    fprintf(pch_deps, "H %d ", is_dquote);
+    put_str(pch_deps, includer, strlen(includer));
+    put_str(pch_deps, filename, strlen(filename));
+    put_str(pch_deps, path, strlen(path));
+    fputc('\n', pch_deps);
+}
+
+static void pch_snapshot(Token *head, Token *cur) {
+    FILE *f = pch_deps;
+    pch_mark = NULL;
+    pch_deps = NULL;
+
+    // An open #if or a time stamp in the prefix cannot be replayed
+    if (cond_incl || pch_volatile) {
+        fclose(f);
+        free(pch_state);
+        pch_state = NULL;
+        return;
+    }
+
+    HashEntry *ent;
+    int i = 0;
+    while ((ent = hashmap_next(&pragma_once, &i))) {
+        fprintf(f, "O ");
+        put_str(f, ent->key, ent->keylen);
+        fputc('\n', f);
+    }
+    i = 0;
+    while ((ent = hashmap_next(&include_guards, &i))) {
+        fprintf(f, "G ");
+        put_str(f, ent->key, ent->keylen);
+        put_str(f, ent->val, strlen(ent->val));
+        fputc('\n', f);
+    }
+
+    i = 0;
+    while ((ent = hashmap_next(&macros, &i))) {
+        Macro *m = ent->val;
+        if (m->handler)
+            continue;
+
+        fprintf(f, "M %d ", m->is_objlike);
+        put_str(f, ent->key, ent->keylen);
+        char *file = m->body->file->name;
+        put_str(f, file, strlen(file));
+
+        int n = 0;
+        for (MacroParam *p = m->params; p; p = p->next)
+            n++;
+        fprintf(f, "%d ", n);
+        for (MacroParam *p = m->params; p; p = p->next)
+            put_str(f, p->name, strlen(p->name));
+        char *va = m->va_args_name ? m->va_args_name : "";
+        put_str(f, va, strlen(va));
+
+        n = 0;
+        for (Token *t = m->body; t->kind != TK_EOF; t = t->next)
+            n++;
+        fprintf(f, "%d ", n);
+        for (Token *t = m->body; t->kind != TK_EOF; t = t->next)
+            fprintf(f, "%d ", t->line_no);
+
+        // Spaces are kept where they were, so re-tokenizing the body
+        // gives back the same tokens
+        char *body;
+        size_t len;
+        FILE *bf = open_memstream(&body, &len);
+        for (Token *t = m->body; t->kind != TK_EOF; t = t->next)
+            fprintf(bf, "%s%.*s", t->has_space ? " " : "", t->len, t->loc);
+        fclose(bf);
+        put_str(f, body, len);
+        fputc('\n', f);
+        free(body);
+    }
+
+    fclose(f);
+    pch_last = cur == head ? NULL : cur;
+}
+
+// True if the state was captured; *last is then the last token the
+// prefix put out, or NULL if it put out none
+bool pch_end(Token **last) {
+    if (pch_deps) {
+        fclose(pch_deps);
+        pch_deps = NULL;
+        free(pch_state);
+        pch_state = NULL;
+    }
+    *last = pch_last;
+    return pch_state != NULL;
+}
+
+// Write the snapshot and the prefix output; the cache is only an
+// optimization, so failing to write it is not an error
+void pch_save(char *path, char *text, size_t len) {
+    char *tmp = format("%s.%d", path, (int)getpid());
+    FILE *f = fopen(tmp, "w");
+    if (!f)
+        return;
+    fputs(PCH_MAGIC, f);
+    fwrite(pch_state, 1, pch_statelen, f);
+    fprintf(f, "T ");
+    put_str(f, text, len);
+    fputc('\n', f);
+    if (fclose(f) != 0 || rename(tmp, path) != 0)
+        remove(tmp);
+}
+
+static bool get_num(char **p, long *v) {
+    char *end;
+    *v = strtol(*p, &end, 10);
+    if (end == *p)
+        return false;
+    *p = end;
+    while (**p == ' ' || **p == '\n')
+        (*p)++;
+    return true;
+}
+
+static char *get_str(char **p, char *end) {
+    char *s = *p;
+    long len = strtol(s, &s, 10);
+    if (s == *p || *s != ':' || len < 0 || len > end - s - 1)
+        return NULL;
+    *p = s + 1 + len;
+    if (**p == ' ')
+        (*p)++;
+    return strndup_checked(s + 1, len);
+}
+
+static Macro *pch_macro(char **p, char *end) {
+    long objlike, nparams, ntok;
+    char *name, *file, *va, *body;
+
+    if (!get_num(p, &objlike) || !(name = get_str(p, end)) ||
+        !(file = get_str(p, end)) || !get_num(p, &nparams))
+        return NULL;
+
+    MacroParam head = {};
+    MacroParam *cur = &head;
+    for (long i = 0; i < nparams; i++) {
+        cur = cur->next = calloc_checked(1, sizeof(MacroParam));
+        if (!(cur->name = get_str(p, end)))
+            return NULL;
+    }
+    if (!(va = get_str(p, end)) || !get_num(p, &ntok))
+        return NULL;
+
+    int *lines = calloc_checked(ntok + 1, sizeof(int));
+    for (long i = 0; i < ntok; i++) {
+        long line;
+        if (!get_num(p, &line))
+            return NULL;
+        lines[i] = line;
+    }
+    if (!(body = get_str(p, end)))
+        return NULL;
+
+    Token *tok = tokenize(new_file(file, 0, body));
+    long n = 0;
+    for (Token *t = tok; t->kind != TK_EOF; t = t->next) {
+        if (n == ntok)
+            return NULL;
+        t->at_bol = false;
+        t->line_no = lines[n++];
+    }
+    free(lines);
+    if (n != ntok)
+        return NULL;
+
+    Macro *m = calloc_checked(1, sizeof(Macro));
+    m->name = name;
+    m->is_objlike = objlike;
+    m->params = head.next;
+    m->va_args_name = *va ? va : NULL;
+    m->body = tok;
+    return m;
+}
+
+// Restore the state saved by pch_save and return the prefix output,
+// or NULL if there is no cache or it is stale
+char *pch_load(char *path) {
+    FILE *fp = fopen(path, "r");
+    if (!fp)
+        return NULL;
+    char *buf = NULL;
+    size_t len = 0, cap = 0, n;
+    do {
+        if (len + 8192 + 1 > cap) {
+            cap = cap ? cap * 2 : 65536;
+            buf = realloc(buf, cap);
+            if (!buf)
+                error("out of memory");
+        }
+        n = fread(buf + len, 1, cap - len - 1, fp);
+        len += n;
+    } while (n > 0);
+    fclose(fp);
+    buf[len] = '\0';
+
+    char *p = buf, *end = buf + len;
+    if (strncmp(p, PCH_MAGIC, strlen(PCH_MAGIC)) != 0)
+        return NULL;
+    p += strlen(PCH_MAGIC);
+
+    HashMap macros2 = {}, once2 = {}, guards2 = {};
+    while (p < end) {
+        char kind = *p;
+        p += 2;
+        if (kind == 'R') {
+            long dquote;
+            char *includer, *filename, *path, *found;
+            uint64_t hash;
+            if (!get_num(&p, &dquote) || !(includer = get_str(&p, end)) ||
+                !(filename = get_str(&p, end)) || !(path = get_str(&p, end)))
+                return NULL;
+            found = resolve_include(includer, filename, dquote);
+            if (!found || strcmp(found, path) != 0 || !hash_file(path, &hash) ||
+                hash != strtoull(p, &p, 16))
+                return NULL;
+            p++;
+        } else if (kind == 'H') {
+            long dquote;
+            char *includer, *filename, *path, *found;
+            if (!get_num(&p, &dquote) || !(includer = get_str(&p, end)) ||
+                !(filename = get_str(&p, end)) || !(path = get_str(&p, end)))
+                return NULL;
+            found = resolve_include(includer, filename, dquote);
+            if (found ? strcmp(found, path) != 0 : *path != '\0')
+                return NULL;
+            p++;
+        } else if (kind == 'O') {
+            char *s = get_str(&p, end);
+            if (!s)
+                return NULL;
+            hashmap_put(&once2, s, (void *)1);
+            p++;
+        } else if (kind == 'G') {
+            char *s = get_str(&p, end), *guard = get_str(&p, end);
+            if (!s || !guard)
+                return NULL;
+            hashmap_put(&guards2, s, guard);
+            p++;
+        } else if (kind == 'M') {
+            Macro *m = pch_macro(&p, end);
+            if (!m)
+                return NULL;
+            hashmap_put(&macros2, m->name, m);
+            p++;
+        } else if (kind == 'T') {
+            char *text = get_str(&p, end);
+            if (!text)
+                return NULL;
+            macros = macros2;
+            pragma_once = once2;
+            include_guards = guards2;
+            init_macros();
+            free(buf);
+            return text;
+        } else {
+            return NULL;
+        }
+    }
+    return NULL;
+}
@@ -27,6 +27,16 @@ static uint64_t fnv_hash(char *s, int len) {
     return hash;
 }
 
+// Continue an FNV-1a hash over n more bytes (start from FNV_BASIS)
+uint64_t fnv_update(uint64_t hash, void *p, size_t n) {
+    unsigned char *s = p;
+    for (size_t i = 0; i < n; i++) {
+        hash *= 0x100000001b3ULL;
+        hash ^= s[i];
+    }
+    return hash;
+}
+
 static bool match(HashEntry *ent, char *key, int keylen) {
     return ent->key && ent->key != TOMBSTONE &&
            ent->keylen == keylen && memcmp(ent->key, key, keylen) == 0;
@@ -137,6 +147,16 @@ void hashmap_delete2(HashMap *map, char *key, int keylen) {
         ent->key = TOMBSTONE;
 }
 
+// Step through the live entries: start with *i = 0, NULL at the end
+HashEntry *hashmap_next(HashMap *map, int *i) {
+    while (*i < map->capacity) {
+        HashEntry *ent = &map->buckets[(*i)++];
+        if (ent->key && ent->key != TOMBSTONE)
+            return ent;
+    }
+    return NULL;
+}
+
 //
 // StringArray implementation
 //
@@ -189,6 +209,31 @@ void *malloc_checked(size_t size) {
     return ptr;
 }
 
+//
+// Arena allocation
+//
+// Tokens, hidesets and macro arguments are never freed: they live until
+// the preprocessor exits.  Carving them out of large zeroed blocks saves
+// a calloc per token, which dominated on big headers.
+//
+
+#define ARENA_BLOCK (1 << 20)
+
+static char *arena_cur;
+static char *arena_end;
+
+void *arena_alloc(size_t size) {
+    size = (size + 15) & ~(size_t)15;
+    if (size > (size_t)(arena_end - arena_cur)) {
+        size_t n = size > ARENA_BLOCK ? size : ARENA_BLOCK;
+        arena_cur = calloc_checked(1, n);
+        arena_end = arena_cur + n;
+    }
+    void *ptr = arena_cur;
+    arena_cur += size;
+    return ptr;
+}
+
 char *strndup_checked(char *s, size_t n) {
     char *buf = malloc_checked(n + 1);
     strncpy(buf, s, n);
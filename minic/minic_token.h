@@ -190,6 +190,13 @@ Token *preprocess(Token *tok);
 char *search_include_paths(char *filename);
 void add_include_path(char *path);
 
+// Prefix cache: the macro table and include state after the leading
+// #include lines of a file, saved for later runs (see pch_begin)
+void pch_begin(Token *mark);
+bool pch_end(Token **last);
+void pch_save(char *path, char *text, size_t len);
+char *pch_load(char *path);
+
 //
 // support.c - Utility functions
 //
@@ -201,6 +208,10 @@ void hashmap_put(HashMap *map, char *key, void *val);
 void hashmap_put2(HashMap *map, char *key, int keylen, void *val);
 void hashmap_delete(HashMap *map, char *key);
 void hashmap_delete2(HashMap *map, char *key, int keylen);
+HashEntry *hashmap_next(HashMap *map, int *i);
+
+#define FNV_BASIS 0xcbf29ce484222325ULL
+uint64_t fnv_update(uint64_t hash, void *p, size_t n);
 
 // String array functions
 void strarray_push(StringArray *arr, char *s);
@@ -210,6 +221,7 @@ char *format(char *fmt, ...) __attribute__((format(printf, 1, 2)));
 void *calloc_checked(size_t nmemb, size_t size);
 void *malloc_checked(size_t size);
 char *strndup_checked(char *s, size_t n);
+void *arena_alloc(size_t size);  // zeroed, never freed
 
 //
 // Error reporting
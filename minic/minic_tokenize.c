@@ -55,7 +55,7 @@ static int from_hex(char c) {
 //
 
 static Token *new_token(TokenKind kind, char *start, char *end) {
-    Token *tok = calloc_checked(1, sizeof(Token));
+    Token *tok = arena_alloc(sizeof(Token));
     tok->kind = kind;
     tok->loc = start;
     tok->len = end - start;
@@ -70,7 +70,7 @@ static Token *new_token(TokenKind kind, char *start, char *end) {
 }
 
 Token *copy_token(Token *tok) {
-    Token *t = calloc_checked(1, sizeof(Token));
+    Token *t = arena_alloc(sizeof(Token));
     *t = *tok;
     t->next = NULL;
     return t;
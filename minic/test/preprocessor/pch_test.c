@@ -0,0 +1,6 @@
+/* Test minic_cpp -C: pch_test.h is cached, the body is not */
+#include "pch_test.h"
+
+int main() {
+    return PCH_VALUE + LATE_VALUE;
+}
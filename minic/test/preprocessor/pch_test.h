@@ -0,0 +1,8 @@
+/* Header for pch_test.c; run_tests.sh edits it and adds pch_late.h */
+#define PCH_VALUE 1
+
+#if __has_include("pch_late.h")
+#include "pch_late.h"
+#else
+#define LATE_VALUE 0
+#endif
@@ -56,6 +56,48 @@ for test_file in "$DIR"/test_*.c; do
 	fi
 done
 
+# The sizeof test is all _Static_assert, so compiling it for every
+# memory model checks the near and far pointer sizes too
+for model in tiny small medium compact large huge; do
+	total=$((total + 1))
+
+	echo -n "Compiling test_sizeof_expr -m $model... "
+
+	if "$MINIC_DIR/minic" -m $model < "$DIR/test_sizeof_expr.c" >/dev/null; then
+		echo -e "${GREEN}PASS${NC}"
+		passed=$((passed + 1))
+	else
+		echo -e "${RED}FAIL${NC}"
+		failed=$((failed + 1))
+	fi
+done
+
+# minic_cpp -C must print what a run without the cache prints: cold,
+# warm, once pch_late.h appears for the negative __has_include, and
+# after pch_test.h is edited
+tmp=$(mktemp -d)
+cp "$DIR/preprocessor/pch_test.c" "$DIR/preprocessor/pch_test.h" "$tmp"
+for step in cold warm late edit; do
+	total=$((total + 1))
+
+	echo -n "Running minic_cpp -C ($step)... "
+
+	case $step in
+	late) echo "#define LATE_VALUE 2" > "$tmp/pch_late.h" ;;
+	edit) sed -i 's/PCH_VALUE 1/PCH_VALUE 3/' "$tmp/pch_test.h" ;;
+	esac
+	(cd "$tmp" && "$MINIC_DIR/minic_cpp" pch_test.c > plain.out &&
+		"$MINIC_DIR/minic_cpp" -C . pch_test.c > cached.out)
+	if [ $? -eq 0 ] && cmp -s "$tmp/plain.out" "$tmp/cached.out"; then
+		echo -e "${GREEN}PASS${NC}"
+		passed=$((passed + 1))
+	else
+		echo -e "${RED}FAIL${NC}"
+		failed=$((failed + 1))
+	fi
+done
+rm -rf "$tmp"
+
 # Clean up
 rm -f ./a.out
 
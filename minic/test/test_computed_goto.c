@@ -0,0 +1,94 @@
+# Label addresses, computed goto and dense switches
+
+int printf();
+
+# a direct-threaded interpreter: 0 halt, 1 push, 2 add, 3 dup, 4 mul
+run(char *code) {
+	static void *ops[8] = { [0 ... 7] = &&bad, [0] = &&halt,
+	                        [1] = &&push, [2] = &&add, [3] = &&dup,
+	                        [4] = &&mul };
+	int stk[16];
+	int sp;
+	char *pc;
+
+	sp = 0;
+	pc = code;
+	goto *ops[*pc++];
+push:
+	stk[sp++] = *pc++;
+	goto *ops[*pc++];
+add:
+	sp--;
+	stk[sp - 1] = stk[sp - 1] + stk[sp];
+	goto *ops[*pc++];
+dup:
+	stk[sp] = stk[sp - 1];
+	sp++;
+	goto *ops[*pc++];
+mul:
+	sp--;
+	stk[sp - 1] = stk[sp - 1] * stk[sp];
+	goto *ops[*pc++];
+halt:
+	return stk[sp - 1];
+bad:
+	return -1;
+}
+
+# a label value kept in a local
+pick(int n) {
+	void *l;
+
+	l = &&small;
+	if (n > 9)
+		l = &&big;
+	goto *l;
+small:
+	return 1;
+big:
+	return 2;
+}
+
+# dense enough for a jump table, with holes
+sw(int x) {
+	switch (x) {
+	case 3: return 30;
+	case 4: return 40;
+	case 6: return 60;
+	case 7: return 70;
+	case 8: return 80;
+	default: return -1;
+	}
+}
+
+main() {
+	char code[9];
+	int failures;
+
+	failures = 0;
+
+	code[0] = 1; code[1] = 3;
+	code[2] = 1; code[3] = 4;
+	code[4] = 2;
+	code[5] = 3;
+	code[6] = 4;
+	code[7] = 0;
+	if (run(code) != 49) failures = failures + 1;
+	code[7] = 5;
+	if (run(code) != -1) failures = failures + 1;
+
+	if (pick(3) != 1) failures = failures + 1;
+	if (pick(30) != 2) failures = failures + 1;
+
+	if (sw(3) != 30) failures = failures + 1;
+	if (sw(5) != -1) failures = failures + 1;
+	if (sw(8) != 80) failures = failures + 1;
+	if (sw(2) != -1) failures = failures + 1;
+	if (sw(9) != -1) failures = failures + 1;
+	if (sw(-3) != -1) failures = failures + 1;
+
+	if (failures == 0)
+		printf("PASS: computed goto test\n");
+	else
+		printf("FAIL: computed goto test\n");
+}
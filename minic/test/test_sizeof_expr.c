@@ -0,0 +1,92 @@
+# sizeof of expressions: casts, ternaries, member and array access,
+# compound expressions, string literals and pointer arithmetic.  Each
+# size is stated against sizeof of the type it must have, so the same
+# assertions hold in every memory model; run_tests.sh also compiles
+# this file with -m tiny .. -m huge.
+
+int printf();
+
+struct In {
+	char c;
+	int a[3];
+};
+
+struct S {
+	char c;
+	int i;
+	long l;
+	char *p;
+	struct In in;
+	struct In *pin;
+	int m[5];
+};
+
+struct S gs;
+struct S ga[4];
+char gbuf[10];
+int far *gfp;
+
+_Static_assert(sizeof((long)gs.c) == sizeof(long), "cast to long");
+_Static_assert(sizeof((char)gs.l) == 1, "cast to char");
+_Static_assert(sizeof((char *)gs.l) == sizeof(char *), "cast to pointer");
+_Static_assert(sizeof((struct In *)0) == sizeof(struct In *), "null cast");
+_Static_assert(sizeof(gs.i ? gs.c : gs.c) == sizeof(int), "ternary promotes");
+_Static_assert(sizeof(gs.i ? gs.i : gs.l) == sizeof(long), "ternary widens");
+_Static_assert(sizeof(gs.i ? gs.p : 0) == sizeof(char *), "ternary pointer");
+_Static_assert(sizeof(gs.i ? gs.in : gs.in) == sizeof(struct In), "ternary struct");
+_Static_assert(sizeof(gs.in) == sizeof(struct In), "member struct");
+_Static_assert(sizeof(gs.in.a) == 3 * sizeof(int), "nested member array");
+_Static_assert(sizeof(gs.pin->a[1]) == sizeof(int), "arrow index");
+_Static_assert(sizeof(ga[2].m) == 5 * sizeof(int), "array of structs");
+_Static_assert(sizeof(ga[2].m[4]) == sizeof(int), "element");
+_Static_assert(sizeof(ga[gs.i].in.a[gs.c]) == sizeof(int), "variable indices");
+_Static_assert(sizeof(ga) == 4 * sizeof(struct S), "whole array");
+_Static_assert(sizeof(*ga) == sizeof(struct S), "array deref");
+_Static_assert(sizeof(&ga[1]) == sizeof(struct S *), "address of element");
+_Static_assert(sizeof(gs.c + gs.c) == sizeof(int), "char arithmetic");
+_Static_assert(sizeof(gs.i * 2 + gs.l) == sizeof(long), "mixed arithmetic");
+_Static_assert(sizeof(-gs.c) == sizeof(int), "unary minus");
+_Static_assert(sizeof(!gs.l) == sizeof(int), "logical not");
+_Static_assert(sizeof(gs.l << gs.c) == sizeof(long), "shift");
+_Static_assert(sizeof(gs.i < gs.l && gs.p) == sizeof(int), "logical and");
+_Static_assert(sizeof((gs.i + 1) * (gs.l - 2)) == sizeof(long), "parens");
+_Static_assert(sizeof("abc") == 4, "string literal");
+_Static_assert(sizeof("") == 1, "empty string literal");
+_Static_assert(sizeof("ab" "cd") == 5, "concatenated literals");
+_Static_assert(sizeof(*"abc") == 1, "string deref");
+_Static_assert(sizeof(gbuf) == 10, "char array");
+_Static_assert(sizeof(gbuf + 1) == sizeof(char *), "array decays in arithmetic");
+_Static_assert(sizeof(gs.p + gs.i) == sizeof(char *), "pointer plus int");
+_Static_assert(sizeof(gs.p - gs.p)
+    == (sizeof(char *) == sizeof(int) ? sizeof(int) : sizeof(long)),
+    "pointer difference");
+_Static_assert(sizeof(*(gs.p + 1)) == 1, "deref of pointer sum");
+_Static_assert(sizeof(gs.pin + 1) == sizeof(struct In *), "struct pointer sum");
+_Static_assert(sizeof(gfp + 1) == sizeof(int far *), "far pointer sum");
+_Static_assert(sizeof(*gfp) == sizeof(int), "far deref");
+
+main() {
+	struct S s;
+	struct S *ps;
+	int failures;
+
+	failures = 0;
+	ps = &s;
+
+	# the same shapes on locals, checked at run time
+	if (sizeof((long)s.c) != sizeof(long)) failures = failures + 1;
+	if (sizeof(s.i ? s.c : s.l) != sizeof(long)) failures = failures + 1;
+	if (sizeof(ps->in.a) != 3 * sizeof(int)) failures = failures + 1;
+	if (sizeof(ps->m) != 5 * sizeof(int)) failures = failures + 1;
+	if (sizeof(ps[0].m[2] + s.l) != sizeof(long)) failures = failures + 1;
+	if (sizeof("hello") != 6) failures = failures + 1;
+	if (sizeof(ps + 1) != sizeof(struct S *)) failures = failures + 1;
+	if (sizeof(&ps->in) != sizeof(struct In *)) failures = failures + 1;
+	if (sizeof(s) != sizeof(struct S)) failures = failures + 1;
+
+	if (failures == 0) {
+		printf("PASS: sizeof expression test\n");
+	} else {
+		printf("FAIL: sizeof expression test\n");
+	}
+}
@@ -165,6 +165,18 @@ O(faroff,  T(l,l,e,e, x,x,e,e), F(0,0,0,0,0,0,0,0,0,0)) X(0,0,0) V(0)  /* extrac
  * it back into a plain `add`.  See [[project-far-ptr-unsigned-index-bug]]. */
 O(addfo,   T(e,l,e,e, e,l,e,e), F(0,0,0,0,0,0,0,0,0,0)) X(0,0,0) V(0)  /* far ptr + offset (segment preserved) */
 O(subfo,   T(e,l,e,e, e,l,e,e), F(0,0,0,0,0,0,0,0,0,0)) X(0,0,0) V(0)  /* far ptr - offset (segment preserved) */
+/* Huge-pointer arithmetic: arg0 = far ptr, arg1 = signed 32-bit byte offset
+ * (hugeadd/hugesub) or a second far ptr (hugecmp).  hugeadd/hugesub carry
+ * into the segment at paragraph granularity, so the result addresses
+ * seg*16+off ± arg1 for objects > 64 KB and normalise the result
+ * (offset < 16), since flat adds of member offsets follow; i8086 isel
+ * relaxes induction steps without such uses to hugeinc/hugedec.
+ * hugecmp returns the signed linear difference (arg0 - arg1), so it is
+ * independent of normalisation.
+ * Opaque to the optimiser like addfo/subfo. */
+O(hugeadd, T(e,l,e,e, e,l,e,e), F(0,0,0,0,0,0,0,0,0,0)) X(0,0,0) V(0)  /* huge ptr + offset */
+O(hugesub, T(e,l,e,e, e,l,e,e), F(0,0,0,0,0,0,0,0,0,0)) X(0,0,0) V(0)  /* huge ptr - offset */
+O(hugecmp, T(e,l,e,e, e,l,e,e), F(0,0,0,0,0,0,0,0,0,0)) X(0,0,0) V(0)  /* linear(arg0) - linear(arg1) */
 O(vargp,   T(x,x,x,x, x,x,x,x), F(0,0,0,0,0,0,0,0,0,0)) X(0,0,0) V(0)  /* va_start: ptr to first vararg = SS:(bp+vararg_off) */
 
 /****************************************/
@@ -190,6 +202,11 @@ O(acmn,    T(w,l,e,e, w,l,e,e), F(0,0,0,0,0,0,0,0,0,0)) X(0,0,0) V(0)
 O(afcmp,   T(e,e,s,d, e,e,s,d), F(0,0,0,0,0,0,0,0,0,0)) X(0,0,0) V(0)
 O(reqz,    T(w,l,e,e, x,x,e,e), F(0,0,0,0,0,0,0,0,0,0)) X(0,0,0) V(0)
 O(rnez,    T(w,l,e,e, x,x,e,e), F(0,0,0,0,0,0,0,0,0,0)) X(0,0,0) V(0)
+/* i8086 hugeadd/hugesub of an induction pointer by a constant (see
+ * hugeiv() in i8086/isel.c): the result is only normalised once the
+ * offset would pass 0xFFF0, otherwise just the offset word moves */
+O(hugeinc, T(e,l,e,e, e,l,e,e), F(0,0,0,0,0,0,0,0,0,0)) X(0,0,0) V(0)
+O(hugedec, T(e,l,e,e, e,l,e,e), F(0,0,0,0,0,0,0,0,0,0)) X(0,0,0) V(0)
 
 /* Arguments, Parameters, and Calls */
 O(par,     T(x,x,x,x, x,x,x,x), F(0,0,0,0,0,0,0,0,0,1)) X(0,0,0) V(0)
@@ -53,6 +53,7 @@ enum Token {
 	Tphi,
 	Tjmp,
 	Tjnz,
+	Tjtab,
 	Tret,
 	Thlt,
 	Texport,
@@ -115,6 +116,7 @@ static char *kwmap[Ntok] = {
 	[Tphi] = "phi",
 	[Tjmp] = "jmp",
 	[Tjnz] = "jnz",
+	[Tjtab] = "jtab",
 	[Tret] = "ret",
 	[Thlt] = "hlt",
 	[Texport] = "export",
@@ -467,6 +469,12 @@ parseref()
 	case Tglo:
 		c.type = CAddr;
 		c.sym.id = intern(tokval.str);
+		if (c.sym.type == SGlo && peek() == Tplus) {
+			next();
+			if (next() != Tint)
+				err("invalid token after offset in ref");
+			c.bits.i = tokval.num;
+		}
 		break;
 	}
 	return newcon(&c, curf);
@@ -690,6 +698,27 @@ parseline(PState ps)
 		if (curb->s1 == curf->start || curb->s2 == curf->start)
 			err("invalid jump to the start block");
 		goto Close;
+	case Tjtab:
+		curb->jmp.type = Jjtab;
+		r = parseref();
+		if (req(r, R))
+			err("invalid argument for jtab jump");
+		curb->jmp.arg = r;
+		expect(Tcomma);
+		expect(Tlbl);
+		curb->s1 = findblk();
+		curb->tab = vnew(0, sizeof curb->tab[0], PFn);
+		while (peek() == Tcomma) {
+			next();
+			expect(Tlbl);
+			vgrow(&curb->tab, ++curb->ntab);
+			curb->tab[curb->ntab-1] = findblk();
+			if (curb->tab[curb->ntab-1] == curf->start)
+				err("invalid jump to the start block");
+		}
+		if (curb->s1 == curf->start)
+			err("invalid jump to the start block");
+		goto Close;
 	case Thlt:
 		curb->jmp.type = Jhlt;
 	Close:
@@ -951,7 +980,8 @@ typecheck(Fn *fn)
 			if (!usecheck(r, k, fn))
 				goto JErr;
 		}
-		if (b->jmp.type == Jjnz && !usecheck(r, Kw, fn))
+		if ((b->jmp.type == Jjnz || b->jmp.type == Jjtab)
+		&& !usecheck(r, Kw, fn))
 		JErr:
 			err("invalid type for jump argument %%%s in block @%s",
 				fn->tmp[r.val].name, b->name);
@@ -959,6 +989,10 @@ typecheck(Fn *fn)
 			err("block @%s is used undefined", b->s1->name);
 		if (b->s2 && b->s2->jmp.type == Jxxx)
 			err("block @%s is used undefined", b->s2->name);
+		for (n=0; n<b->ntab; n++)
+			if (b->tab[n]->jmp.type == Jxxx)
+				err("block @%s is used undefined",
+					b->tab[n]->name);
 	}
 }
 
@@ -1282,20 +1316,28 @@ parselnk(Lnk *lnk)
 		}
 }
 
+/* parseinit, parsefeed and parsefini split parse() so that
+ * libqbe can hand over the input in several chunks; the
+ * aggregate types stay defined from one chunk to the next
+ */
 void
-parse(FILE *f, char *path, void dbgfile(char *), void data(Dat *), void func(Fn *))
+parseinit(char *path)
 {
-	Lnk lnk;
-	uint n;
-
 	lexinit();
-	inf = f;
 	inpath = path;
 	lnum = 1;
-	thead = Txxx;
 	ntyp = 0;
 	typ = vnew(0, sizeof typ[0], PHeap);
 	tokval.str = vnew(128, 1, PHeap);
+}
+
+void
+parsefeed(FILE *f, void dbgfile(char *), void data(Dat *), void func(Fn *))
+{
+	Lnk lnk;
+
+	inf = f;
+	thead = Txxx;
 	for (;;) {
 		lnk = (Lnk){0};
 		switch (parselnk(&lnk)) {
@@ -1316,17 +1358,33 @@ parse(FILE *f, char *path, void dbgfile(char *), void data(Dat *), void func(Fn
 			parsetyp();
 			break;
 		case Teof:
-			for (n=0; n<ntyp; n++) {
-				free(typ[n].name);
-				if (typ[n].nunion)
-					vfree(typ[n].fields);
-			}
-			vfree(typ);
 			return;
 		}
 	}
 }
 
+void
+parsefini()
+{
+	uint n;
+
+	for (n=0; n<ntyp; n++) {
+		free(typ[n].name);
+		if (typ[n].nunion)
+			vfree(typ[n].fields);
+	}
+	vfree(typ);
+	vfree(tokval.str);
+}
+
+void
+parse(FILE *f, char *path, void dbgfile(char *), void data(Dat *), void func(Fn *))
+{
+	parseinit(path);
+	parsefeed(f, dbgfile, data, func);
+	parsefini();
+}
+
 static void
 printcon(Con *c, FILE *f)
 {
@@ -1506,6 +1564,14 @@ printfn(Fn *fn, FILE *f)
 			if (b->s1 != b->link)
 				fprintf(f, "\tjmp @%s\n", b->s1->name);
 			break;
+		case Jjtab:
+			fprintf(f, "\tjtab ");
+			printref(b->jmp.arg, fn, f);
+			fprintf(f, ", @%s", b->s1->name);
+			for (n=0; n<b->ntab; n++)
+				fprintf(f, ", @%s", b->tab[n]->name);
+			fprintf(f, "\n");
+			break;
 		default:
 			fprintf(f, "\t%s ", jtoa[b->jmp.type]);
 			if (b->jmp.type == Jjnz) {
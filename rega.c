@@ -32,6 +32,7 @@ static int loop;       /* current loop level */
 
 static uint stmov;     /* stats: added moves */
 static uint stblk;     /* stats: added blocks */
+static uint stremat;   /* stats: rematerializations */
 
 static int *
 hint(int t)
@@ -554,17 +555,18 @@ prio2(int t1, int t2)
 void
 rega(Fn *fn)
 {
-	int j, t, r, x, rl[Tmp0];
-	Blk *b, *b1, *s, ***ps, *blist, **blk, **bp;
+	int j, t, r, x, nrm, rl[Tmp0], rmt[Tmp0], rmr[Tmp0];
+	Blk *b, *b1, *s, *blist, **blk, **bp;
 	RMap *end, *beg, cur, old, *m;
 	Ins *i;
 	Phi *p;
-	uint u, n;
+	uint u, n, ns;
 	Ref src, dst;
 
 	/* 1. setup */
 	stmov = 0;
 	stblk = 0;
+	stremat = 0;
 	regu = 0;
 	curfn = fn;
 	tmp = fn->tmp;
@@ -715,8 +717,7 @@ rega(Fn *fn)
 	/* 4. emit remaining copies in new blocks */
 	blist = 0;
 	for (b=fn->start;; b=b->link) {
-		ps = (Blk**[3]){&b->s1, &b->s2, (Blk*[1]){0}};
-		for (; (s=**ps); ps++) {
+		for (ns=0; (s=nextsucc(b, &ns));) {
 			npm = 0;
 			for (p=s->phi; p; p=p->link) {
 				dst = p->to;
@@ -734,12 +735,38 @@ rega(Fn *fn)
 					src = rref(&end[b->id], src.val);
 				pmadd(src, dst, p->cls);
 			}
+			nrm = 0;
 			for (t=Tmp0; bsiter(s->in, &t); t++) {
+				if (tmp[t].remat) {
+					/* recompute rather than reload,
+					 * and with no slot there is
+					 * nothing to store */
+					r = rfind(&end[b->id], t);
+					x = rfind(&beg[s->id], t);
+					if (r == -1 && x != -1) {
+						rmt[nrm] = t;
+						rmr[nrm++] = x;
+						continue;
+					}
+					if (tmp[t].slot == -1) {
+						if (x != -1)
+							pmadd(TMP(r), TMP(x),
+								tmp[t].cls);
+						continue;
+					}
+				}
 				src = rref(&end[b->id], t);
 				dst = rref(&beg[s->id], t);
 				pmadd(src, dst, tmp[t].cls);
 			}
 			curi = &insb[NIns];
+			/* after the moves, which may read rmr[] */
+			while (nrm-- > 0) {
+				t = rmt[nrm];
+				emit(tmp[t].remat->op, tmp[t].cls,
+					TMP(rmr[nrm]), tmp[t].remat->arg[0], R);
+				stremat++;
+			}
 			pmgen();
 			if (curi == &insb[NIns])
 				continue;
@@ -754,7 +781,13 @@ rega(Fn *fn)
 			idup(b1, curi, &insb[NIns]-curi);
 			b1->jmp.type = Jjmp;
 			b1->s1 = s;
-			**ps = b1;
+			if (b->s1 == s)
+				b->s1 = b1;
+			if (b->s2 == s)
+				b->s2 = b1;
+			for (u=0; u<b->ntab; u++)
+				if (b->tab[u] == s)
+					b->tab[u] = b1;
 		}
 		if (!b->link) {
 			b->link = blist;
@@ -769,6 +802,7 @@ rega(Fn *fn)
 		fprintf(stderr, "\n> Register allocation statistics:\n");
 		fprintf(stderr, "\tnew moves:  %d\n", stmov);
 		fprintf(stderr, "\tnew blocks: %d\n", stblk);
+		fprintf(stderr, "\tremats:     %d\n", stremat);
 		fprintf(stderr, "\n> After register allocation:\n");
 		printfn(fn, stderr);
 	}
@@ -100,6 +100,7 @@ static int ntmp;  /* current # of temps (for limit) */
 static int locs;  /* stack size used by locals */
 static int slot4; /* next slot of 4 bytes */
 static int slot8; /* ditto, 8 bytes */
+static uint nslot, nstore, nreload, nremat; /* statistics */
 static BSet mask[2][1]; /* class masks */
 
 /* Register-clobber mask declared by an inline-asm instruction: BIT(reg)
@@ -140,162 +141,9 @@ tcmp1(const void *pa, const void *pb)
 	return c ? c : tcmp0(pa, pb);
 }
 
-static void
-kedge(uchar *adj, int nc, int a, int b)
-{
-	size_t i;
-
-	if (a == b)
-		return;
-	i = (size_t)a*nc + b;
-	adj[i>>3] |= 1 << (i&7);
-	i = (size_t)b*nc + a;
-	adj[i>>3] |= 1 << (i&7);
-}
-
-/* i8086 only: assign stack slots to the slot-resident Kl/Ks temps by
- * interference-graph coloring so temps with disjoint live ranges SHARE
- * a slot.  The naive alternative (one private 2-word slot per temp,
- * what this pass replaces) makes frame size proportional to the number
- * of Kl temps in the function: MicroPython's mp_execute_bytecode had
- * 1261 Kl temps = 5044 bytes of frame for a maximum simultaneous
- * liveness of ~10 — and that frame is the per-level cost of generator
- * recursion ([[gen-frame-diet]]).
- *
- * Interference rules (conservative):
- *   - a def interferes with everything live across it (standard);
- *   - a def interferes with its own instruction's args: the i8086 emit
- *     handlers are multi-instruction sequences that may write the dest
- *     slot's two words while still reading arg slots;
- *   - a phi def interferes with the block's live-in, with the block's
- *     other phi defs, AND with every phi argument of the block: rega's
- *     pmgen orders the edge parallel-copies by comparing slot refs, and
- *     a slot shared between a phi def and a phi arg of the same block
- *     could otherwise force a slot<->slot cycle that emit's Oswap
- *     handler does not implement (it only swaps registers).
- * Temps that already own a slot — incoming Kl params aliased to their
- * ABI slot (negative), isel fast-local alloca address temps — keep it
- * and do not participate.
+/* On i8086 every spilled temp keeps a private slot; once rega is
+ * done, i8086/emit.c packframe() shares them by memory liveness.
  */
-static void
-colorklslots(Fn *fn)
-{
-	int t, n, c, nc, color, maxcolor;
-	int *cidx, *cand, *col, *used;
-	uchar *adj;
-	BSet live[1];
-	Blk *b;
-	Ins *i;
-	Phi *p, *q;
-	Mem *m;
-	uint a;
-	size_t bit;
-
-	cidx = emalloc(ntmp * sizeof cidx[0]);
-	nc = 0;
-	for (t=0; t<ntmp; t++)
-		cidx[t] = (t >= Tmp0
-		    && (tmp[t].cls == Kl || tmp[t].cls == Ks)
-		    && tmp[t].slot == -1) ? nc++ : -1;
-	if (nc == 0) {
-		free(cidx);
-		return;
-	}
-	cand = emalloc(nc * sizeof cand[0]);
-	for (t=0; t<ntmp; t++)
-		if (cidx[t] >= 0)
-			cand[cidx[t]] = t;
-	adj = emalloc(((size_t)nc*nc + 7) / 8);
-	bsinit(live, ntmp);
-
-	for (b=fn->start; b; b=b->link) {
-		bscopy(live, b->out);
-		if (rtype(b->jmp.arg) == RTmp)
-			bsset(live, b->jmp.arg.val);
-		for (i=&b->ins[b->nins]; i!=b->ins;) {
-			i--;
-			if (rtype(i->to) == RTmp) {
-				t = i->to.val;
-				bsclr(live, t);
-				if (cidx[t] >= 0) {
-					for (n=0; bsiter(live, &n); n++)
-						if (cidx[n] >= 0)
-							kedge(adj, nc, cidx[t], cidx[n]);
-					for (n=0; n<2; n++)
-						if (rtype(i->arg[n]) == RTmp
-						 && cidx[i->arg[n].val] >= 0)
-							kedge(adj, nc, cidx[t],
-								cidx[i->arg[n].val]);
-				}
-			}
-			for (n=0; n<2; n++)
-				switch (rtype(i->arg[n])) {
-				case RMem:
-					m = &fn->mem[i->arg[n].val];
-					if (rtype(m->base) == RTmp)
-						bsset(live, m->base.val);
-					if (rtype(m->index) == RTmp)
-						bsset(live, m->index.val);
-					break;
-				case RTmp:
-					bsset(live, i->arg[n].val);
-					break;
-				}
-		}
-		for (p=b->phi; p; p=p->link) {
-			if (rtype(p->to) != RTmp || cidx[p->to.val] < 0)
-				continue;
-			c = cidx[p->to.val];
-			for (n=0; bsiter(live, &n); n++)
-				if (cidx[n] >= 0)
-					kedge(adj, nc, c, cidx[n]);
-			for (q=b->phi; q; q=q->link) {
-				if (q != p && rtype(q->to) == RTmp
-				 && cidx[q->to.val] >= 0)
-					kedge(adj, nc, c, cidx[q->to.val]);
-				for (a=0; a<q->narg; a++)
-					if (rtype(q->arg[a]) == RTmp
-					 && cidx[q->arg[a].val] >= 0)
-						kedge(adj, nc, c,
-							cidx[q->arg[a].val]);
-			}
-		}
-	}
-
-	col = emalloc(nc * sizeof col[0]);
-	used = emalloc(nc * sizeof used[0]);
-	for (c=0; c<nc; c++)
-		used[c] = -1;
-	maxcolor = -1;
-	for (c=0; c<nc; c++) {
-		for (n=0; n<c; n++) {
-			bit = (size_t)c*nc + n;
-			if (adj[bit>>3] & (1 << (bit&7)))
-				used[col[n]] = c;
-		}
-		for (color=0; used[color] == c; color++)
-			;
-		col[c] = color;
-		if (color > maxcolor)
-			maxcolor = color;
-	}
-
-	for (c=0; c<nc; c++)
-		tmp[cand[c]].slot = locs + 2*col[c];
-	slot8 = 2*(maxcolor+1);
-	slot4 = slot8;
-
-	if (getenv("QBE_SLOT_DBG"))
-		fprintf(stderr, "SLOTDBG %s: kl=%d colors=%d slot8=%d locs=%d\n",
-			fn->name, nc, maxcolor+1, slot8, locs);
-
-	free(cidx);
-	free(cand);
-	free(adj);
-	free(col);
-	free(used);
-}
-
 static Ref
 slot(int t)
 {
@@ -331,10 +179,28 @@ slot(int t)
 		}
 		s += locs;
 		tmp[t].slot = s;
+		nslot++;
 	}
 	return SLOT(s);
 }
 
+/* the memory operand standing for a spilled
+ * temporary: the argument slot it was loaded
+ * from whole, else its own slot
+ */
+static Ref
+spillref(int t)
+{
+	Ins *i;
+
+	i = tmp[t].remat;
+	if (i && rtype(i->arg[0]) == RSlot
+	&& (i->op == Oload
+	 || (tmp[t].cls == Kw && (i->op == Oloadsw || i->op == Oloaduw))))
+		return i->arg[0];
+	return slot(t);
+}
+
 /* restricts b to hold at most k
  * temporaries, preferring those
  * present in f (if given), then
@@ -370,7 +236,8 @@ limit(BSet *b, int k, BSet *f)
 	for (i=0; i<k && i<nt; i++)
 		bsset(b, tarr[i]);
 	for (; i<nt; i++)
-		slot(tarr[i]);
+		if (!tmp[tarr[i]].remat)
+			slot(tarr[i]);
 }
 
 /* spills temporaries to fit the
@@ -422,15 +289,81 @@ reloads(BSet *u, BSet *v)
 	int t;
 
 	for (t=Tmp0; bsiter(u, &t); t++)
-		if (!bshas(v, t))
-			emit(Oload, tmp[t].cls, TMP(t), slot(t), R);
+		if (!bshas(v, t)) {
+			if (tmp[t].remat) {
+				emit(tmp[t].remat->op, tmp[t].cls, TMP(t),
+					tmp[t].remat->arg[0], R);
+				nremat++;
+			} else {
+				emit(Oload, tmp[t].cls, TMP(t), slot(t), R);
+				nreload++;
+			}
+		}
 }
 
 static void
 store(Ref r, int s)
 {
-	if (s != -1)
+	if (s != -1) {
 		emit(Ostorew + tmp[r.val].cls, 0, R, r, SLOT(s));
+		nstore++;
+	}
+}
+
+/* temporaries defined once by an instruction
+ * that reads no register and no mutable memory
+ * (a constant, a frame address, or a load from
+ * an incoming argument slot, which nothing
+ * writes) are recomputed at their reloads;
+ * they only get a slot when some use needs
+ * the value in memory
+ */
+static void
+findremat(Fn *fn)
+{
+	int t, n, *nd, argw;
+	Blk *b;
+	Phi *p;
+	Ins *i, **def;
+
+	argw = 0;
+	nd = emalloc(ntmp * sizeof nd[0]);
+	def = emalloc(ntmp * sizeof def[0]);
+	for (b=fn->start; b; b=b->link) {
+		for (p=b->phi; p; p=p->link) {
+			nd[p->to.val] += 2;
+			for (n=0; n<(int)p->narg; n++)
+				if (rtype(p->arg[n]) == RTmp)
+					nd[p->arg[n].val] += 2;
+		}
+		for (i=b->ins; i<&b->ins[b->nins]; i++) {
+			if (rtype(i->to) == RTmp) {
+				nd[i->to.val]++;
+				def[i->to.val] = i;
+			}
+			/* an argument slot whose address is
+			 * taken may be written through it */
+			if (i->op == Oaddr && rtype(i->arg[0]) == RSlot
+			&& rsval(i->arg[0]) < 0)
+				argw = 1;
+		}
+	}
+	for (t=0; t<ntmp; t++) {
+		tmp[t].remat = 0;
+		i = def[t];
+		if (t < Tmp0 || nd[t] != 1 || KBASE(tmp[t].cls) != 0
+		|| (tmp[t].cls == Kl && strcmp(T.name, "i8086") == 0))
+			continue;
+		if ((i->op == Ocopy && rtype(i->arg[0]) == RCon)
+		|| (i->op == Oaddr && rtype(i->arg[0]) == RSlot)
+		|| (isload(i->op) && rtype(i->arg[0]) == RSlot
+		    && rsval(i->arg[0]) < 0 && !argw)) {
+			tmp[t].remat = alloc(sizeof *i);
+			*tmp[t].remat = *i;
+		}
+	}
+	free(nd);
+	free(def);
 }
 
 static int
@@ -499,7 +432,7 @@ merge(BSet *u, Blk *bu, BSet *v, Blk *bv)
 		bsunion(u, v);
 	else
 		for (t=0; bsiter(v, &t); t++)
-			if (tmp[t].slot == -1)
+			if (tmp[t].slot == -1 && !tmp[t].remat)
 				bsset(u, t);
 }
 
@@ -518,9 +451,9 @@ merge(BSet *u, Blk *bu, BSet *v, Blk *bv)
 void
 spill(Fn *fn)
 {
-	Blk *b, *s1, *s2, *hd, **bp;
+	Blk *b, *s, *hd, **bp;
 	int j, l, t, k, lvarg[2];
-	uint n;
+	uint n, ns;
 	BSet u[1], v[1], w[1];
 	Ins *i;
 	Phi *p;
@@ -536,8 +469,10 @@ spill(Fn *fn)
 	bsinit(mask[0], ntmp);
 	bsinit(mask[1], ntmp);
 	locs = fn->slot;
+	fn->spill_slot_base = locs;
 	slot4 = 0;
 	slot8 = 0;
+	nslot = nstore = nreload = nremat = 0;
 	for (t=0; t<ntmp; t++) {
 		k = 0;
 		if (t >= T.fpr0 && t < T.fpr0 + T.nfpr)
@@ -580,8 +515,8 @@ spill(Fn *fn)
 			 && rtype(i->arg[0]) == RSlot
 			 && rsval(i->arg[0]) < 0)
 				tmp[i->to.val].slot = rsval(i->arg[0]);
-		colorklslots(fn);
 	}
+	findremat(fn);
 
 	for (bp=&fn->rpo[fn->nblk]; bp!=fn->rpo;) {
 		b = *--bp;
@@ -591,14 +526,11 @@ spill(Fn *fn)
 		/* 1. find temporaries in registers at
 		 * the end of the block (put them in v) */
 		curi = 0;
-		s1 = b->s1;
-		s2 = b->s2;
 		hd = 0;
-		if (s1 && s1->id <= b->id)
-			hd = s1;
-		if (s2 && s2->id <= b->id)
-		if (!hd || s2->id >= hd->id)
-			hd = s2;
+		for (ns=0; (s=nextsucc(b, &ns));)
+			if (s->id <= b->id)
+			if (!hd || s->id >= hd->id)
+				hd = s;
 		if (hd) {
 			/* back-edge */
 			bszero(v);
@@ -619,15 +551,15 @@ spill(Fn *fn)
 					limit(u, n, 0);
 				bsunion(v, u);
 			}
-		} else if (s1) {
+		} else if (b->s1) {
 			/* avoid reloading temporaries
 			 * in the middle of loops */
 			bszero(v);
-			liveon(w, b, s1);
-			merge(v, b, w, s1);
-			if (s2) {
-				liveon(u, b, s2);
-				merge(v, b, u, s2);
+			liveon(w, b, b->s1);
+			merge(v, b, w, b->s1);
+			for (ns=1; (s=nextsucc(b, &ns));) {
+				liveon(u, b, s);
+				merge(v, b, u, s);
 				bsinter(w, u);
 			}
 			limit2(v, 0, 0, w);
@@ -642,7 +574,7 @@ spill(Fn *fn)
 			bsset(v, t);
 			limit2(v, 0, 0, NULL);
 			if (!bshas(v, t))
-				b->jmp.arg = slot(t);
+				b->jmp.arg = spillref(t);
 		}
 		/* i8086: evict Kl/Ks temps from v before it becomes b->out.
 		 * Otherwise rega's block-entry loop sees them in b->out and
@@ -659,7 +591,7 @@ spill(Fn *fn)
 			}
 		}
 		for (t=Tmp0; bsiter(b->out, &t); t++)
-			if (!bshas(v, t))
+			if (!bshas(v, t) && !tmp[t].remat)
 				slot(t);
 		bscopy(b->out, v);
 
@@ -777,7 +709,7 @@ spill(Fn *fn)
 						 */
 						if (!lvarg[n])
 							bsclr(u, t);
-						i->arg[n] = slot(t);
+						i->arg[n] = spillref(t);
 					}
 				}
 			reloads(u, v);
@@ -858,6 +790,11 @@ spill(Fn *fn)
 	fn->slot += slot8;
 
 	if (debug['S']) {
+		fprintf(stderr, "\n> Spill statistics:\n");
+		fprintf(stderr, "\tslots:   %u\n", nslot);
+		fprintf(stderr, "\tstores:  %u\n", nstore);
+		fprintf(stderr, "\treloads: %u\n", nreload);
+		fprintf(stderr, "\tremats:  %u\n", nremat);
 		fprintf(stderr, "\n> Block information:\n");
 		for (b=fn->start; b; b=b->link) {
 			fprintf(stderr, "\t%-10s (% 5d) ", b->name, b->loop);
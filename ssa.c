@@ -275,8 +275,9 @@ renblk(Blk *b, Name **stk, Fn *fn)
 {
 	Phi *p;
 	Ins *i;
-	Blk *s, **ps, *succ[3];
+	Blk *s;
 	int t, m;
+	uint j;
 
 	for (p=b->phi; p; p=p->link)
 		rendef(&p->to, b, stk, fn);
@@ -293,10 +294,7 @@ renblk(Blk *b, Name **stk, Fn *fn)
 	if (rtype(b->jmp.arg) == RTmp)
 	if (fn->tmp[t].visit)
 		b->jmp.arg = getstk(t, b, stk);
-	succ[0] = b->s1;
-	succ[1] = b->s2 == b->s1 ? 0 : b->s2;
-	succ[2] = 0;
-	for (ps=succ; (s=*ps); ps++)
+	for (j=0; (s=nextsucc(b, &j));)
 		for (p=s->phi; p; p=p->link) {
 			t = p->to.val;
 			if ((t=fn->tmp[t].visit)) {
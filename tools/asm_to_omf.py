@@ -10,12 +10,22 @@ The output is a single file with proper segment directives, a DGROUP
 declaration, and auto-generated `extern`/`global` lines.
 
 Usage:
-    asm_to_omf.py [--model=<m>] <basename> <input.asm> <output.nasm.asm>
+    asm_to_omf.py [--model=<m>] [--far-static-data] [--function-sections]
+                  <basename> <input.asm> <output.nasm.asm>
 
 Near-code models (tiny/small/compact) emit all code into a shared `_TEXT`
 segment so the linker can coalesce multiple modules into a single CS frame.
 Far-code models (medium/large/huge) keep the per-module `<BASE>_TEXT`
 name so each module lands in its own physical 64KB code segment.
+
+--function-sections puts every function and every data object into its own
+COMDAT-style segment named `<SEG>$<symbol>` (e.g. `MAIN_TEXT$_main`,
+`_DATA$_table`).  omf_link.py treats everything up to the `$` as the segment
+the piece belongs to: it coalesces the surviving pieces back into `<SEG>`
+(and into `<SEG>`'s group), while `--gc-sections` can drop each piece
+individually.  A minic string literal's piece is `<SEG>$str$<symbol>`, which
+`--merge-strings` may fold into another piece with the same trailing bytes.  Interrupt handlers additionally export their
+`_qbe_isr_es_<fn>` header label, which omf_link.py treats as a GC root.
 """
 import os
 import re
@@ -36,6 +46,9 @@ def apply_local_prefix(line, prefix):
         lambda m: m.group(1) + prefix + m.group(2) + m.group(3) + prefix + m.group(4),
         line,
     )
+    # jtab entries
+    line = re.sub(r'^(\s*(?:\.short|dw)\s+)(l\d+(?:_l\d+)?)\s*$',
+                  lambda m: m.group(1) + prefix + m.group(2), line)
     line = re.sub(r'^_?glo(\d+):', prefix + r'glo\1:', line)
     line = re.sub(r'\b_?glo(\d+)\b', prefix + r'glo\1', line)
     return line
@@ -238,6 +251,140 @@ def emit_text_segments(out, code_seg, text_lines, func_bounds):
         out.append('')
 
 
+def comdat_name(base, lines, used, skip_isr=False):
+    """Name of the COMDAT-style piece holding `lines`: `<base>$<sym>` where
+    <sym> is the first label the piece defines (the function or data
+    object), made unique within the module.  Interrupt handlers start with
+    their `_qbe_isr_*` header words, so those are skipped to name the piece
+    after the handler itself."""
+    sym = None
+    for ln in lines:
+        lbl = is_label_def(ln.strip())
+        if lbl is None or lbl.startswith('.'):
+            continue
+        if skip_isr and lbl.startswith('_qbe_isr_'):
+            continue
+        sym = lbl
+        break
+    sym = re.sub(r'[^\w]', '_', sym) if sym else str(len(used))
+    name = '%s$%s' % (base, sym)
+    k = 1
+    while name in used:
+        name = '%s$%s_%d' % (base, sym, k)
+        k += 1
+    used.add(name)
+    return name
+
+
+def comdat_align(lines, default):
+    """OMF alignment for one data piece.  An explicit `align N` (from a
+    `.balign`) wins; otherwise byte-only pieces (string literals) stay
+    byte-aligned and anything else gets `default` — an odd-addressed word
+    costs the 8086 an extra bus cycle on every access."""
+    for ln in lines:
+        m = re.match(r'^\s*align\s+(\d+)\s*$', ln)
+        if m:
+            n = int(m.group(1))
+            # nasm -f obj only accepts 1, 2, 4, 16, 256 and 4096.
+            for a in (1, 2, 4, 16, 256, 4096):
+                if n <= a:
+                    return a
+            return 4096
+    if all(re.match(r'^\s*db\b', ln) or is_label_def(ln.strip())
+           for ln in lines):
+        return 1
+    return default
+
+
+def split_at(lines, bounds):
+    """Split `lines` at the given start indices into non-empty pieces.  A
+    piece that defines no label (the model-header comments qbe prints
+    ahead of the first function) is glued onto the piece that follows."""
+    n = len(lines)
+    starts = sorted(set(b for b in bounds if 0 <= b < n))
+    if not starts or starts[0] != 0:
+        starts = [0] + starts
+    starts.append(n)
+    pieces = []
+    carry = []
+    for lo, hi in zip(starts, starts[1:]):
+        piece = carry + lines[lo:hi]
+        if not any(is_label_def(l.strip()) for l in piece):
+            carry = piece
+            continue
+        pieces.append(piece)
+        carry = []
+    if carry:
+        if pieces:
+            pieces[-1].extend(carry)
+        else:
+            pieces.append(carry)
+    return pieces
+
+
+def emit_function_sections(out, code_seg, text_lines, func_bounds, used):
+    """--function-sections: one CODE piece per function.  Pieces are
+    named after their budget chunk (`<BASE>_TEXT`, `<BASE>_TEXT1`, ...,
+    see emit_text_segments) so that coalescing them back by name can
+    never build a segment past 64KB."""
+    chunk = 0
+    chunk_bytes = 0
+    for fn in split_at(text_lines, func_bounds):
+        fb = sum(est_line_bytes(l) for l in fn)
+        if chunk_bytes > 0 and chunk_bytes + fb > TEXT_SEG_BUDGET:
+            chunk += 1
+            chunk_bytes = 0
+        chunk_bytes += fb
+        base = code_seg if chunk == 0 else '%s%d' % (code_seg, chunk)
+        nm = comdat_name(base, fn, used, skip_isr=True)
+        out.append('segment %s class=CODE align=2 use16' % nm)
+        out.extend(fn)
+        out.append('')
+
+
+def is_strlit(lines, prefix):
+    """Whether a data piece is one minic string literal: a single
+    `<prefix>glo<N>` label over `db` bytes ending in a NUL.  C string
+    literals are read-only, so omf_link.py --merge-strings may share one
+    copy between every piece with the same trailing bytes."""
+    labels = [l for l in (is_label_def(ln.strip()) for ln in lines) if l]
+    if len(labels) != 1 or not re.match(re.escape(prefix) + r'glo\d+$',
+                                        labels[0]):
+        return False
+    last = None
+    for ln in lines:
+        s = ln.strip()
+        if not s or s.startswith(';') or is_label_def(s):
+            continue
+        if re.match(r'align\s+\d+$', s):
+            continue
+        if not s.startswith('db'):
+            return False
+        last = s
+    return last is not None and re.match(r'db\s+0$', last) is not None
+
+
+def emit_data_sections(out, seg, cls, lines, obj_bounds, used, prefix):
+    """--function-sections: one piece per data/bss object.  `seg` itself
+    is still emitted (empty unless the bucket holds no label at all) so
+    DGROUP's references resolve.  String literals are named
+    `<SEG>$str$<sym>` (see is_strlit)."""
+    pieces = split_at(lines, obj_bounds)
+    head = []
+    if pieces and not any(is_label_def(l.strip()) for l in pieces[0]):
+        head = pieces.pop(0)
+    out.append('segment %s class=%s align=16 use16' % (seg, cls))
+    out.extend(head)
+    out.append('')
+    for obj in pieces:
+        base = seg + '$str' if is_strlit(obj, prefix) else seg
+        nm = comdat_name(base, obj, used)
+        out.append('segment %s class=%s align=%d use16'
+                   % (nm, cls, comdat_align(obj, 2)))
+        out.extend(obj)
+        out.append('')
+
+
 def emit_huge_section(out, sec_name, lines):
     """Emit one `.section "_HUGE_<sym>"` bucket as one or more NASM
     `segment` blocks of at most HUGE_CHUNK_BYTES.  Splits the trailing
@@ -289,6 +436,7 @@ def main():
     args = sys.argv[1:]
     model = 'medium'
     far_static_data = False
+    function_sections = False
     while args and args[0].startswith('--'):
         a = args.pop(0)
         if a.startswith('--model='):
@@ -303,6 +451,8 @@ def main():
             # DGROUP — making this the default awaits the far-global-access
             # work (see NEXT_SESSION.md).
             far_static_data = True
+        elif a == '--function-sections':
+            function_sections = True
         else:
             print('asm_to_omf: unknown option: ' + a, file=sys.stderr)
             sys.exit(2)
@@ -349,6 +499,9 @@ def main():
     # segment caps at 64KB; far-data codegen can push one big TU's text past
     # it — MicroPython's py/compile.c is 78KB under compact).
     text_func_bounds = []
+    # Same for data objects: qbe emits a `.data`/`.bss` before every one
+    # (emitlnk), so under --function-sections each gets its own piece.
+    obj_bounds = {'data': [], 'bss': []}
     current = 'text'
     current_huge = None   # active `_HUGE_<sym>` key when current == 'huge'
     publics = []          # symbols declared via `.globl`
@@ -369,8 +522,10 @@ def main():
             text_func_bounds.append(len(sections['text']))
             current = 'text'; current_huge = None; continue
         if s == '.data':
+            obj_bounds['data'].append(len(sections['data']))
             current = 'data'; current_huge = None; continue
         if s == '.bss':
+            obj_bounds['bss'].append(len(sections['bss']))
             current = 'bss'; current_huge = None; continue
         m = huge_re.match(s)
         if m:
@@ -428,6 +583,12 @@ def main():
                 defined.add(lbl)
                 if current == 'text':
                     defined_text.add(lbl)
+                # An interrupt handler is entered through the vector
+                # table, not through a fixup omf_link can follow; export
+                # its header word so --gc-sections roots the handler.
+                if (function_sections and lbl.startswith('_qbe_isr_es_')
+                        and lbl not in publics):
+                    publics.append(lbl)
             referenced |= collect_referenced_syms(line)
 
             if current == 'huge':
@@ -498,11 +659,19 @@ def main():
     # paragraph frame.  Near calls and 2-byte code pointers only work when
     # caller, callee, and the runtime CS share that single frame.  No
     # budget splitting either — total code must fit 64KB anyway.
-    if model in ('tiny', 'small'):
+    used_names = set()
+    if model in ('tiny', 'small') and function_sections:
+        emit_function_sections(out, '_TEXT', sections['text'],
+                               text_func_bounds, used_names)
+    elif model in ('tiny', 'small'):
         code_seg = '_TEXT'
         out.append('segment %s class=CODE align=2 use16' % code_seg)
         out.extend(sections['text'])
         out.append('')
+    elif function_sections:
+        emit_function_sections(out, basename.upper() + '_TEXT',
+                               sections['text'], text_func_bounds,
+                               used_names)
     else:
         code_seg = basename.upper() + '_TEXT'
         emit_text_segments(out, code_seg, sections['text'], text_func_bounds)
@@ -511,13 +680,20 @@ def main():
     # base, so a within-segment NASM `align N` (N<=16) yields an N-aligned
     # effective offset.  Declaring align=16 also lets NASM accept the
     # `align 4`/`align 16` directives emitted above without complaint.
-    out.append('segment %s class=%s align=16 use16' % (data_seg, data_cls))
-    out.extend(sections['data'])
-    out.append('')
+    if function_sections:
+        emit_data_sections(out, data_seg, data_cls, sections['data'],
+                           obj_bounds['data'], used_names, prefix)
+        emit_data_sections(out, bss_seg, bss_cls, sections['bss'],
+                           obj_bounds['bss'], used_names, prefix)
+    else:
+        out.append('segment %s class=%s align=16 use16'
+                   % (data_seg, data_cls))
+        out.extend(sections['data'])
+        out.append('')
 
-    out.append('segment %s class=%s align=16 use16' % (bss_seg, bss_cls))
-    out.extend(sections['bss'])
-    out.append('')
+        out.append('segment %s class=%s align=16 use16' % (bss_seg, bss_cls))
+        out.extend(sections['bss'])
+        out.append('')
 
     # Huge data segments: one per `.section "_HUGE_<sym>"` marker.  Each
     # segment is class=HUGE so the linker can recognise it and place it
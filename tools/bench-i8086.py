@@ -0,0 +1,366 @@
+#!/usr/bin/env python3
+"""bench-i8086.py — code-size and cycle regression benchmark for the i8086
+backend.
+
+Compiles a fixed corpus with `qbe -t i8086` under every memory model and
+records, per function:
+
+    insns   instructions in the qbe assembly (always measured)
+    bytes   size of the function's `<SEG>$<sym>` piece in the OMF object
+            (asm_to_omf.py --function-sections + nasm -f obj; needs nasm)
+    cycles  8088 clocks attributed to the function by tools/sim86 -m map,
+            for the CYCLE_PROGS programs (needs nasm, minic and tools/sim86)
+
+and diffs them against the checked-in baseline (tools/bench-i8086.json).
+A metric is only compared where both the baseline and this run have it,
+so a host without nasm still checks instruction counts.
+
+Corpus (entries whose sources are missing are reported as skipped):
+    dhry       test/_dhry.ssa, Dhrystone-style string/record kernels
+    chacha20   test/_chacha20.ssa
+    bfmandel   test/_bfmandel.ssa
+    cprime     test/cprime.ssa
+    regexp     stevie-orig/regexp.c (minic)
+    search     stevie-orig/search.c (minic)
+    mp_vm      build/mp-link/vm.pp.c, the preprocessed MicroPython VM that
+               tools/build-micropython.sh leaves behind (minic)
+
+Usage:
+    bench-i8086.py [-t PCT] [-m MODEL ...] [-k SUBSTRING] [-v]
+                   [--baseline FILE] [--json FILE] [--update]
+
+A regression is an entry/model total, or a function, that grew by more
+than PCT percent (default 1.0) in any compared metric; functions below
+SMALL_FN instructions are reported but never fail the run.  --update
+rewrites the baseline with this run's numbers instead of comparing.
+
+Exit status: 0 when nothing regressed, 1 otherwise.
+"""
+import argparse
+import json
+import os
+import re
+import shutil
+import subprocess
+import sys
+import tempfile
+from typing import Dict, List, Optional, Tuple
+
+ROOT = os.path.dirname(os.path.dirname(os.path.abspath(__file__)))
+sys.path.insert(0, os.path.join(ROOT, 'tools'))
+import omf_link  # noqa: E402
+
+MODELS = ['tiny', 'small', 'medium', 'compact', 'large', 'huge']
+METRICS = ['insns', 'bytes', 'cycles']
+SMALL_FN = 16
+BASELINE = os.path.join(ROOT, 'tools', 'bench-i8086.json')
+
+# (name, path relative to ROOT, kind); kind 'ssa' goes straight to qbe,
+# 'c' through cpp + minic, 'pp' (already preprocessed) through minic.
+CORPUS = [
+    ('dhry', 'test/_dhry.ssa', 'ssa'),
+    ('chacha20', 'test/_chacha20.ssa', 'ssa'),
+    ('bfmandel', 'test/_bfmandel.ssa', 'ssa'),
+    ('cprime', 'test/cprime.ssa', 'ssa'),
+    ('regexp', 'stevie-orig/regexp.c', 'c'),
+    ('search', 'stevie-orig/search.c', 'c'),
+    ('mp_vm', 'build/mp-link/vm.pp.c', 'pp'),
+]
+
+# Whole programs built by tools/build-example.sh and run under sim86.
+CYCLE_PROGS = [
+    ('benchmark', 'minic/dos/examples/benchmark.c'),
+]
+
+# The type spellings minic does not parse, as in tools/build-example.sh.
+NORMALIZE = [
+    (r'\bunsigned short int\b', 'unsigned short'),
+    (r'\bunsigned long int\b', 'unsigned long'),
+    (r'\bsigned short int\b', 'short'),
+    (r'\bsigned long int\b', 'long'),
+    (r'\blong long int\b', 'long long'),
+    (r'\blong int\b', 'long'),
+    (r'\bshort int\b', 'short'),
+    (r'\bsigned char\b', 'char'),
+    (r'\bsigned short\b', 'short'),
+    (r'\bsigned long long\b', 'long long'),
+    (r'\bsigned long\b', 'long'),
+    (r'\bsigned int\b', 'int'),
+    (r'\bsigned\b', ''),
+]
+
+QBE = os.path.join(ROOT, 'qbe')
+MINIC = os.path.join(ROOT, 'minic', 'minic')
+SIM86 = os.path.join(ROOT, 'tools', 'sim86')
+NASM = shutil.which('nasm')
+
+END_FN = re.compile(r'^/\* end function (\S+) \*/')
+DATA_OP = re.compile(r'^(d[bwd]|times|resb|resw)\b')
+SIM_SYM = re.compile(r'^  (\S+)\s+(\d+)\s+[\d.]+%\s+(\d+)$')
+
+
+class BenchError(Exception):
+    pass
+
+
+def run(cmd: List[str], **kw) -> subprocess.CompletedProcess:
+    p = subprocess.run(cmd, stdout=subprocess.PIPE, stderr=subprocess.PIPE,
+                       **kw)
+    if p.returncode != 0:
+        err = p.stderr.decode(errors='replace').strip().splitlines()
+        raise BenchError('%s: %s' % (os.path.basename(cmd[0]),
+                                     err[-1] if err else
+                                     'exit %d' % p.returncode))
+    return p
+
+
+def count_insns(asm: str) -> Dict[str, int]:
+    """Instructions per function of a qbe i8086 .s file.  Functions run
+    from `.text` to qbe's `end function` marker; labels, directives,
+    comments and data pseudo-ops are not counted."""
+    out: Dict[str, int] = {}
+    n = None
+    for line in asm.splitlines():
+        if line == '.text':
+            n = 0
+            continue
+        if n is None:
+            continue
+        m = END_FN.match(line)
+        if m:
+            out['_' + m.group(1)] = n
+            n = None
+            continue
+        s = line.strip()
+        if not s or not line[0].isspace() or s[0] in '.;/':
+            continue
+        if DATA_OP.match(s):
+            continue
+        n += 1
+    return out
+
+
+def code_bytes(obj: str) -> Dict[str, int]:
+    """Bytes per function: the length of every `<SEG>$<sym>` CODE piece."""
+    with open(obj, 'rb') as f:
+        mod = omf_link.ModuleParser(obj, f.read()).parse()
+    out: Dict[str, int] = {}
+    for seg in mod.segments:
+        if seg and seg.cls == 'CODE' and '$' in seg.name:
+            sym = seg.name.split('$', 1)[1]
+            out[sym] = out.get(sym, 0) + seg.length
+    return out
+
+
+def to_ssa(name: str, src: str, kind: str, model: str, tmp: str) -> str:
+    if kind == 'ssa':
+        return src
+    if not os.access(MINIC, os.X_OK):
+        raise BenchError('minic/minic not built')
+    if kind == 'c':
+        p = run(['cpp', '-P', '-nostdinc', '-isysroot/var/empty', '-DDOS',
+                 '-D__TURBOC__', '-I' + os.path.join(ROOT, 'minic', 'include'),
+                 '-I' + os.path.dirname(src), src])
+        text = p.stdout.decode(errors='replace')
+        text = text.replace('\r', '').replace('\032', '')
+        for pat, rep in NORMALIZE:
+            text = re.sub(pat, rep, text)
+    else:
+        with open(src, errors='replace') as f:
+            text = f.read()
+    ssa = os.path.join(tmp, name + '.ssa')
+    with open(ssa, 'w') as f:
+        f.write(run([MINIC, '-m', model],
+                    input=text.encode()).stdout.decode())
+    return ssa
+
+
+def measure_unit(name: str, src: str, kind: str, model: str,
+                 tmp: str) -> Dict[str, Dict[str, int]]:
+    ssa = to_ssa(name, src, kind, model, tmp)
+    asm = run([QBE, '-t', 'i8086', '-m', model, ssa]).stdout.decode()
+    fns = {fn: {'insns': n} for fn, n in count_insns(asm).items()}
+    if NASM:
+        base = re.sub(r'\W', '_', name)
+        s = os.path.join(tmp, base + '.asm')
+        nasm_src = os.path.join(tmp, base + '.nasm.asm')
+        obj = os.path.join(tmp, base + '.obj')
+        with open(s, 'w') as f:
+            f.write(asm)
+        run([sys.executable, os.path.join(ROOT, 'tools', 'asm_to_omf.py'),
+             '--model=' + model, '--function-sections', base, s, nasm_src])
+        run([NASM, '-f', 'obj', '-o', obj, nasm_src])
+        for fn, n in code_bytes(obj).items():
+            fns.setdefault(fn, {})['bytes'] = n
+    return fns
+
+
+def measure_cycles(name: str, src: str, model: str,
+                   tmp: str) -> Dict[str, Dict[str, int]]:
+    out_dir = os.path.join(tmp, name)
+    env = dict(os.environ, EXAMPLE_OUT_DIR=out_dir)
+    run(['bash', os.path.join(ROOT, 'tools', 'build-example.sh'),
+         '--model=' + model, src], env=env, cwd=ROOT)
+    base = os.path.splitext(os.path.basename(src))[0]
+    exe = next((os.path.join(out_dir, base + x) for x in ('.exe', '.com')
+                if os.path.exists(os.path.join(out_dir, base + x))), None)
+    if exe is None:
+        raise BenchError('build-example.sh produced no executable')
+    p = subprocess.run([SIM86, '-n', '-q', '-p', '100000',
+                        '-m', os.path.join(out_dir, base + '.map'), exe],
+                       stdin=subprocess.DEVNULL, stdout=subprocess.DEVNULL,
+                       stderr=subprocess.PIPE)
+    if p.returncode == 124:
+        raise BenchError('sim86: ' + p.stderr.decode().strip())
+    fns: Dict[str, Dict[str, int]] = {}
+    for line in p.stderr.decode().splitlines():
+        m = SIM_SYM.match(line)
+        if m:
+            fns[m.group(1)] = {'cycles': int(m.group(2))}
+    return fns
+
+
+def totals(fns: Dict[str, Dict[str, int]]) -> Dict[str, int]:
+    t: Dict[str, int] = {}
+    for v in fns.values():
+        for k, n in v.items():
+            t[k] = t.get(k, 0) + n
+    return t
+
+
+def pct(old: int, new: int) -> float:
+    return 100.0 * (new - old) / old if old else 0.0
+
+
+def compare(base: Dict, cur: Dict, threshold: float,
+            verbose: bool) -> Tuple[List[str], List[str]]:
+    """Returns (regressions, notes)."""
+    bad: List[str] = []
+    notes: List[str] = []
+    for key in sorted(cur):
+        if key not in base:
+            notes.append('%s: new entry' % key)
+            continue
+        bt, ct = totals(base[key]), totals(cur[key])
+        for k in METRICS:
+            if k not in bt or k not in ct:
+                continue
+            d = pct(bt[k], ct[k])
+            msg = '%s: %s %d -> %d (%+.2f%%)' % (key, k, bt[k], ct[k], d)
+            if d > threshold:
+                bad.append(msg)
+            elif d < -threshold or (verbose and d):
+                notes.append(msg)
+        for fn in sorted(cur[key]):
+            bf, cf = base[key].get(fn), cur[key][fn]
+            if bf is None:
+                continue
+            for k in METRICS:
+                if k not in bf or k not in cf:
+                    continue
+                d = pct(bf[k], cf[k])
+                if abs(d) <= threshold:
+                    continue
+                msg = '  %s %s: %s %d -> %d (%+.2f%%)' % (
+                    key, fn, k, bf[k], cf[k], d)
+                small = bf.get('insns', SMALL_FN) < SMALL_FN
+                if d > 0 and not small:
+                    bad.append(msg)
+                elif verbose:
+                    notes.append(msg)
+    return bad, notes
+
+
+def main() -> int:
+    ap = argparse.ArgumentParser(
+        description='i8086 code-size/cycle regression benchmark')
+    ap.add_argument('-t', '--threshold', type=float, default=1.0,
+                    metavar='PCT', help='regression threshold in percent')
+    ap.add_argument('-m', '--model', action='append', choices=MODELS,
+                    help='memory model (repeatable; default all)')
+    ap.add_argument('-k', metavar='SUBSTRING',
+                    help='only corpus entries whose name contains SUBSTRING')
+    ap.add_argument('-v', '--verbose', action='store_true',
+                    help='also list improvements and sub-threshold changes')
+    ap.add_argument('--baseline', default=BASELINE)
+    ap.add_argument('--json', metavar='FILE',
+                    help='write this run\'s numbers to FILE')
+    ap.add_argument('--update', action='store_true',
+                    help='rewrite the baseline instead of comparing')
+    args = ap.parse_args()
+
+    if not os.access(QBE, os.X_OK):
+        print('bench-i8086: build qbe first', file=sys.stderr)
+        return 1
+    models = args.model or MODELS
+    cycles = bool(NASM) and os.access(SIM86, os.X_OK) \
+        and os.access(MINIC, os.X_OK)
+    print('bench-i8086: insns%s%s' % (
+        ', bytes' if NASM else ' (no nasm: bytes and cycles skipped)',
+        ', cycles' if cycles else
+        '' if not NASM else ' (no sim86/minic: cycles skipped)'))
+
+    cur: Dict[str, Dict[str, Dict[str, int]]] = {}
+    skipped = 0
+    with tempfile.TemporaryDirectory(prefix='bench-i8086.') as tmp:
+        jobs = [(n, p, k, False) for n, p, k in CORPUS]
+        if cycles:
+            jobs += [(n, p, 'c', True) for n, p in CYCLE_PROGS]
+        for name, rel, kind, sim in jobs:
+            if args.k and args.k not in name:
+                continue
+            src = os.path.join(ROOT, rel)
+            if not os.path.exists(src):
+                print('%-10s skipped (%s not found)' % (name, rel))
+                skipped += 1
+                continue
+            for model in models:
+                key = '%s/%s' % (name, model)
+                d = os.path.join(tmp, name + '.' + model)
+                os.makedirs(d)
+                try:
+                    if sim:
+                        fns = measure_cycles(name, src, model, d)
+                    else:
+                        fns = measure_unit(name, src, kind, model, d)
+                except BenchError as e:
+                    print('%-18s skipped (%s)' % (key, e))
+                    skipped += 1
+                    continue
+                cur[key] = fns
+                t = totals(fns)
+                print('%-18s %4d fns %s' % (key, len(fns), '  '.join(
+                    '%s=%d' % (k, t[k]) for k in METRICS if k in t)))
+
+    if args.json:
+        with open(args.json, 'w') as f:
+            json.dump(cur, f, indent=1, sort_keys=True)
+            f.write('\n')
+    if args.update:
+        with open(args.baseline, 'w') as f:
+            json.dump(cur, f, indent=1, sort_keys=True)
+            f.write('\n')
+        print('bench-i8086: wrote %s (%d entries)' % (
+            os.path.relpath(args.baseline), len(cur)))
+        return 0
+
+    try:
+        with open(args.baseline) as f:
+            base = json.load(f)
+    except FileNotFoundError:
+        print('bench-i8086: no baseline, run with --update', file=sys.stderr)
+        return 1
+    bad, notes = compare(base, cur, args.threshold, args.verbose)
+    for n in notes:
+        print(n)
+    if bad:
+        print('\nRegressions (> %.2f%%):' % args.threshold)
+        for b in bad:
+            print(b)
+        return 1
+    print('\nNo regression (%d entries, %d skipped).' % (len(cur), skipped))
+    return 0
+
+
+if __name__ == '__main__':
+    sys.exit(main())
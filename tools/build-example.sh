@@ -3,7 +3,8 @@
 # Modeled on tools/build-int86x-probe.sh, parameterized by source file.
 #
 # Usage: tools/build-example.sh path/to/source.c [path/to/extra.c ...]
-# Output: build/examples/<name>/<name>.exe
+# Output: build/examples/<name>/<name>.exe, or $EXAMPLE_OUT_DIR/<name>.exe
+# when set (tools/ptest.py gives each parallel build its own directory).
 
 set -eu
 
@@ -120,7 +121,7 @@ done
 
 SRC="${SOURCES[0]}"
 base="$(basename "$SRC" .c)"
-OUT_DIR="$QBE_DIR/build/examples/$base"
+OUT_DIR="${EXAMPLE_OUT_DIR:-$QBE_DIR/build/examples/$base}"
 MINIC="$QBE_DIR/minic/minic"
 INC_DIR="$QBE_DIR/minic/include"
 QBE="$QBE_DIR/qbe"
@@ -193,6 +194,7 @@ grep -v -E '^\.(text|data|bss|balign|section|globl|type|size|local|file|ident|st
 		s/^(l\d+(?:_l\d+)?):/${p}$1:/;
 		s/^(\s*j[a-z]+\s+)(l\d+(?:_l\d+)?)\b/$1${p}$2/;
 		s/^(\s*jnz\s+[^,]+,\s*)(l\d+(?:_l\d+)?)(\s*,\s*)(l\d+(?:_l\d+)?)\b/$1${p}$2$3${p}$4/;
+		s/^(\s*(?:\.short|dw)\s+)(l\d+(?:_l\d+)?)\s*$/$1${p}$2/;
 		s/^_?glo(\d+):/${p}glo$1:/;
 		s/\b_?glo(\d+)\b/${p}glo$1/g;
 	' \
@@ -27,6 +27,8 @@
 # the FAR_*_EXE helpers in libstub_to_exe.py.
 #
 # Usage: tools/build-micropython.sh [--keep-going] [--model=<m>]
+#   MP_JOBS=<n>          parallel TU compiles (default: one per CPU)
+#   MP_CACHE_DIR=<dir>   stage cache (default build/mp-cache); MP_CACHE=0 off
 
 set -u
 KEEP_GOING=0
@@ -87,6 +89,12 @@ INC_DIR="$QBE_DIR/minic/include"
 STUB="$QBE_DIR/build/mp-spike/stubinc"
 MINIC="$QBE_DIR/minic/minic"
 QBE="$QBE_DIR/qbe"
+# minic with libqbe linked in (`make -C minic minic-qbe`) compiles each TU in
+# one process with no .ssa round trip; MP_INPROC=0 forces the two-step path.
+MINIC_QBE=""
+if [ "${MP_INPROC:-1}" != "0" ] && [ -x "$QBE_DIR/minic/minic-qbe" ]; then
+	MINIC_QBE="$QBE_DIR/minic/minic-qbe"
+fi
 DOS_DIR="$QBE_DIR/minic/dos"
 OUT_DIR="$QBE_DIR/build/mp-link"
 mkdir -p "$OUT_DIR"
@@ -134,17 +142,16 @@ MP_HEAP2_SIZE=${MP_HEAP2_SIZE:-65024}
 MP_DOS_TINY_STACK_CHECK=${MP_DOS_TINY_STACK_CHECK:-0}
 MP_DOS_STACKLESS_RECURSION_RAISE=${MP_DOS_STACKLESS_RECURSION_RAISE:-0}
 MP_EXTRA_CPPFLAGS=${MP_EXTRA_CPPFLAGS:-}
-# Per-FUNCTION text segments (§4t): with budget=1, asm_to_omf splits .text at
-# every function boundary, so omf_link --gc-sections strips each unreachable
-# function individually (statics included) instead of whole-TU text blocks,
-# and --pack-code re-packs the survivors back-to-back (word-aligned, no
-# paragraph waste).  On the curated MicroPython link this cut code 703553 →
-# 452461 bytes (-251 KB, -36%): the whole-TU granularity had been retaining
-# every dead function in any partially-used TU (mpz, showbc, profile, ...).
-# Only set here — the asm_to_omf default stays 56000 for builds that don't
-# link with --gc-sections --pack-code (per-function segments without packing
-# would ADD paragraph padding per function).
-export QBE_TEXT_SEG_BUDGET=${QBE_TEXT_SEG_BUDGET:-1}
+# Per-FUNCTION sections (§4t): asm_to_omf --function-sections puts every
+# function and every data object in its own `<SEG>$<sym>` piece, so omf_link
+# --gc-sections strips each unreachable function (statics included) and each
+# unreferenced data object individually instead of whole-TU blocks, and
+# --pack-code re-packs the surviving code back-to-back (word-aligned, no
+# paragraph waste).  On the curated MicroPython link per-function text alone
+# cut code 703553 → 452461 bytes (-251 KB, -36%): the whole-TU granularity had
+# been retaining every dead function in any partially-used TU (mpz, showbc,
+# profile, ...).  The link map's "Discarded segments" table reports the rest.
+FUNCSEC_FLAG=--function-sections
 
 NORMALIZE='s/\bunsigned short int\b/unsigned short/g;s/\bunsigned long int\b/unsigned long/g;s/\bsigned short int\b/short/g;s/\bsigned long int\b/long/g;s/\blong long int\b/long long/g;s/\blong int\b/long/g;s/\bshort int\b/short/g;s/\bsigned char\b/char/g;s/\bsigned long long\b/long long/g;s/\bsigned long\b/long/g;s/\bsigned int\b/int/g'
 
@@ -171,27 +178,72 @@ PORT_SRCS=("$DOSPORT/main.c" "$DOSPORT/mphalport.c" "$DOSPORT/gcheap2.c")
 SOFTFLOAT_SRC=("$DOS_DIR/softfloat.c")
 ALL_SRCS=("${CORE_SRCS[@]}" "${PORT_SRCS[@]}" "${SOFTFLOAT_SRC[@]}")
 
-echo "=== Compiling ${#ALL_SRCS[@]} TUs (${#CORE_SRCS[@]} core + ${#PORT_SRCS[@]} port + ${#SOFTFLOAT_SRC[@]} softfloat) [model=$MODEL${FARSTATIC_FLAG:+, far-static-data}] ==="
+# Parallel, cached TU compiles.  Each TU runs in its own worker (xargs -P,
+# MP_JOBS at a time, default one per CPU).  Every stage's output is stored
+# in a content-addressed cache (MP_CACHE_DIR, default build/mp-cache) under
+# a hash of the stage's inputs: the input file, the tool binary and the
+# flags.  A stage whose key is already there is copied out instead of run,
+# so after an edit only the TUs (and stages) it actually reaches rebuild.
+# The cpp stage cannot hash its inputs up front; it keeps a manifest of the
+# headers the last run read (clang -MD) and is a hit while all of them,
+# the source, the flags and this script are unchanged.  MP_CACHE=0 turns
+# the cache off.
+#
+# Each stage appends "<stage> <ms> run|hit" to $OUT_DIR/<tu>.time, and the
+# totals are reported after the compile.
+if command -v sha256sum >/dev/null; then
+	HASH=sha256sum
+else
+	HASH="shasum -a 256"
+fi
+MP_JOBS=${MP_JOBS:-$(getconf _NPROCESSORS_ONLN 2>/dev/null || echo 4)}
+MP_CACHE=${MP_CACHE:-1}
+CACHE_DIR="${MP_CACHE_DIR:-$QBE_DIR/build/mp-cache}"
+mkdir -p "$CACHE_DIR"
 
-pass_objs=()
-fail=()
-for f in "${ALL_SRCS[@]}"; do
-	base=$(basename "$f" .c)
-	pp="$OUT_DIR/$base.pp.c"
-	ssa="$OUT_DIR/$base.ssa"
-	asm="$OUT_DIR/$base.asm"
-	omf="$OUT_DIR/$base.omf.asm"
-	obj="$OUT_DIR/$base.obj"
-	err="$OUT_DIR/$base.err"
-	: > "$err"
+now_ms() {
+	if [ -n "${EPOCHREALTIME:-}" ]; then
+		local t=${EPOCHREALTIME/[.,]/}
+		echo $((t / 1000))
+	else
+		python3 -c 'import time; print(int(time.time() * 1000))'
+	fi
+}
+hash_str() { printf '%s' "$1" | $HASH | cut -c1-64; }
+hash_file() { $HASH < "$1" | cut -c1-64; }
 
-	if ! clang -E -P -nostdinc -DDOS -D__TURBOC__ $FARDATA_DEF $MP_LIBC_DEFS \
-			"-DMP_GC_HEAP2_SIZE=$MP_HEAP2_SIZE" \
-			$MP_EXTRA_CPPFLAGS \
-			"-I$DOSPORT" "-I$STUB" "-I$INC_DIR" "-I$MP" "-I$GENHDR" \
-			"$f" 2>"$err" > "$OUT_DIR/$base.raw.c"; then
-		fail+=("$base (cpp)"); [ $KEEP_GOING -eq 0 ] && { echo "FAIL cpp: $base"; cat "$err"; exit 1; }; continue
+# run_stage <stage> <out> <key> <cmd...>: run cmd to produce out, or take
+# out from the cache when a run with the same key has been stored
+run_stage() {
+	local stage=$1 out=$2 key t0 t1
+	key=$(hash_str "$3")
+	shift 3
+	if [ "$MP_CACHE" != 0 ] && [ -f "$CACHE_DIR/$key" ]; then
+		cp "$CACHE_DIR/$key" "$out"
+		echo "$stage 0 hit" >> "$OUT_DIR/$base.time"
+		return 0
 	fi
+	t0=$(now_ms)
+	"$@" || return 1
+	t1=$(now_ms)
+	echo "$stage $((t1 - t0)) run" >> "$OUT_DIR/$base.time"
+	cp "$out" "$CACHE_DIR/$key.$$" && mv "$CACHE_DIR/$key.$$" "$CACHE_DIR/$key"
+}
+
+CPP_FLAGS="-DDOS -D__TURBOC__ $FARDATA_DEF $MP_LIBC_DEFS -DMP_GC_HEAP2_SIZE=$MP_HEAP2_SIZE $MP_EXTRA_CPPFLAGS -I$DOSPORT -I$STUB -I$INC_DIR -I$MP -I$GENHDR"
+CPP_ID="$(hash_file "$0")|$(clang --version 2>/dev/null | head -1)|$CPP_FLAGS|$MP_STACK_LIMIT|$MP_HEAP_SIZE|$MP_DOS_TINY_STACK_CHECK|$MP_DOS_STACKLESS_RECURSION_RAISE"
+if [ -n "$MINIC_QBE" ]; then
+	CC_ID="$(hash_file "$MINIC_QBE")|$MODEL|$QBE_SPLIT_FLAG"
+else
+	CC_ID="$(hash_file "$MINIC")|$(hash_file "$QBE")|$MODEL|$QBE_SPLIT_FLAG"
+fi
+OMF_ID="$(hash_file "$QBE_DIR/tools/asm_to_omf.py")|$MODEL|$FARSTATIC_FLAG|$FUNCSEC_FLAG"
+NASM_ID="$(nasm -v 2>/dev/null)|$(command -v nasm)"
+
+# C → preprocessed, normalized C ($pp), with the local patches below
+tu_cpp() {
+	clang -E -P -nostdinc $CPP_FLAGS -MD -MF "$OUT_DIR/$base.d" \
+		"$f" 2>"$err" > "$OUT_DIR/$base.raw.c" || return 1
 	tr -d '\r\032' < "$OUT_DIR/$base.raw.c" | sed "$NORMALIZE" > "$pp"
 	if [ "$base" = "main" ] && [ "$MP_STACK_LIMIT" != "8192" ]; then
 		sed "s/mp_stack_set_limit(8192);/mp_stack_set_limit($MP_STACK_LIMIT);/" "$pp" > "$pp.tmp"
@@ -220,23 +272,108 @@ __attribute__((noreturn)) void mp_raise_recursion_depth(void) {
 }
 EOF
 	fi
+}
 
-	if ! "$MINIC" -m "$MODEL" < "$pp" > "$ssa" 2>"$err"; then
-		fail+=("$base (minic)"); [ $KEEP_GOING -eq 0 ] && { echo "FAIL minic: $base"; cat "$err"; exit 1; }; continue
+# The cpp stage: the manifest's first line names the cached $pp, the rest
+# are "<hash>  <file>" lines for the source and every header it read
+tu_cpp_cached() {
+	local manifest t0 t1 pphash
+	manifest="$CACHE_DIR/m-$(hash_str "$CPP_ID|$f")"
+	if [ "$MP_CACHE" != 0 ] && [ -f "$manifest" ] &&
+	   tail -n +2 "$manifest" | $HASH --status -c - 2>/dev/null &&
+	   cp "$CACHE_DIR/$(head -1 "$manifest")" "$pp" 2>/dev/null; then
+		echo "cpp 0 hit" >> "$OUT_DIR/$base.time"
+		return 0
 	fi
-	# Empty SSA: minic accepted but emitted nothing (arch-gated-out TU).  Skip.
-	if [ ! -s "$ssa" ]; then continue; fi
+	t0=$(now_ms)
+	tu_cpp || return 1
+	t1=$(now_ms)
+	echo "cpp $((t1 - t0)) run" >> "$OUT_DIR/$base.time"
+	pphash=$(hash_file "$pp")
+	cp "$pp" "$CACHE_DIR/$pphash"
+	{
+		echo "$pphash"
+		$HASH "$f" $(sed -e 's/^[^:]*://' -e 's/\\$//' "$OUT_DIR/$base.d")
+	} > "$manifest.$$" && mv "$manifest.$$" "$manifest"
+}
 
-	if ! "$QBE" -t i8086 -m "$MODEL" $QBE_SPLIT_FLAG "$ssa" > "$asm" 2>"$err"; then
-		fail+=("$base (qbe)"); [ $KEEP_GOING -eq 0 ] && { echo "FAIL qbe: $base"; cat "$err"; exit 1; }; continue
-	fi
-	if ! "$QBE_DIR/tools/asm_to_omf.py" "--model=$MODEL" $FARSTATIC_FLAG "$base" "$asm" "$omf" 2>"$err"; then
-		fail+=("$base (omf-wrap)"); [ $KEEP_GOING -eq 0 ] && { echo "FAIL omf-wrap: $base"; cat "$err"; exit 1; }; continue
-	fi
-	if ! nasm -w-label-redef-late -f obj "$omf" -o "$obj" 2>"$err"; then
-		fail+=("$base (nasm)"); [ $KEEP_GOING -eq 0 ] && { echo "FAIL nasm: $base"; cat "$err"; exit 1; }; continue
+tu_minic_qbe() { "$MINIC_QBE" -t i8086 -m "$MODEL" $QBE_SPLIT_FLAG -o "$asm" < "$pp" 2>"$err"; }
+tu_minic() { "$MINIC" -m "$MODEL" < "$pp" > "$ssa" 2>"$err"; }
+tu_qbe() { "$QBE" -t i8086 -m "$MODEL" $QBE_SPLIT_FLAG "$ssa" > "$asm" 2>"$err"; }
+tu_omf() { "$QBE_DIR/tools/asm_to_omf.py" "--model=$MODEL" $FARSTATIC_FLAG $FUNCSEC_FLAG "$base" "$asm" "$omf" 2>"$err"; }
+tu_nasm() { nasm -w-label-redef-late -f obj "$omf" -o "$obj" 2>"$err"; }
+
+# compile_tu <src>: one TU through the whole pipeline.  The outcome goes
+# to $OUT_DIR/<tu>.status: "ok", "empty" (an arch-gated-out TU) or
+# "fail <stage>".  Without --keep-going a failure exits 255, which stops
+# xargs from starting further TUs.
+compile_tu() {
+	local f=$1 base pp ssa asm omf obj err
+	base=$(basename "$f" .c)
+	pp="$OUT_DIR/$base.pp.c"
+	ssa="$OUT_DIR/$base.ssa"
+	asm="$OUT_DIR/$base.asm"
+	omf="$OUT_DIR/$base.omf.asm"
+	obj="$OUT_DIR/$base.obj"
+	err="$OUT_DIR/$base.err"
+	: > "$err"
+	: > "$OUT_DIR/$base.time"
+
+	tu_fail() {
+		echo "fail $1" > "$OUT_DIR/$base.status"
+		[ "$KEEP_GOING" -eq 0 ] && exit 255
+		exit 0
+	}
+	tu_cpp_cached || tu_fail cpp
+	if [ -n "$MINIC_QBE" ]; then
+		# One process: minic streams each function to the linked-in
+		# backend; an arch-gated-out TU gives an empty .asm.
+		run_stage minic-qbe "$asm" "$CC_ID|$(hash_file "$pp")" tu_minic_qbe || tu_fail minic-qbe
+	else
+		run_stage minic "$ssa" "$CC_ID|$(hash_file "$pp")" tu_minic || tu_fail minic
+		# Empty SSA: minic accepted but emitted nothing (arch-gated-out TU).
+		if [ ! -s "$ssa" ]; then echo empty > "$OUT_DIR/$base.status"; exit 0; fi
+		run_stage qbe "$asm" "$CC_ID|$(hash_file "$ssa")" tu_qbe || tu_fail qbe
 	fi
-	pass_objs+=("$obj")
+	if [ ! -s "$asm" ]; then echo empty > "$OUT_DIR/$base.status"; exit 0; fi
+	run_stage omf-wrap "$omf" "$OMF_ID|$base|$(hash_file "$asm")" tu_omf || tu_fail omf-wrap
+	run_stage nasm "$obj" "$NASM_ID|$(hash_file "$omf")" tu_nasm || tu_fail nasm
+	echo ok > "$OUT_DIR/$base.status"
+}
+
+export HASH MP_CACHE CACHE_DIR OUT_DIR KEEP_GOING MODEL QBE_DIR MINIC MINIC_QBE QBE \
+	QBE_SPLIT_FLAG FARSTATIC_FLAG FUNCSEC_FLAG NORMALIZE CPP_FLAGS CPP_ID CC_ID \
+	OMF_ID NASM_ID MP_STACK_LIMIT MP_HEAP_SIZE MP_DOS_TINY_STACK_CHECK \
+	MP_DOS_STACKLESS_RECURSION_RAISE
+export -f now_ms hash_str hash_file run_stage tu_cpp tu_cpp_cached tu_minic_qbe \
+	tu_minic tu_qbe tu_omf tu_nasm compile_tu
+
+echo "=== Compiling ${#ALL_SRCS[@]} TUs (${#CORE_SRCS[@]} core + ${#PORT_SRCS[@]} port + ${#SOFTFLOAT_SRC[@]} softfloat) [model=$MODEL${FARSTATIC_FLAG:+, far-static-data}, $MP_JOBS jobs] ==="
+
+compile_t0=$(now_ms)
+for f in "${ALL_SRCS[@]}"; do
+	rm -f "$OUT_DIR/$(basename "$f" .c).status"
+done
+printf '%s\n' "${ALL_SRCS[@]}" | xargs -P "$MP_JOBS" -n 1 bash -c 'compile_tu "$1"' _ 2>/dev/null
+compile_t1=$(now_ms)
+
+# Collect in source order: the link order must not depend on which
+# worker finished first
+pass_objs=()
+fail=()
+for f in "${ALL_SRCS[@]}"; do
+	base=$(basename "$f" .c)
+	status=$(cat "$OUT_DIR/$base.status" 2>/dev/null || echo "fail not-run")
+	case "$status" in
+		ok) pass_objs+=("$OUT_DIR/$base.obj") ;;
+		empty) ;;
+		fail\ not-run) [ $KEEP_GOING -eq 0 ] || fail+=("$base (not run)") ;;
+		fail\ *)
+			fail+=("$base (${status#fail })")
+			if [ $KEEP_GOING -eq 0 ]; then
+				echo "FAIL ${status#fail }: $base"; cat "$OUT_DIR/$base.err"; exit 1
+			fi ;;
+	esac
 done
 
 echo "  compiled ${#pass_objs[@]} objects; ${#fail[@]} failed"
@@ -244,6 +381,18 @@ if [ ${#fail[@]} -gt 0 ]; then
 	printf '    FAIL: %s\n' "${fail[@]}"
 fi
 
+# Per-stage wall time summed over the TUs; "hit" stages came from the cache
+echo "  stage times ($((compile_t1 - compile_t0)) ms wall, $MP_JOBS jobs):"
+for f in "${ALL_SRCS[@]}"; do
+	cat "$OUT_DIR/$(basename "$f" .c).time" 2>/dev/null
+done | awk '
+	!($1 in ms) { order[n++] = $1 }
+	{ ms[$1] += $2; if ($3 == "hit") hit[$1]++; else run[$1]++ }
+	END {
+		for (i = 0; i < n; i++)
+			printf "    %-10s %8d ms  %4d run  %4d cached\n", order[i], ms[order[i]], run[order[i]], hit[order[i]]
+	}'
+
 # crt0 + libstub.  Far-data models need crt0_exe to build argv as 4-byte far
 # pointers (the FAR_DATA-gated path in crt0_exe.asm).
 CRT0_FLAGS=""
@@ -283,7 +432,7 @@ if [ "$NO_LIBSTUB" = 1 ]; then
 			> "$OUT_DIR/$unit_base.ssa" 2>>"$OUT_DIR/nl.err"
 		"$QBE" -t i8086 -m "$MODEL" "$OUT_DIR/$unit_base.ssa" \
 			> "$OUT_DIR/$unit_base.nlasm" 2>>"$OUT_DIR/nl.err"
-		"$QBE_DIR/tools/asm_to_omf.py" "--model=$MODEL" "$unit_base" \
+		"$QBE_DIR/tools/asm_to_omf.py" "--model=$MODEL" $FUNCSEC_FLAG "$unit_base" \
 			"$OUT_DIR/$unit_base.nlasm" "$OUT_DIR/$unit_base.nlomf.asm" 2>>"$OUT_DIR/nl.err"
 		nasm -w-label-redef-late -f obj "$OUT_DIR/$unit_base.nlomf.asm" \
 			-o "$OUT_DIR/$unit_base.obj" 2>>"$OUT_DIR/nl.err" || {
@@ -355,6 +504,12 @@ printf '%s\n' "${OBJS[@]}" > /tmp/mp_objs.txt
 # few <=64KB buckets, reclaiming the per-function paragraph padding (~5KB on the
 # core subset — see NEXT_SESSION.md §2p).  Safe because every code reference is
 # an offset-aware OMF fixup and near jumps stay intra-function.
+# --pack-callgraph fills the buckets by call-graph cluster rather than input
+# order, so most `call far`s stay within one segment; the map's "Code
+# segments" table reports intra- vs cross-segment far calls per bucket.
+# --merge-strings keeps one copy of each DGROUP string literal across TUs,
+# folding a literal that ends another into it; the map's "Merged string
+# literals" line reports the bytes saved.
 # The VM recurses through C frames for generator resumes; 8KB corrupted the
 # return path at recsum(8) on Victor.  The stack cap is DGROUP (see the
 # MP_STACK_SIZE comment above), not image size.
@@ -365,7 +520,8 @@ if "$QBE_DIR/tools/omf_link.py" \
 		--stack-size "$MP_STACK_SIZE" \
 		$LINK_SPLIT_FLAG \
 		--gc-sections \
-		--pack-code \
+		--pack-callgraph \
+		--merge-strings \
 		"${OBJS[@]}" 2>"$OUT_DIR/link.err"; then
 	echo "  OK: $OUT_DIR/mpython.exe ($(wc -c <"$OUT_DIR/mpython.exe") bytes)"
 else
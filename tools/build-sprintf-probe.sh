@@ -75,6 +75,7 @@ grep -v -E '^\.(text|data|bss|balign|section|globl|type|size|local|file|ident|st
 		s/^(l\d+(?:_l\d+)?):/${p}$1:/;
 		s/^(\s*j[a-z]+\s+)(l\d+(?:_l\d+)?)\b/$1${p}$2/;
 		s/^(\s*jnz\s+[^,]+,\s*)(l\d+(?:_l\d+)?)(\s*,\s*)(l\d+(?:_l\d+)?)\b/$1${p}$2$3${p}$4/;
+		s/^(\s*(?:\.short|dw)\s+)(l\d+(?:_l\d+)?)\s*$/$1${p}$2/;
 		s/^_?glo(\d+):/${p}glo$1:/;
 		s/\b_?glo(\d+)\b/${p}glo$1/g;
 	' \
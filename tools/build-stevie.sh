@@ -266,6 +266,8 @@ for src in "${SOURCES[@]}"; do
 			s/^(\s*j[a-z]+\s+)(l\d+(?:_l\d+)?)\b/$1${p}$2/;
 			# jnz val, lN, lM (two operands)
 			s/^(\s*jnz\s+[^,]+,\s*)(l\d+(?:_l\d+)?)(\s*,\s*)(l\d+(?:_l\d+)?)\b/$1${p}$2$3${p}$4/;
+			# jtab entries: .short lN
+			s/^(\s*(?:\.short|dw)\s+)(l\d+(?:_l\d+)?)\s*$/$1${p}$2/;
 			# Global glo: definitions and references (with or without leading
 			# underscore — QBE emits both forms in different contexts).
 			s/^_?glo(\d+):/${p}glo$1:/;
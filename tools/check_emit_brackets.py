@@ -10,8 +10,10 @@ For each marked region (marker .. next marker/block label) the checker
 symbolically executes the emitted instructions and reports any register in
 the live set — other than the instruction's destination (or the ABI
 caller-save set for calls) — whose final value is not the region-entry
-value.  ES and DS must hold their entry values at the end of EVERY region
-(the DGROUP invariants), live or not.
+value.  DS must hold its entry value at the end of EVERY region (the
+DGROUP invariant), live or not.  ES is exempt: a far access through a
+slot-resident pointer leaves it holding the pointer's segment, and the
+emitter's ES tracking restores DGROUP before calls and returns.
 
 The simulator is deliberately simple: linear scan (conditional jumps inside
 a region are treated as fallthrough — emit brackets are always straight-
@@ -30,6 +32,7 @@ from collections import defaultdict
 GPRS = ("ax", "cx", "dx", "bx", "si", "di")
 SEGS = ("es", "ds")
 TRACKED = GPRS + SEGS
+INVARIANT = ("ds",)    # ES is left to the emitter's ES tracking
 SUB8 = {"al": "ax", "ah": "ax", "bl": "bx", "bh": "bx",
         "cl": "cx", "ch": "cx", "dl": "dx", "dh": "dx"}
 
@@ -264,7 +267,7 @@ def check_region(reg, report):
               and sim.regs[changed[1]] == ("entry", changed[0]))
         if not ok:
             report[("swap", "exchange" if reg.lines else "DROPPED")].append(reg)
-        for r in SEGS:
+        for r in INVARIANT:
             if sim.regs[r] != ("entry", r):
                 report[(reg.op, r)].append(reg)
         return
@@ -277,7 +280,7 @@ def check_region(reg, report):
     for r in sorted(reg.live - allowed):
         if r in GPRS and sim.regs[r] != ("entry", r):
             report[(reg.op, r)].append(reg)
-    for r in SEGS:
+    for r in INVARIANT:
         if sim.regs[r] != ("entry", r):
             report[(reg.op, r)].append(reg)
     # dest-destroyed rule (the §4x Ocmps CX shape): a non-empty region whose
@@ -34,11 +34,12 @@ char *tok[] = {
 	"copy", "dbgloc", "asm",
 	"loadfb", "loadfh", "loadfw", "loadfl", "loadfs",
 	"storefb", "storefh", "storefw", "storefl", "storefs",
-	"mkfar", "farseg", "faroff", "addfo", "subfo", "vargp",
+	"mkfar", "farseg", "faroff", "addfo", "subfo",
+	"hugeadd", "hugesub", "hugecmp", "vargp",
 
 	/* parse.c kwmap aliases */
 	"loadw", "loadl", "loads", "loadd", "alloc1", "alloc2",
-	"blit", "call", "env", "phi", "jmp", "jnz", "ret", "hlt",
+	"blit", "call", "env", "phi", "jmp", "jnz", "jtab", "ret", "hlt",
 	"export", "thread", "extern", "common", "interrupt",
 	"function", "type", "data", "section", "align", "dbgfile",
 	"sb", "ub", "sh", "uh", "b", "h", "w", "l", "s", "d", "z",
@@ -9,9 +9,19 @@ references, and writes a DOS MZ executable.
 
 Usage:
     omf_link.py [-o OUT.exe] [--map MAP.txt] [--stack-size N]
-                [--entry SYMBOL] OBJ1.obj OBJ2.obj ...
+                [--entry SYMBOL] [--gc-sections [--keep SYMBOL ...]]
+                [--pack-code | --pack-callgraph] [--relax-far-calls]
+                [--merge-strings] OBJ1.obj OBJ2.obj ...
 
 Defaults: -o a.out, --stack-size 4096, --entry _start.
+
+COMDAT-style pieces: a segment named `<SEG>$<anything>` (asm_to_omf.py
+--function-sections) is a piece of segment <SEG>.  Pieces coalesce into
+<SEG> exactly as if their bytes had been written there, join <SEG>'s group,
+and are individually discardable under --gc-sections.  A string-literal
+piece, `<SEG>$str$<sym>`, may also be merged with --merge-strings: one
+whose bytes end another's is not laid out, and its references resolve into
+the other piece instead, across modules.
 """
 
 from __future__ import annotations
@@ -72,6 +82,23 @@ def die(msg: str) -> None:
     sys.exit(1)
 
 
+def comdat_base(name: str) -> str:
+    """Segment a COMDAT-style piece `<SEG>$<sym>` belongs to (the name
+    itself for an ordinary segment)."""
+    return name.split('$', 1)[0]
+
+
+# Marks a string-literal piece `<SEG>$str$<sym>` (asm_to_omf.py
+# --function-sections): read-only, NUL-terminated, no fixups.
+STRLIT_PIECE = '$str$'
+
+
+# Publics with this prefix are interrupt-handler header words (exported by
+# asm_to_omf.py --function-sections).  Handlers are entered through the
+# vector table, so --gc-sections treats them as roots like the entry point.
+ISR_ROOT_PREFIX = '_qbe_isr_'
+
+
 # ---------------------------------------------------------------------------
 # Low-level OMF parsing helpers
 # ---------------------------------------------------------------------------
@@ -624,7 +651,10 @@ class Linker:
     def __init__(self, modules: List[Module],
                  stack_size: int, entry_symbol: str,
                  gc_sections: bool = False,
-                 pack_code: bool = False,
+                 keep_symbols: Optional[List[str]] = None,
+                 pack_code: Optional[str] = None,
+                 relax_far_calls: bool = False,
+                 merge_strings: bool = False,
                  separate_stack: bool = False,
                  raw_binary: bool = False,
                  load_addr: int = 0):
@@ -632,7 +662,20 @@ class Linker:
         self.stack_size = stack_size
         self.entry_symbol = entry_symbol
         self.gc_sections = gc_sections
+        self.keep_symbols = keep_symbols or []
+        # None (one segment per name), 'order' (greedy, input order) or
+        # 'callgraph' (callers and callees packed into the same bucket).
         self.pack_code = pack_code
+        self.relax_far_calls = relax_far_calls
+        # Per output CODE segment: [intra-segment far calls,
+        # cross-segment far calls, far calls relaxed to near].
+        self.far_calls: Dict[int, List[int]] = {}
+        self.merge_strings = merge_strings
+        # String-literal pieces folded into another (--merge-strings), as
+        # (module_idx, mod_seg_idx) → (owner module_idx, owner mod_seg_idx,
+        # byte offset within the owner).
+        self.merged: Dict[Tuple[int, int], Tuple[int, int, int]] = {}
+        self.bytes_merged: int = 0
         self.separate_stack = separate_stack
         self.raw_binary = raw_binary
         self.load_addr = load_addr
@@ -644,6 +687,9 @@ class Linker:
         # None means "no dead-strip" (every segment is live).
         self.live_segs: Optional[set] = None
         self.n_stripped: int = 0
+        # Dead-stripped segments as (module_idx, mod_seg_idx), for the map.
+        self.stripped: List[Tuple[int, int]] = []
+        self.bytes_stripped: int = 0
 
         self.out_segs: List[OutSeg] = []
         # Map (module_idx, mod_seg_idx) → (out_seg_idx, byte_offset_within_out_seg)
@@ -753,25 +799,35 @@ class Linker:
 
         return out
 
+    def _gc_roots(self) -> List[Tuple[int, int]]:
+        """Segments --gc-sections keeps unconditionally: the entry symbol's,
+        every --keep symbol's, and every interrupt handler's."""
+        names = [self.entry_symbol] + self.keep_symbols
+        for name in names:
+            if name not in self.symbols:
+                die('%s symbol %r not found'
+                    % ('entry' if name == self.entry_symbol else '--keep',
+                       name))
+        names += [n for n in self.symbols if n.startswith(ISR_ROOT_PREFIX)]
+        return [(self.symbols[n].module_idx, self.symbols[n].seg_idx)
+                for n in names]
+
     def _compute_liveness(self) -> None:
-        """Mark every segment reachable from the entry symbol through FIXUPP
-        references.  Segments that nothing reachable points at are dropped
-        from the image (the standard linker --gc-sections model).
+        """Mark every segment reachable from the GC roots (_gc_roots) through
+        FIXUPP references.  Segments that nothing reachable points at are
+        dropped from the image (the standard linker --gc-sections model).
 
         Reachability is segment-granular: if any byte of a segment is
         referenced, the whole segment is kept.  asm_to_omf.py splits a large
-        TU's text into per-function-group CODE segments, so the granularity
-        is finer than per-TU.  This is SOUND for this toolchain because every
+        TU's text into per-function-group CODE segments, and with
+        --function-sections into one piece per function and per data object,
+        so the granularity is finer than per-TU.  This is SOUND for this toolchain because every
         cross-segment dependency (a call, a data-table function pointer, a
         `seg sym` selector load) is emitted as an OMF fixup — there are no
         hand-computed addresses outside crt0/libstub, which themselves use
         nasm-generated fixups."""
-        entry = self.symbols.get(self.entry_symbol)
-        if entry is None:
-            die('entry symbol %r not found' % self.entry_symbol)
-
         live: set = set()
-        work: List[Tuple[int, int]] = [(entry.module_idx, entry.seg_idx)]
+        work: List[Tuple[int, int]] = self._gc_roots()
         while work:
             key = work.pop()
             if key in live:
@@ -792,16 +848,48 @@ class Linker:
                         work.append(tgt)
 
         self.live_segs = live
-        n_total = sum(1 for m in self.modules
-                      for seg in m.segments[1:] if seg is not None)
-        self.n_stripped = n_total - sum(
-            1 for (mi, si) in live
-            if 0 < si < len(self.modules[mi].segments)
-            and self.modules[mi].segments[si] is not None)
+        for mi, m in enumerate(self.modules):
+            for si, seg in enumerate(m.segments):
+                if seg is not None and (mi, si) not in live:
+                    self.stripped.append((mi, si))
+                    self.bytes_stripped += len(seg.data)
+        self.n_stripped = len(self.stripped)
 
     def _live(self, mi: int, si: int) -> bool:
         return self.live_segs is None or (mi, si) in self.live_segs
 
+    # -------------------- string merging (--merge-strings) --------------------
+
+    def _merge_string_pieces(self) -> None:
+        """Fold every live DGROUP string-literal piece (STRLIT_PIECE) whose
+        bytes are the tail of another's into that one: identical literals
+        from different modules, and "error" into "parse error".
+
+        The pieces are sorted on their reversed bytes, longest first, so a
+        piece's bytes end the last piece kept before it or no kept piece's
+        at all.  Ties keep input order, so the first module's copy is the
+        one laid out.  Literals are module-local labels reached only through
+        segment-relative fixups, which _resolve_target maps through seg_map
+        like any other piece's."""
+        lits: List[Tuple[bytes, int, int]] = []
+        for mi, m in enumerate(self.modules):
+            for si, seg in enumerate(m.segments):
+                if (seg is None or not self._live(mi, si)
+                        or seg.cls.upper() != 'DATA'
+                        or STRLIT_PIECE not in seg.name
+                        or seg.fixups or not seg.data.endswith(b'\0')):
+                    continue
+                lits.append((bytes(seg.data[::-1]), mi, si))
+        lits.sort(key=lambda t: t[0], reverse=True)
+        owner: Optional[Tuple[bytes, int, int]] = None
+        for rev, mi, si in lits:
+            if owner is not None and owner[0].startswith(rev):
+                self.merged[(mi, si)] = (owner[1], owner[2],
+                                         len(owner[0]) - len(rev))
+                self.bytes_merged += len(rev)
+            else:
+                owner = (rev, mi, si)
+
     # -------------------- layout --------------------
 
     def _layout_segments(self) -> None:
@@ -836,7 +924,10 @@ class Linker:
                     continue
                 if seg.cls.upper() == 'CODE':
                     live_code.append((mi, si))
-        if self.pack_code:
+        if self.pack_code == 'callgraph':
+            for bucket in self._callgraph_buckets(live_code):
+                self._place_packed_code(bucket)
+        elif self.pack_code:
             self._place_packed_code(live_code)
         else:
             # Coalesce by NAME, like DATA/BSS.  For far-code models every
@@ -852,16 +943,22 @@ class Linker:
                 self._place_coalesced(mi, si, self.modules[mi].segments[si],
                                       coalesced_code)
 
-        # DATA: coalesced by segment NAME across modules.
+        # DATA: coalesced by segment NAME across modules.  A merged string
+        # piece takes its owner's place plus the offset of its bytes.
+        if self.merge_strings:
+            self._merge_string_pieces()
         coalesced_data: Dict[str, int] = {}
         for mi, m in enumerate(self.modules):
             for si, seg in enumerate(m.segments):
                 if seg is None:
                     continue
-                if not self._live(mi, si):
+                if not self._live(mi, si) or (mi, si) in self.merged:
                     continue
                 if seg.cls.upper() == 'DATA':
                     self._place_coalesced(mi, si, seg, coalesced_data)
+        for key, (omi, osi, off) in self.merged.items():
+            out_idx, base = self.seg_map[(omi, osi)]
+            self.seg_map[key] = (out_idx, base + off)
 
         # BSS: same coalescing rule.
         coalesced_bss: Dict[str, int] = {}
@@ -906,7 +1003,10 @@ class Linker:
         # paragraph base, addressed by its own `seg _sym` selector), OUTSIDE
         # DGROUP — so the aggregate static data can exceed 64KB.  Laid out
         # after the stack so they never inflate the DGROUP/SP overflow check.
+        # The names are per-module, so coalescing by name only gathers a
+        # module's --function-sections pieces back into its own segment.
         for cls in ('FAR_DATA', 'FAR_BSS'):
+            coalesced_far: Dict[str, int] = {}
             for mi, m in enumerate(self.modules):
                 for si, seg in enumerate(m.segments):
                     if seg is None:
@@ -914,7 +1014,7 @@ class Linker:
                     if not self._live(mi, si):
                         continue
                     if seg.cls.upper() == cls:
-                        self._place_distinct(mi, si, seg)
+                        self._place_coalesced(mi, si, seg, coalesced_far)
 
         # Compute paragraph bases.  HUGE chunks already arrive in
         # `_HUGE_<sym>_N` order so the `_0`, `_1`, ... chunks of the
@@ -942,8 +1042,9 @@ class Linker:
 
     def _place_coalesced(self, mi: int, si: int, seg: Segment,
                          table: Dict[str, int]) -> None:
-        if seg.name in table:
-            idx = table[seg.name]
+        name = comdat_base(seg.name)
+        if name in table:
+            idx = table[name]
             out = self.out_segs[idx]
             # Pad to alignment within combined segment
             align = max(seg.align, 1)
@@ -959,11 +1060,11 @@ class Linker:
             self.seg_map[(mi, si)] = (idx, offset)
         else:
             idx = len(self.out_segs)
-            out = OutSeg(name=seg.name, cls=seg.cls, align=seg.align)
+            out = OutSeg(name=name, cls=seg.cls, align=seg.align)
             out.data = bytearray(seg.data)
             out.length = len(seg.data)
             self.out_segs.append(out)
-            table[seg.name] = idx
+            table[name] = idx
             self.seg_map[(mi, si)] = (idx, 0)
 
     # Hard cap on a packed CODE bucket.  Every offset within a bucket must fit
@@ -977,7 +1078,9 @@ class Linker:
         granularity forces.  Functions are appended word-aligned (8086 favours
         even instruction starts; they do NOT need paragraph alignment because
         they are reached by offset within the bucket, not by segment selector —
-        the bucket itself is paragraph-aligned by _layout_segments)."""
+        the bucket itself is paragraph-aligned by _layout_segments).
+        Each call starts a fresh bucket; the call-graph packer hands over
+        one pre-sized bucket at a time."""
         bucket_idx = -1
         for mi, si in live_code:
             seg = self.modules[mi].segments[si]
@@ -1001,15 +1104,110 @@ class Linker:
             out.length = len(out.data)
             self.seg_map[(mi, si)] = (bucket_idx, offset)
 
+    def _code_target(self, m: Module, mi: int,
+                     fix: Fixup) -> Optional[Tuple[int, int]]:
+        """The (module_idx, mod_seg_idx) CODE segment a fixup targets, or
+        None if it targets data, a group, or an unknown symbol."""
+        tm = fix.target_method & 0x3
+        if tm == 0:
+            key = (mi, fix.target_index)
+        elif tm == 2:
+            sym = self.symbols.get(m.externs[fix.target_index]) \
+                if 0 < fix.target_index < len(m.externs) else None
+            if sym is None:
+                return None
+            key = (sym.module_idx, sym.seg_idx)
+        else:
+            return None
+        tmi, tsi = key
+        if not 0 < tsi < len(self.modules[tmi].segments):
+            return None
+        seg = self.modules[tmi].segments[tsi]
+        if seg is None or seg.cls.upper() != 'CODE':
+            return None
+        return key
+
+    def _callgraph_buckets(self, live_code: List[Tuple[int, int]]
+                           ) -> List[List[Tuple[int, int]]]:
+        """Partition the live CODE segments into <=CODE_BUCKET_MAX buckets so
+        that functions which call each other share a bucket — a far call
+        whose caller and callee share a bucket is an intra-segment call
+        (see --relax-far-calls and the map's Code segments table).
+
+        Pettis-Hansen style: every code-to-code fixup adds weight 1 to the
+        (undirected) edge between its two segments; edges are visited
+        heaviest first and merge the two clusters they join whenever the
+        merged cluster still fits a bucket.  The clusters are then placed
+        first-fit-decreasing.  Ties break on input order, so the layout is
+        deterministic.  With --function-sections every segment is a single
+        function and the graph is the static call graph."""
+        order = {key: n for n, key in enumerate(live_code)}
+        size = {key: len(self.modules[key[0]].segments[key[1]].data) + 1
+                for key in live_code}
+        weight: Dict[Tuple[Tuple[int, int], Tuple[int, int]], int] = {}
+        for key in live_code:
+            mi, si = key
+            m = self.modules[mi]
+            for fix in m.segments[si].fixups:
+                tgt = self._code_target(m, mi, fix)
+                if tgt is None or tgt == key or tgt not in order:
+                    continue
+                edge = (key, tgt) if order[key] < order[tgt] else (tgt, key)
+                weight[edge] = weight.get(edge, 0) + 1
+
+        leader = {key: key for key in live_code}
+        members = {key: [key] for key in live_code}
+        csize = dict(size)
+
+        def find(k: Tuple[int, int]) -> Tuple[int, int]:
+            while leader[k] != k:
+                leader[k] = leader[leader[k]]
+                k = leader[k]
+            return k
+
+        edges = sorted(weight.items(),
+                       key=lambda e: (-e[1], order[e[0][0]], order[e[0][1]]))
+        for (a, b), _ in edges:
+            ra, rb = find(a), find(b)
+            if ra == rb or csize[ra] + csize[rb] > self.CODE_BUCKET_MAX:
+                continue
+            if order[rb] < order[ra]:
+                ra, rb = rb, ra
+            leader[rb] = ra
+            members[ra].extend(members.pop(rb))
+            csize[ra] += csize.pop(rb)
+
+        clusters = sorted(members.items(),
+                          key=lambda c: (-csize[c[0]], order[c[0]]))
+        buckets: List[List[Tuple[int, int]]] = []
+        room: List[int] = []
+        for root, keys in clusters:
+            for n, free in enumerate(room):
+                if csize[root] <= free:
+                    buckets[n].extend(keys)
+                    room[n] -= csize[root]
+                    break
+            else:
+                buckets.append(list(keys))
+                room.append(self.CODE_BUCKET_MAX - csize[root])
+        return buckets
+
     def _coalesce_groups(self) -> None:
-        for m in self.modules:
+        for mi, m in enumerate(self.modules):
             for g in m.groups[1:]:
                 if g is None:
                     continue
                 og = self.out_groups.setdefault(g.name, OutGroup(name=g.name))
-                # Translate segment indices from this module to output segs
-                mi = self.modules.index(m)
-                for si in g.seg_indices:
+                # Translate segment indices from this module to output segs.
+                # A `<SEG>$<sym>` piece is a member wherever <SEG> is, so
+                # GRPDEF never has to list the (possibly thousands of)
+                # pieces and the group survives <SEG> itself being empty.
+                names = set(m.segments[si].name for si in g.seg_indices
+                            if 0 < si < len(m.segments)
+                            and m.segments[si] is not None)
+                for si, seg in enumerate(m.segments):
+                    if seg is None or comdat_base(seg.name) not in names:
+                        continue
                     if (mi, si) not in self.seg_map:
                         continue
                     out_idx, _ = self.seg_map[(mi, si)]
@@ -1196,6 +1394,22 @@ class Linker:
                 self._add_reloc(site_out, mod_base_in_out + fix.where)
             return
 
+        if loc == 3 and self._far_call_site(site_out, mod_base_in_out + fix.where):
+            if self._count_far_call(site_out_idx, tgt_out_idx):
+                # Intra-segment `call far` (9A off seg) → `push cs` (0E) +
+                # `call near` (E8 rel16) + `nop` (90): same 5 bytes, same
+                # CS:IP pushed for the callee's retf, one MZ relocation
+                # fewer.  Cycle-neutral on the 8088 (36 vs 14+23+3), so it
+                # is opt-in: the win is the relocation table / load time.
+                at = mod_base_in_out + fix.where
+                cur_off = struct.unpack_from('<H', site_out.data, at)[0]
+                rel = (tgt_abs_byte + cur_off - (site_abs_byte + 3)) & 0xFFFF
+                site_out.data[at - 1] = 0x0E
+                site_out.data[at] = 0xE8
+                struct.pack_into('<H', site_out.data, at + 1, rel)
+                site_out.data[at + 3] = 0x90
+                return
+
         if loc == 3:  # 32-bit far ptr: low word = offset within frame, high word = selector
             cur_off = struct.unpack_from('<H', site_out.data,
                                          mod_base_in_out + fix.where)[0]
@@ -1232,6 +1446,25 @@ class Linker:
 
         die('unsupported fixup location %d' % loc)
 
+    def _far_call_site(self, site_out: OutSeg, at: int) -> bool:
+        """True if the far-pointer field at `at` is the operand of a direct
+        `call far` (opcode 9A) in a CODE segment."""
+        return (site_out.cls.upper() == 'CODE' and at >= 1
+                and site_out.data[at - 1] == 0x9A)
+
+    def _count_far_call(self, site_out_idx: int, tgt_out_idx: int) -> bool:
+        """Tally a direct far call for the map; True if it should be relaxed
+        to a near call (same output segment and --relax-far-calls)."""
+        st = self.far_calls.setdefault(site_out_idx, [0, 0, 0])
+        if site_out_idx != tgt_out_idx:
+            st[1] += 1
+            return False
+        st[0] += 1
+        if not self.relax_far_calls:
+            return False
+        st[2] += 1
+        return True
+
     @staticmethod
     def _read_field(buf: bytearray, off: int, size: int) -> int:
         if size == 1:
@@ -1437,6 +1670,29 @@ class Linker:
             lines.append('  %-20s %-8s 0x%04X   0x%04X   %d'
                          % (seg.name, seg.cls, seg.para_base,
                             seg.length, seg.length))
+        code = [n for n, seg in enumerate(self.out_segs)
+                if seg.cls.upper() == 'CODE']
+        if code:
+            pieces: Dict[int, int] = {}
+            for out_idx, _ in self.seg_map.values():
+                pieces[out_idx] = pieces.get(out_idx, 0) + 1
+            lines.append('')
+            lines.append('Code segments:')
+            lines.append('  %-20s %-8s %-6s %-6s %-9s %-9s %s'
+                         % ('NAME', 'BYTES', 'FILL', 'PIECES', 'INTRA-FAR',
+                            'CROSS-FAR', 'RELAXED'))
+            tot = [0, 0, 0]
+            for n in code:
+                seg = self.out_segs[n]
+                st = self.far_calls.get(n, [0, 0, 0])
+                tot = [a + b for a, b in zip(tot, st)]
+                lines.append('  %-20s %-8d %5.1f%% %-6d %-9d %-9d %d'
+                             % (seg.name, seg.length,
+                                100.0 * seg.length / 0x10000,
+                                pieces.get(n, 0), st[0], st[1], st[2]))
+            lines.append('  direct far calls: %d intra-segment (%d relaxed '
+                         'to near), %d cross-segment' % (tot[0], tot[2],
+                                                         tot[1]))
         lines.append('')
         lines.append('Symbols:')
         for name in sorted(self.symbols):
@@ -1450,6 +1706,36 @@ class Linker:
                          % (name, seg.name, seg.para_base,
                             base + sym.offset,
                             Path(self.modules[sym.module_idx].path).name))
+        if self.gc_sections:
+            lines.append('')
+            lines.append('Discarded segments (--gc-sections): %d segments, '
+                         '%d bytes saved' % (self.n_stripped,
+                                             self.bytes_stripped))
+            by_cls: Dict[str, List[int]] = {}
+            for mi, si in self.stripped:
+                seg = self.modules[mi].segments[si]
+                tot = by_cls.setdefault(seg.cls.upper(), [0, 0])
+                tot[0] += 1
+                tot[1] += len(seg.data)
+            for cls in sorted(by_cls):
+                lines.append('  %-8s %6d segments %8d bytes'
+                             % (cls, by_cls[cls][0], by_cls[cls][1]))
+            for mi, si in self.stripped:
+                seg = self.modules[mi].segments[si]
+                lines.append('  %-32s %-8s %6d (mod=%s)'
+                             % (seg.name, seg.cls, len(seg.data),
+                                Path(self.modules[mi].path).name))
+        if self.merge_strings:
+            lines.append('')
+            lines.append('Merged string literals (--merge-strings): %d '
+                         'pieces, %d bytes saved'
+                         % (len(self.merged), self.bytes_merged))
+            for (mi, si), (omi, osi, off) in self.merged.items():
+                seg = self.modules[mi].segments[si]
+                lines.append('  %-32s %6d -> %s+%d (mod=%s)'
+                             % (seg.name, len(seg.data),
+                                self.modules[omi].segments[osi].name, off,
+                                Path(self.modules[mi].path).name))
         Path(map_path).write_text('\n'.join(lines) + '\n')
 
     def _print_summary(self, out_path: str, image_size: int,
@@ -1463,7 +1749,11 @@ class Linker:
         n_relocs = len(self.relocs)
         print('omf_link: linked %d modules' % n_mods)
         if self.gc_sections:
-            print('  dead-stripped %d segments (--gc-sections)' % self.n_stripped)
+            print('  dead-stripped %d segments, %d bytes (--gc-sections)'
+                  % (self.n_stripped, self.bytes_stripped))
+        if self.merge_strings:
+            print('  merged %d string literals, %d bytes (--merge-strings)'
+                  % (len(self.merged), self.bytes_merged))
         print('  code: %d bytes' % code_bytes)
         if fardata_bytes:
             print('  far data: %d bytes' % fardata_bytes)
@@ -1494,10 +1784,29 @@ def main() -> None:
     ap.add_argument('--memory-model', default='medium',
                     help='only "medium" is currently supported')
     ap.add_argument('--gc-sections', dest='gc_sections', action='store_true',
-                    help='dead-strip segments unreachable from --entry')
-    ap.add_argument('--pack-code', dest='pack_code', action='store_true',
+                    help='dead-strip segments unreachable from --entry, '
+                         '--keep symbols and interrupt handlers')
+    ap.add_argument('--keep', dest='keep_symbols', action='append',
+                    default=[], metavar='SYMBOL',
+                    help='extra --gc-sections root (repeatable)')
+    ap.add_argument('--pack-code', dest='pack_code', action='store_const',
+                    const='order',
                     help='coalesce live CODE segments into <=64KB buckets, '
                          'removing per-function paragraph padding')
+    ap.add_argument('--pack-callgraph', dest='pack_code',
+                    action='store_const', const='callgraph',
+                    help='like --pack-code, but pack callers into the same '
+                         'bucket as their callees (call-graph clustering)')
+    ap.add_argument('--relax-far-calls', dest='relax_far_calls',
+                    action='store_true',
+                    help='rewrite each `call far` whose target landed in '
+                         'the same code segment as `push cs; call near`, '
+                         'dropping its MZ relocation')
+    ap.add_argument('--merge-strings', dest='merge_strings',
+                    action='store_true',
+                    help='share one copy of string literals with the same '
+                         'trailing bytes across modules (`<SEG>$str$<sym>` '
+                         'pieces from asm_to_omf.py --function-sections)')
     ap.add_argument('--separate-stack', dest='separate_stack',
                     action='store_true',
                     help='give the stack its own segment (SS != DS); '
@@ -1533,7 +1842,10 @@ def main() -> None:
 
     linker = Linker(modules, args.stack_size, args.entry,
                     gc_sections=args.gc_sections,
+                    keep_symbols=args.keep_symbols,
                     pack_code=args.pack_code,
+                    relax_far_calls=args.relax_far_calls,
+                    merge_strings=args.merge_strings,
                     separate_stack=args.separate_stack,
                     raw_binary=args.raw_binary,
                     load_addr=args.load_addr)
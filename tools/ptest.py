@@ -0,0 +1,370 @@
+#!/usr/bin/env python3
+"""ptest.py — parallel runner for the QBE test suites.
+
+Runs every test of the selected suites in its own temporary directory,
+N at a time, and prints one line per test as it finishes (the same
+`name... [ok]` shape as tools/test.sh).  Optionally writes a JSON and/or a
+JUnit XML summary with the per-test wall time.
+
+Suites:
+    ssa   test/[!_]*.ssa, each through `tools/test.sh FILE` with TMPDIR
+          pointed at a private directory (the default suite).
+    dos   the RUNTIME_TESTS table of tools/test-dos.sh.  Each probe is built
+          by `tools/test-dos.sh --build-runtime` with EXAMPLE_OUT_DIR set to
+          a private directory, run through tools/run-dos-exe.sh (export
+          DOS_RUNNER=sim86 to use the in-tree simulator instead of DOSBox)
+          and diffed against its golden.  Exit status 77 from either step
+          is a skip, as in test-dos.sh.
+
+Cache (build/ptest-cache, --no-cache to bypass).  Keys are SHA-256 hashes
+of the inputs:
+    ssa   qbe binary + test.sh + the test file + $TARGET/$CC.  A hit means
+          the same inputs already passed; the test is reported as cached
+          instead of being compiled and run again.
+    dos   the probe source, its model and every toolchain input (qbe, minic,
+          the build scripts, minic/dos and minic/include).  A hit reuses the
+          built .EXE; the probe is always run.
+
+Usage:
+    ptest.py [-j N] [-k SUBSTRING] [--json FILE] [--junit FILE]
+             [--no-cache] [--cache-dir DIR] [suite ...]
+
+Exit status: 0 when nothing failed, 1 otherwise.
+"""
+import argparse
+import concurrent.futures
+import glob
+import hashlib
+import json
+import os
+import shutil
+import subprocess
+import sys
+import tempfile
+import threading
+import time
+import xml.etree.ElementTree as ET
+from dataclasses import dataclass, field
+from typing import Callable, List, Optional
+
+ROOT = os.path.dirname(os.path.dirname(os.path.abspath(__file__)))
+SKIP_RC = 77
+
+
+@dataclass
+class Result:
+    suite: str
+    name: str
+    status: str = 'pass'         # pass | fail | skip
+    seconds: float = 0.0
+    cached: bool = False
+    output: str = ''
+
+
+@dataclass
+class Test:
+    suite: str
+    name: str
+    run: Callable[['Test', str], Result]
+    args: tuple = field(default_factory=tuple)
+
+
+# ---------------------------------------------------------------------------
+# Input hashing
+# ---------------------------------------------------------------------------
+
+_digest_lock = threading.Lock()
+_digests = {}
+
+
+def file_digest(path: str) -> str:
+    with _digest_lock:
+        if path in _digests:
+            return _digests[path]
+    h = hashlib.sha256()
+    try:
+        with open(path, 'rb') as f:
+            for chunk in iter(lambda: f.read(1 << 16), b''):
+                h.update(chunk)
+    except OSError:
+        h.update(b'<missing>')
+    d = h.hexdigest()
+    with _digest_lock:
+        _digests[path] = d
+    return d
+
+
+def key_of(parts: List[str], files: List[str]) -> str:
+    h = hashlib.sha256()
+    for p in parts:
+        h.update(p.encode() + b'\0')
+    for f in files:
+        h.update(os.path.relpath(f, ROOT).encode() + b'\0')
+        h.update(file_digest(f).encode())
+    return h.hexdigest()
+
+
+class Cache:
+    def __init__(self, root: Optional[str]):
+        self.root = root
+
+    def path(self, suite: str, key: str, ext: str = '') -> Optional[str]:
+        if not self.root:
+            return None
+        d = os.path.join(self.root, suite)
+        os.makedirs(d, exist_ok=True)
+        return os.path.join(d, key + ext)
+
+
+CACHE = Cache(None)
+
+
+# ---------------------------------------------------------------------------
+# ssa suite
+# ---------------------------------------------------------------------------
+
+def ssa_tests() -> List[Test]:
+    files = sorted(glob.glob(os.path.join(ROOT, 'test', '[!_]*.ssa')))
+    return [Test('ssa', os.path.basename(f), run_ssa, (f,)) for f in files]
+
+
+def run_ssa(t: Test, tmp: str) -> Result:
+    (path,) = t.args
+    r = Result(t.suite, t.name)
+    key = key_of([os.environ.get('TARGET', ''), os.environ.get('CC', '')],
+                 [os.path.join(ROOT, 'qbe'),
+                  os.path.join(ROOT, 'tools', 'test.sh'), path])
+    stamp = CACHE.path('ssa', key)
+    if stamp and os.path.exists(stamp):
+        r.cached = True
+        return r
+    env = dict(os.environ, TMPDIR=tmp)
+    p = subprocess.run([os.path.join(ROOT, 'tools', 'test.sh'), path],
+                       cwd=tmp, env=env, stdout=subprocess.PIPE,
+                       stderr=subprocess.STDOUT, text=True)
+    r.output = p.stdout
+    if p.returncode == SKIP_RC or (p.returncode == 0 and not p.stdout):
+        r.status = 'skip'        # not built for $TARGET, or no toolchain
+    elif p.returncode != 0:
+        r.status = 'fail'
+    elif stamp:
+        open(stamp, 'w').close()
+    return r
+
+
+# ---------------------------------------------------------------------------
+# dos suite
+# ---------------------------------------------------------------------------
+
+def dos_toolchain() -> List[str]:
+    files = [os.path.join(ROOT, p) for p in (
+        'qbe', 'minic/minic', 'tools/test-dos.sh', 'tools/build-example.sh',
+        'tools/asm_to_omf.py', 'tools/omf_link.py',
+        'tools/libstub_to_exe.py', 'tools/near_to_far_rt.py')]
+    for sub in ('minic/dos', 'minic/include'):
+        for dirpath, _, names in os.walk(os.path.join(ROOT, sub)):
+            files += [os.path.join(dirpath, n) for n in names
+                      if n.endswith(('.asm', '.c', '.h'))]
+    return sorted(files)
+
+
+def dos_tests() -> List[Test]:
+    p = subprocess.run([os.path.join(ROOT, 'tools', 'test-dos.sh'),
+                        '--list-runtime'], stdout=subprocess.PIPE,
+                       text=True, check=True)
+    tests = []
+    for line in p.stdout.splitlines():
+        src, golden, model = line.split(':')
+        base = os.path.splitext(os.path.basename(src))[0]
+        tests.append(Test('dos', '%s runtime (%s)' % (model, base), run_dos,
+                          (src, golden, model)))
+    return tests
+
+
+def run_dos(t: Test, tmp: str) -> Result:
+    src, golden, model = t.args
+    r = Result(t.suite, t.name)
+    base = os.path.splitext(os.path.basename(src))[0]
+    exe = os.path.join(tmp, base + '.exe')
+    cached = None
+    if CACHE.root:
+        key = key_of([model], DOS_TOOLCHAIN + [os.path.join(ROOT, src)])
+        cached = CACHE.path('dos', key, '.exe')
+    if cached and os.path.exists(cached):
+        shutil.copyfile(cached, exe)
+        r.cached = True
+    else:
+        env = dict(os.environ, EXAMPLE_OUT_DIR=tmp, TMPDIR=tmp)
+        p = subprocess.run([os.path.join(ROOT, 'tools', 'test-dos.sh'),
+                            '--build-runtime', src, model], env=env,
+                           stdout=subprocess.PIPE, stderr=subprocess.STDOUT,
+                           text=True)
+        if p.returncode != 0:
+            r.status = 'skip' if p.returncode == SKIP_RC else 'fail'
+            r.output = p.stdout
+            return r
+        if cached:
+            shutil.copyfile(exe, cached + '.tmp%d' % threading.get_ident())
+            os.replace(cached + '.tmp%d' % threading.get_ident(), cached)
+    p = subprocess.run([os.path.join(ROOT, 'tools', 'run-dos-exe.sh'), exe],
+                       env=dict(os.environ, TMPDIR=tmp),
+                       stdout=subprocess.PIPE, stderr=subprocess.PIPE)
+    if p.returncode == SKIP_RC:
+        r.status = 'skip'
+        r.output = p.stderr.decode(errors='replace')
+        return r
+    want = open(os.path.join(ROOT, golden), 'rb').read()
+    got = p.stdout.rstrip(b'\n') + b'\n'
+    if p.returncode != 0 or got != want:
+        r.status = 'fail'
+        d = subprocess.run(['diff', '-u', os.path.join(ROOT, golden), '-'],
+                           input=got, stdout=subprocess.PIPE)
+        r.output = (p.stderr + d.stdout).decode(errors='replace')
+    return r
+
+
+DOS_TOOLCHAIN: List[str] = []
+
+
+def warm_newlibc_cache(tests: List[Test]) -> None:
+    """build-example.sh rebuilds its shared per-model newlibc object cache
+    (build/nl-cache/<model>) on a miss; build one probe per model up front
+    so the parallel builds only ever read it."""
+    seen = set()
+    for t in tests:
+        model = t.args[2]
+        if model in seen:
+            continue
+        seen.add(model)
+        with tempfile.TemporaryDirectory(prefix='ptest.') as tmp:
+            subprocess.run([os.path.join(ROOT, 'tools', 'test-dos.sh'),
+                            '--build-runtime', t.args[0], model],
+                           env=dict(os.environ, EXAMPLE_OUT_DIR=tmp),
+                           stdout=subprocess.DEVNULL,
+                           stderr=subprocess.DEVNULL)
+
+
+SUITES = {'ssa': ssa_tests, 'dos': dos_tests}
+
+
+# ---------------------------------------------------------------------------
+# Driver
+# ---------------------------------------------------------------------------
+
+def execute(t: Test) -> Result:
+    t0 = time.monotonic()
+    with tempfile.TemporaryDirectory(prefix='ptest.') as tmp:
+        try:
+            r = t.run(t, tmp)
+        except Exception as e:  # a runner bug must not hang the pool
+            r = Result(t.suite, t.name, 'fail', output=repr(e))
+    r.seconds = time.monotonic() - t0
+    return r
+
+
+def report(r: Result) -> None:
+    tag = {'pass': 'ok', 'fail': 'FAIL', 'skip': 'skip'}[r.status]
+    if r.cached:
+        tag += ', cached'
+    print('%-45s[%s] %.2fs' % (r.name + '...', tag, r.seconds))
+    if r.status == 'fail' and r.output:
+        for line in r.output.rstrip('\n').splitlines():
+            print('    ' + line)
+    sys.stdout.flush()
+
+
+def write_json(path: str, results: List[Result], wall: float) -> None:
+    doc = {
+        'wall_seconds': round(wall, 3),
+        'passed': sum(r.status == 'pass' for r in results),
+        'failed': sum(r.status == 'fail' for r in results),
+        'skipped': sum(r.status == 'skip' for r in results),
+        'tests': [{'suite': r.suite, 'name': r.name, 'status': r.status,
+                   'seconds': round(r.seconds, 3), 'cached': r.cached,
+                   'output': r.output if r.status == 'fail' else ''}
+                  for r in results],
+    }
+    with open(path, 'w') as f:
+        json.dump(doc, f, indent=1)
+        f.write('\n')
+
+
+def write_junit(path: str, results: List[Result]) -> None:
+    top = ET.Element('testsuites')
+    for suite in sorted({r.suite for r in results}):
+        rs = [r for r in results if r.suite == suite]
+        el = ET.SubElement(top, 'testsuite', name=suite, tests=str(len(rs)),
+                           failures=str(sum(r.status == 'fail' for r in rs)),
+                           skipped=str(sum(r.status == 'skip' for r in rs)),
+                           time='%.3f' % sum(r.seconds for r in rs))
+        for r in rs:
+            tc = ET.SubElement(el, 'testcase', classname=suite, name=r.name,
+                               time='%.3f' % r.seconds)
+            if r.status == 'fail':
+                ET.SubElement(tc, 'failure', message='failed').text = r.output
+            elif r.status == 'skip':
+                ET.SubElement(tc, 'skipped', message=r.output.strip()[:200])
+    ET.ElementTree(top).write(path, encoding='utf-8', xml_declaration=True)
+
+
+def main() -> int:
+    ap = argparse.ArgumentParser(
+        description='Run QBE test suites in parallel.')
+    ap.add_argument('suites', nargs='*', metavar='suite',
+                    help='ssa (default) and/or dos')
+    ap.add_argument('-j', '--jobs', type=int, default=os.cpu_count() or 1,
+                    help='parallel jobs (default: number of CPUs)')
+    ap.add_argument('-k', dest='pattern', default='',
+                    help='only run tests whose name contains SUBSTRING')
+    ap.add_argument('--json', dest='json_path',
+                    help='write a JSON summary to FILE')
+    ap.add_argument('--junit', dest='junit_path',
+                    help='write a JUnit XML summary to FILE')
+    ap.add_argument('--cache-dir',
+                    default=os.path.join(ROOT, 'build', 'ptest-cache'),
+                    help='result/build cache (default: build/ptest-cache)')
+    ap.add_argument('--no-cache', action='store_true',
+                    help='ignore and do not update the cache')
+    args = ap.parse_args()
+
+    for s in args.suites:
+        if s not in SUITES:
+            ap.error('unknown suite %r (choose from %s)'
+                     % (s, ', '.join(sorted(SUITES))))
+    CACHE.root = None if args.no_cache else args.cache_dir
+    tests: List[Test] = []
+    for s in dict.fromkeys(args.suites or ['ssa']):
+        tests += [t for t in SUITES[s]() if args.pattern in t.name]
+    if any(t.suite == 'dos' for t in tests):
+        DOS_TOOLCHAIN.extend(dos_toolchain())
+        warm_newlibc_cache([t for t in tests if t.suite == 'dos'])
+
+    t0 = time.monotonic()
+    results: List[Result] = []
+    with concurrent.futures.ThreadPoolExecutor(max(1, args.jobs)) as pool:
+        for fut in concurrent.futures.as_completed(
+                [pool.submit(execute, t) for t in tests]):
+            r = fut.result()
+            results.append(r)
+            report(r)
+    wall = time.monotonic() - t0
+
+    order = {(t.suite, t.name): n for n, t in enumerate(tests)}
+    results.sort(key=lambda r: order[(r.suite, r.name)])
+    if args.json_path:
+        write_json(args.json_path, results, wall)
+    if args.junit_path:
+        write_junit(args.junit_path, results)
+
+    fail = sum(r.status == 'fail' for r in results)
+    skip = sum(r.status == 'skip' for r in results)
+    print()
+    print('%d tests, %d failed, %d skipped, %.1fs wall with -j%d'
+          % (len(results), fail, skip, wall, args.jobs))
+    print('%d of %d tests failed!' % (fail, len(results)) if fail
+          else 'All is fine!')
+    return 1 if fail else 0
+
+
+if __name__ == '__main__':
+    sys.exit(main())
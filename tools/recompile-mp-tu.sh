@@ -3,7 +3,9 @@
 # relink build/mp-link/mpython.exe (with --gc-sections), reusing every other
 # already-built object in build/mp-link/.  This is the fast inner loop for the
 # on-target bring-up debugging (a full tools/build-micropython.sh run recompiles
-# all 106 TUs; this touches one).
+# all 106 TUs; this touches one).  A full build now also skips TUs whose
+# inputs are unchanged (its stage cache), but still re-runs every cpp and
+# relinks in the full script's order; this is still the quickest loop.
 #
 # Prereq: a full `bash tools/build-micropython.sh --model=compact --keep-going`
 # has populated build/mp-link/ with every TU's .obj, and /tmp/mp_objs.txt lists
@@ -70,12 +72,11 @@ EOF
 fi
 "$MINIC" -m "$MODEL" < "$OUT_DIR/$base.pp.c" > "$OUT_DIR/$base.ssa" 2>"$OUT_DIR/$base.err" || { echo "MINIC_FAIL $base"; cat "$OUT_DIR/$base.err"; exit 1; }
 "$QBE" -t i8086 -m "$MODEL" $QBE_SPLIT_FLAG "$OUT_DIR/$base.ssa" > "$OUT_DIR/$base.asm" 2>"$OUT_DIR/$base.err" || { echo "QBE_FAIL $base"; cat "$OUT_DIR/$base.err"; exit 1; }
-# Per-function text segments, matching build-micropython.sh (§4t) — a TU
-# rebuilt here must split .text identically or the relink silently reverts
-# that TU to whole-TU gc-sections granularity.
-QBE_TEXT_SEG_BUDGET=${QBE_TEXT_SEG_BUDGET:-1} \
-tools/asm_to_omf.py "--model=$MODEL" --far-static-data "$base" "$OUT_DIR/$base.asm" "$OUT_DIR/$base.omf.asm" 2>"$OUT_DIR/$base.err" || { echo "OMF_FAIL $base"; cat "$OUT_DIR/$base.err"; exit 1; }
+# Per-function sections, matching build-micropython.sh (§4t) — a TU rebuilt
+# here must be split identically or the relink silently reverts that TU to
+# whole-TU gc-sections granularity.
+tools/asm_to_omf.py "--model=$MODEL" --far-static-data --function-sections "$base" "$OUT_DIR/$base.asm" "$OUT_DIR/$base.omf.asm" 2>"$OUT_DIR/$base.err" || { echo "OMF_FAIL $base"; cat "$OUT_DIR/$base.err"; exit 1; }
 nasm -w-label-redef-late -f obj "$OUT_DIR/$base.omf.asm" -o "$OUT_DIR/$base.obj" 2>"$OUT_DIR/$base.err" || { echo "NASM_FAIL $base"; cat "$OUT_DIR/$base.err"; exit 1; }
 echo "$base.obj rebuilt"
 OBJS=(); while IFS= read -r l; do OBJS+=("$l"); done < /tmp/mp_objs.txt
-tools/omf_link.py -o "$OUT_DIR/mpython.exe" --map "$OUT_DIR/mpython.map" --entry _start --stack-size "$MP_STACK_SIZE" $LINK_SPLIT_FLAG --gc-sections --pack-code "${OBJS[@]}" 2>&1 | grep -E "image|stripped"
+tools/omf_link.py -o "$OUT_DIR/mpython.exe" --map "$OUT_DIR/mpython.map" --entry _start --stack-size "$MP_STACK_SIZE" $LINK_SPLIT_FLAG --gc-sections --pack-callgraph "${OBJS[@]}" 2>&1 | grep -E "image|stripped"
@@ -7,7 +7,10 @@
 # Usage:  tools/run-dos-exe.sh path/to/foo.exe [maxsecs]
 #         tools/run-dos-exe.sh build/examples/cstrprobe/cstrprobe.exe 20
 #
-# Looks up DOSBox via, in order:
+# With DOS_RUNNER=sim86 the program runs under the in-tree 8086 simulator
+# (tools/sim86, `make sim86`) instead: no DOSBox, no 8.3 renaming, and the
+# clock/profile summary goes to stderr when $SIM86_FLAGS asks for it (e.g.
+# SIM86_FLAGS="-m foo.map").  Otherwise this looks up DOSBox via, in order:
 #   1. $DOSBOX               — explicit override (full path)
 #   2. `command -v dosbox`   — Linux / Homebrew default
 #   3. /Applications/dosbox.app/Contents/MacOS/DOSBox — macOS .app bundle
@@ -17,13 +20,15 @@
 # DOS-side particulars:
 #   * 8.3 filename truncation breaks `foo.exe` if the basename is ≥ 9
 #     chars (mounting just exposes the LFN as a tilded short).  We copy
-#     the .exe into a sibling `RUN.EXE` (always 8.3-safe) before launch.
+#     the .exe as `RUN.EXE` (always 8.3-safe) into a private staging
+#     directory, which is what gets mounted as C:.
 #   * The .EXE runs with stdout redirected to `OUT.TXT` on the C: mount.
 #     DOSBox doesn't propagate the child's stdout to ours, so the
 #     redirect file is the only reliable channel.
-#   * Cleanup deletes both the renamed copy and OUT.TXT on exit so the
-#     next run starts fresh (and stale OUT.TXT from a previous failing
-#     run never masquerades as the current invocation's output).
+#   * The staging directory is per invocation and removed on exit, so
+#     concurrent runs (tools/ptest.py -j) never share RUN.EXE/OUT.TXT and
+#     a stale OUT.TXT from a previous failing run never masquerades as the
+#     current invocation's output.
 
 set -eu
 
@@ -35,6 +40,19 @@ if [ -z "$EXE" ] || [ ! -f "$EXE" ]; then
 	exit 2
 fi
 
+if [ "${DOS_RUNNER:-dosbox}" = sim86 ]; then
+	SIM86="$(cd "$(dirname "$0")" && pwd)/sim86"
+	if [ ! -x "$SIM86" ]; then
+		echo "run-dos-exe: $SIM86 not built (run: make sim86)" >&2
+		exit 77
+	fi
+	# 4.77 MHz worth of clocks per second of the DOSBox timeout.
+	STDIN_FILE="${DOS_STDIN:-/dev/null}"
+	# shellcheck disable=SC2086
+	exec "$SIM86" -n -q -l $((TIMEOUT_SEC * 4772727)) ${SIM86_FLAGS:-} \
+		"$EXE" < "$STDIN_FILE"
+fi
+
 # Locate DOSBox.
 DOSBOX_APP=""
 if [ -n "${DOSBOX:-}" ] && [ -x "$DOSBOX" ]; then
@@ -54,13 +72,13 @@ case "$DOSBOX_BIN" in
 	*.app/Contents/MacOS/*) DOSBOX_APP="${DOSBOX_BIN%.app/Contents/MacOS/*}.app" ;;
 esac
 
-EXE_DIR="$(cd "$(dirname "$EXE")" && pwd)"
+STAGE_DIR="$(mktemp -d -t run-dos-exe.XXXXXX)"
 EXE_BASE="$(basename "$EXE")"
 SHORT_NAME="RUN.${EXE_BASE##*.}"        # RUN.EXE or RUN.COM
-SHORT_PATH="$EXE_DIR/$SHORT_NAME"
-OUT_PATH="$EXE_DIR/OUT.TXT"
-DONE_PATH="$EXE_DIR/DONE.TXT"
-IN_PATH="$EXE_DIR/IN.TXT"
+SHORT_PATH="$STAGE_DIR/$SHORT_NAME"
+OUT_PATH="$STAGE_DIR/OUT.TXT"
+DONE_PATH="$STAGE_DIR/DONE.TXT"
+IN_PATH="$STAGE_DIR/IN.TXT"
 
 # Optional stdin redirect: $DOS_STDIN points at a host file whose bytes are
 # fed to the program as DOS stdin (`PROG < IN.TXT`).  Used by the keyboard
@@ -77,7 +95,7 @@ if [ -n "${DOS_STDIN:-}" ]; then
 fi
 
 cleanup() {
-	rm -f "$SHORT_PATH" "$OUT_PATH" "$DONE_PATH" "$IN_PATH"
+	rm -rf "$STAGE_DIR"
 }
 trap cleanup EXIT
 
@@ -91,7 +109,7 @@ CONF="$(mktemp -t run-dos-exe-conf.XXXXXX)"
 trap 'rm -f "$CONF"; cleanup' EXIT
 cat > "$CONF" <<EOF
 [autoexec]
-mount c "$EXE_DIR"
+mount c "$STAGE_DIR"
 c:
 $SHORT_NAME ${REDIR_IN}> OUT.TXT
 echo done > DONE.TXT
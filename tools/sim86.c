@@ -0,0 +1,2117 @@
+/* sim86 -- cycle-counting 8086/8088 interpreter for DOS .EXE/.COM images
+ *
+ *	make sim86
+ *	tools/sim86 [-8 | -6] [-m prog.map] [-p N] [-l LIMIT] [-n] [-q]
+ *	            prog.exe [args...]
+ *
+ * Runs a real-mode program produced by the i8086 pipeline (qbe ->
+ * asm_to_omf.py -> nasm -> omf_link.py) without DOSBox, and reports the
+ * instruction and clock counts on stderr when it exits.  With -m, the
+ * clocks are also attributed to the symbols of an omf_link.py --map file
+ * (each instruction is charged to the closest preceding public symbol),
+ * which gives a flat per-function profile.
+ *
+ * Timing.  Each instruction is charged the execution-unit clocks from the
+ * Intel 8086 data sheet (register/memory/immediate forms, effective-address
+ * clocks, REP per-iteration counts, taken/not-taken branches).  Every word
+ * memory transfer then costs 4 extra clocks on the 8088 (-8, the default:
+ * its bus is 8 bits wide) or, on the 8086 (-6), only when the address is
+ * odd.  The prefetch queue is NOT modelled, so code that starves the 8088
+ * queue (long runs of short fast instructions) runs slower on hardware
+ * than reported here; the numbers are meant for comparing two builds of
+ * the same program, not for predicting wall-clock time.  MUL/DIV are
+ * charged the midpoint of their data-dependent range.
+ *
+ * DOS.  INT 21h is emulated at the INT instruction (high-level emulation)
+ * for the subset our libc reaches through dos_syscall.asm, libstub.asm and
+ * crt0*.asm: console I/O (01 02 06 07 08 09 0A 0B), vectors (25 35), date
+ * and time (2A 2C, deterministic: derived from the clock count), files by
+ * handle (3C-42, 56, 41, 43, 44, 57), directories (39 3A 3B 47), memory
+ * (48 49 4A), PSP/DTA (1A 2F 62), version (30) and exit (4C, INT 20h).
+ * INT 10h teletype, INT 16h keyboard and INT 1Ah ticks are emulated as
+ * far as stdio needs.  An interrupt the program hooked (through AH=25h or
+ * by writing the vector table) is dispatched to the program's handler; no
+ * hardware interrupt is ever raised.  Clocks spent inside emulated
+ * services are not counted, only the INT itself.
+ *
+ * The exit status is the program's AL, 124 on a simulator error (bad
+ * image, unimplemented opcode, divide error, clock limit), like timeout(1).
+ */
+#define _POSIX_C_SOURCE 200809L
+#include <errno.h>
+#include <fcntl.h>
+#include <stdarg.h>
+#include <stdint.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <sys/stat.h>
+#include <unistd.h>
+
+enum { AX, CX, DX, BX, SP, BP, SI, DI };
+enum { ES, CS, SS, DS };
+
+enum {
+	CF = 0x001,
+	PF = 0x004,
+	AF = 0x010,
+	ZF = 0x040,
+	SF = 0x080,
+	TF = 0x100,
+	IF = 0x200,
+	DF = 0x400,
+	OF = 0x800,
+};
+
+enum {
+	MemTop = 0xA000,   /* first paragraph past conventional memory */
+	PspSeg = 0x0800,   /* where the program's PSP goes */
+	BiosSeg = 0xF000,  /* default vectors point at BiosSeg:n */
+	NHandle = 20,
+	NBlk = 32,
+	ErrExit = 124,
+};
+
+typedef struct Sym Sym;
+typedef struct Blk Blk;
+
+struct Sym {
+	char *name;
+	uint32_t addr;
+	uint64_t clk;
+	uint64_t ins;
+};
+
+struct Blk {
+	uint16_t seg;
+	uint16_t len;
+};
+
+static uint8_t mem[0x100000];
+static uint16_t reg[8], sreg[4], ip, flags;
+static uint64_t clk, nins, clklimit;
+static int i8088 = 1, crlf, quiet;
+
+/* current instruction */
+static uint16_t ip0, cs0;
+static int ovr, rep;
+static int mod, rreg, rm;
+static uint16_t eseg, eoff;
+
+static Sym *sym;
+static int nsym;
+static uint32_t imgbase;
+
+static int hfd[NHandle];
+static Blk blk[NBlk];
+static int nblk;
+static uint16_t dtaseg, dtaoff;
+static int exitcode = -1;
+static char *progname;
+
+static void
+die(char *fmt, ...)
+{
+	va_list ap;
+
+	fflush(stdout);
+	fprintf(stderr, "sim86: ");
+	va_start(ap, fmt);
+	vfprintf(stderr, fmt, ap);
+	va_end(ap);
+	fprintf(stderr, "\n");
+	exit(ErrExit);
+}
+
+static void
+fault(char *msg)
+{
+	die("%s at %04X:%04X after %llu clocks", msg, cs0, ip0,
+		(unsigned long long)clk);
+}
+
+/* memory */
+
+static uint32_t
+lin(uint16_t s, uint16_t o)
+{
+	return ((uint32_t)s * 16 + o) & 0xFFFFF;
+}
+
+static uint8_t
+rdb(uint16_t s, uint16_t o)
+{
+	return mem[lin(s, o)];
+}
+
+static void
+wrb(uint16_t s, uint16_t o, uint8_t v)
+{
+	uint32_t a;
+
+	a = lin(s, o);
+	if (a < 0xF0000)
+		mem[a] = v;
+}
+
+/* A word transfer takes two bus cycles on the 8088, and on the
+ * 8086 whenever the address is odd.
+ */
+static void
+wordbus(uint16_t o)
+{
+	if (i8088 || (o & 1))
+		clk += 4;
+}
+
+static uint16_t
+rdw(uint16_t s, uint16_t o)
+{
+	wordbus(o);
+	return rdb(s, o) | rdb(s, o + 1) << 8;
+}
+
+static void
+wrw(uint16_t s, uint16_t o, uint16_t v)
+{
+	wordbus(o);
+	wrb(s, o, v);
+	wrb(s, o + 1, v >> 8);
+}
+
+/* Untimed accessors for the emulated DOS services. */
+static uint16_t
+peekw(uint16_t s, uint16_t o)
+{
+	return rdb(s, o) | rdb(s, o + 1) << 8;
+}
+
+static void
+pokew(uint16_t s, uint16_t o, uint16_t v)
+{
+	wrb(s, o, v);
+	wrb(s, o + 1, v >> 8);
+}
+
+static uint8_t
+fetchb(void)
+{
+	return rdb(sreg[CS], ip++);
+}
+
+static uint16_t
+fetchw(void)
+{
+	uint16_t v;
+
+	v = fetchb();
+	return v | fetchb() << 8;
+}
+
+static uint8_t
+getr8(int r)
+{
+	return r < 4 ? reg[r] & 0xFF : reg[r - 4] >> 8;
+}
+
+static void
+setr8(int r, uint8_t v)
+{
+	if (r < 4)
+		reg[r] = (reg[r] & 0xFF00) | v;
+	else
+		reg[r - 4] = (reg[r - 4] & 0x00FF) | v << 8;
+}
+
+static void
+push(uint16_t v)
+{
+	reg[SP] -= 2;
+	wrw(sreg[SS], reg[SP], v);
+}
+
+static uint16_t
+pop(void)
+{
+	uint16_t v;
+
+	v = rdw(sreg[SS], reg[SP]);
+	reg[SP] += 2;
+	return v;
+}
+
+/* ModRM */
+
+static const uint8_t eaclk[8] = { 7, 8, 8, 7, 5, 5, 5, 5 };
+
+static void
+modrm(void)
+{
+	uint8_t b;
+	uint16_t o;
+	int s;
+
+	b = fetchb();
+	mod = b >> 6;
+	rreg = (b >> 3) & 7;
+	rm = b & 7;
+	if (mod == 3)
+		return;
+	s = DS;
+	switch (rm) {
+	case 0: o = reg[BX] + reg[SI]; break;
+	case 1: o = reg[BX] + reg[DI]; break;
+	case 2: o = reg[BP] + reg[SI]; s = SS; break;
+	case 3: o = reg[BP] + reg[DI]; s = SS; break;
+	case 4: o = reg[SI]; break;
+	case 5: o = reg[DI]; break;
+	case 6: o = reg[BP]; s = SS; break;
+	default: o = reg[BX]; break;
+	}
+	if (mod == 0 && rm == 6) {
+		o = fetchw();
+		s = DS;
+		clk += 6;
+	} else {
+		clk += eaclk[rm];
+		if (mod == 1) {
+			o += (int8_t)fetchb();
+			clk += 4;
+		} else if (mod == 2) {
+			o += fetchw();
+			clk += 4;
+		}
+	}
+	eseg = ovr >= 0 ? sreg[ovr] : sreg[s];
+	eoff = o;
+}
+
+static uint8_t
+getrm8(void)
+{
+	return mod == 3 ? getr8(rm) : rdb(eseg, eoff);
+}
+
+static void
+setrm8(uint8_t v)
+{
+	if (mod == 3)
+		setr8(rm, v);
+	else
+		wrb(eseg, eoff, v);
+}
+
+static uint16_t
+getrm16(void)
+{
+	return mod == 3 ? reg[rm] : rdw(eseg, eoff);
+}
+
+static void
+setrm16(uint16_t v)
+{
+	if (mod == 3)
+		reg[rm] = v;
+	else
+		wrw(eseg, eoff, v);
+}
+
+static uint16_t
+getrm(int w)
+{
+	return w ? getrm16() : getrm8();
+}
+
+static void
+setrm(int w, uint16_t v)
+{
+	if (w)
+		setrm16(v);
+	else
+		setrm8(v);
+}
+
+static uint16_t
+getreg(int w, int r)
+{
+	return w ? reg[r] : getr8(r);
+}
+
+static void
+setreg(int w, int r, uint16_t v)
+{
+	if (w)
+		reg[r] = v;
+	else
+		setr8(r, v);
+}
+
+/* flags */
+
+static void
+setf(int f, int on)
+{
+	if (on)
+		flags |= f;
+	else
+		flags &= ~f;
+}
+
+static void
+szp(uint16_t v, int w)
+{
+	uint8_t p;
+
+	if (!w)
+		v &= 0xFF;
+	setf(ZF, v == 0);
+	setf(SF, v & (w ? 0x8000 : 0x80));
+	p = v & 0xFF;
+	p ^= p >> 4;
+	p ^= p >> 2;
+	p ^= p >> 1;
+	setf(PF, !(p & 1));
+}
+
+static uint16_t
+alu(int op, uint16_t a, uint16_t b, int w)
+{
+	uint32_t r, sign, mask;
+	int c;
+
+	sign = w ? 0x8000 : 0x80;
+	mask = w ? 0xFFFF : 0xFF;
+	a &= mask;
+	b &= mask;
+	c = 0;
+	switch (op) {
+	case 2: /* adc */
+		c = flags & CF;
+		/* fall through */
+	case 0: /* add */
+		r = (uint32_t)a + b + c;
+		setf(CF, r > mask);
+		setf(AF, (a ^ b ^ r) & 0x10);
+		setf(OF, (r ^ a) & (r ^ b) & sign);
+		break;
+	case 3: /* sbb */
+		c = flags & CF;
+		/* fall through */
+	case 5: /* sub */
+	case 7: /* cmp */
+		r = (uint32_t)a - b - c;
+		setf(CF, r > mask);
+		setf(AF, (a ^ b ^ r) & 0x10);
+		setf(OF, (a ^ b) & (a ^ r) & sign);
+		break;
+	case 1: r = a | b; goto logic;
+	case 4: r = a & b; goto logic;
+	default: r = a ^ b;
+	logic:
+		flags &= ~(CF | OF | AF);
+		break;
+	}
+	r &= mask;
+	szp(r, w);
+	return r;
+}
+
+static uint16_t
+incdec(uint16_t v, int dec, int w)
+{
+	int cf;
+
+	cf = flags & CF;
+	v = alu(dec ? 5 : 0, v, 1, w);
+	setf(CF, cf);
+	return v;
+}
+
+static uint16_t
+shift(int op, uint16_t v, unsigned n, int w)
+{
+	uint32_t sign, mask;
+	unsigned i, cf;
+
+	if (n == 0)
+		return v;
+	sign = w ? 0x8000 : 0x80;
+	mask = w ? 0xFFFF : 0xFF;
+	v &= mask;
+	cf = 0;
+	for (i = 0; i < n; i++)
+		switch (op) {
+		case 0: /* rol */
+			cf = !!(v & sign);
+			v = ((v << 1) | cf) & mask;
+			break;
+		case 1: /* ror */
+			cf = v & 1;
+			v = (v >> 1) | (cf ? sign : 0);
+			break;
+		case 2: /* rcl */
+			cf = !!(v & sign);
+			v = ((v << 1) | !!(flags & CF)) & mask;
+			setf(CF, cf);
+			break;
+		case 3: /* rcr */
+			cf = v & 1;
+			v = (v >> 1) | (flags & CF ? sign : 0);
+			setf(CF, cf);
+			break;
+		case 4: /* shl */
+		case 6:
+			cf = !!(v & sign);
+			v = (v << 1) & mask;
+			break;
+		case 5: /* shr */
+			cf = v & 1;
+			v >>= 1;
+			break;
+		default: /* sar */
+			cf = v & 1;
+			v = (v >> 1) | (v & sign);
+			break;
+		}
+	setf(CF, cf);
+	switch (op) {
+	case 0: case 2: case 4: case 6:
+		setf(OF, !!(v & sign) != cf);
+		break;
+	case 1: case 3:
+		setf(OF, ((v << 1) ^ v) & sign);
+		break;
+	case 5:
+		setf(OF, n == 1 && ((v << 1) & sign));
+		break;
+	default:
+		flags &= ~OF;
+		break;
+	}
+	if (op >= 4)
+		szp(v, w);
+	return v;
+}
+
+/* interrupts */
+
+static void hle(int);
+
+static int
+hooked(int n)
+{
+	return peekw(0, n * 4) != n || peekw(0, n * 4 + 2) != BiosSeg;
+}
+
+static void
+intr(int n)
+{
+	push(flags | 0xF002);
+	push(sreg[CS]);
+	push(ip);
+	flags &= ~(IF | TF);
+	ip = rdw(0, n * 4);
+	sreg[CS] = rdw(0, n * 4 + 2);
+}
+
+static void
+softint(int n)
+{
+	if (hooked(n))
+		intr(n);
+	else
+		hle(n);
+}
+
+static void
+diverr(void)
+{
+	if (!hooked(0))
+		fault("divide error");
+	/* the 8086 pushes the address of the faulting instruction's
+	 * successor; we have already decoded it
+	 */
+	intr(0);
+}
+
+/* multiply and divide */
+
+static void
+muldiv(int op, int w)
+{
+	uint32_t a, b, q, r;
+	int32_t sa, sb, sq, sr;
+	static const uint8_t t8[4] = { 74, 89, 85, 107 };
+	static const uint8_t t16[4] = { 126, 141, 153, 175 };
+
+	clk += w ? t16[op - 4] : t8[op - 4];
+	if (mod != 3)
+		clk += 6;
+	b = getrm(w);
+	switch (op) {
+	case 4: /* mul */
+		if (w) {
+			a = (uint32_t)reg[AX] * b;
+			reg[AX] = a;
+			reg[DX] = a >> 16;
+			setf(CF | OF, reg[DX] != 0);
+		} else {
+			a = (reg[AX] & 0xFF) * b;
+			reg[AX] = a;
+			setf(CF | OF, (reg[AX] >> 8) != 0);
+		}
+		break;
+	case 5: /* imul */
+		if (w) {
+			sa = (int32_t)(int16_t)reg[AX] * (int16_t)b;
+			reg[AX] = sa;
+			reg[DX] = (uint32_t)sa >> 16;
+			setf(CF | OF, sa != (int16_t)sa);
+		} else {
+			sa = (int8_t)reg[AX] * (int8_t)b;
+			reg[AX] = sa;
+			setf(CF | OF, sa != (int8_t)sa);
+		}
+		break;
+	case 6: /* div */
+		if (w) {
+			a = (uint32_t)reg[DX] << 16 | reg[AX];
+			if (b == 0 || a / b > 0xFFFF) {
+				diverr();
+				return;
+			}
+			q = a / b;
+			r = a % b;
+			reg[AX] = q;
+			reg[DX] = r;
+		} else {
+			a = reg[AX];
+			if (b == 0 || a / b > 0xFF) {
+				diverr();
+				return;
+			}
+			q = a / b;
+			r = a % b;
+			reg[AX] = (r << 8) | q;
+		}
+		break;
+	default: /* idiv */
+		if (w) {
+			sa = (int32_t)((uint32_t)reg[DX] << 16 | reg[AX]);
+			sb = (int16_t)b;
+			if (sb == 0 || (sa == INT32_MIN && sb == -1)) {
+				diverr();
+				return;
+			}
+			sq = sa / sb;
+			sr = sa % sb;
+			if (sq > 0x7FFF || sq < -0x7FFF) {
+				diverr();
+				return;
+			}
+			reg[AX] = sq;
+			reg[DX] = sr;
+		} else {
+			sa = (int16_t)reg[AX];
+			sb = (int8_t)b;
+			if (sb == 0) {
+				diverr();
+				return;
+			}
+			sq = sa / sb;
+			sr = sa % sb;
+			if (sq > 0x7F || sq < -0x7F) {
+				diverr();
+				return;
+			}
+			reg[AX] = (uint8_t)sr << 8 | (uint8_t)sq;
+		}
+		break;
+	}
+}
+
+/* string instructions; the clocks of one iteration are returned,
+ * with bit 8 set for the ones REPE/REPNE also stop on ZF
+ */
+
+static int
+strop(uint8_t op)
+{
+	int w, d;
+	uint16_t a, b, s;
+
+	w = op & 1;
+	d = flags & DF ? -(1 + w) : 1 + w;
+	s = ovr >= 0 ? sreg[ovr] : sreg[DS];
+	switch (op & ~1) {
+	case 0xA4: /* movs */
+		if (w)
+			wrw(sreg[ES], reg[DI], rdw(s, reg[SI]));
+		else
+			wrb(sreg[ES], reg[DI], rdb(s, reg[SI]));
+		reg[SI] += d;
+		reg[DI] += d;
+		return rep ? 17 : 18;
+	case 0xA6: /* cmps */
+		a = w ? rdw(s, reg[SI]) : rdb(s, reg[SI]);
+		b = w ? rdw(sreg[ES], reg[DI]) : rdb(sreg[ES], reg[DI]);
+		alu(7, a, b, w);
+		reg[SI] += d;
+		reg[DI] += d;
+		return 22 | 1 << 8;
+	case 0xAA: /* stos */
+		if (w)
+			wrw(sreg[ES], reg[DI], reg[AX]);
+		else
+			wrb(sreg[ES], reg[DI], reg[AX]);
+		reg[DI] += d;
+		return rep ? 10 : 11;
+	case 0xAC: /* lods */
+		if (w)
+			reg[AX] = rdw(s, reg[SI]);
+		else
+			setr8(0, rdb(s, reg[SI]));
+		reg[SI] += d;
+		return rep ? 13 : 12;
+	default: /* scas */
+		b = w ? rdw(sreg[ES], reg[DI]) : rdb(sreg[ES], reg[DI]);
+		alu(7, w ? reg[AX] : reg[AX] & 0xFF, b, w);
+		reg[DI] += d;
+		return 15 | 1 << 8;
+	}
+}
+
+static void
+string(uint8_t op)
+{
+	int t;
+
+	if (!rep) {
+		clk += strop(op) & 0xFF;
+		return;
+	}
+	clk += 9;
+	while (reg[CX]) {
+		t = strop(op);
+		clk += t & 0xFF;
+		reg[CX]--;
+		if (t >> 8 && !!(flags & ZF) != (rep == 0xF3))
+			break;
+	}
+}
+
+/* BCD */
+
+static void
+bcd(uint8_t op)
+{
+	uint8_t al, old;
+	int af, cf;
+
+	al = old = reg[AX];
+	cf = 0;
+	af = (al & 0x0F) > 9 || (flags & AF);
+	switch (op) {
+	case 0x27: /* daa */
+	case 0x2F: /* das */
+		cf = old > 0x99 || (flags & CF);
+		if (af)
+			al = op == 0x27 ? al + 6 : al - 6;
+		if (cf)
+			al = op == 0x27 ? al + 0x60 : al - 0x60;
+		setr8(0, al);
+		szp(al, 0);
+		break;
+	case 0x37: /* aaa */
+	case 0x3F: /* aas */
+		cf = af;
+		if (af) {
+			al = op == 0x37 ? al + 6 : al - 6;
+			setr8(4, getr8(4) + (op == 0x37 ? 1 : -1));
+		}
+		setr8(0, al & 0x0F);
+		break;
+	}
+	setf(AF, af);
+	setf(CF, cf);
+	clk += 4;
+}
+
+/* control transfer helpers */
+
+static int
+cond(int c)
+{
+	int r;
+
+	switch (c >> 1) {
+	case 0: r = flags & OF; break;
+	case 1: r = flags & CF; break;
+	case 2: r = flags & ZF; break;
+	case 3: r = flags & (CF | ZF); break;
+	case 4: r = flags & SF; break;
+	case 5: r = flags & PF; break;
+	case 6: r = !(flags & SF) != !(flags & OF); break;
+	default: r = (flags & ZF) || !(flags & SF) != !(flags & OF); break;
+	}
+	return (c & 1) ? !r : !!r;
+}
+
+static void
+jshort(int taken, int tclk, int nclk)
+{
+	int8_t d;
+
+	d = fetchb();
+	if (taken) {
+		ip += d;
+		clk += tclk;
+	} else
+		clk += nclk;
+}
+
+static void
+grp5(void)
+{
+	uint16_t v, s;
+
+	modrm();
+	switch (rreg) {
+	case 0: /* inc */
+	case 1: /* dec */
+		if (mod == 3)
+			clk += 2;
+		else
+			clk += 15;
+		setrm16(incdec(getrm16(), rreg, 1));
+		break;
+	case 2: /* call near */
+		v = getrm16();
+		clk += mod == 3 ? 16 : 21;
+		push(ip);
+		ip = v;
+		break;
+	case 3: /* call far */
+		if (mod == 3)
+			fault("call far register");
+		v = rdw(eseg, eoff);
+		s = rdw(eseg, eoff + 2);
+		clk += 37;
+		push(sreg[CS]);
+		push(ip);
+		ip = v;
+		sreg[CS] = s;
+		break;
+	case 4: /* jmp near */
+		ip = getrm16();
+		clk += mod == 3 ? 11 : 18;
+		break;
+	case 5: /* jmp far */
+		if (mod == 3)
+			fault("jmp far register");
+		v = rdw(eseg, eoff);
+		sreg[CS] = rdw(eseg, eoff + 2);
+		ip = v;
+		clk += 24;
+		break;
+	default: /* push */
+		v = getrm16();
+		clk += mod == 3 ? 11 : 16;
+		push(v);
+		break;
+	}
+}
+
+static void
+grp3(int w)
+{
+	uint16_t v;
+
+	modrm();
+	switch (rreg) {
+	case 0: /* test */
+	case 1:
+		v = getrm(w);
+		alu(4, v, w ? fetchw() : fetchb(), w);
+		clk += mod == 3 ? 5 : 11;
+		break;
+	case 2: /* not */
+		setrm(w, ~getrm(w));
+		clk += mod == 3 ? 3 : 16;
+		break;
+	case 3: /* neg */
+		v = getrm(w);
+		setrm(w, alu(5, 0, v, w));
+		clk += mod == 3 ? 3 : 16;
+		break;
+	default:
+		muldiv(rreg, w);
+		break;
+	}
+}
+
+/* one instruction */
+
+static void
+step(void)
+{
+	uint8_t op;
+	uint16_t v, s, t;
+	int w, d, n;
+
+	ip0 = ip;
+	cs0 = sreg[CS];
+	ovr = -1;
+	rep = 0;
+	if (cs0 == BiosSeg && ip0 < 256) {
+		/* a far call or jump through a saved default vector, as an
+		 * interrupt chain does: serve it and return like IRET
+		 */
+		ip = pop();
+		sreg[CS] = pop();
+		flags = (pop() & 0x0FD5) | 0xF002;
+		clk += 24;
+		hle(ip0);
+		return;
+	}
+	for (;;) {
+		op = fetchb();
+		switch (op) {
+		case 0x26: case 0x2E: case 0x36: case 0x3E:
+			ovr = (op >> 3) & 3;
+			clk += 2;
+			continue;
+		case 0xF0: case 0xF1:
+			clk += 2;
+			continue;
+		case 0xF2: case 0xF3:
+			rep = op;
+			continue;
+		}
+		break;
+	}
+
+	if (op < 0x40 && (op & 7) < 6) {
+		/* add or adc sbb and sub xor cmp */
+		n = op >> 3;
+		w = op & 1;
+		switch (op & 7) {
+		case 0: case 1: case 2: case 3:
+			d = op & 2;
+			modrm();
+			if (d) {
+				v = alu(n, getreg(w, rreg), getrm(w), w);
+				if (n != 7)
+					setreg(w, rreg, v);
+				clk += mod == 3 ? 3 : 9;
+			} else {
+				v = alu(n, getrm(w), getreg(w, rreg), w);
+				if (n != 7)
+					setrm(w, v);
+				clk += mod == 3 ? 3 : n == 7 ? 9 : 16;
+			}
+			break;
+		default:
+			w = op & 1;
+			v = alu(n, getreg(w, AX), w ? fetchw() : fetchb(), w);
+			if (n != 7)
+				setreg(w, AX, v);
+			clk += 4;
+			break;
+		}
+		return;
+	}
+
+	switch (op) {
+	case 0x06: case 0x0E: case 0x16: case 0x1E:
+		push(sreg[op >> 3]);
+		clk += 10;
+		break;
+	case 0x07: case 0x0F: case 0x17: case 0x1F:
+		sreg[op >> 3] = pop();
+		clk += 8;
+		break;
+	case 0x27: case 0x2F: case 0x37: case 0x3F:
+		bcd(op);
+		break;
+	case 0x40: case 0x41: case 0x42: case 0x43:
+	case 0x44: case 0x45: case 0x46: case 0x47:
+	case 0x48: case 0x49: case 0x4A: case 0x4B:
+	case 0x4C: case 0x4D: case 0x4E: case 0x4F:
+		reg[op & 7] = incdec(reg[op & 7], op & 8, 1);
+		clk += 2;
+		break;
+	case 0x50: case 0x51: case 0x52: case 0x53:
+	case 0x54: case 0x55: case 0x56: case 0x57:
+		/* the 8086 pushes SP after the decrement */
+		v = reg[op & 7];
+		if ((op & 7) == SP)
+			v -= 2;
+		push(v);
+		clk += 11;
+		break;
+	case 0x58: case 0x59: case 0x5A: case 0x5B:
+	case 0x5C: case 0x5D: case 0x5E: case 0x5F:
+		reg[op & 7] = pop();
+		clk += 8;
+		break;
+	case 0x60: case 0x61: case 0x62: case 0x63:
+	case 0x64: case 0x65: case 0x66: case 0x67:
+	case 0x68: case 0x69: case 0x6A: case 0x6B:
+	case 0x6C: case 0x6D: case 0x6E: case 0x6F:
+		/* 60-6F alias the conditional jumps on the 8086 */
+	case 0x70: case 0x71: case 0x72: case 0x73:
+	case 0x74: case 0x75: case 0x76: case 0x77:
+	case 0x78: case 0x79: case 0x7A: case 0x7B:
+	case 0x7C: case 0x7D: case 0x7E: case 0x7F:
+		jshort(cond(op & 15), 16, 4);
+		break;
+	case 0x80: case 0x81: case 0x82: case 0x83:
+		w = op & 1;
+		modrm();
+		v = getrm(w);
+		if (op == 0x81)
+			t = fetchw();
+		else if (op == 0x83)
+			t = (int8_t)fetchb();
+		else
+			t = fetchb();
+		v = alu(rreg, v, t, w);
+		if (rreg != 7)
+			setrm(w, v);
+		clk += mod == 3 ? 4 : rreg == 7 ? 10 : 17;
+		break;
+	case 0x84: case 0x85:
+		w = op & 1;
+		modrm();
+		alu(4, getrm(w), getreg(w, rreg), w);
+		clk += mod == 3 ? 3 : 9;
+		break;
+	case 0x86: case 0x87:
+		w = op & 1;
+		modrm();
+		v = getrm(w);
+		setrm(w, getreg(w, rreg));
+		setreg(w, rreg, v);
+		clk += mod == 3 ? 4 : 17;
+		break;
+	case 0x88: case 0x89: case 0x8A: case 0x8B:
+		w = op & 1;
+		modrm();
+		if (op & 2) {
+			setreg(w, rreg, getrm(w));
+			clk += mod == 3 ? 2 : 8;
+		} else {
+			setrm(w, getreg(w, rreg));
+			clk += mod == 3 ? 2 : 9;
+		}
+		break;
+	case 0x8C:
+		modrm();
+		setrm16(sreg[rreg & 3]);
+		clk += mod == 3 ? 2 : 9;
+		break;
+	case 0x8D:
+		modrm();
+		if (mod == 3)
+			fault("lea with register operand");
+		reg[rreg] = eoff;
+		clk += 2;
+		break;
+	case 0x8E:
+		modrm();
+		sreg[rreg & 3] = getrm16();
+		clk += mod == 3 ? 2 : 8;
+		break;
+	case 0x8F:
+		modrm();
+		v = pop();
+		setrm16(v);
+		clk += mod == 3 ? 8 : 17;
+		break;
+	case 0x90:
+		clk += 3;
+		break;
+	case 0x91: case 0x92: case 0x93:
+	case 0x94: case 0x95: case 0x96: case 0x97:
+		v = reg[AX];
+		reg[AX] = reg[op & 7];
+		reg[op & 7] = v;
+		clk += 3;
+		break;
+	case 0x98:
+		reg[AX] = (int8_t)reg[AX];
+		clk += 2;
+		break;
+	case 0x99:
+		reg[DX] = reg[AX] & 0x8000 ? 0xFFFF : 0;
+		clk += 5;
+		break;
+	case 0x9A:
+		v = fetchw();
+		s = fetchw();
+		push(sreg[CS]);
+		push(ip);
+		ip = v;
+		sreg[CS] = s;
+		clk += 28;
+		break;
+	case 0x9B:
+		clk += 4;
+		break;
+	case 0x9C:
+		push(flags | 0xF002);
+		clk += 10;
+		break;
+	case 0x9D:
+		flags = (pop() & 0x0FD5) | 0xF002;
+		clk += 8;
+		break;
+	case 0x9E:
+		flags = (flags & 0xFF00) | ((reg[AX] >> 8) & 0xD5) | 2;
+		clk += 4;
+		break;
+	case 0x9F:
+		setr8(4, flags & 0xFF);
+		clk += 4;
+		break;
+	case 0xA0: case 0xA1: case 0xA2: case 0xA3:
+		w = op & 1;
+		v = fetchw();
+		s = ovr >= 0 ? sreg[ovr] : sreg[DS];
+		if (op & 2) {
+			if (w)
+				wrw(s, v, reg[AX]);
+			else
+				wrb(s, v, reg[AX]);
+		} else {
+			if (w)
+				reg[AX] = rdw(s, v);
+			else
+				setr8(0, rdb(s, v));
+		}
+		clk += 10;
+		break;
+	case 0xA4: case 0xA5: case 0xA6: case 0xA7:
+	case 0xAA: case 0xAB: case 0xAC: case 0xAD:
+	case 0xAE: case 0xAF:
+		string(op);
+		break;
+	case 0xA8: case 0xA9:
+		w = op & 1;
+		alu(4, getreg(w, AX), w ? fetchw() : fetchb(), w);
+		clk += 4;
+		break;
+	case 0xB0: case 0xB1: case 0xB2: case 0xB3:
+	case 0xB4: case 0xB5: case 0xB6: case 0xB7:
+		setr8(op & 7, fetchb());
+		clk += 4;
+		break;
+	case 0xB8: case 0xB9: case 0xBA: case 0xBB:
+	case 0xBC: case 0xBD: case 0xBE: case 0xBF:
+		reg[op & 7] = fetchw();
+		clk += 4;
+		break;
+	case 0xC0: case 0xC2:
+		/* C0/C1 alias C2/C3 on the 8086 */
+		v = fetchw();
+		ip = pop();
+		reg[SP] += v;
+		clk += 12;
+		break;
+	case 0xC1: case 0xC3:
+		ip = pop();
+		clk += 8;
+		break;
+	case 0xC4: case 0xC5:
+		modrm();
+		if (mod == 3)
+			fault("les/lds with register operand");
+		reg[rreg] = rdw(eseg, eoff);
+		sreg[op == 0xC4 ? ES : DS] = rdw(eseg, eoff + 2);
+		clk += 16;
+		break;
+	case 0xC6: case 0xC7:
+		w = op & 1;
+		modrm();
+		setrm(w, w ? fetchw() : fetchb());
+		clk += mod == 3 ? 4 : 10;
+		break;
+	case 0xC8: case 0xCA:
+		v = fetchw();
+		ip = pop();
+		sreg[CS] = pop();
+		reg[SP] += v;
+		clk += 17;
+		break;
+	case 0xC9: case 0xCB:
+		ip = pop();
+		sreg[CS] = pop();
+		clk += 18;
+		break;
+	case 0xCC:
+		clk += 52;
+		softint(3);
+		break;
+	case 0xCD:
+		n = fetchb();
+		clk += 51;
+		softint(n);
+		break;
+	case 0xCE:
+		if (flags & OF) {
+			clk += 53;
+			softint(4);
+		} else
+			clk += 4;
+		break;
+	case 0xCF:
+		ip = pop();
+		sreg[CS] = pop();
+		flags = (pop() & 0x0FD5) | 0xF002;
+		clk += 24;
+		break;
+	case 0xD0: case 0xD1: case 0xD2: case 0xD3:
+		w = op & 1;
+		modrm();
+		n = op & 2 ? reg[CX] & 0xFF : 1;
+		setrm(w, shift(rreg, getrm(w), n, w));
+		if (op & 2)
+			clk += (mod == 3 ? 8 : 20) + 4 * n;
+		else
+			clk += mod == 3 ? 2 : 15;
+		break;
+	case 0xD4:
+		n = fetchb();
+		if (n == 0) {
+			clk += 83;
+			diverr();
+			break;
+		}
+		v = reg[AX] & 0xFF;
+		reg[AX] = (v / n) << 8 | (v % n);
+		szp(reg[AX], 0);
+		clk += 83;
+		break;
+	case 0xD5:
+		n = fetchb();
+		reg[AX] = ((reg[AX] >> 8) * n + reg[AX]) & 0xFF;
+		szp(reg[AX], 0);
+		clk += 60;
+		break;
+	case 0xD6:
+		setr8(0, flags & CF ? 0xFF : 0);
+		clk += 4;
+		break;
+	case 0xD7:
+		s = ovr >= 0 ? sreg[ovr] : sreg[DS];
+		setr8(0, rdb(s, reg[BX] + (reg[AX] & 0xFF)));
+		clk += 11;
+		break;
+	case 0xD8: case 0xD9: case 0xDA: case 0xDB:
+	case 0xDC: case 0xDD: case 0xDE: case 0xDF:
+		/* ESC: no coprocessor, the operand is decoded and ignored */
+		modrm();
+		clk += mod == 3 ? 2 : 8;
+		break;
+	case 0xE0:
+		reg[CX]--;
+		jshort(reg[CX] && !(flags & ZF), 19, 5);
+		break;
+	case 0xE1:
+		reg[CX]--;
+		jshort(reg[CX] && (flags & ZF), 18, 6);
+		break;
+	case 0xE2:
+		reg[CX]--;
+		jshort(reg[CX] != 0, 17, 5);
+		break;
+	case 0xE3:
+		jshort(reg[CX] == 0, 18, 6);
+		break;
+	case 0xE4: case 0xE5:
+		fetchb();
+		setreg(op & 1, AX, 0xFFFF);
+		clk += 10;
+		break;
+	case 0xE6: case 0xE7:
+		fetchb();
+		clk += 10;
+		break;
+	case 0xE8:
+		v = fetchw();
+		push(ip);
+		ip += v;
+		clk += 19;
+		break;
+	case 0xE9:
+		v = fetchw();
+		ip += v;
+		clk += 15;
+		break;
+	case 0xEA:
+		v = fetchw();
+		sreg[CS] = fetchw();
+		ip = v;
+		clk += 15;
+		break;
+	case 0xEB:
+		jshort(1, 15, 15);
+		break;
+	case 0xEC: case 0xED:
+		setreg(op & 1, AX, 0xFFFF);
+		clk += 8;
+		break;
+	case 0xEE: case 0xEF:
+		clk += 8;
+		break;
+	case 0xF4:
+		fault("hlt with no interrupt source");
+		break;
+	case 0xF5:
+		flags ^= CF;
+		clk += 2;
+		break;
+	case 0xF6: case 0xF7:
+		grp3(op & 1);
+		break;
+	case 0xF8: case 0xF9:
+		setf(CF, op & 1);
+		clk += 2;
+		break;
+	case 0xFA: case 0xFB:
+		setf(IF, op & 1);
+		clk += 2;
+		break;
+	case 0xFC: case 0xFD:
+		setf(DF, op & 1);
+		clk += 2;
+		break;
+	case 0xFE:
+		modrm();
+		if (rreg > 1)
+			fault("bad FE opcode");
+		setrm8(incdec(getrm8(), rreg, 0));
+		clk += mod == 3 ? 3 : 15;
+		break;
+	case 0xFF:
+		grp5();
+		break;
+	default:
+		fault("unimplemented opcode");
+	}
+}
+
+/* DOS and BIOS services */
+
+static void
+setcf(int on)
+{
+	setf(CF, on);
+}
+
+static void
+doserr(int e)
+{
+	switch (e) {
+	case ENOENT: reg[AX] = 2; break;
+	case EMFILE: reg[AX] = 4; break;
+	case EACCES: case EPERM: case EEXIST: reg[AX] = 5; break;
+	case EBADF: reg[AX] = 6; break;
+	case ENOMEM: reg[AX] = 8; break;
+	default: reg[AX] = 5; break;
+	}
+	setcf(1);
+}
+
+static char *
+asciz(uint16_t s, uint16_t o)
+{
+	static char buf[2][256];
+	static int k;
+	char *p;
+	int i;
+
+	p = buf[k ^= 1];
+	for (i = 0; i < 255; i++)
+		if (!(p[i] = rdb(s, o + i)))
+			break;
+	p[i] = 0;
+	for (i = 0; p[i]; i++)
+		if (p[i] == '\\')
+			p[i] = '/';
+	return p;
+}
+
+static int
+conin(void)
+{
+	unsigned char c;
+
+	fflush(stdout);
+	if (hfd[0] < 0 || read(hfd[0], &c, 1) != 1)
+		return 0x1A;
+	return c;
+}
+
+static void
+conout(int c)
+{
+	if (crlf && c == '\r')
+		return;
+	putchar(c);
+}
+
+static int
+newhandle(int fd)
+{
+	int h;
+
+	for (h = 5; h < NHandle; h++)
+		if (hfd[h] < 0) {
+			hfd[h] = fd;
+			return h;
+		}
+	close(fd);
+	return -1;
+}
+
+static int
+handle(int h)
+{
+	if (h < 0 || h >= NHandle || hfd[h] == -1) {
+		reg[AX] = 6;
+		setcf(1);
+		return -3;
+	}
+	return hfd[h];
+}
+
+static void
+fileio(int ah)
+{
+	int fd, h, n, fl;
+	off_t off;
+	char *p, *q;
+	uint8_t buf[512];
+	uint16_t o;
+	struct stat st;
+
+	n = 0;
+	setcf(0);
+	switch (ah) {
+	case 0x39: /* mkdir */
+	case 0x3A: /* rmdir */
+	case 0x3B: /* chdir */
+	case 0x41: /* unlink */
+		p = asciz(sreg[DS], reg[DX]);
+		if ((ah == 0x39 ? mkdir(p, 0777) : ah == 0x3A ? rmdir(p)
+		: ah == 0x3B ? chdir(p) : unlink(p)) < 0)
+			doserr(errno);
+		break;
+	case 0x3C: /* creat */
+	case 0x3D: /* open */
+		p = asciz(sreg[DS], reg[DX]);
+		if (ah == 0x3C)
+			fl = O_RDWR | O_CREAT | O_TRUNC;
+		else
+			fl = (reg[AX] & 3) == 0 ? O_RDONLY
+				: (reg[AX] & 3) == 1 ? O_WRONLY : O_RDWR;
+		if ((fd = open(p, fl, 0666)) < 0) {
+			doserr(errno);
+			break;
+		}
+		if ((h = newhandle(fd)) < 0) {
+			reg[AX] = 4;
+			setcf(1);
+			break;
+		}
+		reg[AX] = h;
+		break;
+	case 0x3E: /* close */
+		h = reg[BX];
+		if ((fd = handle(h)) == -3)
+			break;
+		if (fd > 2)
+			close(fd);
+		hfd[h] = -1;
+		break;
+	case 0x3F: /* read */
+		if ((fd = handle(reg[BX])) == -3)
+			break;
+		if (fd == 0)
+			fflush(stdout);
+		for (o = 0; o < reg[CX]; o += n) {
+			n = reg[CX] - o;
+			if (n > (int)sizeof buf)
+				n = sizeof buf;
+			if (fd < 0 || (n = read(fd, buf, n)) <= 0)
+				break;
+			for (h = 0; h < n; h++)
+				wrb(sreg[DS], reg[DX] + o + h, buf[h]);
+			if (fd == 0 && buf[n - 1] == '\n') {
+				o += n;
+				break;
+			}
+		}
+		if (n < 0) {
+			doserr(errno);
+			break;
+		}
+		reg[AX] = o;
+		break;
+	case 0x40: /* write */
+		if ((fd = handle(reg[BX])) == -3)
+			break;
+		if (fd == 1 || fd == 2) {
+			if (fd == 2)
+				fflush(stdout);
+			for (o = 0; o < reg[CX]; o++) {
+				n = rdb(sreg[DS], reg[DX] + o);
+				if (fd == 1)
+					conout(n);
+				else if (!crlf || n != '\r')
+					fputc(n, stderr);
+			}
+			reg[AX] = reg[CX];
+			break;
+		}
+		if (fd < 0) {
+			reg[AX] = reg[CX];
+			break;
+		}
+		if (reg[CX] == 0) {
+			if ((off = lseek(fd, 0, SEEK_CUR)) < 0
+			|| ftruncate(fd, off) < 0)
+				doserr(errno);
+			else
+				reg[AX] = 0;
+			break;
+		}
+		for (o = 0; o < reg[CX]; o += n) {
+			n = reg[CX] - o;
+			if (n > (int)sizeof buf)
+				n = sizeof buf;
+			for (h = 0; h < n; h++)
+				buf[h] = rdb(sreg[DS], reg[DX] + o + h);
+			if ((n = write(fd, buf, n)) <= 0)
+				break;
+		}
+		if (n < 0) {
+			doserr(errno);
+			break;
+		}
+		reg[AX] = o;
+		break;
+	case 0x42: /* lseek */
+		if ((fd = handle(reg[BX])) == -3)
+			break;
+		off = (int32_t)((uint32_t)reg[CX] << 16 | reg[DX]);
+		if (fd < 3)
+			off = 0;
+		else if ((off = lseek(fd, off, reg[AX] & 3)) < 0) {
+			doserr(errno);
+			break;
+		}
+		reg[AX] = off;
+		reg[DX] = off >> 16;
+		break;
+	case 0x43: /* get/set attributes */
+		if (stat(asciz(sreg[DS], reg[DX]), &st) < 0) {
+			doserr(errno);
+			break;
+		}
+		if ((reg[AX] & 0xFF) == 0)
+			reg[CX] = S_ISDIR(st.st_mode) ? 0x10 : 0;
+		break;
+	case 0x44: /* ioctl */
+		if ((fd = handle(reg[BX])) == -3)
+			break;
+		if ((reg[AX] & 0xFF) == 0)
+			reg[DX] = fd >= 0 && fd < 3 ? 0x80D3 - (fd != 0)
+				: fd < 0 ? 0x8084 : 0x0002;
+		break;
+	case 0x47: /* getcwd */
+		wrb(sreg[DS], reg[SI], 0);
+		break;
+	case 0x56: /* rename */
+		p = asciz(sreg[DS], reg[DX]);
+		q = asciz(sreg[ES], reg[DI]);
+		if (rename(p, q) < 0)
+			doserr(errno);
+		break;
+	case 0x57: /* file date/time */
+		reg[CX] = 0;
+		reg[DX] = 0x0021;
+		break;
+	}
+}
+
+static int
+blkfind(uint16_t seg)
+{
+	int i;
+
+	for (i = 0; i < nblk; i++)
+		if (blk[i].seg == seg)
+			return i;
+	return -1;
+}
+
+static uint16_t
+blkend(int i)
+{
+	return blk[i].seg + blk[i].len;
+}
+
+/* Next block boundary above seg: the start of the lowest block
+ * beginning after it, or the top of memory.
+ */
+static uint16_t
+blklimit(uint16_t seg)
+{
+	uint16_t lim;
+	int i;
+
+	lim = MemTop;
+	for (i = 0; i < nblk; i++)
+		if (blk[i].seg > seg && blk[i].seg < lim)
+			lim = blk[i].seg;
+	return lim;
+}
+
+static void
+memory(int ah)
+{
+	uint16_t s;
+	int i;
+
+	setcf(0);
+	switch (ah) {
+	case 0x48: /* allocate */
+		s = PspSeg;
+		for (i = 0; i < nblk; i++)
+			if (blkend(i) > s)
+				s = blkend(i);
+		if (MemTop - s >= reg[BX] && nblk < NBlk) {
+			blk[nblk].seg = s;
+			blk[nblk++].len = reg[BX];
+			reg[AX] = s;
+			break;
+		}
+		reg[AX] = 8;
+		reg[BX] = MemTop - s;
+		setcf(1);
+		break;
+	case 0x49: /* free */
+		if ((i = blkfind(sreg[ES])) < 0) {
+			reg[AX] = 9;
+			setcf(1);
+			break;
+		}
+		blk[i] = blk[--nblk];
+		break;
+	case 0x4A: /* resize */
+		if ((i = blkfind(sreg[ES])) < 0) {
+			reg[AX] = 9;
+			setcf(1);
+			break;
+		}
+		s = blklimit(blk[i].seg);
+		if (blk[i].seg + (uint32_t)reg[BX] > s) {
+			reg[AX] = 8;
+			reg[BX] = s - blk[i].seg;
+			setcf(1);
+			break;
+		}
+		blk[i].len = reg[BX];
+		if (blk[i].seg == PspSeg)
+			pokew(PspSeg, 2, blkend(i));
+		break;
+	}
+}
+
+static void
+dos(void)
+{
+	int ah, c;
+	uint16_t n, o;
+	uint64_t cs;
+
+	ah = reg[AX] >> 8;
+	switch (ah) {
+	case 0x00: /* terminate */
+		exitcode = 0;
+		break;
+	case 0x01: /* read with echo */
+		c = conin();
+		conout(c);
+		setr8(0, c);
+		break;
+	case 0x02: /* write DL */
+		conout(reg[DX] & 0xFF);
+		setr8(0, reg[DX]);
+		break;
+	case 0x06: /* direct console I/O */
+		if ((reg[DX] & 0xFF) == 0xFF) {
+			setr8(0, conin());
+			flags &= ~ZF;
+		} else
+			conout(reg[DX] & 0xFF);
+		break;
+	case 0x07: /* read without echo */
+	case 0x08:
+		setr8(0, conin());
+		break;
+	case 0x09: /* write $-string */
+		for (o = reg[DX]; (c = rdb(sreg[DS], o)) != '$'; o++)
+			conout(c);
+		setr8(0, '$');
+		break;
+	case 0x0A: /* buffered input */
+		n = rdb(sreg[DS], reg[DX]);
+		for (o = 0; n && o < n - 1; o++) {
+			if ((c = conin()) == 0x1A || c == '\n')
+				break;
+			wrb(sreg[DS], reg[DX] + 2 + o, c);
+		}
+		wrb(sreg[DS], reg[DX] + 1, o);
+		wrb(sreg[DS], reg[DX] + 2 + o, '\r');
+		break;
+	case 0x0B: /* input status */
+		setr8(0, 0xFF);
+		break;
+	case 0x19: /* current drive: C: */
+		setr8(0, 2);
+		break;
+	case 0x1A: /* set DTA */
+		dtaseg = sreg[DS];
+		dtaoff = reg[DX];
+		break;
+	case 0x25: /* set vector */
+		pokew(0, (reg[AX] & 0xFF) * 4, reg[DX]);
+		pokew(0, (reg[AX] & 0xFF) * 4 + 2, sreg[DS]);
+		break;
+	case 0x2A: /* date: 1990-01-01, a Monday */
+		reg[CX] = 1990;
+		reg[DX] = 0x0101;
+		setr8(0, 1);
+		break;
+	case 0x2C: /* time: elapsed simulated time at 4.77 MHz */
+		cs = clk / 47727;
+		reg[CX] = (cs / 360000 % 24) << 8 | (cs / 6000 % 60);
+		reg[DX] = (cs / 100 % 60) << 8 | (cs % 100);
+		break;
+	case 0x2F: /* get DTA */
+		sreg[ES] = dtaseg;
+		reg[BX] = dtaoff;
+		break;
+	case 0x30: /* version: 5.0 */
+		reg[AX] = 0x0005;
+		reg[BX] = 0;
+		reg[CX] = 0;
+		break;
+	case 0x33: /* ctrl-break state */
+		setr8(2, 0);
+		break;
+	case 0x35: /* get vector */
+		reg[BX] = peekw(0, (reg[AX] & 0xFF) * 4);
+		sreg[ES] = peekw(0, (reg[AX] & 0xFF) * 4 + 2);
+		break;
+	case 0x39: case 0x3A: case 0x3B: case 0x3C:
+	case 0x3D: case 0x3E: case 0x3F: case 0x40:
+	case 0x41: case 0x42: case 0x43: case 0x44:
+	case 0x47: case 0x56: case 0x57:
+		fileio(ah);
+		break;
+	case 0x48: case 0x49: case 0x4A:
+		memory(ah);
+		break;
+	case 0x4C: /* exit */
+		exitcode = reg[AX] & 0xFF;
+		break;
+	case 0x4D: /* child return code */
+		reg[AX] = 0;
+		break;
+	case 0x4E: /* find first */
+	case 0x4F: /* find next */
+		reg[AX] = 18;
+		setcf(1);
+		break;
+	case 0x51: /* get PSP */
+	case 0x62:
+		reg[BX] = PspSeg;
+		break;
+	default:
+		fprintf(stderr, "sim86: unsupported INT 21h AH=%02Xh at "
+			"%04X:%04X\n", ah, cs0, ip0);
+		reg[AX] = 1;
+		setcf(1);
+		break;
+	}
+}
+
+static void
+hle(int n)
+{
+	int c;
+
+	switch (n) {
+	case 0x00:
+		fault("divide error");
+		break;
+	case 0x10: /* video */
+		switch (reg[AX] >> 8) {
+		case 0x0E:
+			conout(reg[AX] & 0xFF);
+			break;
+		case 0x0F:
+			reg[AX] = 80 << 8 | 3;
+			setr8(7, 0);
+			break;
+		case 0x03:
+			reg[CX] = 0x0607;
+			reg[DX] = 0;
+			break;
+		}
+		break;
+	case 0x11: /* equipment */
+		reg[AX] = 0x0021;
+		break;
+	case 0x12: /* memory size in KB */
+		reg[AX] = MemTop / 64;
+		break;
+	case 0x16: /* keyboard */
+		switch (reg[AX] >> 8) {
+		case 0x00: case 0x10:
+			c = conin();
+			reg[AX] = c == '\n' ? 0x1C0D : c;
+			break;
+		case 0x01: case 0x11:
+			flags &= ~ZF;
+			break;
+		case 0x02: case 0x12:
+			setr8(0, 0);
+			break;
+		}
+		break;
+	case 0x1A: /* ticks since midnight, 18.2 Hz = 262144 clocks */
+		if ((reg[AX] >> 8) == 0) {
+			reg[CX] = (clk >> 18) >> 16;
+			reg[DX] = clk >> 18;
+			setr8(0, 0);
+		}
+		break;
+	case 0x20:
+		exitcode = 0;
+		break;
+	case 0x21:
+		dos();
+		break;
+	case 0x33: /* mouse: not installed */
+		reg[AX] = 0;
+		break;
+	default:
+		/* the default vector is an IRET */
+		break;
+	}
+}
+
+/* loading */
+
+static uint8_t *
+slurp(char *path, long *len)
+{
+	FILE *f;
+	uint8_t *buf;
+
+	if (!(f = fopen(path, "rb")))
+		die("cannot open %s", path);
+	fseek(f, 0, SEEK_END);
+	*len = ftell(f);
+	rewind(f);
+	if (!(buf = malloc(*len + 1)) || fread(buf, 1, *len, f) != (size_t)*len)
+		die("cannot read %s", path);
+	fclose(f);
+	return buf;
+}
+
+static void
+mkpsp(uint16_t top, int argc, char **argv)
+{
+	uint8_t *p;
+	int i, n, l;
+
+	p = &mem[PspSeg * 16];
+	p[0] = 0xCD;
+	p[1] = 0x20;
+	p[2] = top;
+	p[3] = top >> 8;
+	n = 0;
+	for (i = 0; i < argc; i++) {
+		l = strlen(argv[i]);
+		if (n + l + 1 > 126)
+			die("command tail too long");
+		p[0x81 + n] = ' ';
+		memcpy(&p[0x82 + n], argv[i], l);
+		n += l + 1;
+	}
+	p[0x80] = n;
+	p[0x81 + n] = '\r';
+	dtaseg = PspSeg;
+	dtaoff = 0x80;
+}
+
+static void
+load(char *path, int argc, char **argv)
+{
+	uint8_t *buf;
+	long len, hdr, img;
+	uint16_t lseg, top, minpara, maxpara;
+	uint32_t need;
+	int i, nrel, relo;
+	uint16_t ro, rs;
+
+	buf = slurp(path, &len);
+	for (i = 0; i < 256; i++) {
+		pokew(0, i * 4, i);
+		pokew(0, i * 4 + 2, BiosSeg);
+	}
+	lseg = PspSeg + 0x10;
+	if (len >= 0x1C && buf[0] == 'M' && buf[1] == 'Z') {
+		hdr = (buf[8] | buf[9] << 8) * 16L;
+		img = (buf[4] | buf[5] << 8) * 512L - hdr;
+		if (buf[2] | buf[3] << 8)
+			img -= 512 - (buf[2] | buf[3] << 8);
+		if (img > len - hdr)
+			img = len - hdr;
+		if (img < 0)
+			die("%s: bad MZ header", path);
+		need = ((uint32_t)img + 15) / 16;
+		if ((uint32_t)lseg + need > MemTop)
+			die("%s: image too large", path);
+		memcpy(&mem[lseg * 16], buf + hdr, img);
+		nrel = buf[6] | buf[7] << 8;
+		relo = buf[0x18] | buf[0x19] << 8;
+		for (i = 0; i < nrel; i++) {
+			if (relo + 4 * i + 4 > len)
+				die("%s: truncated relocation table", path);
+			ro = buf[relo + 4*i] | buf[relo + 4*i + 1] << 8;
+			rs = buf[relo + 4*i + 2] | buf[relo + 4*i + 3] << 8;
+			pokew(lseg + rs, ro, peekw(lseg + rs, ro) + lseg);
+		}
+		minpara = buf[0x0A] | buf[0x0B] << 8;
+		maxpara = buf[0x0C] | buf[0x0D] << 8;
+		if (lseg + need + minpara > MemTop)
+			die("%s: not enough memory", path);
+		need += maxpara;
+		top = lseg + need > MemTop ? MemTop : lseg + need;
+		sreg[SS] = lseg + (buf[0x0E] | buf[0x0F] << 8);
+		reg[SP] = buf[0x10] | buf[0x11] << 8;
+		ip = buf[0x14] | buf[0x15] << 8;
+		sreg[CS] = lseg + (buf[0x16] | buf[0x17] << 8);
+		imgbase = lseg * 16;
+	} else {
+		if (len > 0xFF00)
+			die("%s: .COM image too large", path);
+		memcpy(&mem[PspSeg * 16 + 0x100], buf, len);
+		top = MemTop;
+		sreg[CS] = sreg[SS] = PspSeg;
+		reg[SP] = 0xFFFE;
+		ip = 0x100;
+		pokew(PspSeg, 0xFFFE, 0);
+		imgbase = PspSeg * 16;
+	}
+	free(buf);
+	sreg[DS] = sreg[ES] = PspSeg;
+	flags = 0xF202;
+	blk[0].seg = PspSeg;
+	blk[0].len = top - PspSeg;
+	nblk = 1;
+	mkpsp(top, argc, argv);
+	hfd[0] = 0;
+	hfd[1] = 1;
+	hfd[2] = 2;
+	hfd[3] = hfd[4] = -2;
+	for (i = 5; i < NHandle; i++)
+		hfd[i] = -1;
+}
+
+/* profile */
+
+static int
+symcmp(const void *a, const void *b)
+{
+	const Sym *x = a, *y = b;
+
+	return x->addr < y->addr ? -1 : x->addr > y->addr;
+}
+
+static int
+clkcmp(const void *a, const void *b)
+{
+	const Sym *x = a, *y = b;
+
+	return x->clk < y->clk ? 1 : x->clk > y->clk ? -1 : symcmp(a, b);
+}
+
+static void
+loadmap(char *path)
+{
+	FILE *f;
+	char line[512], name[256], seg[64];
+	unsigned para, off;
+	int insyms, cap;
+
+	if (!(f = fopen(path, "r")))
+		die("cannot open %s", path);
+	insyms = 0;
+	cap = 0;
+	while (fgets(line, sizeof line, f)) {
+		if (strncmp(line, "Symbols:", 8) == 0) {
+			insyms = 1;
+			continue;
+		}
+		if (!insyms)
+			continue;
+		if (line[0] != ' ')
+			break;
+		if (sscanf(line, " %255s seg=%63s para=0x%x off=0x%x",
+		name, seg, &para, &off) != 4)
+			continue;
+		if (nsym == cap) {
+			cap = cap ? 2 * cap : 256;
+			if (!(sym = realloc(sym, cap * sizeof sym[0])))
+				die("out of memory");
+		}
+		sym[nsym].name = strdup(name);
+		sym[nsym].addr = imgbase + para * 16 + off;
+		sym[nsym].clk = 0;
+		sym[nsym].ins = 0;
+		nsym++;
+	}
+	fclose(f);
+	if (!nsym)
+		die("%s: no symbols (not an omf_link.py --map file?)", path);
+	qsort(sym, nsym, sizeof sym[0], symcmp);
+}
+
+static Sym *
+symat(uint32_t a)
+{
+	int lo, hi, m;
+
+	lo = 0;
+	hi = nsym - 1;
+	if (!nsym || a < sym[0].addr)
+		return 0;
+	while (lo < hi) {
+		m = (lo + hi + 1) / 2;
+		if (sym[m].addr <= a)
+			lo = m;
+		else
+			hi = m - 1;
+	}
+	return &sym[lo];
+}
+
+static void
+report(int top)
+{
+	int i;
+	uint64_t other;
+
+	fflush(stdout);
+	fprintf(stderr, "sim86: %s exit %d, %llu instructions, %llu clocks "
+		"(%s, %.3f ms at 4.77 MHz)\n", progname, exitcode,
+		(unsigned long long)nins, (unsigned long long)clk,
+		i8088 ? "8088" : "8086", clk / 4772.727);
+	if (!nsym)
+		return;
+	qsort(sym, nsym, sizeof sym[0], clkcmp);
+	other = clk;
+	fprintf(stderr, "  %-32s %12s %6s %12s\n",
+		"SYMBOL", "CLOCKS", "%", "INSNS");
+	for (i = 0; i < nsym && i < top && sym[i].clk; i++) {
+		fprintf(stderr, "  %-32s %12llu %5.1f%% %12llu\n",
+			sym[i].name, (unsigned long long)sym[i].clk,
+			clk ? 100.0 * sym[i].clk / clk : 0.0,
+			(unsigned long long)sym[i].ins);
+		other -= sym[i].clk;
+	}
+	if (other)
+		fprintf(stderr, "  %-32s %12llu %5.1f%%\n", "(other)",
+			(unsigned long long)other, 100.0 * other / clk);
+}
+
+static void
+usage(void)
+{
+	fprintf(stderr,
+		"usage: sim86 [-8 | -6] [-m prog.map] [-p N] [-l LIMIT] [-n] [-q]"
+		" prog.exe [args...]\n"
+		"\t-8\t8088 bus timing (default)\n"
+		"\t-6\t8086 bus timing\n"
+		"\t-m map\tper-symbol clock profile from an omf_link.py map\n"
+		"\t-p N\tprint the N hottest symbols (default 20)\n"
+		"\t-l N\tstop with an error after N clocks\n"
+		"\t-n\tdrop CR from console output\n"
+		"\t-q\tno summary unless -m is given\n");
+	exit(2);
+}
+
+int
+main(int argc, char *argv[])
+{
+	char *map;
+	int top, i;
+	uint64_t c0;
+	Sym *s;
+
+	map = 0;
+	top = 20;
+	for (i = 1; i < argc && argv[i][0] == '-' && argv[i][1]; i++) {
+		if (strcmp(argv[i], "-8") == 0)
+			i8088 = 1;
+		else if (strcmp(argv[i], "-6") == 0)
+			i8088 = 0;
+		else if (strcmp(argv[i], "-n") == 0)
+			crlf = 1;
+		else if (strcmp(argv[i], "-q") == 0)
+			quiet = 1;
+		else if (strcmp(argv[i], "-m") == 0 && i + 1 < argc)
+			map = argv[++i];
+		else if (strcmp(argv[i], "-p") == 0 && i + 1 < argc)
+			top = atoi(argv[++i]);
+		else if (strcmp(argv[i], "-l") == 0 && i + 1 < argc)
+			clklimit = strtoull(argv[++i], 0, 0);
+		else
+			usage();
+	}
+	if (i >= argc)
+		usage();
+	progname = argv[i];
+	load(progname, argc - i - 1, argv + i + 1);
+	if (map)
+		loadmap(map);
+
+	while (exitcode < 0) {
+		c0 = clk;
+		s = nsym ? symat(lin(sreg[CS], ip)) : 0;
+		step();
+		nins++;
+		if (s) {
+			s->clk += clk - c0;
+			s->ins++;
+		}
+		if (clklimit && clk > clklimit)
+			fault("clock limit reached");
+	}
+	fflush(stdout);
+	for (i = 5; i < NHandle; i++)
+		if (hfd[i] >= 0)
+			close(hfd[i]);
+	if (!quiet || nsym)
+		report(top);
+	return exitcode;
+}
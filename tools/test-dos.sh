@@ -9,6 +9,7 @@
 # Run alongside tools/test.sh for full coverage:
 #   tools/test.sh all       # QBE SSA-level tests
 #   tools/test-dos.sh       # DOS pipeline + size budgets
+#   tools/ptest.py ssa dos  # both, in parallel (runtime probes only)
 
 set -u
 
@@ -256,6 +257,8 @@ RUNTIME_TESTS=(
 	"minic/dos/examples/aggregate_init_probe.c:minic/dos/tests/aggregate_init_probe.golden.txt:medium"
 	"minic/dos/examples/sret_probe.c:minic/dos/tests/sret_probe.golden.txt:medium"
 	"minic/dos/examples/sret_probe.c:minic/dos/tests/sret_probe.golden.txt:large"
+	"minic/dos/examples/sret_elide_probe.c:minic/dos/tests/sret_elide_probe.golden.txt:medium"
+	"minic/dos/examples/sret_elide_probe.c:minic/dos/tests/sret_elide_probe.golden.txt:compact"
 	"minic/dos/examples/structarg_probe.c:minic/dos/tests/structarg_probe.golden.txt:compact"
 	"minic/dos/examples/structarg_probe.c:minic/dos/tests/structarg_probe.golden.txt:large"
 	"minic/dos/examples/bitfield_far_probe.c:minic/dos/tests/bitfield_far_probe.golden.txt:compact"
@@ -1025,6 +1028,20 @@ build_com_runtime_probe() {
 	"$QBE_DIR/tools/build-com-test.sh" --model="$model" "$QBE_DIR/$src" >/dev/null
 }
 
+# tools/ptest.py runs the RUNTIME_TESTS table itself (parallel builds in
+# private directories); these entry points hand it the table and the
+# per-probe build flags above without running the gate.
+case "${1:-}" in
+--list-runtime)
+	printf '%s\n' "${RUNTIME_TESTS[@]}"
+	exit 0
+	;;
+--build-runtime)
+	build_runtime_probe "$2" "$3"
+	exit $?
+	;;
+esac
+
 # Ensure qbe/minic are built before anything else.
 run "build qbe + minic" \
 	make -C "$QBE_DIR" -s qbe minic/minic
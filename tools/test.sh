@@ -8,13 +8,15 @@ if [ -z "${binref:-}" ]; then
 	binref=${bin}.ref
 fi
 
-tmp=/tmp/qbe.zzzz
+# A private directory per run, so concurrent runs (tools/ptest.py) do
+# not clobber each other's files.
+tmp=`mktemp -d "${TMPDIR:-/tmp}/qbe.XXXXXX"` || exit 1
 
-drv=$tmp.c
-asm=$tmp.s
-asmref=$tmp.ref.s
-exe=$tmp.exe
-out=$tmp.out
+drv=$tmp/drv.c
+asm=$tmp/out.s
+asmref=$tmp/ref.s
+exe=$tmp/out.exe
+out=$tmp/out.txt
 
 qemu_not_needed() {
 	"$@"
@@ -135,7 +137,7 @@ init() {
 }
 
 cleanup() {
-	rm -f $drv $asm $exe $out
+	rm -rf "$tmp"
 }
 
 extract() {
@@ -230,7 +232,7 @@ once() {
 	fi
 }
 
-#trap cleanup TERM QUIT
+trap cleanup EXIT
 
 init
 
@@ -8,6 +8,14 @@
 #   2. Stevie smoke test: link the 24 build/stevie-orig/*.obj files
 #      together with stub publics for runtime symbols. Should not crash;
 #      we don't try to run the result.
+#   3. Raw-binary output (--raw-binary).
+#   4. --gc-sections over COMDAT-style `<SEG>$<sym>` pieces: dead functions
+#      and data objects are dropped individually, pieces coalesce back into
+#      their segment/group, and the map reports the bytes saved.
+#   5. --pack-callgraph keeps callers with their callees, and
+#      --relax-far-calls rewrites the intra-segment far calls.
+#   6. --merge-strings folds `<SEG>$str$<sym>` literal pieces whose bytes
+#      end another piece's into it, across modules.
 #
 # Usage: tools/test_omf_link.sh
 
@@ -256,6 +264,275 @@ print('  stub OK, entry %04X:%04X, far call -> %04X:%04X (absolute)'
 print('[test3] OK')
 PYEOF
 
+# ---------------- Test 4: function-granular --gc-sections ----------------
+# Per-function / per-object pieces as asm_to_omf.py --function-sections
+# writes them.  _dead and _deadtbl are unreachable; _handler is only reached
+# through the vector table, so its exported `_qbe_isr_es_` header word must
+# root it.
+
+cat > "$TMP/gc_a.asm" <<'EOF'
+        bits 16
+        cpu 8086
+        group DGROUP _DATA _BSS
+        extern _helper
+        global _start
+        global _dead
+
+        segment GC_A_TEXT$_start class=CODE align=2 use16
+_start:
+        call far _helper
+        mov  ah, 0x4C
+        int  0x21
+
+        segment GC_A_TEXT$_dead class=CODE align=2 use16
+_dead:
+        mov  ax, [_deadtbl]
+        retf
+
+        segment _DATA class=DATA align=16 use16
+        segment _DATA$_deadtbl class=DATA align=2 use16
+_deadtbl:
+        times 40 db 0xEE
+        segment _DATA$_tbl class=DATA align=2 use16
+_tbl:
+        dw 0x1234
+        segment _BSS  class=BSS  align=16 use16
+EOF
+
+cat > "$TMP/gc_b.asm" <<'EOF'
+        bits 16
+        cpu 8086
+        group DGROUP _DATA _BSS
+        extern _tbl
+        global _helper
+        global _qbe_isr_es_handler
+
+        segment GC_B_TEXT$_helper class=CODE align=2 use16
+_helper:
+        mov  ax, [_tbl]
+        retf
+
+        segment GC_B_TEXT$_handler class=CODE align=2 use16
+_qbe_isr_es_handler:
+        dw 0
+_handler:
+        iret
+
+        segment GC_B_TEXT$_unused class=CODE align=2 use16
+_unused:
+        times 100 retf
+
+        segment _DATA class=DATA align=16 use16
+        segment _BSS  class=BSS  align=16 use16
+EOF
+
+echo
+echo "[test4] assembling + linking with --gc-sections..."
+"$NASM" -f obj -o "$TMP/gc_a.obj" "$TMP/gc_a.asm"
+"$NASM" -f obj -o "$TMP/gc_b.obj" "$TMP/gc_b.asm"
+python3 "$LINK" -o "$TMP/gc.exe" --map "$TMP/gc.map" --entry _start \
+                 --gc-sections "$TMP/gc_a.obj" "$TMP/gc_b.obj"
+
+python3 - "$TMP/gc.map" "$TMP/gc.exe" <<'PYEOF'
+import re, struct, sys
+m = open(sys.argv[1]).read()
+syms = dict(re.findall(r'^  (\S+)\s+seg=(\S+)', m, re.M))
+assert '_dead' not in syms, "dead function must be stripped"
+assert syms.get('_qbe_isr_es_handler') == 'GC_B_TEXT', "ISR must be a root"
+assert syms.get('_tbl') == '_DATA', "piece must coalesce into _DATA"
+mm = re.search(r'Discarded segments \(--gc-sections\): (\d+) segments, '
+               r'(\d+) bytes saved', m)
+assert mm, "map must report the discarded bytes"
+assert int(mm.group(2)) >= 100 + 40 + 4, "dead pieces: %s" % mm.group(2)
+for name in ('GC_A_TEXT$_dead', '_DATA$_deadtbl', 'GC_B_TEXT$_unused'):
+    assert re.search(r'^  %s\s' % re.escape(name), m, re.M), name
+# _helper loads _tbl DGROUP-relative; _tbl is the first live DGROUP byte.
+data = open(sys.argv[2], 'rb').read()
+hdr = struct.unpack_from('<H', data, 8)[0] * 16
+para, off = re.search(r'^  _helper\s+seg=\S+\s+para=0x([0-9A-F]+) '
+                      r'off=0x([0-9A-F]+)', m, re.M).groups()
+at = hdr + int(para, 16) * 16 + int(off, 16)
+assert data[at] == 0xA1, "mov ax, moffs16"
+assert struct.unpack_from('<H', data, at + 1)[0] == 0, \
+    "mov ax,[_tbl] must resolve to DGROUP:0000"
+print('  stripped %s segments, %s bytes' % (mm.group(1), mm.group(2)))
+print('[test4] OK')
+PYEOF
+
+# ---------------- Test 5: --pack-callgraph + --relax-far-calls ----------------
+# Two ~30KB callers each calling their own ~20KB callee twice, in an input
+# order that puts both callers in one bucket.  Call-graph packing must pair
+# each caller with its callee (one cross-segment call left: _start → _f2),
+# and --relax-far-calls must turn the intra-segment ones into
+# `push cs; call near; nop` with no MZ relocation.
+
+cat > "$TMP/pk_a.asm" <<'EOF'
+        bits 16
+        cpu 8086
+        extern _g1
+        extern _g2
+        global _start
+        global _f1
+        global _f2
+
+        segment PK_A_TEXT$_start class=CODE align=2 use16
+_start:
+        call far _f1
+        call far _f2
+        mov  ah, 0x4C
+        int  0x21
+
+        segment PK_A_TEXT$_f1 class=CODE align=2 use16
+_f1:
+        call far _g1
+        call far _g1
+        times 29989 nop
+        retf
+
+        segment PK_A_TEXT$_f2 class=CODE align=2 use16
+_f2:
+        call far _g2
+        call far _g2
+        times 29989 nop
+        retf
+EOF
+
+cat > "$TMP/pk_b.asm" <<'EOF'
+        bits 16
+        cpu 8086
+        global _g1
+        global _g2
+
+        segment PK_B_TEXT$_g1 class=CODE align=2 use16
+_g1:
+        times 19999 nop
+        retf
+
+        segment PK_B_TEXT$_g2 class=CODE align=2 use16
+_g2:
+        times 19999 nop
+        retf
+EOF
+
+echo
+echo "[test5] assembling + linking with --pack-callgraph..."
+"$NASM" -f obj -o "$TMP/pk_a.obj" "$TMP/pk_a.asm"
+"$NASM" -f obj -o "$TMP/pk_b.obj" "$TMP/pk_b.asm"
+python3 "$LINK" -o "$TMP/pk.exe" --map "$TMP/pk.map" --entry _start \
+                 --gc-sections --pack-callgraph --relax-far-calls \
+                 "$TMP/pk_a.obj" "$TMP/pk_b.obj"
+
+python3 - "$TMP/pk.map" "$TMP/pk.exe" <<'PYEOF'
+import re, struct, sys
+m = open(sys.argv[1]).read()
+seg = dict(re.findall(r'^  (_\w+)\s+seg=(\S+)', m, re.M))
+assert seg['_f1'] == seg['_g1'] == seg['_start'], seg
+assert seg['_f2'] == seg['_g2'] != seg['_f1'], seg
+mm = re.search(r'direct far calls: (\d+) intra-segment \((\d+) relaxed '
+               r'to near\), (\d+) cross-segment', m)
+assert mm and mm.groups() == ('5', '5', '1'), mm and mm.groups()
+data = open(sys.argv[2], 'rb').read()
+assert struct.unpack_from('<H', data, 6)[0] == 1, "only _start→_f2 relocates"
+hdr = struct.unpack_from('<H', data, 8)[0] * 16
+sym = {n: (int(p, 16), int(o, 16)) for n, p, o in re.findall(
+    r'^  (_\w+)\s+seg=\S+\s+para=0x([0-9A-F]+) off=0x([0-9A-F]+)', m, re.M)}
+para, off = sym['_start']
+at = hdr + para * 16 + off
+assert data[at:at + 2] == b'\x0e\xe8' and data[at + 4] == 0x90, \
+    data[at:at + 5].hex()
+rel = struct.unpack_from('<H', data, at + 2)[0]
+assert (off + 4 + rel) & 0xFFFF == sym['_f1'][1], "call near must reach _f1"
+assert data[at + 5] == 0x9A, "cross-segment call stays far"
+print('[test5] OK')
+PYEOF
+
+# ---------------- Test 6: --merge-strings ----------------
+# Module a holds "parse error"; module b holds a copy of it, "error" and an
+# unrelated "ok".  Only a's "parse error" and b's "ok" may be laid out, and
+# b's references must land inside a's copy.
+
+cat > "$TMP/ms_a.asm" <<'EOF'
+        bits 16
+        cpu 8086
+        group DGROUP _DATA _BSS
+        extern _f
+        global _start
+
+        segment MS_A_TEXT class=CODE align=2 use16
+_start:
+        mov  ax, ms_a_glo1
+        call far _f
+        mov  ah, 0x4C
+        int  0x21
+
+        segment _DATA class=DATA align=16 use16
+        segment _DATA$str$ms_a_glo1 class=DATA align=1 use16
+ms_a_glo1:
+        db `parse error`
+        db 0
+        segment _BSS  class=BSS  align=16 use16
+EOF
+
+cat > "$TMP/ms_b.asm" <<'EOF'
+        bits 16
+        cpu 8086
+        group DGROUP _DATA _BSS
+        global _f
+
+        segment MS_B_TEXT class=CODE align=2 use16
+_f:
+        mov  ax, ms_b_glo1
+        mov  ax, ms_b_glo2
+        mov  ax, ms_b_glo3
+        retf
+
+        segment _DATA class=DATA align=16 use16
+        segment _DATA$str$ms_b_glo1 class=DATA align=1 use16
+ms_b_glo1:
+        db `error`
+        db 0
+        segment _DATA$str$ms_b_glo2 class=DATA align=1 use16
+ms_b_glo2:
+        db `parse error`
+        db 0
+        segment _DATA$str$ms_b_glo3 class=DATA align=1 use16
+ms_b_glo3:
+        db `ok`
+        db 0
+        segment _BSS  class=BSS  align=16 use16
+EOF
+
+echo
+echo "[test6] assembling + linking with --merge-strings..."
+"$NASM" -f obj -o "$TMP/ms_a.obj" "$TMP/ms_a.asm"
+"$NASM" -f obj -o "$TMP/ms_b.obj" "$TMP/ms_b.asm"
+python3 "$LINK" -o "$TMP/ms.exe" --map "$TMP/ms.map" --entry _start \
+                 --merge-strings "$TMP/ms_a.obj" "$TMP/ms_b.obj"
+
+python3 - "$TMP/ms.map" "$TMP/ms.exe" <<'PYEOF'
+import re, struct, sys
+m = open(sys.argv[1]).read()
+mm = re.search(r'Merged string literals \(--merge-strings\): (\d+) pieces, '
+               r'(\d+) bytes saved', m)
+assert mm and mm.groups() == ('2', '18'), mm and mm.groups()
+seg = {n: (int(p, 16), int(l, 16)) for n, p, l in re.findall(
+    r'^  (\S+)\s+\S+\s+0x([0-9A-F]+)\s+0x([0-9A-F]+)\s+\d+$', m, re.M)}
+data = open(sys.argv[2], 'rb').read()
+assert data.count(b'error\0') == 1, "one copy of the merged bytes"
+hdr = struct.unpack_from('<H', data, 8)[0] * 16
+dg = hdr + seg['_DATA'][0] * 16
+def lit(code, k):
+    off = struct.unpack_from('<H', data, code + 3 * k + 1)[0]
+    return data[dg + off:data.index(b'\0', dg + off)]
+a = hdr + seg['MS_A_TEXT'][0] * 16
+b = hdr + seg['MS_B_TEXT'][0] * 16
+assert lit(a, 0) == b'parse error'
+assert [lit(b, k) for k in range(3)] == [b'error', b'parse error', b'ok']
+assert data[b + 4:b + 6] == data[a + 1:a + 3], "one copy of \"parse error\""
+print('  merged %s pieces, %s bytes' % mm.groups())
+print('[test6] OK')
+PYEOF
+
 echo
 echo "All tests passed."
 echo "Output files in $TMP:"
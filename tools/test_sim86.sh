@@ -0,0 +1,398 @@
+#!/bin/bash
+# test_sim86.sh — validation tests for tools/sim86.c
+#
+# Tests (hand-assembled images, no nasm needed):
+#   1. .COM: INT 21h AH=09h output, AH=4Ch exit status, clock count.
+#   2. .COM: a LOOP kernel with word memory traffic; checks the result and
+#      the 8086 vs 8088 clock counts (the 8088 pays 4 per word transfer).
+#   3. .EXE: MZ relocation of a far call into a second segment, and the
+#      per-symbol profile from an omf_link.py-style map.
+#   4. qbe -t i8086 code generation, run under sim86: the IL programs in
+#      test/sim86/*.ssa and test/fold3.ssa, and ones generated here with
+#      python, are compiled
+#      for a memory model, assembled with GNU as (skipped when as/ld
+#      cannot target i386) and $main must return 0.
+#
+# Usage: tools/test_sim86.sh   (after `make sim86` and `make`)
+
+set -e
+set -u
+
+ROOT="$(cd "$(dirname "$0")/.." && pwd)"
+SIM="${SIM86:-$ROOT/tools/sim86}"
+TMP="$(mktemp -d "${TMPDIR:-/tmp}/sim86test.XXXXXX")"
+trap 'rm -rf "$TMP"' EXIT
+
+if [ ! -x "$SIM" ]; then
+	echo "test_sim86: $SIM not built (run: make sim86)" >&2
+	exit 1
+fi
+
+# clocks <stderr-file>: the clock count from sim86's summary line.
+clocks() {
+	sed -n 's/.* instructions, \([0-9]*\) clocks.*/\1/p' "$1"
+}
+
+# ---------------- Test 1: hello via AH=09h ----------------
+#   mov dx, msg / mov ah, 9 / int 21h / mov ax, 4C03h / int 21h
+#   msg: db 'Hi', 13, 10, '$'
+printf '\272\014\001\264\011\315\041\270\003\114\315\041Hi\r\n$' \
+	> "$TMP/hello.com"
+set +e
+"$SIM" -n "$TMP/hello.com" > "$TMP/hello.out" 2> "$TMP/hello.err"
+rc=$?
+set -e
+[ "$rc" = 3 ] || { echo "[test1] exit status $rc, want 3"; exit 1; }
+[ "$(cat "$TMP/hello.out")" = "Hi" ] || { echo "[test1] bad output"; exit 1; }
+# 4 + 4 + 51 + 4 + 51
+[ "$(clocks "$TMP/hello.err")" = 114 ] || {
+	echo "[test1] clocks: $(cat "$TMP/hello.err")"; exit 1; }
+echo "[test1] OK"
+
+# ---------------- Test 2: sum 1..100 through memory ----------------
+#   xor ax, ax / mov cx, 100 / L: add ax, cx / loop L
+#   mov [200h], ax / mov bx, [200h] / mov al, bl / mov ah, 4Ch / int 21h
+printf '\061\300\271\144\000\001\310\342\374\243\000\002\213\036\000\002\210\330\264\114\315\041' \
+	> "$TMP/sum.com"
+for cpu in 6 8; do
+	set +e
+	"$SIM" -$cpu "$TMP/sum.com" 2> "$TMP/sum$cpu.err"
+	rc=$?
+	set -e
+	# 5050 = 0x13BA
+	[ "$rc" = 186 ] || { echo "[test2] exit status $rc, want 186"; exit 1; }
+done
+# 3 + 4 + 100*3 + 99*17 + 5 + 10 + 14 + 2 + 4 + 51; two word transfers
+[ "$(clocks "$TMP/sum6.err")" = 2076 ] || {
+	echo "[test2] 8086: $(cat "$TMP/sum6.err")"; exit 1; }
+[ "$(clocks "$TMP/sum8.err")" = 2084 ] || {
+	echo "[test2] 8088: $(cat "$TMP/sum8.err")"; exit 1; }
+echo "[test2] OK"
+
+# ---------------- Test 3: MZ relocation + map profile ----------------
+python3 - "$TMP/far.exe" "$TMP/far.map" <<'PYEOF'
+import struct, sys
+code = bytes([0x9A, 0, 0, 1, 0,         # call far 0001:0000 (relocated)
+              0xB8, 0x00, 0x4C,         # mov ax, 4C00h
+              0xCD, 0x21]).ljust(16, b'\x90')
+code += bytes([0xB9, 0xE8, 0x03,        # _work: mov cx, 1000
+               0xE2, 0xFE,              # loop $
+               0xCB])                   # retf
+total = 32 + len(code)
+hdr = struct.pack('<2sHHHHHHHHHHHHH', b'MZ', total % 512,
+                  (total + 511) // 512, 1, 2, 0x10, 0xFFFF,
+                  2, 0x100, 0, 0, 0, 0x1C, 0)
+hdr += struct.pack('<HH', 3, 0)
+open(sys.argv[1], 'wb').write(hdr + code)
+open(sys.argv[2], 'w').write(
+    'Symbols:\n'
+    '  _start                           seg=_TEXT        para=0x0000 '
+    'off=0x0000 (mod=a.obj)\n'
+    '  _work                            seg=W_TEXT       para=0x0001 '
+    'off=0x0000 (mod=a.obj)\n')
+PYEOF
+"$SIM" -m "$TMP/far.map" "$TMP/far.exe" 2> "$TMP/far.err"
+python3 - "$TMP/far.err" <<'PYEOF'
+import re, sys
+err = open(sys.argv[1]).read()
+rows = re.findall(r'^  (\S+)\s+(\d+)\s+([\d.]+)%\s+(\d+)', err, re.M)
+assert rows and rows[0][0] == '_work', err
+assert int(rows[0][3]) == 1002, "mov + 1000 loop + retf: %s" % rows[0][3]
+assert float(rows[0][2]) > 90, err
+print('[test3] OK')
+PYEOF
+
+# ---------------- Test 4: qbe-generated code ----------------
+# il <file.ssa> <model>: compile an IL program, link it at 0x100
+# behind a start-up stub and run it.  The stub provides:
+#   $eschk    exit 126 unless ES == DS; load a junk ES, restore DGROUP
+#   $callisr  call $isr as an interrupt with a junk ES, exit 125 unless
+#             ES survives
+# and exits 126 if $main returns with ES != DS.  qbe's NASM-style
+# output is rewritten for GNU as on the way; far calls become
+# push cs / call near, as everything sits in one segment.
+QBE="$ROOT/qbe"
+il() {
+	case $2 in
+	medium|large|huge) ret=retf ;;
+	*) ret=ret ;;
+	esac
+	name=$(basename "$1" .ssa)
+	"$QBE" -t i8086 -m "$2" "$1" > "$TMP/il.s" ||
+		{ echo "[test4] $name -m $2: qbe failed"; exit 1; }
+	# as would quietly wrap a symbol offset past 16 bits
+	if grep -o '_[A-Za-z0-9_]*[+-][0-9]*' "$TMP/il.s" |
+	   awk -F'[+-]' '$2 > 65535 { print; bad = 1 } END { exit !bad }'; then
+		echo "[test4] $name -m $2: symbol offset out of range"; exit 1
+	fi
+	{
+	cat <<-STUB
+	.intel_syntax noprefix
+	.code16
+	.arch i8086
+	.set DGROUP, 0x800
+	.globl _start
+	.weak _isr
+	.text
+	_start:
+	 push cs
+	 call _main
+	 mov dx, es
+	 mov cx, ds
+	 cmp dx, cx
+	 jne _esbad
+	 mov ah, 0x4c
+	 int 0x21
+	_esbad:
+	 mov ax, 0x4c7e
+	 int 0x21
+	_eschk:
+	 mov dx, es
+	 mov cx, ds
+	 cmp dx, cx
+	 jne _esbad
+	 mov dx, 0x3000
+	 mov es, dx
+	 push ds
+	 pop es
+	 $ret
+	_callisr:
+	 mov dx, 0x3000
+	 mov es, dx
+	 pushf
+	 push cs
+	 call _isr
+	 mov dx, es
+	 cmp dx, 0x3000
+	 je 1f
+	 mov ax, 0x4c7d
+	 int 0x21
+	1:
+	 push ds
+	 pop es
+	 $ret
+	STUB
+	sed -e 's/\(byte\|word\|dword\) \[\([a-z][a-z]\):/\1 ptr \2:[/g' \
+	    -e 's/\(byte\|word\|dword\) \[/\1 ptr [/g' \
+	    -e 's/\[\([a-z][a-z]\):/\1:[/g' \
+	    -e 's/^\([ 	]*\)\(j[a-z]*\|call\) near /\1\2 /' \
+	    -e 's/^\([ 	]*\)call far /\1push cs\n\1call /' \
+	    -e 's/^\([ 	]*\)dw /\1.short /' \
+	    -e 's/^\([ 	]*\)\.int /\1.short /' \
+	    -e 's/^\([ 	]*[a-z]*[ 	]\+[a-z][a-z],[ 	]*\)\(_[A-Za-z_][A-Za-z0-9_]*\(+[0-9]\+\)\?\)[ 	]*$/\1offset \2/' \
+	    -e 's/^\([ 	]*mov[ 	]\+word ptr \[[^]]*\],[ 	]*\)\(_[A-Za-z_][A-Za-z0-9_]*\(+[0-9]\+\)\?\)[ 	]*$/\1offset \2/' \
+	    -e 's/\.\.@/.L/g' \
+	    -e '/^;/d' -e '/^\/\*/d' -e '/GNU-stack/d' -e 's/;.*$//' \
+	    "$TMP/il.s"
+	} > "$TMP/il.S"
+	as --32 -o "$TMP/il.o" "$TMP/il.S" 2> "$TMP/il.err" &&
+	ld -m elf_i386 -Ttext=0x100 --oformat binary -e _start \
+		-o "$TMP/il.com" "$TMP/il.o" 2>> "$TMP/il.err" || {
+		echo "[test4] $name -m $2: assembly failed"
+		head "$TMP/il.err"; exit 1; }
+	set +e
+	"$SIM" -q -l 4000000000 "$TMP/il.com" 2> "$TMP/il.err"
+	rc=$?
+	set -e
+	[ "$rc" = 0 ] || { echo "[test4] $name -m $2: exit status $rc"; exit 1; }
+}
+
+# cmpl.ssa: the Kl compares (signed and unsigned <, <=, >, >=, ==, !=)
+# against a register, zero and a constant, over values whose high words
+# differ.  Bit n of each function's result is ops[n]; in the f*
+# functions each compare only feeds its jnz, so isel fuses it into a
+# flag jump, in the m* ones it feeds the bit too and stays materialised.
+python3 - "$TMP/cmpl.ssa" <<'PYEOF'
+import sys
+out = open(sys.argv[1], 'w')
+def p(s=''):
+    out.write(s + '\n')
+M = 1 << 32
+vals = [0, 1, -1, 0x10000, 0xFFFF, -0x10000, 0x7FFFFFFF, -0x80000000]
+K = 0x1FFFF
+ops = ['ceql', 'cnel', 'csltl', 'cslel', 'csgtl', 'csgel',
+       'cultl', 'culel', 'cugtl', 'cugel']
+def ref(op, a, b):
+    a, b = a % M, b % M
+    if op[1] == 's':
+        a, b = a ^ 1 << 31, b ^ 1 << 31
+    return {'eq': a == b, 'ne': a != b, 'lt': a < b, 'le': a <= b,
+            'gt': a > b, 'ge': a >= b}[op[-3:-1]]
+def mask(a, b):
+    # bit 10 keeps ifconvert off the first diamond
+    return 1024 | sum(ref(op, a, b) << n for n, op in enumerate(ops))
+def fn(name, params, rhs, multi):
+    p('function w $%s(%s) {' % (name, params))
+    p('@%s_s' % name)
+    prev = '1024'
+    for n, op in enumerate(ops):
+        b = '%s%d' % (name, n)
+        if n:
+            p('@%s' % b)
+            p('\t%%m%d =w phi @%s_t %%b%d, @%s_f %s'
+              % (n - 1, q, n - 1, q, prev))
+            prev = '%%m%d' % (n - 1)
+        p('\t%%c%d =w %s %%a, %s' % (n, op, rhs))
+        p('\tjnz %%c%d, @%s_t, @%s_f' % (n, b, b))
+        p('@%s_t' % b)
+        if multi:
+            p('\t%%w%d =w shl %%c%d, %d' % (n, n, n))
+            p('\t%%b%d =w or %s, %%w%d' % (n, prev, n))
+        else:
+            p('\t%%b%d =w or %s, %d' % (n, prev, 1 << n))
+        p('\tjmp @%s%d' % (name, n + 1))
+        p('@%s_f' % b)
+        p('\tjmp @%s%d' % (name, n + 1))
+        q = b
+    n = len(ops)
+    p('@%s%d' % (name, n))
+    p('\t%%m%d =w phi @%s_t %%b%d, @%s_f %s' % (n - 1, q, n - 1, q, prev))
+    p('\tret %%m%d' % (n - 1))
+    p('}')
+fn('fvv', 'l %a, l %r', '%r', 0)
+fn('mvv', 'l %a, l %r', '%r', 1)
+fn('fv0', 'l %a', '0', 0)
+fn('mv0', 'l %a', '0', 1)
+fn('fvk', 'l %a', str(K), 0)
+fn('mvk', 'l %a', str(K), 1)
+chk = []
+for a in vals:
+    for b in vals:
+        chk += [('fvv', 'l %d, l %d' % (a, b), mask(a, b)),
+                ('mvv', 'l %d, l %d' % (a, b), mask(a, b))]
+    for f, k in (('fv0', 0), ('mv0', 0), ('fvk', K), ('mvk', K)):
+        chk.append((f, 'l %d' % a, mask(a, k)))
+p('export function w $main() {')
+p('@main')
+for n, (f, args, m) in enumerate(chk):
+    p('\t%%r%d =w call $%s(%s)' % (n, f, args))
+    p('\t%%k%d =w ceqw %%r%d, %d' % (n, n, m))
+    p('\tjnz %%k%d, @ok%d, @fail' % (n, n))
+    p('@ok%d' % n)
+p('\tret 0')
+p('@fail')
+p('\tret 1')
+p('}')
+PYEOF
+
+# mulsh.ssa: Kw and Kl multiplies by constants (mulplan/selmul chains
+# and the Kl partial products) and Kw/Kl shl, shr and sar by every
+# count (shplan, emit_shiftk, emit_klshiftk), one function each,
+# checked over a table of operands against values python computes.
+python3 - "$TMP/mulsh.ssa" <<'PYEOF'
+import sys
+out = open(sys.argv[1], 'w')
+def p(s=''):
+    out.write(s + '\n')
+W, L = 1 << 16, 1 << 32
+def sx(v, m):
+    return v - m if v >= m >> 1 else v
+cw = sorted(set(list(range(260))
+    + [(1 << k) + d for k in range(16) for d in (-1, 0, 1)]
+    + [(-c) % W for c in range(1, 20)]
+    + [0x7FFF, 0x8000, 0xAAAA, 0x5555, 100, 1000, 10000, 12345, 40000]
+    # a spread over the rest of the range, where the longer chains and
+    # the kept `mul` show up
+    + [(n * 40503 + 257) % W for n in range(160)]) & set(range(W)))
+cl = [0, 1, 2, 3, 5, 7, 10, 255, 256, 1000, 65535, 65536, 65537,
+      0x12345, 100000, L - 1, L - 2, L - 10, 0x7FFFFFFF, 0x80000000,
+      0xFFFF0000]
+aw = [0, 1, 3, 0x7FFF, 0x8000, 0xFFFF, 0x1234, 0xBEEF]
+al = [0, 1, 0xFFFF, 0x10000, 0x12345678, 0xFFFFFFFF, 0x80000000,
+      0x7FFF8001]
+def shift(op, a, n, m):
+    if op == 'shl':
+        return (a << n) % m
+    if op == 'shr':
+        return a >> n
+    return (sx(a, m) >> n) % m
+# (table, class, functions as (name, body op, constant), reference)
+sets = []
+for k, cs, args, m in (('w', cw, aw, W), ('l', cl, al, L)):
+    fns = [('mul%s%d' % (k, n), 'mul', c) for n, c in enumerate(cs)]
+    sets.append(('mul' + k, k, fns, args,
+                 [(a * c) % m for _, _, c in fns for a in args]))
+    fns = [('%s%s%d' % (op, k, n), op, n)
+           for op in ('shl', 'shr', 'sar') for n in range(16 if k == 'w' else 32)]
+    sets.append(('sh' + k, k, fns, args,
+                 [shift(op, a, n, m) for _, op, n in fns for a in args]))
+dk = {'w': 'h', 'l': 'l'}
+for name, k, fns, args, exp in sets:
+    for f, op, c in fns:
+        p('function %s $%s(%s %%a) {' % (k, f, k))
+        p('@%s' % f)
+        p('\t%%r =%s %s %%a, %d' % (k, op, c))
+        p('\tret %r')
+        p('}')
+    p('data $%s_fn = { h %s }' % (name, ' '.join('$' + f for f, _, _ in fns)))
+    p('data $%s_arg = { %s %s }' % (name, dk[k], ' '.join(map(str, args))))
+    p('data $%s_exp = { %s %s }' % (name, dk[k], ' '.join(map(str, exp))))
+# sweepK(fns, nfn, args, exp): 0 if every fns[i](args[j]) == exp[i][j]
+for k, sz, ld in (('w', 2, 'loaduh'), ('l', 4, 'loadl')):
+    s = 'sw' + k
+    p('function w $sweep%s(w %%fn, w %%nfn, w %%arg, w %%exp) {' % k)
+    p('@%s' % s)
+    p('\tjmp @%s_f' % s)
+    p('@%s_f' % s)
+    p('\t%%i =w phi @%s 0, @%s_nf %%i1' % (s, s))
+    p('\t%%e0 =w phi @%s %%exp, @%s_nf %%e2' % (s, s))
+    p('\t%i2 =w mul %i, 2')
+    p('\t%fp =w add %fn, %i2')
+    p('\t%f =w loaduh %fp')
+    p('\tjmp @%s_a' % s)
+    p('@%s_a' % s)
+    p('\t%%j =w phi @%s_f 0, @%s_na %%j1' % (s, s))
+    p('\t%%e1 =w phi @%s_f %%e0, @%s_na %%e2' % (s, s))
+    p('\t%%jo =w mul %%j, %d' % sz)
+    p('\t%ap =w add %arg, %jo')
+    p('\t%%x =%s %s %%ap' % (k, ld))
+    p('\t%%r =%s call %%f(%s %%x)' % (k, k))
+    p('\t%%y =%s %s %%e1' % (k, ld))
+    p('\t%%ok =w ceq%s %%r, %%y' % k)
+    p('\tjnz %%ok, @%s_na, @%s_bad' % (s, s))
+    p('@%s_na' % s)
+    p('\t%%e2 =w add %%e1, %d' % sz)
+    p('\t%j1 =w add %j, 1')
+    p('\t%%ca =w csltw %%j1, %d' % len(aw))
+    p('\tjnz %%ca, @%s_a, @%s_nf' % (s, s))
+    p('@%s_nf' % s)
+    p('\t%i1 =w add %i, 1')
+    p('\t%cf =w csltw %i1, %nfn')
+    p('\tjnz %%cf, @%s_f, @%s_ok' % (s, s))
+    p('@%s_ok' % s)
+    p('\tret 0')
+    p('@%s_bad' % s)
+    p('\tret 1')
+    p('}')
+p('export function w $main() {')
+p('@main')
+for n, (name, k, fns, args, exp) in enumerate(sets):
+    p('\t%%r%d =w call $sweep%s(w $%s_fn, w %d, w $%s_arg, w $%s_exp)'
+      % (n, k, name, len(fns), name, name))
+    p('\tjnz %%r%d, @main_f%d, @main%d' % (n, n, n))
+    p('@main%d' % n)
+p('\tret 0')
+for n in range(len(sets)):
+    p('@main_f%d' % n)
+    p('\tret %d' % (n + 1))
+p('}')
+PYEOF
+
+if ! [ -x "$QBE" ]; then
+	echo "[test4] skipped: $QBE not built"
+elif ! echo 'nop' | as --32 -o "$TMP/probe.o" - 2> /dev/null ||
+     ! ld -m elf_i386 --oformat binary -o "$TMP/probe.bin" "$TMP/probe.o" \
+		2> /dev/null; then
+	echo "[test4] skipped: no i386 as/ld"
+else
+	for m in small large huge; do il "$ROOT/test/sim86/es.ssa" $m; done
+	il "$ROOT/test/sim86/hugewalk.ssa" huge
+	il "$ROOT/test/sim86/hugeiv.ssa" huge
+	il "$ROOT/test/fold3.ssa" small
+	il "$TMP/cmpl.ssa" small
+	il "$TMP/mulsh.ssa" small
+	echo "[test4] OK"
+fi
+
+echo
+echo "All tests passed."